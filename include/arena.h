@@ -0,0 +1,68 @@
+// Filename: arena.h
+// Programmer(s): Abdurrahman Alyajouri
+// Date: 10/19/2026
+// Purpose: To hand out memory that lives exactly as long as whatever owns the arena. allocations are carved out of
+//          large blocks and are never freed one by one, the whole arena is rewound or reset at once instead.
+
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#ifndef TRUE
+# define TRUE 1
+#endif //TRUE
+#ifndef FALSE
+# define FALSE 0
+#endif //FALSE
+
+#ifndef SUCCESS
+# define SUCCESS 0
+#endif //SUCCESS
+#ifndef ERROR
+# define ERROR 1
+#endif //ERROR
+
+#define ARENA_ALIGNMENT 16 //every allocation starts on this boundary, enough for any type the server stores.
+
+typedef struct arena_block {
+    struct arena_block* next; //the block allocated before this one, or the next spare block.
+    size_t capacity;
+    size_t used;
+} arena_block_t;
+
+//not thread safe, an arena belongs to one owner at a time.
+typedef struct arena {
+    arena_block_t* current; //allocations come from here, older blocks follow it.
+    arena_block_t* spare; //blocks given back by a rewind or reset, reused before allocating new ones.
+    size_t block_size;
+    size_t bytes_used; //in use right now, alignment padding included.
+    size_t bytes_peak; //most bytes in use at once since the last reset.
+    uint32_t allocations; //arena_alloc() calls since the last reset.
+    uint32_t heap_allocations; //blocks malloc()'d since the last reset, 0 once an arena was recycled.
+    struct arena* next; //links arenas kept on a free-list.
+} arena_t;
+
+//a point to rewind an arena to, everything allocated after it is given back at once.
+typedef struct arena_mark {
+    arena_block_t* block;
+    size_t used;
+    size_t bytes_used;
+} arena_mark_t;
+
+// initializer/cleanup.
+//blocks are block_size bytes unless a single allocation needs more.
+arena_t* arena_init(size_t block_size);
+int arena_free(arena_t* arena);
+
+// main api
+//returns NULL if no block could be allocated.
+void* arena_alloc(arena_t* arena, size_t size);
+void* arena_calloc(arena_t* arena, size_t count, size_t size);
+arena_mark_t arena_mark(arena_t* arena);
+void arena_rewind(arena_t* arena, arena_mark_t mark);
+//gives back every allocation but keeps the blocks, so a recycled arena doesn't allocate again. clears the counters.
+void arena_reset(arena_t* arena);
+
+#endif //ARENA_H
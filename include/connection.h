@@ -0,0 +1,79 @@
+// Filename: connection.h
+// Programmer(s): Abdurrahman Alyajouri
+// Date: 10/19/2026
+// Purpose: To buffer the input and output of a non-blocking MRMP connection, so many connections can be
+//          serviced by a single thread without ever blocking on one of them.
+
+#ifndef CONNECTION_H
+#define CONNECTION_H
+
+#include <winsock2.h>
+
+#include "networking_utils.h"
+#include "metrics.h"
+#include "rtt_estimator.h"
+
+#ifndef TRUE
+# define TRUE 1
+#endif //TRUE
+#ifndef FALSE
+# define FALSE 0
+#endif //FALSE
+
+#ifndef SUCCESS
+# define SUCCESS 0
+#endif //SUCCESS
+#ifndef ERROR
+# define ERROR 1
+#endif //ERROR
+
+//clients only send small frames, anything that doesn't fit is treated as a protocol violation.
+#define CONNECTION_READ_BUFFER_SIZE     1024
+//frames waiting to be sent, a connection that falls this far behind is considered dead.
+#define CONNECTION_OUTPUT_QUEUE_SIZE    64
+
+typedef struct connection {
+    SOCKET socket;
+    mrmp_version_t version; //framing of every frame parsed or queued from now on, MRMP_VERSION_0 until HELLO.
+    int peer_is_server; //FALSE until set, frames only a server may send are then rejected before they are parsed.
+
+    //bytes received but not yet parsed into frames.
+    char read_buffer[CONNECTION_READ_BUFFER_SIZE];
+    int read_length;
+
+    //ring of referenced frames, output_offset bytes of the front frame were already sent.
+    mrmp_shared_buffer_t* output_queue[CONNECTION_OUTPUT_QUEUE_SIZE];
+    int output_front;
+    int output_count;
+    int output_offset;
+
+    //shard of the thread that currently services the connection, NULL counts nothing. bytes and frames are counted
+    //into it, so whoever hands the connection to another thread should point it at that thread's shard.
+    metrics_shard_t* metrics;
+
+    //round trip time of the peer, kept across races on the same connection. only sampled by whoever services it.
+    rtt_estimator_t rtt;
+} connection_t;
+
+// initializer/cleanup.
+//takes ownership of the socket and switches it to non-blocking mode.
+connection_t* connection_init(SOCKET socket);
+//shuts down and closes the socket, releasing any frames that were never sent.
+int connection_free(connection_t* connection);
+
+// main api
+//reads whatever is available on the socket, returns SUCCESS, GRACEFUL_DC or DISGRACEFUL_DC.
+int connection_fill(connection_t* connection);
+//parses the next buffered frame into *out_msg. returns SUCCESS if one was parsed, TIMEDOUT if no complete
+//frame is buffered yet, or ERROR if the peer sent an unknown opcode or an oversized frame.
+int connection_next_msg(connection_t* connection, char** out_msg);
+//same as above, but the frame is parsed into the arena and must not be freed.
+int connection_next_msg_in(connection_t* connection, arena_t* arena, char** out_msg);
+//adds a reference to the frame, framed for the connection's version, and appends it to the output queue. returns
+//ERROR if the queue is full or the frame can't be framed for the version.
+int connection_queue(connection_t* connection, mrmp_shared_buffer_t* buffer);
+//sends as much queued output as the socket accepts without blocking, returns SUCCESS or SOCKET_ERROR.
+int connection_flush(connection_t* connection);
+int connection_has_output(connection_t* connection);
+
+#endif //CONNECTION_H
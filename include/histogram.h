@@ -0,0 +1,52 @@
+// Filename: histogram.h
+// Programmer(s): Abdurrahman Alyajouri
+// Date: 10/19/2026
+// Purpose: To record distributions of latencies in log-linear buckets and query their percentiles.
+
+#ifndef HISTOGRAM_H
+#define HISTOGRAM_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#ifndef TRUE
+# define TRUE 1
+#endif //TRUE
+#ifndef FALSE
+# define FALSE 0
+#endif //FALSE
+
+#ifndef SUCCESS
+# define SUCCESS 0
+#endif //SUCCESS
+#ifndef ERROR
+# define ERROR 1
+#endif //ERROR
+
+//each power of two range is split into 16 linear sub buckets, so a recorded value is off by at most ~6%.
+#define HISTOGRAM_SUB_BUCKET_BITS   4
+#define HISTOGRAM_SUB_BUCKETS       (1 << HISTOGRAM_SUB_BUCKET_BITS)
+#define HISTOGRAM_BUCKETS           ((65 - HISTOGRAM_SUB_BUCKET_BITS) * HISTOGRAM_SUB_BUCKETS)
+
+//values are unitless, callers decide whether they record milliseconds, microseconds, etc.
+typedef struct histogram {
+    uint64_t counts[HISTOGRAM_BUCKETS];
+    uint64_t total;
+    uint64_t max;
+} histogram_t;
+
+// initializer/cleanup.
+histogram_t* histogram_init(void);
+int histogram_free(histogram_t* histogram);
+
+// main api
+int histogram_record(histogram_t* histogram, uint64_t value);
+int histogram_clear(histogram_t* histogram);
+//adds every sample recorded in one histogram to another, e.g. to combine per thread histograms. from may be
+//recorded to by its owning thread at the same time, without any locking.
+int histogram_merge(histogram_t* into, histogram_t* from);
+//returns the highest value equivalent to the given percentile (0.0 - 100.0), 0 if nothing was recorded.
+uint64_t histogram_percentile(histogram_t* histogram, double percentile);
+uint64_t histogram_count(histogram_t* histogram);
+
+#endif //HISTOGRAM_H
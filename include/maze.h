@@ -9,6 +9,8 @@
 #include <stdint.h>
 #include <stddef.h>
 
+#include "arena.h"
+
 #ifndef TRUE
 # define TRUE 1
 #endif //TRUE
@@ -23,6 +25,12 @@
 # define ERROR 1
 #endif //ERROR
 
+//direction bitmasks of a cell's walls, defined in maze.c.
+extern const uint8_t NORTH;
+extern const uint8_t SOUTH;
+extern const uint8_t EAST;
+extern const uint8_t WEST;
+
 //a cell will be defined as a bitset representing surrounding walls.
 typedef uint8_t maze_cell_t;
 
@@ -67,6 +75,10 @@ void backtrack_recursive(int rows, int columns, int row, int column, temp_cell_t
 //rows * columns cells, using recursive backtracking.
 maze_t* generate_maze(maze_size_t rows, maze_size_t columns);
 
+//same as generate_maze(), but everything comes from the arena, including the scratch space used while generating,
+//which is given back before returning. returns NULL if the arena ran out. never pass the maze to free_maze().
+maze_t* generate_maze_in(arena_t* arena, maze_size_t rows, maze_size_t columns);
+
 //given a valid 2D maze, will deallocate/free everything.
 int free_maze(maze_t* maze);
 
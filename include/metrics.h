@@ -0,0 +1,84 @@
+// Filename: metrics.h
+// Programmer(s): Abdurrahman Alyajouri
+// Date: 10/19/2026
+// Purpose: To count server activity in per thread shards and export the totals in the Prometheus text format.
+
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <windows.h>
+
+#ifndef TRUE
+# define TRUE 1
+#endif //TRUE
+#ifndef FALSE
+# define FALSE 0
+#endif //FALSE
+
+#ifndef SUCCESS
+# define SUCCESS 0
+#endif //SUCCESS
+#ifndef ERROR
+# define ERROR 1
+#endif //ERROR
+
+#define METRICS_MAX_SHARDS      128
+#define METRICS_MAX_OPCODES     32 //frames with a higher opcode are counted under opcode 0.
+#define METRICS_CACHE_LINE      64
+
+typedef enum metric {
+    METRIC_CONNECTIONS_TOTAL,
+    METRIC_CONNECTIONS_ACTIVE,
+    METRIC_CONNECTIONS_REJECTED,
+    METRIC_SESSIONS_TOTAL,
+    METRIC_SESSIONS_ACTIVE,
+    METRIC_SPECTATORS_TOTAL,
+    METRIC_SPECTATORS_ACTIVE,
+    METRIC_REQUEUES,
+    METRIC_REMATCHES,
+    METRIC_BYTES_RECEIVED,
+    METRIC_BYTES_SENT,
+    METRIC_BAD_MOVES,
+    METRIC_HANDSHAKE_TIMEOUTS,
+    METRIC_READY_TIMEOUTS,
+    METRIC_RACE_TIMEOUTS,
+    METRIC_LIVENESS_TIMEOUTS,
+    METRIC_COUNT
+} metric_t;
+
+//one thread's counts. a shard is padded so no two shards share a cache line, and is meant to be written by the
+//thread it was handed to, though any thread may add to it since every update is atomic.
+typedef struct metrics_shard {
+    char pad0[METRICS_CACHE_LINE];
+    volatile LONG64 values[METRIC_COUNT];
+    volatile LONG64 frames_received[METRICS_MAX_OPCODES];
+    volatile LONG64 frames_sent[METRICS_MAX_OPCODES];
+    char pad1[METRICS_CACHE_LINE];
+} metrics_shard_t;
+
+//the totals of a metric are the sums of every shard, gauges are sums of increments and decrements.
+typedef struct metrics {
+    metrics_shard_t* shards[METRICS_MAX_SHARDS];
+    volatile LONG shard_count;
+} metrics_t;
+
+// initializer/cleanup.
+metrics_t* metrics_init(void);
+//frees every shard, no thread may still be using one.
+int metrics_free(metrics_t* metrics);
+//hands out a new shard, returns NULL once METRICS_MAX_SHARDS were handed out.
+metrics_shard_t* metrics_shard(metrics_t* metrics);
+
+// main api
+//a NULL shard counts nothing, so callers don't need to check whether they were given one.
+void metrics_add(metrics_shard_t* shard, metric_t metric, int64_t delta);
+void metrics_count_frame_received(metrics_shard_t* shard, uint8_t opcode);
+void metrics_count_frame_sent(metrics_shard_t* shard, uint8_t opcode);
+//sums a metric over every shard without locking, the total may miss updates made while it is read.
+int64_t metrics_read(metrics_t* metrics, metric_t metric);
+//writes every metric in the Prometheus text exposition format, returns the length written or -1 if it didn't fit.
+int metrics_format_prometheus(metrics_t* metrics, char* buffer, size_t size);
+
+#endif //METRICS_H
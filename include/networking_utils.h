@@ -7,14 +7,23 @@
 # define NETWORKING_UTILS_H
 
 #include <stdint.h>
-#include <winsock2.h>
-#include <ws2tcpip.h>
 
 #include "maze.h"
+#include "platform.h"
+#include "slab_pool.h"
 
 //default server/client properties.
 #define MRMP_DEFAULT_PORT "9898"
 
+//protocol versions, chosen by the client in HELLO. HELLO and the server's answer to it always use version 0 framing.
+//version 0 frames start with a 1-byte opcode and a 4-byte big-endian length. version 1 frames start with the opcode
+//alone if the opcode's payload has a fixed size, otherwise the opcode is followed by the length as a varint.
+#define MRMP_VERSION_0                  0
+#define MRMP_VERSION_1                  1
+#define MRMP_VERSION                    MRMP_VERSION_1 //newest version, every older one is still supported.
+#define MRMP_MAX_FRAME_HEADER_SIZE      (sizeof(mrmp_opcode_t) + 5) //a 32-bit varint takes at most 5 bytes.
+#define MRMP_FRAME_COMPLETION_MS        1000 //how long receive_mrmp_msg() waits for the rest of a frame it started reading.
+
 //helper error codes.
 #define GRACEFUL_DC                     (-1)
 #define DISGRACEFUL_DC                  (-2)
@@ -34,24 +43,59 @@
 #define MRMP_OPCODE_TIMEOUT 		    0b00001011
 #define MRMP_OPCODE_OPPONENT_MOVE	    0b00001100
 #define MRMP_OPCODE_HELLO_ACK 			0b00001101
+#define MRMP_OPCODE_REMATCH 			0b00001110 //sent after RESULT instead of JOIN to race the same opponents again.
+#define MRMP_OPCODE_UDP_OFFER 		    0b00001111 //where to send move datagrams for the session, only if UDP was negotiated.
+#define MRMP_OPCODE_DIRECTIONS 		    0b00010000 //a run of steps replacing MOVE, only if directions were negotiated.
+#define MRMP_OPCODE_OPPONENT_DIRECTIONS 0b00010001 //an opponent's steps during one server tick, replacing OPPONENT_MOVE.
+#define MRMP_OPCODE_SPECTATE 		    0b00010010 //sent instead of JOIN to watch a running session.
+#define MRMP_OPCODE_POSITIONS 		    0b00010011 //every player's position, sent to spectators.
+#define MRMP_OPCODE_PING 		        0b00010100 //server to client, only if heartbeats were negotiated.
+#define MRMP_OPCODE_PONG 		        0b00010101 //the client's immediate answer to PING, echoing its stamp.
 
 //error codes.
 #define  MRMP_ERR_UNKNOWN               0b00000000
 #define  MRMP_ERR_ILLEGAL_OPCODE        0b00000001
 #define  MRMP_ERR_VERSION_MISMATCH      0b00000010
 #define  MRMP_ERR_FULL_QUEUE            0b00000011
+#define  MRMP_ERR_NO_SESSION            0b00000100 //there is no running session to spectate.
 
 typedef uint8_t mrmp_opcode_t;
 typedef uint32_t mrmp_payload_size_t;
 typedef uint8_t mrmp_version_t;
 typedef uint8_t mrmp_error_t;
 typedef uint8_t mrmp_winner_t;
+typedef uint8_t mrmp_player_t;
+typedef uint8_t mrmp_features_t;
+typedef uint32_t mrmp_move_seq_t;
+typedef uint32_t mrmp_session_id_t;
+
+//optional features, requested with a trailing byte in HELLO and granted with a trailing byte in HELLO_ACK.
+#define MRMP_FEATURE_UDP                0b00000001
+#define MRMP_FEATURE_DIRECTIONS         0b00000010
+#define MRMP_FEATURE_HEARTBEAT          0b00000100
+//JOIN was sent right behind HELLO without waiting for HELLO_ACK, framed for the version asked for in HELLO. the
+//server then can't time the round trip between the two and has to find it some other way.
+#define MRMP_FEATURE_PIPELINED          0b00001000
+
+//steps of a direction run are 2-bit codes packed four to a byte, the first step in the highest bits.
+#define MRMP_DIR_NORTH                  0b00
+#define MRMP_DIR_EAST                   0b01
+#define MRMP_DIR_SOUTH                  0b10
+#define MRMP_DIR_WEST                   0b11
+#define MRMP_MAX_RUN_STEPS              252
+#define MRMP_RUN_BYTES(steps)           (((steps) + 3) / 4)
 
 #define PHEADER(msg) ((mrmp_pkt_header_t*)(msg))
 #define PMOVE(msg)   ((mrmp_pkt_move_t*)(msg))
 #define PJOINRE(msg) ((mrmp_pkt_join_resp_t*)(msg))
 #define PRESULT(msg) ((mrmp_pkt_result_t*)(msg))
 #define PHELLO(msg)  ((mrmp_pkt_hello_t*)(msg))
+#define PHELLOACK(msg) ((mrmp_pkt_hello_ack_t*)(msg))
+#define PUDPOFFER(msg) ((mrmp_pkt_udp_offer_t*)(msg))
+#define PDIRS(msg)   ((mrmp_pkt_directions_t*)(msg))
+#define PSPECTATE(msg) ((mrmp_pkt_spectate_t*)(msg))
+#define PPOSITIONS(msg) ((mrmp_pkt_positions_t*)(msg))
+#define PPING(msg)   ((mrmp_pkt_ping_t*)(msg))
 
 //manually maintain tightly packed sizes of structs due to struct padding throwing off sizes.
 #define MRMP_PKT_HEADER_SIZE (sizeof(mrmp_opcode_t) + sizeof(mrmp_payload_size_t))
@@ -59,7 +103,12 @@ typedef uint8_t mrmp_winner_t;
 #define MRMP_PKT_HELLO_SIZE (MRMP_PKT_HEADER_SIZE + sizeof(mrmp_version_t))
 #define MRMP_PKT_JOIN_RESP_PARTIAL_SIZE (MRMP_HEADER_SIZE + sizeof(maze_size_t) * 2) //size of maze isnt known at compile time.
 #define MRMP_PKT_MOVE_SIZE (MRMP_PKT_HEADER_SIZE + sizeof(maze_size_t) * 2)
+#define MRMP_PKT_SEQ_MOVE_SIZE (MRMP_PKT_MOVE_SIZE + sizeof(mrmp_move_seq_t))
+#define MRMP_PKT_OPPONENT_MOVE_SIZE (MRMP_PKT_MOVE_SIZE + sizeof(mrmp_player_t))
 #define MRMP_PKT_RESULT_SIZE (MRMP_PKT_HEADER_SIZE + sizeof(mrmp_winner_t))
+#define MRMP_PKT_UDP_OFFER_SIZE (MRMP_PKT_HEADER_SIZE + sizeof(uint16_t) + sizeof(uint32_t) * 2 + sizeof(mrmp_player_t))
+#define MRMP_PKT_SPECTATE_SIZE (MRMP_PKT_HEADER_SIZE + sizeof(mrmp_session_id_t))
+#define MRMP_PKT_PING_SIZE (MRMP_PKT_HEADER_SIZE + sizeof(uint32_t))
 
 //#pragma pack(push, 1) //easy way out, less portable
  
@@ -77,8 +126,14 @@ typedef struct mrmp_pkt_error {
 typedef struct mrmp_pkt_hello {
     mrmp_pkt_header_t header;
     mrmp_version_t version;
+    mrmp_features_t features; //0 if absent.
 } mrmp_pkt_hello_t; 
 
+typedef struct mrmp_pkt_hello_ack {
+    mrmp_pkt_header_t header;
+    mrmp_features_t features; //the requested features the server agreed to, 0 if absent.
+} mrmp_pkt_hello_ack_t;
+
 typedef struct mrmp_pkt_join_resp {
     mrmp_pkt_header_t header;
     maze_size_t rows;
@@ -90,6 +145,8 @@ typedef struct mrmp_pkt_move {
     mrmp_pkt_header_t header;
     maze_size_t row;
     maze_size_t column;
+    mrmp_player_t player; //only sent with OPPONENT_MOVE, identifies which opponent moved. 0 if absent.
+    mrmp_move_seq_t seq; //only sent with MOVE and BAD_MOVE, BAD_MOVE names the rejected MOVE's seq. 0 if absent.
 } mrmp_pkt_move_t; 
 
 //#pragma pack(pop) //easy way out, less portable
@@ -107,31 +164,166 @@ typedef struct mrmp_pkt_move {
 //     maze_size_t column;
 // } mrmp_pkt_bad_move_t; 
 
+//players are sent 1 if they won and 0 if they lost, spectators are sent the id of the player that won.
 typedef struct mrmp_pkt_result {
     mrmp_pkt_header_t header;
     mrmp_winner_t winner;
 } mrmp_pkt_result_t; 
 
+typedef struct mrmp_pkt_udp_offer {
+    mrmp_pkt_header_t header;
+    uint16_t port;
+    uint32_t endpoint;      //identifies the player's session slot on the server.
+    uint32_t token;         //secret proving a datagram came from the player it claims to.
+    mrmp_player_t player;   //the id the server uses for this player in OPPONENT_MOVE and datagrams.
+} mrmp_pkt_udp_offer_t;
+
+//DIRECTIONS carries seq, OPPONENT_DIRECTIONS carries player. step i of a run has seq + i.
+typedef struct mrmp_pkt_directions {
+    mrmp_pkt_header_t header;
+    mrmp_player_t player;
+    mrmp_move_seq_t seq;
+    uint8_t count;
+    uint8_t codes[MRMP_RUN_BYTES(MRMP_MAX_RUN_STEPS)];
+} mrmp_pkt_directions_t;
+
+typedef struct mrmp_pkt_spectate {
+    mrmp_pkt_header_t header;
+    mrmp_session_id_t session_id; //0 to watch whichever session started most recently.
+} mrmp_pkt_spectate_t;
+
+//PING and PONG, the stamp means nothing to the client, it is only echoed back.
+typedef struct mrmp_pkt_ping {
+    mrmp_pkt_header_t header;
+    uint32_t stamp; //when the server sent the PING, in microseconds of its own clock.
+} mrmp_pkt_ping_t;
+
+//datagrams of the optional UDP channel. only positions use it, everything else stays on TCP. every datagram is
+//sequenced and newer positions replace older ones, so nothing is ever retransmitted in order.
+#define MRMP_DGRAM_MOVES        0b00000001 //client to server, the sender's unacknowledged positions, oldest first.
+#define MRMP_DGRAM_ACK          0b00000010 //server to client, seq is the newest move that was applied.
+#define MRMP_DGRAM_POSITIONS    0b00000011 //server to client, the latest positions of other players.
+
+#define MRMP_DGRAM_MAX_ENTRIES  32
+#define MRMP_DGRAM_HEADER_SIZE  (sizeof(uint8_t) * 2 + sizeof(uint32_t) * 3)
+#define MRMP_DGRAM_ENTRY_SIZE   (sizeof(mrmp_player_t) + sizeof(maze_size_t) * 2)
+#define MRMP_DGRAM_MAX_SIZE     (MRMP_DGRAM_HEADER_SIZE + MRMP_DGRAM_ENTRY_SIZE * MRMP_DGRAM_MAX_ENTRIES)
+
+typedef struct mrmp_dgram_entry {
+    mrmp_player_t player; //unused in MOVES.
+    maze_size_t row;
+    maze_size_t column;
+} mrmp_dgram_entry_t;
+
+typedef struct mrmp_dgram {
+    uint8_t type;
+    uint32_t endpoint;
+    uint32_t token;
+    uint32_t seq; //of the newest entry, entry i of count has seq - (count - 1 - i).
+    uint8_t count;
+    mrmp_dgram_entry_t entries[MRMP_DGRAM_MAX_ENTRIES];
+} mrmp_dgram_t;
+
+//a full snapshot for spectators, each entry is laid out like a datagram entry. newer snapshots replace older ones.
+typedef struct mrmp_pkt_positions {
+    mrmp_pkt_header_t header;
+    uint8_t count;
+    mrmp_dgram_entry_t entries[MRMP_DGRAM_MAX_ENTRIES];
+} mrmp_pkt_positions_t;
+
+//an encoded frame that can be sent to any number of sockets, freed once the last reference is released. frames are
+//encoded with version 0 framing, the compact version 1 twin is made the first time it is needed and kept alongside.
+typedef struct mrmp_shared_buffer {
+    volatile LONG references;
+    struct mrmp_shared_buffer* compact;
+    int length;
+    char data[];
+} mrmp_shared_buffer_t;
+
+//human readable strings indexed by error code.
+extern const char* code_to_error[];
+
 int send_buffer(SOCKET socket, const char* buffer, int buffer_length);
-char* buffer_to_mrmp_pkt_struct(char* buffer);
+//packet structs are taken from the calling thread's packet pool, or from the heap if the thread has none, and
+//released with mrmp_pkt_free().
+char* buffer_to_mrmp_pkt_struct(char* buffer); //version 0 frames only.
+char* mrmp_payload_to_pkt_struct(mrmp_pkt_header_t header, const char* payload);
+//same as above, but the struct comes from the arena and must not be freed. a NULL arena means the packet pool.
+char* mrmp_payload_to_pkt_struct_in(arena_t* arena, mrmp_pkt_header_t header, const char* payload);
+void mrmp_pkt_free(char* msg);
+//a pool with a block size for every fixed size packet struct and size classes for JOIN_RESP's mazes.
+slab_pool_t* mrmp_pkt_pool_init(void);
+//structs received on the calling thread come from the pool from now on, NULL goes back to the heap. the pool has to
+//outlive every struct taken from it.
+void mrmp_pkt_pool_use(slab_pool_t* pool);
+//parses the frame header at the front of the buffer. returns SUCCESS with the header and the number of bytes it
+//took, TIMEDOUT if more bytes are needed to tell, or ERROR if it is malformed or the opcode's size is unknown.
+int mrmp_parse_frame_header(const char* buffer, int length, mrmp_version_t version, mrmp_pkt_header_t* out_header, int* out_header_length);
+//TRUE if a client may send the opcode, everything else only ever comes from a server.
+int mrmp_opcode_from_client(mrmp_opcode_t opcode);
 
 int send_error_pkt(SOCKET socket, mrmp_error_t error);
-int send_hello_pkt(SOCKET socket, mrmp_version_t version);
-int send_hello_ack_pkt(SOCKET socket);
+int send_hello_pkt(SOCKET socket, mrmp_version_t version, mrmp_features_t features);
+//HELLO followed by JOIN in a single write, the features must include MRMP_FEATURE_PIPELINED.
+int send_hello_join_pkts(SOCKET socket, mrmp_version_t version, mrmp_features_t features);
+int send_hello_ack_pkt(SOCKET socket, mrmp_features_t features);
 int send_join_pkt(SOCKET socket);
 int send_join_resp_pkt(SOCKET socket, maze_t* maze);
 int send_ready_pkt(SOCKET socket);
 int send_start_pkt(SOCKET socket);
 int send_leave_pkt(SOCKET socket);
-int send_move_pkt(SOCKET socket, maze_size_t row, maze_size_t column);
-int send_opponent_move_pkt(SOCKET socket, maze_size_t row, maze_size_t column);
-int send_bad_move_pkt(SOCKET socket, maze_size_t last_row, maze_size_t last_column);
+int send_move_pkt(SOCKET socket, maze_size_t row, maze_size_t column, mrmp_move_seq_t seq);
+int send_bad_move_pkt(SOCKET socket, maze_size_t last_row, maze_size_t last_column, mrmp_move_seq_t seq);
 int send_result_pkt(SOCKET socket, mrmp_winner_t winner);
 int send_timeout_pkt(SOCKET socket);
+int send_rematch_pkt(SOCKET socket);
+int send_directions_pkt(SOCKET socket, mrmp_move_seq_t seq, const uint8_t* codes, uint8_t count);
+
+//shared buffers start with a single reference owned by the caller.
+mrmp_shared_buffer_t* mrmp_shared_buffer_create(int length);
+mrmp_shared_buffer_t* mrmp_shared_buffer_acquire(mrmp_shared_buffer_t* buffer);
+void mrmp_shared_buffer_release(mrmp_shared_buffer_t* buffer);
+int send_shared_buffer(SOCKET socket, mrmp_shared_buffer_t* buffer);
+//the frame framed for the given version, owned by buffer. not thread safe, pick it before sharing the frame across
+//threads. returns NULL if the frame can't be framed that way.
+mrmp_shared_buffer_t* mrmp_shared_buffer_for_version(mrmp_shared_buffer_t* buffer, mrmp_version_t version);
+//sends the frame framed for the given version and releases it.
+int send_frame(SOCKET socket, mrmp_shared_buffer_t* buffer, mrmp_version_t version);
+
+//encode a frame once so it can be queued or sent to many recipients.
+mrmp_shared_buffer_t* encode_error_pkt(mrmp_error_t error);
+mrmp_shared_buffer_t* encode_hello_pkt(mrmp_version_t version, mrmp_features_t features);
+mrmp_shared_buffer_t* encode_hello_ack_pkt(mrmp_features_t features);
+mrmp_shared_buffer_t* encode_empty_pkt(mrmp_opcode_t opcode); //join, ready, start, leave, timeout and rematch.
+mrmp_shared_buffer_t* encode_join_resp_pkt(maze_t* maze);
+mrmp_shared_buffer_t* encode_move_pkt(maze_size_t row, maze_size_t column, mrmp_move_seq_t seq);
+mrmp_shared_buffer_t* encode_bad_move_pkt(maze_size_t last_row, maze_size_t last_column, mrmp_move_seq_t seq);
+mrmp_shared_buffer_t* encode_opponent_move_pkt(maze_size_t row, maze_size_t column, mrmp_player_t player);
+mrmp_shared_buffer_t* encode_result_pkt(mrmp_winner_t winner);
+mrmp_shared_buffer_t* encode_udp_offer_pkt(uint16_t port, uint32_t endpoint, uint32_t token, mrmp_player_t player);
+mrmp_shared_buffer_t* encode_directions_pkt(mrmp_move_seq_t seq, const uint8_t* codes, uint8_t count);
+mrmp_shared_buffer_t* encode_opponent_directions_pkt(mrmp_player_t player, const uint8_t* codes, uint8_t count);
+mrmp_shared_buffer_t* encode_spectate_pkt(mrmp_session_id_t session_id);
+mrmp_shared_buffer_t* encode_positions_pkt(const mrmp_dgram_entry_t* entries, uint8_t count);
+mrmp_shared_buffer_t* encode_ping_pkt(mrmp_opcode_t opcode, uint32_t stamp); //ping and pong.
+
+//direction runs, codes must hold MRMP_RUN_BYTES(MRMP_MAX_RUN_STEPS) bytes.
+void mrmp_run_set(uint8_t* codes, int step, uint8_t direction);
+uint8_t mrmp_run_get(const uint8_t* codes, int step);
+//the direction of a single step between adjacent cells, returns ERROR if they aren't adjacent.
+int mrmp_step_direction(maze_size_t row, maze_size_t column, maze_size_t new_row, maze_size_t new_column, uint8_t* out_direction);
+//moves row and column one step into the direction, leaving them out of range if it leads off the maze's edge.
+void mrmp_apply_step(uint8_t direction, int* row, int* column);
+
+//udp datagrams, encoded into a caller provided buffer of at least MRMP_DGRAM_MAX_SIZE bytes.
+int encode_dgram(mrmp_dgram_t* dgram, char* buffer); //returns the encoded length.
+int decode_dgram(const char* buffer, int length, mrmp_dgram_t* dgram); //returns ERROR if malformed.
 
 maze_t* maze_network_to_host(mrmp_pkt_join_resp_t* msg);
 
 int recv_w_timeout(SOCKET socket, char* buffer, int length, int flags, struct timeval* timeout);
-int receive_mrmp_msg(SOCKET socket, char** out_msg, struct timeval* timeout);
+//the round trip time the TCP stack measured on the socket. returns ERROR where the stack doesn't report it.
+int get_tcp_rtt_us(SOCKET socket, uint32_t* out_rtt_us);
+int receive_mrmp_msg(SOCKET socket, char** out_msg, struct timeval* timeout, mrmp_version_t version);
 
 #endif //NETWORKING_UTILS_H
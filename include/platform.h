@@ -0,0 +1,121 @@
+// Filename: platform.h
+// Programmer(s): Abdurrahman Alyajouri
+// Date: 10/19/2026
+// Purpose: To hide the differences between windows and posix systems from the client and the sources it shares with
+//          the server: sockets, waiting on them together with the keyboard, the terminal and mapping files.
+
+#ifndef PLATFORM_H
+#define PLATFORM_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#ifdef _WIN32
+# include <winsock2.h>
+# include <ws2tcpip.h>
+# include <windows.h>
+#else
+# include <sys/types.h>
+# include <sys/socket.h>
+# include <sys/select.h>
+# include <sys/time.h>
+# include <netinet/in.h>
+# include <netinet/tcp.h>
+# include <arpa/inet.h>
+# include <netdb.h>
+# include <unistd.h>
+# include <errno.h>
+# include <string.h>
+#endif //_WIN32
+
+#ifndef TRUE
+# define TRUE 1
+#endif //TRUE
+#ifndef FALSE
+# define FALSE 0
+#endif //FALSE
+
+#ifndef SUCCESS
+# define SUCCESS 0
+#endif //SUCCESS
+#ifndef ERROR
+# define ERROR 1
+#endif //ERROR
+
+//the subset of winsock and win32 the shared sources use, so they read the same on every system.
+#ifndef _WIN32
+typedef int SOCKET;
+typedef long LONG;
+typedef unsigned long long ULONGLONG;
+# define INVALID_SOCKET             (-1)
+# define SOCKET_ERROR               (-1)
+# define SD_SEND                    SHUT_WR
+# define WSAECONNRESET              ECONNRESET
+# define WSAEWOULDBLOCK             EWOULDBLOCK
+# define closesocket(socket)        close(socket)
+# define WSAGetLastError()          errno
+# define ZeroMemory(address, size)  memset((address), 0, (size))
+# define GetTickCount64()           platform_now_ms()
+# define InterlockedIncrement(address) __atomic_add_fetch((address), 1, __ATOMIC_SEQ_CST)
+# define InterlockedDecrement(address) __atomic_sub_fetch((address), 1, __ATOMIC_SEQ_CST)
+#endif //_WIN32
+
+//gives every thread its own copy of a static variable.
+#ifdef _MSC_VER
+# define PLATFORM_THREAD_LOCAL      __declspec(thread)
+#else
+# define PLATFORM_THREAD_LOCAL      _Thread_local
+#endif //_MSC_VER
+
+//what platform_wait() woke up for, or'd together.
+#define PLATFORM_EVENT_TCP          0b001
+#define PLATFORM_EVENT_UDP          0b010
+#define PLATFORM_EVENT_KEY          0b100
+
+#define PLATFORM_DEFAULT_COLUMNS    80
+#define PLATFORM_DEFAULT_ROWS       24
+
+//a cell of the terminal, counted from 0 at its top left.
+typedef struct platform_point {
+    int x;
+    int y;
+} platform_point_t;
+
+//a file mapped read-only into memory.
+typedef struct platform_mapping {
+    const uint8_t* data;
+    size_t length;
+#ifdef _WIN32
+    HANDLE file;
+    HANDLE mapping;
+#endif //_WIN32
+} platform_mapping_t;
+
+// initializer/cleanup.
+//starts winsock, or puts the terminal into raw mode so keys arrive one at a time without being echoed. the
+//terminal is restored by platform_cleanup(), which also runs at exit.
+int platform_init(void);
+void platform_cleanup(void);
+
+// main api
+//milliseconds on a monotonic clock.
+ULONGLONG platform_now_ms(void);
+//blocks until either socket is readable, a key was typed or timeout_ms passed, a negative timeout waits forever.
+//INVALID_SOCKET skips a socket. returns the PLATFORM_EVENT_* that happened, 0 on a timeout.
+int platform_wait(SOCKET tcp_socket, SOCKET udp_socket, int timeout_ms);
+int platform_key_pending(void);
+//the next typed key without waiting for enter, blocks if none is pending.
+int platform_read_key(void);
+int platform_set_non_blocking(SOCKET socket);
+
+//the terminal's cursor and its size in cells, the size falls back to 80x24 if the terminal doesn't say.
+platform_point_t platform_cursor_position(void);
+platform_point_t platform_terminal_size(void);
+//writes straight to the terminal in as few system calls as it allows, after flushing stdout so the order is kept.
+int platform_write_terminal(const char* data, size_t length);
+
+//maps the whole file, returns ERROR if it can't be opened or is empty.
+int platform_map_file(const char* path, platform_mapping_t* mapping);
+void platform_unmap_file(platform_mapping_t* mapping);
+
+#endif //PLATFORM_H
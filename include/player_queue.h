@@ -7,8 +7,11 @@
 #define PLAYER_QUEUE_H
 
 #include <stddef.h>
+#include <stdint.h>
 #include <winsock2.h>
 
+#include "connection.h"
+
 #ifndef TRUE
 # define TRUE 1
 #endif //TRUE
@@ -23,18 +26,43 @@
 # define ERROR 1
 #endif //ERROR
 
+//number of preallocated slots, must be a power of two. pushing to a full queue fails.
+#ifndef PLAYER_QUEUE_CAPACITY
+# define PLAYER_QUEUE_CAPACITY 1024
+#endif //PLAYER_QUEUE_CAPACITY
+
+#define PLAYER_QUEUE_CACHE_LINE 64
+
+//a player who finished their handshake and is waiting to be matched.
+typedef struct player {
+    connection_t* connection; //non-blocking, may already hold bytes the player sent after JOIN.
+    uint32_t rtt_ms;        //measured between sending HELLO_ACK and receiving JOIN.
+    ULONGLONG queued_at_ms; //GetTickCount64() when the player was queued.
+    uint64_t queued_at_us; //the same moment with microsecond precision, for latency histograms.
+    ULONGLONG requested_at_ms; //when the player asked for a race, i.e. was accepted or sent JOIN again.
+    int reused; //TRUE if the player is coming back from a finished race on the same connection.
+    mrmp_features_t features; //negotiated during the handshake.
+} player_t;
+
 //for future portability.
-typedef SOCKET player_queue_type_t;
+typedef player_t player_queue_type_t;
 
-typedef struct player_queue_node {
+//a slot is ready to be pushed into when sequence == position, and ready to be popped when sequence == position + 1.
+typedef struct player_queue_slot {
+    volatile LONG64 sequence;
     player_queue_type_t data;
-    struct player_queue_node* next;
-} player_queue_node_t;
+} player_queue_slot_t;
 
+//bounded lock-free queue, any number of threads may push but only a single thread may
+//query the front, pop or clear it. size is approximate while pushes are in flight.
 typedef struct player_queue {
-    player_queue_node_t* front;
-    player_queue_node_t* back;
-    size_t size;  
+    player_queue_slot_t* slots;
+    LONG64 mask;
+    char pad0[PLAYER_QUEUE_CACHE_LINE];
+    volatile LONG64 enqueue_position; //shared by producers.
+    char pad1[PLAYER_QUEUE_CACHE_LINE];
+    volatile LONG64 dequeue_position; //only written by the consumer.
+    char pad2[PLAYER_QUEUE_CACHE_LINE];
 } player_queue_t;
 
 // initializer/cleanup.
@@ -50,4 +78,3 @@ int player_queue_is_empty(player_queue_t* queue);
 size_t player_queue_size(player_queue_t* queue);
 
 #endif //PLAYER_QUEUE_H
-
@@ -0,0 +1,77 @@
+// Filename: renderer.h
+// Programmer(s): Abdurrahman Alyajouri
+// Date: 10/19/2026
+// Purpose: To draw a maze and the players racing on it in the terminal. frames are composed off screen and only the
+//          cells that changed since the last frame are written, as one batch of ANSI escape sequences.
+
+#ifndef RENDERER_H
+#define RENDERER_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include "platform.h"
+#include "maze.h"
+
+#ifndef TRUE
+# define TRUE 1
+#endif //TRUE
+#ifndef FALSE
+# define FALSE 0
+#endif //FALSE
+
+#ifndef SUCCESS
+# define SUCCESS 0
+#endif //SUCCESS
+#ifndef ERROR
+# define ERROR 1
+#endif //ERROR
+
+#define RENDERER_MAX_PLAYERS 32
+//unchanged cells between two changed ones are rewritten rather than jumped over when there are at most this many,
+//a cursor movement costs about as many bytes.
+#define RENDERER_MAX_GAP 8
+//lines kept free below the maze for messages, so printing them doesn't scroll the maze out of place.
+#define RENDERER_MESSAGE_LINES 1
+
+//the maze is laid out the way print_maze() prints it: every cell is 3x3 characters, each followed by a space.
+typedef struct renderer {
+    platform_point_t origin;        //where the maze's top left corner is on screen.
+    int width;                      //of the part of the maze that fits on screen, in terminal cells.
+    int height;
+    char* maze;                     //the maze without players, width * height.
+    char* back;                     //the frame being composed.
+    char* front;                    //what the terminal shows, 0 where it is unknown.
+    uint8_t* dirty_rows;            //rows of the frame being composed that may differ from the terminal.
+    int dirty_count;
+    platform_point_t players[RENDERER_MAX_PLAYERS]; //cells players were put in, so they can be taken off again.
+    int player_count;
+    char* batch;                    //escape sequences of the frame being written.
+    size_t batch_capacity;
+    ULONGLONG frame_interval_ms;
+    ULONGLONG last_frame_ms;
+    int first_frame;                //the next frame draws a new maze.
+} renderer_t;
+
+// initializer/cleanup.
+//frames are written at most frames_per_second times a second, changes made in between are drawn together.
+renderer_t* renderer_init(int frames_per_second);
+int renderer_free(renderer_t* renderer);
+
+// main api
+//lays a new maze out with its top left corner at origin, clipped to the terminal. the next frame draws all of it,
+//the screen below origin is expected to be blank. returns ERROR, and draws nothing, if none of it fits.
+int renderer_set_maze(renderer_t* renderer, maze_t* maze, platform_point_t origin);
+//takes every player off the frame being composed.
+void renderer_clear_players(renderer_t* renderer);
+//puts a player into a maze cell of the frame being composed, cells off screen are skipped.
+void renderer_put_player(renderer_t* renderer, int row, int column, char symbol);
+//writes what changed in the composed frame with a single write, unless the last frame was too recent. the first
+//frame of a maze leaves the cursor below it, later ones put it back where it was. returns TRUE if it wrote.
+int renderer_present(renderer_t* renderer, ULONGLONG now_ms);
+//writes the composed frame right away, for the last frame before something else is printed.
+int renderer_flush(renderer_t* renderer);
+//milliseconds until the composed frame may be written, -1 if the terminal already shows it.
+int renderer_wait_ms(renderer_t* renderer, ULONGLONG now_ms);
+
+#endif //RENDERER_H
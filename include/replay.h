@@ -0,0 +1,155 @@
+// Filename: replay.h
+// Programmer(s): Abdurrahman Alyajouri
+// Date: 10/19/2026
+// Purpose: To record races into compact binary replay files and read them back, either to watch them again or to
+//          verify their outcome.
+
+#ifndef REPLAY_H
+#define REPLAY_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include "maze.h"
+#include "platform.h"
+
+#ifndef TRUE
+# define TRUE 1
+#endif //TRUE
+#ifndef FALSE
+# define FALSE 0
+#endif //FALSE
+
+#ifndef SUCCESS
+# define SUCCESS 0
+#endif //SUCCESS
+#ifndef ERROR
+# define ERROR 1
+#endif //ERROR
+
+//a replay file is laid out as follows, every integer in big-endian byte order so a file can be read in place:
+//  header      REPLAY_HEADER_SIZE bytes, see below.
+//  maze        rows * columns cells, row by row.
+//  events      event_count variable sized events, up to index_offset.
+//  index       index_count entries of REPLAY_INDEX_ENTRY_SIZE(player_count) bytes.
+//
+//the header holds, in order: the magic, version, player count, rows, columns, session id, race (the number of
+//races the session hosted before this one), the wall clock time of START in unix milliseconds, the race's duration,
+//event count, index offset, index count, outcome and winner, followed by 2 reserved bytes.
+//
+//every event starts with the milliseconds since the previous event as a varint, followed by a byte holding the
+//player in its high 4 bits and the event kind in its low 4 bits. a rejected move is followed by the row and column
+//the player tried to move to. the index records the state before every REPLAY_INDEX_INTERVAL-th event, so a
+//reader can seek to any time without decoding the events before it. an entry holds the number and offset of the
+//event it precedes, the time of the event before it, a bitmask of the players that left and every position.
+#define REPLAY_MAGIC                "MRRP"
+#define REPLAY_VERSION              1
+#define REPLAY_HEADER_SIZE          44
+#define REPLAY_MAX_PLAYERS          16
+#define REPLAY_INDEX_INTERVAL       64
+#define REPLAY_INDEX_ENTRY_SIZE(players) (sizeof(uint32_t) * 3 + sizeof(uint16_t) + 2 * (players))
+#define REPLAY_FILE_EXTENSION       ".mrr"
+
+//event kinds, a step's kind is its MRMP_DIR_* direction.
+#define REPLAY_EVENT_STEP_NORTH     0
+#define REPLAY_EVENT_STEP_EAST      1
+#define REPLAY_EVENT_STEP_SOUTH     2
+#define REPLAY_EVENT_STEP_WEST      3
+#define REPLAY_EVENT_REJECTED       4
+#define REPLAY_EVENT_LEAVE          5
+
+#define REPLAY_OUTCOME_WON          0
+#define REPLAY_OUTCOME_TIMEOUT      1
+#define REPLAY_OUTCOME_ABORTED      2
+#define REPLAY_NO_WINNER            0xFF
+
+//a growing replay, owned by the thread hosting the race.
+typedef struct replay_recorder {
+    uint8_t* data; //header, maze and events.
+    size_t length;
+    size_t capacity;
+    uint8_t* index;
+    size_t index_length;
+    size_t index_capacity;
+    uint32_t event_count;
+    uint32_t index_count;
+    uint32_t last_ms;
+    int player_count;
+    int rows[REPLAY_MAX_PLAYERS]; //positions after the last event, for the index.
+    int columns[REPLAY_MAX_PLAYERS];
+    uint16_t left; //bit i is set once player i left.
+    int failed; //an allocation failed, the replay can't be finished.
+} replay_recorder_t;
+
+//a replay file mapped into memory, or a replay image parsed in place.
+typedef struct replay {
+    const uint8_t* data;
+    size_t length;
+    uint8_t version;
+    uint8_t player_count;
+    maze_size_t rows;
+    maze_size_t columns;
+    uint32_t session_id;
+    uint32_t race;
+    uint64_t started_at_ms;
+    uint32_t duration_ms;
+    uint32_t event_count;
+    uint32_t index_offset;
+    uint32_t index_count;
+    uint8_t outcome;
+    uint8_t winner;
+    const uint8_t* cells;
+    const uint8_t* events;
+    const uint8_t* index;
+    platform_mapping_t mapping; //of the file opened by replay_open(), empty for a parsed image.
+} replay_t;
+
+//a decoded event. row and column are where a step led or where a rejected move tried to go, they may lie outside
+//the maze in a corrupt or forged replay.
+typedef struct replay_event {
+    uint32_t time_ms; //since START.
+    uint8_t player;
+    uint8_t kind;
+    int row;
+    int column;
+} replay_event_t;
+
+//walks the events of a replay, tracking where every player is.
+typedef struct replay_cursor {
+    const replay_t* replay;
+    size_t offset; //of the next event.
+    uint32_t event; //number of the next event.
+    uint32_t time_ms; //of the last event read.
+    int rows[REPLAY_MAX_PLAYERS];
+    int columns[REPLAY_MAX_PLAYERS];
+    uint16_t left;
+} replay_cursor_t;
+
+// initializer/cleanup.
+replay_recorder_t* replay_recorder_init(maze_t* maze, int player_count, uint32_t session_id, uint32_t race, uint64_t started_at_ms);
+int replay_recorder_free(replay_recorder_t* recorder);
+//maps the file read-only and parses it, returns NULL if it can't be opened or isn't a valid replay.
+replay_t* replay_open(const char* path);
+int replay_close(replay_t* replay);
+
+// main api
+//time_ms counts from START, events are expected in order.
+int replay_record_step(replay_recorder_t* recorder, uint32_t time_ms, int player, uint8_t direction);
+int replay_record_rejected(replay_recorder_t* recorder, uint32_t time_ms, int player, maze_size_t row, maze_size_t column);
+int replay_record_leave(replay_recorder_t* recorder, uint32_t time_ms, int player);
+//frees the recorder and returns the finished replay file, to be freed by the caller. returns NULL if it failed.
+uint8_t* replay_recorder_finish(replay_recorder_t* recorder, uint8_t outcome, uint8_t winner, uint32_t duration_ms, size_t* out_length);
+
+//checks the header and the bounds of every section. data must outlive the replay.
+int replay_parse(replay_t* replay, const uint8_t* data, size_t length);
+//builds the maze the race was run on, to be freed with free_maze().
+maze_t* replay_maze(const replay_t* replay);
+
+void replay_cursor_init(replay_cursor_t* cursor, const replay_t* replay);
+//reads the next event and applies it to the cursor. returns ERROR once every event was read or if the rest of the
+//events are malformed, cursor->event tells them apart.
+int replay_next(replay_cursor_t* cursor, replay_event_t* out_event);
+//moves the cursor to just after the last event at or before time_ms, starting from the closest index entry.
+int replay_seek(replay_cursor_t* cursor, uint32_t time_ms);
+
+#endif //REPLAY_H
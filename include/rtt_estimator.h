@@ -0,0 +1,32 @@
+// Filename: rtt_estimator.h
+// Programmer(s): Abdurrahman Alyajouri
+// Date: 10/19/2026
+// Purpose: To estimate a connection's round trip time and derive timeouts from it, the way TCP computes its
+//          retransmission timeout (RFC 6298).
+
+#ifndef RTT_ESTIMATOR_H
+#define RTT_ESTIMATOR_H
+
+#include <stdint.h>
+
+#ifndef TRUE
+# define TRUE 1
+#endif //TRUE
+#ifndef FALSE
+# define FALSE 0
+#endif //FALSE
+
+//embedded into whatever owns the connection, not thread safe.
+typedef struct rtt_estimator {
+    uint32_t srtt_us;   //smoothed round trip time.
+    uint32_t rttvar_us; //smoothed mean deviation of the round trip time.
+    uint32_t samples;
+} rtt_estimator_t;
+
+void rtt_estimator_init(rtt_estimator_t* estimator);
+//folds a measured round trip into the estimate, the first sample seeds it.
+void rtt_estimator_sample(rtt_estimator_t* estimator, uint32_t rtt_us);
+//srtt + 4 * rttvar clamped to [min_ms, max_ms], or max_ms until the first sample.
+uint32_t rtt_estimator_timeout_ms(rtt_estimator_t* estimator, uint32_t min_ms, uint32_t max_ms);
+
+#endif //RTT_ESTIMATOR_H
@@ -0,0 +1,84 @@
+// Filename: slab_pool.h
+// Programmer(s): Abdurrahman Alyajouri
+// Date: 10/19/2026
+// Purpose: To hand out small blocks of a few known sizes without going through malloc() for each one. every size
+//          class keeps its free blocks on a list and carves new ones out of large slabs, which are only given back
+//          to the heap when the pool is freed.
+
+#ifndef SLAB_POOL_H
+#define SLAB_POOL_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stddef.h>
+
+#ifndef TRUE
+# define TRUE 1
+#endif //TRUE
+#ifndef FALSE
+# define FALSE 0
+#endif //FALSE
+
+#ifndef SUCCESS
+# define SUCCESS 0
+#endif //SUCCESS
+#ifndef ERROR
+# define ERROR 1
+#endif //ERROR
+
+#define SLAB_POOL_MAX_CLASSES   16
+#define SLAB_POOL_SLAB_SIZE     (16 * 1024) //a slab holds at least one block, even of a class larger than this.
+#define SLAB_POOL_ALIGNMENT     16
+#define SLAB_POOL_HEAP_CLASS    UINT32_MAX //blocks larger than every class are malloc()'d one by one.
+
+typedef struct slab_pool_slab {
+    struct slab_pool_slab* next;
+} slab_pool_slab_t;
+
+//every block starts with this header, the caller gets the memory right behind it.
+typedef struct slab_pool_chunk {
+    union {
+        struct slab_pool* pool;         //while handed out, where the block goes back to, NULL if it is on the heap.
+        struct slab_pool_chunk* next;   //while free, the next free block of its class.
+    } link;
+    uint32_t size_class;
+} slab_pool_chunk_t;
+
+typedef struct slab_pool_class {
+    size_t size;                //largest allocation the class serves.
+    size_t stride;              //bytes between two blocks of a slab, header included.
+    size_t blocks_per_slab;
+    slab_pool_chunk_t* free_list;
+    slab_pool_slab_t* slabs;
+    uint32_t slab_count;
+    uint32_t in_use;
+    uint32_t in_use_peak;       //most blocks handed out at once, the pool never holds more slabs than this needs.
+    uint64_t allocations;
+} slab_pool_class_t;
+
+//not thread safe, a pool belongs to one thread and its blocks have to be released on that thread. the counters
+//are only ever written by that thread, so others may read them for statistics.
+typedef struct slab_pool {
+    slab_pool_class_t classes[SLAB_POOL_MAX_CLASSES];
+    int class_count;
+    uint32_t heap_in_use;
+    uint64_t heap_allocations;  //allocations too large for every class.
+} slab_pool_t;
+
+// initializer/cleanup.
+//class_sizes must be ascending, sizes that don't grow over the one before them are dropped.
+slab_pool_t* slab_pool_init(const size_t* class_sizes, int class_count);
+//every block must have been released already, the slabs they came from are freed.
+int slab_pool_free(slab_pool_t* pool);
+
+// main api
+//the smallest class that fits the size serves it. a NULL pool, or a size larger than every class, is served by
+//malloc() instead, the block is released the same way. returns NULL if out of memory.
+void* slab_pool_alloc(slab_pool_t* pool, size_t size);
+//gives a block back to the pool it came from, or to the heap. NULL is ignored.
+void slab_pool_release(void* memory);
+//a table of every class's slabs, blocks in use and their high-water mark. may be called from any thread, the numbers
+//are read without locking and may be slightly stale.
+void slab_pool_print(slab_pool_t* pool, FILE* file);
+
+#endif //SLAB_POOL_H
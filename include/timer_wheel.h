@@ -0,0 +1,65 @@
+// Filename: timer_wheel.h
+// Programmer(s): Abdurrahman Alyajouri
+// Date: 10/19/2026
+// Purpose: To track large numbers of absolute deadlines with constant time arming and cancelling, using a
+//          hierarchical timing wheel.
+
+#ifndef TIMER_WHEEL_H
+#define TIMER_WHEEL_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifndef TRUE
+# define TRUE 1
+#endif //TRUE
+#ifndef FALSE
+# define FALSE 0
+#endif //FALSE
+
+#ifndef SUCCESS
+# define SUCCESS 0
+#endif //SUCCESS
+#ifndef ERROR
+# define ERROR 1
+#endif //ERROR
+
+//4 levels of 64 slots cover 64^4 ticks, about 46 hours at a 10 ms granularity. deadlines further out are clamped.
+#define TIMER_WHEEL_SLOT_BITS   6
+#define TIMER_WHEEL_SLOTS       (1 << TIMER_WHEEL_SLOT_BITS)
+#define TIMER_WHEEL_LEVELS      4
+
+//embedded into whatever owns the deadline, so arming a timer never allocates.
+typedef struct timer_wheel_timer {
+    struct timer_wheel_timer* next;
+    struct timer_wheel_timer** pprev; //the pointer pointing at this timer, NULL while the timer isn't armed.
+    uint64_t expires_tick;
+    void* data;
+} timer_wheel_timer_t;
+
+typedef void (*timer_wheel_callback_t)(timer_wheel_timer_t* timer, void* context);
+
+//not thread safe, meant to be owned by a single thread.
+typedef struct timer_wheel {
+    timer_wheel_timer_t* slots[TIMER_WHEEL_LEVELS][TIMER_WHEEL_SLOTS];
+    uint64_t current_tick;
+    uint64_t granularity_ms;
+    size_t armed_count;
+} timer_wheel_t;
+
+// initializer/cleanup.
+timer_wheel_t* timer_wheel_init(uint64_t now_ms, uint64_t granularity_ms);
+//timers still armed are owned by the caller and are simply forgotten.
+int timer_wheel_free(timer_wheel_t* wheel);
+void timer_wheel_timer_init(timer_wheel_timer_t* timer, void* data);
+
+// main api
+//arms the timer to fire once now_ms passes deadline_ms, re-arming an armed timer moves it.
+void timer_wheel_arm(timer_wheel_t* wheel, timer_wheel_timer_t* timer, uint64_t deadline_ms);
+void timer_wheel_cancel(timer_wheel_t* wheel, timer_wheel_timer_t* timer);
+int timer_wheel_is_armed(timer_wheel_timer_t* timer);
+//fires every timer whose deadline passed, disarming it before its callback runs. callbacks may arm or cancel any
+//timer. returns the number of timers fired.
+size_t timer_wheel_advance(timer_wheel_t* wheel, uint64_t now_ms, timer_wheel_callback_t callback, void* context);
+
+#endif //TIMER_WHEEL_H
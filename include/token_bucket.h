@@ -0,0 +1,42 @@
+// Filename: token_bucket.h
+// Programmer(s): Abdurrahman Alyajouri
+// Date: 10/19/2026
+// Purpose: To serve as a token bucket rate limiter for admitting new client handshakes.
+
+#ifndef TOKEN_BUCKET_H
+#define TOKEN_BUCKET_H
+
+#include <windows.h>
+
+#ifndef TRUE
+# define TRUE 1
+#endif //TRUE
+#ifndef FALSE
+# define FALSE 0
+#endif //FALSE
+
+#ifndef SUCCESS
+# define SUCCESS 0
+#endif //SUCCESS
+#ifndef ERROR
+# define ERROR 1
+#endif //ERROR
+
+//not thread safe, meant to be owned by the single thread accepting connections.
+typedef struct token_bucket {
+    double tokens;
+    double capacity;        //maximum burst size.
+    double refill_rate;     //tokens added per second.
+    LARGE_INTEGER last_refill;
+    LARGE_INTEGER frequency;
+} token_bucket_t;
+
+// initializer/cleanup.
+token_bucket_t* token_bucket_init(double refill_rate, double capacity);
+int token_bucket_free(token_bucket_t* bucket);
+
+// main api
+//returns TRUE and consumes a token if one is available, FALSE otherwise.
+int token_bucket_take(token_bucket_t* bucket);
+
+#endif //TOKEN_BUCKET_H
@@ -0,0 +1,85 @@
+// Filename: trace.h
+// Programmer(s): Abdurrahman Alyajouri
+// Date: 10/19/2026
+// Purpose: To record timestamped events into per thread ring buffers and dump them in the Chrome trace format,
+//          so a slow session can be inspected in a trace viewer.
+
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <windows.h>
+
+#ifndef TRUE
+# define TRUE 1
+#endif //TRUE
+#ifndef FALSE
+# define FALSE 0
+#endif //FALSE
+
+#ifndef SUCCESS
+# define SUCCESS 0
+#endif //SUCCESS
+#ifndef ERROR
+# define ERROR 1
+#endif //ERROR
+
+#define TRACE_RING_SIZE     8192 //events kept per thread, must be a power of two. the oldest are overwritten.
+#define TRACE_MAX_RINGS     128
+#define TRACE_MAX_NAME      32
+
+//phases as named by the Chrome trace format.
+#define TRACE_PHASE_BEGIN       'B'
+#define TRACE_PHASE_END         'E'
+#define TRACE_PHASE_COMPLETE    'X' //a span that is recorded once it is over, so spans of one thread may interleave.
+#define TRACE_PHASE_INSTANT     'i'
+
+typedef struct trace_event {
+    uint64_t timestamp_us;
+    uint64_t duration_us; //complete events only.
+    const char* name; //must be a string literal, it is kept by pointer and written out as is.
+    uint32_t session_id; //0 if the event doesn't belong to a session.
+    char phase;
+} trace_event_t;
+
+//written by exactly one thread without locking, events are published by advancing head.
+typedef struct trace_ring {
+    struct trace* trace;
+    int id;
+    char name[TRACE_MAX_NAME];
+    volatile LONG64 head; //number of events ever recorded.
+    trace_event_t events[TRACE_RING_SIZE];
+} trace_ring_t;
+
+typedef struct trace {
+    volatile LONG enabled; //nothing is recorded while FALSE, so tracing costs a single load until it's turned on.
+    LARGE_INTEGER frequency;
+    trace_ring_t* rings[TRACE_MAX_RINGS];
+    volatile LONG ring_count;
+} trace_t;
+
+// initializer/cleanup.
+//tracing starts out disabled.
+trace_t* trace_init(void);
+//frees every ring, no thread may still be recording into one.
+int trace_free(trace_t* trace);
+//hands out a new ring for a single thread, named as shown by trace viewers. returns NULL once TRACE_MAX_RINGS
+//were handed out.
+trace_ring_t* trace_ring(trace_t* trace, const char* name);
+
+// main api
+void trace_set_enabled(trace_t* trace, int enabled);
+//microseconds on the performance counter, the clock every event is timestamped with.
+uint64_t trace_now_us(trace_t* trace);
+//a NULL ring records nothing, so callers don't need to check whether they were given one.
+void trace_begin(trace_ring_t* ring, const char* name, uint32_t session_id);
+void trace_end(trace_ring_t* ring, const char* name, uint32_t session_id);
+//records a span that started at started_us, as returned by trace_now_us, and ends now.
+void trace_complete(trace_ring_t* ring, const char* name, uint32_t session_id, uint64_t started_us);
+void trace_instant(trace_ring_t* ring, const char* name, uint32_t session_id);
+//writes every event still held by the rings as Chrome trace JSON. threads may keep recording while it runs, events
+//overwritten in the meantime are left out. returns the number of events written, or -1 on a write error.
+long long trace_write_chrome(trace_t* trace, FILE* file);
+
+#endif //TRACE_H
@@ -0,0 +1,123 @@
+// Filename: arena.c
+// Programmer(s): Abdurrahman Alyajouri
+// Date: 10/19/2026
+// Purpose: To implement the api functions defined in arena.h
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "arena.h"
+
+//the block header is padded so the first allocation in a block is aligned as well.
+#define BLOCK_HEADER_SIZE (((sizeof(arena_block_t) + ARENA_ALIGNMENT - 1) / ARENA_ALIGNMENT) * ARENA_ALIGNMENT)
+
+static uint8_t* block_data(arena_block_t* block) {
+    return (uint8_t*) block + BLOCK_HEADER_SIZE;
+}
+
+arena_t* arena_init(size_t block_size) {
+    arena_t* arena = calloc(1, sizeof(arena_t));
+    if(!arena) {
+        perror("failed to initialize arena");
+        return NULL;
+    }
+
+    arena->block_size = block_size;
+    return arena;
+}
+
+static void free_blocks(arena_block_t* block) {
+    while(block != NULL) {
+        arena_block_t* next = block->next;
+        free(block);
+        block = next;
+    }
+}
+
+int arena_free(arena_t* arena) {
+    if(!arena) {
+        fprintf(stderr, "cannot free an invalid arena\n");
+        return ERROR;
+    }
+
+    free_blocks(arena->current);
+    free_blocks(arena->spare);
+    free(arena);
+    return SUCCESS;
+}
+
+//makes a block with room for size bytes current, preferring a spare one.
+static arena_block_t* push_block(arena_t* arena, size_t size) {
+    arena_block_t** link = &arena->spare;
+    while(*link != NULL && (*link)->capacity < size) link = &(*link)->next;
+
+    arena_block_t* block = *link;
+    if(block != NULL) {
+        *link = block->next;
+    } else {
+        size_t capacity = size > arena->block_size ? size : arena->block_size;
+        block = malloc(BLOCK_HEADER_SIZE + capacity);
+        if(block == NULL) return NULL;
+        block->capacity = capacity;
+        ++arena->heap_allocations;
+    }
+
+    block->used = 0;
+    block->next = arena->current;
+    arena->current = block;
+    return block;
+}
+
+void* arena_alloc(arena_t* arena, size_t size) {
+    size_t aligned_size = ((size + ARENA_ALIGNMENT - 1) / ARENA_ALIGNMENT) * ARENA_ALIGNMENT;
+    if(aligned_size == 0) aligned_size = ARENA_ALIGNMENT;
+
+    arena_block_t* block = arena->current;
+    if(block == NULL || block->capacity - block->used < aligned_size) {
+        block = push_block(arena, aligned_size);
+        if(block == NULL) {
+            fprintf(stderr, "failed to malloc() an arena block.\n");
+            return NULL;
+        }
+    }
+
+    void* memory = block_data(block) + block->used;
+    block->used += aligned_size;
+    arena->bytes_used += aligned_size;
+    if(arena->bytes_used > arena->bytes_peak) arena->bytes_peak = arena->bytes_used;
+    ++arena->allocations;
+    return memory;
+}
+
+void* arena_calloc(arena_t* arena, size_t count, size_t size) {
+    void* memory = arena_alloc(arena, count * size);
+    if(memory != NULL) memset(memory, 0, count * size);
+    return memory;
+}
+
+arena_mark_t arena_mark(arena_t* arena) {
+    arena_mark_t mark = { arena->current, arena->current != NULL ? arena->current->used : 0, arena->bytes_used };
+    return mark;
+}
+
+void arena_rewind(arena_t* arena, arena_mark_t mark) {
+    //blocks started after the mark are kept as spares, the next allocations that outgrow the block fill them again.
+    while(arena->current != mark.block) {
+        arena_block_t* block = arena->current;
+        arena->current = block->next;
+        block->next = arena->spare;
+        arena->spare = block;
+    }
+
+    if(arena->current != NULL) arena->current->used = mark.used;
+    arena->bytes_used = mark.bytes_used;
+}
+
+void arena_reset(arena_t* arena) {
+    arena_mark_t empty = { NULL, 0, 0 };
+    arena_rewind(arena, empty);
+    arena->bytes_peak = 0;
+    arena->allocations = 0;
+    arena->heap_allocations = 0;
+}
@@ -0,0 +1,158 @@
+// Filename: connection.c
+// Programmer(s): Abdurrahman Alyajouri
+// Date: 10/19/2026
+// Purpose: To implement the api functions defined in connection.h
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "connection.h"
+
+connection_t* connection_init(SOCKET socket) {
+    connection_t* connection = malloc(sizeof(connection_t));
+    if(!connection) {
+        perror("failed to initialize connection");
+        return NULL;
+    }
+
+    u_long non_blocking = 1;
+    if(ioctlsocket(socket, FIONBIO, &non_blocking) != NO_ERROR) {
+        fprintf(stderr, "ioctlsocket failed with error: %d\n", WSAGetLastError());
+        free(connection);
+        return NULL;
+    }
+
+    connection->socket = socket;
+    connection->version = MRMP_VERSION_0;
+    connection->peer_is_server = FALSE;
+    connection->read_length = 0;
+    connection->output_front = 0;
+    connection->output_count = 0;
+    connection->output_offset = 0;
+    connection->metrics = NULL;
+    rtt_estimator_init(&connection->rtt);
+    return connection;
+}
+
+int connection_free(connection_t* connection) {
+    if(!connection) {
+        fprintf(stderr, "cannot free an invalid connection\n");
+        return ERROR;
+    }
+
+    while(connection->output_count > 0) {
+        mrmp_shared_buffer_release(connection->output_queue[connection->output_front]);
+        connection->output_front = (connection->output_front + 1) % CONNECTION_OUTPUT_QUEUE_SIZE;
+        --connection->output_count;
+    }
+
+    shutdown(connection->socket, SD_SEND);
+    closesocket(connection->socket);
+    free(connection);
+    return SUCCESS;
+}
+
+int connection_fill(connection_t* connection) {
+    int space = CONNECTION_READ_BUFFER_SIZE - connection->read_length;
+    if(space == 0) return SUCCESS;
+
+    int bytes_received = recv(connection->socket, connection->read_buffer + connection->read_length, space, 0);
+    if(bytes_received == 0) {
+        return GRACEFUL_DC;
+    } else if(bytes_received == SOCKET_ERROR) {
+        if(WSAGetLastError() == WSAEWOULDBLOCK) return SUCCESS;
+        return DISGRACEFUL_DC;
+    }
+
+    connection->read_length += bytes_received;
+    metrics_add(connection->metrics, METRIC_BYTES_RECEIVED, bytes_received);
+    return SUCCESS;
+}
+
+int connection_next_msg(connection_t* connection, char** out_msg) {
+    return connection_next_msg_in(connection, NULL, out_msg);
+}
+
+int connection_next_msg_in(connection_t* connection, arena_t* arena, char** out_msg) {
+    *out_msg = NULL;
+
+    mrmp_pkt_header_t header;
+    int header_length;
+    int parse_result = mrmp_parse_frame_header(connection->read_buffer, connection->read_length, connection->version, &header, &header_length);
+    if(parse_result != SUCCESS) return parse_result;
+
+    //a client has no business sending a maze or a result, and the parser shouldn't be handed one.
+    if(connection->peer_is_server == FALSE && mrmp_opcode_from_client(header.opcode) == FALSE) return ERROR;
+    if(header.length > (mrmp_payload_size_t)(CONNECTION_READ_BUFFER_SIZE - header_length)) return ERROR;
+
+    int frame_length = header_length + header.length;
+    if(connection->read_length < frame_length) return TIMEDOUT;
+
+    *out_msg = mrmp_payload_to_pkt_struct_in(arena, header, connection->read_buffer + header_length);
+    metrics_count_frame_received(connection->metrics, header.opcode);
+
+    //shift the remaining bytes to the front, frames are small so this is cheap.
+    connection->read_length -= frame_length;
+    memmove(connection->read_buffer, connection->read_buffer + frame_length, connection->read_length);
+
+    if(*out_msg == NULL) return ERROR;
+    return SUCCESS;
+}
+
+int connection_queue(connection_t* connection, mrmp_shared_buffer_t* buffer) {
+    if(connection->output_count == CONNECTION_OUTPUT_QUEUE_SIZE) return ERROR;
+
+    //the compact twin is cached on the frame, so a broadcast is still framed only once per version.
+    buffer = mrmp_shared_buffer_for_version(buffer, connection->version);
+    if(buffer == NULL) return ERROR;
+
+    int back = (connection->output_front + connection->output_count) % CONNECTION_OUTPUT_QUEUE_SIZE;
+    connection->output_queue[back] = mrmp_shared_buffer_acquire(buffer);
+    ++connection->output_count;
+    //every framing starts with the opcode.
+    metrics_count_frame_sent(connection->metrics, (uint8_t) buffer->data[0]);
+    return SUCCESS;
+}
+
+int connection_flush(connection_t* connection) {
+    while(connection->output_count > 0) {
+        //gather every queued frame into a single send call.
+        WSABUF buffers[CONNECTION_OUTPUT_QUEUE_SIZE];
+        for(int i = 0; i < connection->output_count; ++i) {
+            mrmp_shared_buffer_t* frame = connection->output_queue[(connection->output_front + i) % CONNECTION_OUTPUT_QUEUE_SIZE];
+            int offset = (i == 0) ? connection->output_offset : 0;
+            buffers[i].buf = frame->data + offset;
+            buffers[i].len = frame->length - offset;
+        }
+
+        DWORD bytes_sent = 0;
+        if(WSASend(connection->socket, buffers, connection->output_count, &bytes_sent, 0, NULL, NULL) == SOCKET_ERROR) {
+            if(WSAGetLastError() == WSAEWOULDBLOCK) return SUCCESS;
+            return SOCKET_ERROR;
+        }
+        metrics_add(connection->metrics, METRIC_BYTES_SENT, bytes_sent);
+
+        //release every frame that went out completely, remember how far into a partially sent one we got.
+        while(bytes_sent > 0) {
+            mrmp_shared_buffer_t* frame = connection->output_queue[connection->output_front];
+            DWORD remaining = frame->length - connection->output_offset;
+            if(bytes_sent < remaining) {
+                connection->output_offset += bytes_sent;
+                break;
+            }
+
+            bytes_sent -= remaining;
+            mrmp_shared_buffer_release(frame);
+            connection->output_front = (connection->output_front + 1) % CONNECTION_OUTPUT_QUEUE_SIZE;
+            connection->output_offset = 0;
+            --connection->output_count;
+        }
+    }
+
+    return SUCCESS;
+}
+
+int connection_has_output(connection_t* connection) {
+    return connection->output_count > 0;
+}
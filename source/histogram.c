@@ -0,0 +1,124 @@
+// Filename: histogram.c
+// Programmer(s): Abdurrahman Alyajouri
+// Date: 10/19/2026
+// Purpose: To implement the api functions defined in histogram.h
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "histogram.h"
+
+//values below 2 * HISTOGRAM_SUB_BUCKETS map one to one, larger values are shifted down until they fit
+//in [HISTOGRAM_SUB_BUCKETS, 2 * HISTOGRAM_SUB_BUCKETS) and the shift picks the range they land in.
+static size_t histogram_index(uint64_t value) {
+    int shift = 0;
+    while((value >> shift) >= 2 * HISTOGRAM_SUB_BUCKETS) ++shift;
+    return (size_t) shift * HISTOGRAM_SUB_BUCKETS + (size_t)(value >> shift);
+}
+
+static uint64_t histogram_highest_equivalent(size_t index) {
+    if(index < 2 * HISTOGRAM_SUB_BUCKETS) return index;
+
+    int shift = (int)(index / HISTOGRAM_SUB_BUCKETS) - 1;
+    uint64_t sub_bucket = index - (size_t) shift * HISTOGRAM_SUB_BUCKETS;
+    return ((sub_bucket + 1) << shift) - 1;
+}
+
+histogram_t* histogram_init(void) {
+    histogram_t* histogram = malloc(sizeof(histogram_t));
+    if(!histogram) {
+        perror("failed to initialize histogram");
+        return NULL;
+    }
+
+    histogram_clear(histogram);
+    return histogram;
+}
+
+int histogram_free(histogram_t* histogram) {
+    if(!histogram) {
+        fprintf(stderr, "cannot free an invalid histogram\n");
+        return ERROR;
+    }
+
+    free(histogram);
+    return SUCCESS;
+}
+
+int histogram_record(histogram_t* histogram, uint64_t value) {
+    if(!histogram) {
+        fprintf(stderr, "cannot record to an invalid histogram\n");
+        return ERROR;
+    }
+
+    ++histogram->counts[histogram_index(value)];
+    ++histogram->total;
+    if(value > histogram->max) histogram->max = value;
+
+    return SUCCESS;
+}
+
+int histogram_clear(histogram_t* histogram) {
+    if(!histogram) {
+        fprintf(stderr, "cannot clear an invalid histogram\n");
+        return ERROR;
+    }
+
+    memset(histogram, 0, sizeof(histogram_t));
+    return SUCCESS;
+}
+
+int histogram_merge(histogram_t* into, histogram_t* from) {
+    if(!into || !from) {
+        fprintf(stderr, "cannot merge an invalid histogram\n");
+        return ERROR;
+    }
+
+    //the total is counted from the buckets rather than read, so a histogram that is being recorded to by another
+    //thread still merges into a consistent snapshot.
+    uint64_t merged = 0;
+    for(size_t i = 0; i < HISTOGRAM_BUCKETS; ++i) {
+        uint64_t count = from->counts[i];
+        into->counts[i] += count;
+        merged += count;
+    }
+    into->total += merged;
+    if(from->max > into->max) into->max = from->max;
+
+    return SUCCESS;
+}
+
+uint64_t histogram_percentile(histogram_t* histogram, double percentile) {
+    if(!histogram) {
+        fprintf(stderr, "cannot query percentile of an invalid histogram\n");
+        return 0;
+    }
+
+    if(histogram->total == 0) return 0;
+    if(percentile > 100.0) percentile = 100.0;
+
+    //the rank of the sample we are looking for, rounded up so p100 is the last sample.
+    uint64_t rank = (uint64_t)((percentile / 100.0) * (double) histogram->total + 0.5);
+    if(rank < 1) rank = 1;
+
+    uint64_t seen = 0;
+    for(size_t i = 0; i < HISTOGRAM_BUCKETS; ++i) {
+        seen += histogram->counts[i];
+        if(seen >= rank) {
+            uint64_t value = histogram_highest_equivalent(i);
+            return value < histogram->max ? value : histogram->max;
+        }
+    }
+
+    return histogram->max;
+}
+
+uint64_t histogram_count(histogram_t* histogram) {
+    if(!histogram) {
+        fprintf(stderr, "cannot query count of an invalid histogram\n");
+        return 0;
+    }
+
+    return histogram->total;
+}
@@ -117,6 +117,27 @@ void backtrack_recursive(int rows, int columns, int row, int column, temp_cell_t
     }
 }
 
+//carves a maze into the temporary cells by backtracking from the top left corner, then copies the walls into the maze.
+static void carve_maze(maze_t* maze, temp_cell_t** temp_cells) {
+    //initialize maze array.
+    for(int row = 0; row < maze->rows; ++row) {
+        for(int column = 0; column < maze->columns; ++column) {
+            temp_cells[row][column].cell = 0;
+            temp_cells[row][column].visited = FALSE;
+        }
+    }
+
+    //start at the top left corner of the maze, (0, 0).
+    backtrack_recursive(maze->rows, maze->columns, 0, 0, temp_cells);
+
+    //copy only cell component of temp cells structure to maze structure.
+    for(int row = 0; row < maze->rows; ++row) {
+        for(int column = 0; column < maze->columns; ++column) {
+            maze->cells[row][column] = temp_cells[row][column].cell;
+        }
+    }
+}
+
 maze_t* generate_maze(maze_size_t rows, maze_size_t columns) {
     //allocate maze array and related structures.
     maze_t* maze = malloc(sizeof(maze_t));
@@ -130,24 +151,7 @@ maze_t* generate_maze(maze_size_t rows, maze_size_t columns) {
         maze->cells[row] = malloc(sizeof(maze_cell_t) * columns);
     }
 
-    //initialize maze array.
-    for(int row = 0; row < rows; ++row) {
-        for(int column = 0; column < columns; ++column) {
-            temp_cells[row][column].cell = 0;
-            temp_cells[row][column].visited = FALSE;
-        }
-    }
-
-    //start at the top left corner of the maze, (0, 0).
-    backtrack_recursive(rows, columns, 0, 0, temp_cells);
-
-    //copy only cell component of temp cells structure to maze structure.
-    for(int row = 0; row < rows; ++row) {
-        for(int column = 0; column < columns; ++column) {
-            //printf("(%d, %d) - %d\n", row, column, temp_cells[row][column].cell);
-            maze->cells[row][column] = temp_cells[row][column].cell;
-        }
-    }
+    carve_maze(maze, temp_cells);
 
     for(int row = 0; row < rows; ++row)
         free(temp_cells[row]);
@@ -156,6 +160,33 @@ maze_t* generate_maze(maze_size_t rows, maze_size_t columns) {
     return maze;
 }
 
+maze_t* generate_maze_in(arena_t* arena, maze_size_t rows, maze_size_t columns) {
+    //the cells are one contiguous block, the rows point into it.
+    maze_t* maze = arena_alloc(arena, sizeof(maze_t));
+    maze_cell_t** cell_rows = arena_alloc(arena, sizeof(maze_cell_t*) * rows);
+    maze_cell_t* cells = arena_alloc(arena, sizeof(maze_cell_t) * rows * columns);
+    if(maze == NULL || cell_rows == NULL || cells == NULL) return NULL;
+
+    maze->rows = rows;
+    maze->columns = columns;
+    maze->cells = cell_rows;
+    for(int row = 0; row < rows; ++row)
+        maze->cells[row] = cells + row * columns;
+
+    //the temporary cells are only needed while carving, they are given back right after.
+    arena_mark_t scratch = arena_mark(arena);
+    temp_cell_t** temp_cells = arena_alloc(arena, sizeof(temp_cell_t*) * rows);
+    temp_cell_t* temp_cell_block = arena_alloc(arena, sizeof(temp_cell_t) * rows * columns);
+    if(temp_cells == NULL || temp_cell_block == NULL) return NULL;
+    for(int row = 0; row < rows; ++row)
+        temp_cells[row] = temp_cell_block + row * columns;
+
+    carve_maze(maze, temp_cells);
+    arena_rewind(arena, scratch);
+
+    return maze;
+}
+
 int free_maze(maze_t* maze) {
     for(maze_size_t row = 0; row < maze->rows; ++row) {
         free(maze->cells[row]);
@@ -4,12 +4,14 @@
 // Purpose: To confirm messages are being properly sent back and forth.
 
 #include <stdio.h>
-#include <winsock2.h>
-#include <ws2tcpip.h>
-#include <conio.h>
+#include <stdlib.h>
+#include <string.h>
 
+#include "platform.h"
 #include "networking_utils.h"
 #include "maze.h"
+#include "replay.h"
+#include "renderer.h"
 
 #ifndef EXIT_SUCCESS
 # define EXIT_SUCCESS 0
@@ -19,40 +21,126 @@
 #endif //EXIT_FAILURE
 
 #define PLAYER_CHAR 'o'
+#define MAX_OPPONENTS 16
+#define UDP_RESEND_MS 50 //unacknowledged moves are sent again this often.
+#define REPLAY_MAX_SPEED 64.0
+#define REPLAY_MIN_SPEED (1.0 / 64)
+#define REPLAY_MAX_WAIT_MS 1000 //longest sleep between replay events, keeps the wait's timeout in range at any speed.
+#define FRAMES_PER_SECOND 60 //changes in between frames are drawn together with the next one.
 
 static int p1_row = 0;
 static int p1_column = 0; 
-static int last_p1_row = 0;
-static int last_p1_column = 0;
 
-static int p2_row = 0;
-static int p2_column = 0;
-static int last_p2_row = 0;
-static int last_p2_column = 0;
+//opponents are indexed by the player id the server sends along with their moves.
+static int p2_row[MAX_OPPONENTS] = {0};
+static int p2_column[MAX_OPPONENTS] = {0};
+static int p2_moved[MAX_OPPONENTS] = {0}; //the number of opponents isn't sent, only track those we've heard from.
+
+//draws the maze and everyone on it, only what changed since the last frame reaches the terminal.
+static renderer_t* renderer = NULL;
+static slab_pool_t* pkt_pool = NULL; //every frame received is parsed into a block of it.
+
+//moves are predicted locally and sent with a sequence number. moves the server may not have judged yet are kept,
+//oldest first, so they can be replayed on top of the position a BAD_MOVE reports. over UDP they are also resent
+//until acknowledged. entry i has seq move_seq - (pending_count - 1 - i).
+static mrmp_move_seq_t move_seq = 0; //of the newest move sent, keeps counting across races.
+static mrmp_dgram_entry_t pending_moves[MRMP_DGRAM_MAX_ENTRIES];
+static int pending_count = 0;
+
+//moves made since the last loop, they go out together as one DIRECTIONS run if the server supports it.
+static mrmp_features_t granted_features = 0;
+static uint8_t unsent_codes[MRMP_RUN_BYTES(MRMP_MAX_RUN_STEPS)];
+static int unsent_count = 0;
+
+//udp fast path, moves go out over UDP once the server offered an endpoint for this race.
+static int udp_requested = FALSE;
+static int udp_active = FALSE;
+static SOCKET udp_socket = INVALID_SOCKET;
+static mrmp_pkt_udp_offer_t udp_offer;
+static ULONGLONG last_moves_sent_ms = 0;
+static uint32_t opponent_seq[MAX_OPPONENTS] = {0}; //newest position seq applied per opponent.
+static int simulated_loss_percent = 0;
+
+//framing of everything after the handshake, chosen in HELLO.
+static mrmp_version_t protocol_version = MRMP_VERSION;
+
+//watch a session instead of racing, 0 watches the newest one.
+static int spectating = FALSE;
+static mrmp_session_id_t spectate_session_id = 0;
 
 static struct timeval DONT_BLOCK = {
     .tv_sec = 0,
     .tv_usec = 0
 };
 
-void process_input(void);
-int changed_position(int is_p1);
-void draw_player(int old_row, int old_column, int row, int column, int maze_start_row, int maze_start_column, int is_p1);
+void process_input(maze_t* maze);
+void record_move(int row, int column, uint8_t direction);
+void send_moves(SOCKET socket);
+void reconcile(maze_t* maze, mrmp_move_seq_t rejected_seq, int row, int column);
+void spectate(SOCKET socket);
+int receive_msg(SOCKET socket, char** out_msg, struct timeval* timeout);
+int play_replay(const char* path, double speed, uint32_t start_ms);
+void reset_positions(void);
+void draw_maze(maze_t* maze);
+void draw_players(int flush);
 
-//assist in console rendering.
-COORD get_cursor_position();
-void move_cursor(int x, int y);
+int open_udp(const char* host, mrmp_pkt_udp_offer_t* offer);
+int simulate_datagram_loss(void);
+void send_pending_moves(void);
+void receive_dgrams(void);
 
 
 int main(int argc, char* argv[]) {
+    if(argc < 3) {
+        fprintf(stderr, "usage: %s server_address port [-u] [-l udp_loss_percent] [-p protocol_version] [-s session_id]\n", argv[0]);
+        fprintf(stderr, "       %s -r replay_file [-x speed] [-o start_ms]\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    //replays are played offline, no server is involved.
+    if(strcmp(argv[1], "-r") == 0) {
+        double speed = 1.0;
+        uint32_t start_ms = 0;
+        for(int i = 3; i < argc; ++i) {
+            if(strcmp(argv[i], "-x") == 0 && i + 1 < argc) {
+                speed = atof(argv[++i]);
+            } else if(strcmp(argv[i], "-o") == 0 && i + 1 < argc) {
+                start_ms = (uint32_t) strtoul(argv[++i], NULL, 10);
+            }
+        }
+        if(speed < REPLAY_MIN_SPEED) speed = REPLAY_MIN_SPEED;
+        if(speed > REPLAY_MAX_SPEED) speed = REPLAY_MAX_SPEED;
+
+        renderer = renderer_init(FRAMES_PER_SECOND);
+        if(renderer == NULL) return EXIT_FAILURE;
+        int replay_result = play_replay(argv[2], speed, start_ms);
+        renderer_free(renderer);
+        return replay_result == SUCCESS ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+
+    for(int i = 3; i < argc; ++i) {
+        if(strcmp(argv[i], "-u") == 0) {
+            udp_requested = TRUE;
+        } else if(strcmp(argv[i], "-p") == 0 && i + 1 < argc) {
+            protocol_version = (mrmp_version_t) atoi(argv[++i]);
+        } else if(strcmp(argv[i], "-l") == 0 && i + 1 < argc) {
+            simulated_loss_percent = atoi(argv[++i]);
+        } else if(strcmp(argv[i], "-s") == 0 && i + 1 < argc) {
+            spectating = TRUE;
+            spectate_session_id = (mrmp_session_id_t) strtoul(argv[++i], NULL, 10);
+        }
+    }
 
-    //initialize winsock.
-    WSADATA wsa_data;
-    int wsa_startup_result = WSAStartup(MAKEWORD(2, 2), &wsa_data);
-    if(wsa_startup_result != 0) {
-        fprintf(stderr, "WSAStartup failed: %d\n", wsa_startup_result);
+    //initialize winsock, or the raw terminal keys are read from.
+    if(platform_init() == ERROR) return EXIT_FAILURE;
+
+    renderer = renderer_init(FRAMES_PER_SECOND);
+    pkt_pool = mrmp_pkt_pool_init();
+    if(renderer == NULL || pkt_pool == NULL) {
+        platform_cleanup();
         return EXIT_FAILURE;
     }
+    mrmp_pkt_pool_use(pkt_pool);
 
     struct addrinfo *result = NULL, *ptr = NULL, hints;
 
@@ -64,16 +152,16 @@ int main(int argc, char* argv[]) {
     int getaddrinfo_result = getaddrinfo(argv[1], argv[2], &hints, &result);
     if(getaddrinfo_result != 0) {
         fprintf(stderr, "getaddrinfo failed: %d\n", getaddrinfo_result);
-        WSACleanup();
+        platform_cleanup();
         return EXIT_FAILURE;
     }
 
     //connecting socket setup.
     SOCKET connect_socket = socket(result->ai_family, result->ai_socktype, result->ai_protocol);
     if(connect_socket == INVALID_SOCKET) {
-        fprintf(stderr, "error at socket(): %ld\n", WSAGetLastError());
+        fprintf(stderr, "error at socket(): %ld\n", (long) WSAGetLastError());
         freeaddrinfo(result);
-        WSACleanup();
+        platform_cleanup();
         return 1;
     }
 
@@ -93,209 +181,637 @@ int main(int argc, char* argv[]) {
 
     if (connect_result == INVALID_SOCKET) {
         fprintf(stderr, "unable to connect to server!\n");
-        WSACleanup();
+        platform_cleanup();
         return 1;
     }
 
-    //say hello to the server.
-    int hello_result = send_hello_pkt(connect_socket, 0);
-    printf("sent hello packet.\n");
+    //say hello to the server, asking for direction runs, heartbeats and, if wanted, the UDP fast path. players send
+    //JOIN in the same write instead of waiting a round trip for HELLO_ACK, spectators wait to learn the framing.
+    mrmp_features_t features = MRMP_FEATURE_DIRECTIONS | MRMP_FEATURE_HEARTBEAT | (udp_requested == TRUE ? MRMP_FEATURE_UDP : 0);
+    if(spectating == TRUE) {
+        send_hello_pkt(connect_socket, protocol_version, features);
+        printf("sent hello packet.\n");
+    } else {
+        send_hello_join_pkts(connect_socket, protocol_version, features | MRMP_FEATURE_PIPELINED);
+        printf("sent hello and join packets.\n");
+    }
 
     //wait for a hello acknowledgement from the server.
     char* msg = NULL;
-    receive_mrmp_msg(connect_socket, &msg, NULL);
+    if(receive_mrmp_msg(connect_socket, &msg, NULL, MRMP_VERSION_0) != SUCCESS || msg == NULL) {
+        //the server hung up or sent something unreadable instead of answering.
+        fprintf(stderr, "server closed the connection during the handshake.\n");
+        mrmp_pkt_free(msg);
+        closesocket(connect_socket);
+        platform_cleanup();
+        return EXIT_FAILURE;
+    }
+
     if(PHEADER(msg)->opcode == MRMP_OPCODE_HELLO_ACK) {
         printf("Received hello acknowledgement packet!\n");
+        granted_features = PHELLOACK(msg)->features;
+        if(udp_requested == TRUE && (PHELLOACK(msg)->features & MRMP_FEATURE_UDP) == 0)
+            printf("server does not support UDP, moves are sent over TCP.\n");
+    } else if(PHEADER(msg)->opcode == MRMP_OPCODE_ERROR) {
+        //the server turns connections away with an error packet when it is overloaded.
+        mrmp_error_t error_code = ((mrmp_pkt_error_t*)msg)->error_code;
+        if(error_code <= MRMP_ERR_NO_SESSION)
+            fprintf(stderr, "server refused connection: %s\n", code_to_error[error_code]);
+        mrmp_pkt_free(msg);
+        closesocket(connect_socket);
+        platform_cleanup();
+        return EXIT_FAILURE;
     }
-    free(msg);
+    mrmp_pkt_free(msg);
+
+    //tell server you want to join the player queue to be put into a session. after a race the connection stays
+    //open, so the next one starts with another JOIN or a REMATCH instead of reconnecting.
+    mrmp_opcode_t next_race = spectating == TRUE ? 0 : MRMP_OPCODE_JOIN;
+    int join_sent = spectating == FALSE; //the first JOIN went out with HELLO.
+    if(spectating == TRUE) spectate(connect_socket);
+    maze_t* maze = NULL;
+
+    while(next_race != 0) {
+        reset_positions();
+        udp_active = FALSE;
+        pending_count = 0;
+        unsent_count = 0;
+
+        if(next_race == MRMP_OPCODE_REMATCH) {
+            send_frame(connect_socket, encode_empty_pkt(MRMP_OPCODE_REMATCH), protocol_version);
+            printf("sent rematch packet.\n");
+        } else if(join_sent == FALSE) {
+            send_frame(connect_socket, encode_empty_pkt(MRMP_OPCODE_JOIN), protocol_version);
+            printf("sent join packet.\n");
+        }
+        next_race = 0;
+        join_sent = FALSE;
+
+        //wait for receival of the maze structure for rendering purposes.
+        int join_resp_result = receive_msg(connect_socket, &msg, NULL);
+        if(join_resp_result != SUCCESS || msg == NULL || PHEADER(msg)->opcode != MRMP_OPCODE_JOIN_RESP) {
+            fprintf(stderr, "server did not send a maze, exiting.\n");
+            mrmp_pkt_free(msg);
+            break;
+        }
 
-    //tell server you want to join the player queue to be put into a session.
-    send_join_pkt(connect_socket);
-    printf("sent join packet.\n");
+        //TODO: figure out why printed maze origin in console starts printing here.
+        fflush(stdout);
 
-    //wait for receival of the maze structure for rendering purposes.
-    receive_mrmp_msg(connect_socket, &msg, NULL);
+        printf("Received join response + maze packet!\n");
 
-    //TODO: figure out why printed maze origin in console starts printing here.
-    fflush(stdout);
+        //convert the flattened maze array into a 2D array.
+        maze = maze_network_to_host(PJOINRE(msg));
+        mrmp_pkt_free(msg);
+
+        //send ready packet before drawing, so the maze is drawn while READY is on its way to the server.
+        send_frame(connect_socket, encode_empty_pkt(MRMP_OPCODE_READY), protocol_version);
+        fprintf(stderr, "sent ready packet.\n"); 
+
+        //clear screen and draw the maze.
+        printf("\e[1;1H\e[2J");
+        draw_maze(maze);
+
+        //wait for start packet, the server may offer a UDP endpoint for this race before it.
+        int stop_game = FALSE;
+        int race_decided = FALSE;
+        while(TRUE) {
+            int receive_start_result = receive_msg(connect_socket, &msg, NULL);
+            if(receive_start_result != SUCCESS || msg == NULL) {
+                stop_game = TRUE;
+                break;
+            }
+
+            if(PHEADER(msg)->opcode == MRMP_OPCODE_UDP_OFFER) {
+                udp_offer = *PUDPOFFER(msg);
+                udp_active = open_udp(argv[1], &udp_offer) == SUCCESS;
+                if(udp_active == TRUE) {
+                    for(int i = 0; i < MAX_OPPONENTS; ++i) opponent_seq[i] = 0;
+                    //an empty MOVES datagram tells the server where to send positions.
+                    send_pending_moves();
+                }
+                mrmp_pkt_free(msg);
+                continue;
+            }
+
+            if(PHEADER(msg)->opcode != MRMP_OPCODE_START) stop_game = TRUE;
+            break;
+        }
 
-    if(PHEADER(msg)->opcode == MRMP_OPCODE_JOIN_RESP) {
-        printf("Received join response + maze packet!\n");
-    }
+        mrmp_pkt_free(msg);
 
-    //convert the flattened maze array into a 2D array.
-    maze_t* maze = maze_network_to_host(PJOINRE(msg));
-    free(msg);
+        msg = NULL;
 
-    //clear screen, draw the maze and save the position of its top left corner on screen.
-    printf("\e[1;1H\e[2J");
-    fflush(stdout);
-    COORD maze_origin = get_cursor_position();
-    print_maze(maze);
+        //render players, every opponent starts out in the same cell as we do.
+        draw_players(FALSE);
+
+        while(stop_game != TRUE) {
+            //sleep until a frame, a datagram or a key arrives. a frame held back by the frame rate and unacknowledged
+            //moves over UDP wake us up to be drawn and resent.
+            int wait_ms = renderer_wait_ms(renderer, GetTickCount64());
+            if(udp_active == TRUE && pending_count > 0) {
+                ULONGLONG since_sent_ms = GetTickCount64() - last_moves_sent_ms;
+                int resend_ms = since_sent_ms >= UDP_RESEND_MS ? 0 : (int)(UDP_RESEND_MS - since_sent_ms);
+                if(wait_ms < 0 || resend_ms < wait_ms) wait_ms = resend_ms;
+            }
+            int events = platform_wait(connect_socket, udp_active == TRUE ? udp_socket : INVALID_SOCKET, wait_ms);
+
+            //read incoming messages first and foremost.
+            int game_msg_result = events & PLATFORM_EVENT_TCP ? receive_msg(connect_socket, &msg, &DONT_BLOCK) : TIMEDOUT;
+            if(game_msg_result != SUCCESS && game_msg_result != TIMEDOUT) {
+                //TODO: better cleanup logic?
+                stop_game = TRUE; //redunant but consistent.
+                send_frame(connect_socket, encode_empty_pkt(MRMP_OPCODE_LEAVE), protocol_version);
+                break;
+            }
+
+            if(msg != NULL) {
+                switch(PHEADER(msg)->opcode) {
+                    case MRMP_OPCODE_BAD_MOVE:
+                        //roll back to where the server says we were and replay the moves it hasn't judged yet,
+                        //without sending the result as a new move.
+                        reconcile(maze, PMOVE(msg)->seq, PMOVE(msg)->row, PMOVE(msg)->column);
+                        break;
+                    case MRMP_OPCODE_OPPONENT_DIRECTIONS:
+                        //an opponent's steps during one server tick, applied in order.
+                        if(PDIRS(msg)->player < MAX_OPPONENTS) {
+                            for(int i = 0; i < PDIRS(msg)->count; ++i) {
+                                mrmp_apply_step(mrmp_run_get(PDIRS(msg)->codes, i), &p2_row[PDIRS(msg)->player], &p2_column[PDIRS(msg)->player]);
+                            }
+                            p2_moved[PDIRS(msg)->player] = TRUE;
+                        }
+                        break;
+                    case MRMP_OPCODE_OPPONENT_MOVE:
+                        if(PMOVE(msg)->player < MAX_OPPONENTS) {
+                            p2_row[PMOVE(msg)->player] = PMOVE(msg)->row;
+                            p2_column[PMOVE(msg)->player] = PMOVE(msg)->column;
+                            p2_moved[PMOVE(msg)->player] = TRUE;
+                        }
+                        break;
+                    case MRMP_OPCODE_RESULT:
+                        if(PRESULT(msg)->winner == 0) {
+                            printf("You lost.\n");
+                        } else {
+                            printf("You won!\n");
+                        }
+                        race_decided = TRUE;
+                        stop_game = TRUE;
+                        break;
+                    case MRMP_OPCODE_TIMEOUT:
+                        printf("Timeout message received due to inactivity, aborting game session.\n");
+                        stop_game = TRUE;
+                        break;
+                    case MRMP_OPCODE_ERROR:
+                        printf("Error message received, aborting game session.\n");
+                        send_frame(connect_socket, encode_empty_pkt(MRMP_OPCODE_LEAVE), protocol_version);
+                        stop_game = TRUE;
+                        break;
+                    default:
+                        printf("Unknown message received, aborting game session.\n");
+                        send_frame(connect_socket, encode_empty_pkt(MRMP_OPCODE_LEAVE), protocol_version);
+                        stop_game = TRUE;
+                        break;
+                };
+            }
+
+            mrmp_pkt_free(msg);
+            msg = NULL;
+
+            if(stop_game == TRUE) {
+                //the moves that decided the race are shown before anyone is asked what to do next.
+                draw_players(TRUE);
+                break;
+            }
+
+            if(udp_active == TRUE) {
+                if(events & PLATFORM_EVENT_UDP) receive_dgrams();
+                if(pending_count > 0 && GetTickCount64() - last_moves_sent_ms >= UDP_RESEND_MS) send_pending_moves();
+            }
+
+            process_input(maze);
+            send_moves(connect_socket);
+        
+            //render players.
+            draw_players(FALSE);
+        }
+    
 
-    //send ready packet.
-    send_ready_pkt(connect_socket);
-    fprintf(stderr, "sent ready packet.\n"); 
+        free_maze(maze);
+        maze = NULL;
+
+        if(race_decided == TRUE) {
+            while(platform_key_pending()) platform_read_key(); //discard moves typed during the race.
+            printf("Press 'j' to race new opponents, 'r' to rematch the same ones, or any other key to quit.\n");
+
+            //keep answering PING while the player decides, so the server doesn't take the connection for dead.
+            int connected = TRUE;
+            while(TRUE) {
+                int events = platform_wait(connected == TRUE ? connect_socket : INVALID_SOCKET, INVALID_SOCKET, -1);
+                if(events & PLATFORM_EVENT_KEY) break;
+                if((events & PLATFORM_EVENT_TCP) == 0) continue;
+
+                int idle_result = receive_msg(connect_socket, &msg, &DONT_BLOCK);
+                mrmp_pkt_free(msg);
+                msg = NULL;
+                //the server is gone, only a key can end the wait now.
+                if(idle_result != SUCCESS && idle_result != TIMEDOUT) connected = FALSE;
+            }
+            int choice = platform_read_key();
+            if(choice == 'j') next_race = MRMP_OPCODE_JOIN;
+            else if(choice == 'r') next_race = MRMP_OPCODE_REMATCH;
+        }
+    }
 
-    //wait for start packet.
-    int receive_start_result = receive_mrmp_msg(connect_socket, &msg, NULL);
-    // if(receive_start_result == ) {
+    if(udp_socket != INVALID_SOCKET) closesocket(udp_socket);
+    shutdown(connect_socket, SD_SEND);
+    closesocket(connect_socket);
 
-    // }
+    renderer_free(renderer);
+    mrmp_pkt_pool_use(NULL);
+    slab_pool_free(pkt_pool);
+    printf("exiting test client\n");
+    return EXIT_SUCCESS;
+}
 
-    if(PHEADER(msg)->opcode == MRMP_OPCODE_START) {
-       // printf("Received start notification! Beginning game loop.\n");
-    }
+//receives the next frame that isn't a PING, answering every PING on the way with a PONG carrying its stamp.
+int receive_msg(SOCKET socket, char** out_msg, struct timeval* timeout) {
+    while(TRUE) {
+        int result = receive_mrmp_msg(socket, out_msg, timeout, protocol_version);
+        if(result != SUCCESS || *out_msg == NULL || PHEADER(*out_msg)->opcode != MRMP_OPCODE_PING) return result;
 
-    free(msg);
+        send_frame(socket, encode_ping_pkt(MRMP_OPCODE_PONG, PPING(*out_msg)->stamp), protocol_version);
+        mrmp_pkt_free(*out_msg);
+        *out_msg = NULL;
+    }
+}
 
-    msg = NULL;
-    
-    int stop_game = FALSE;
-
-    //render players.
-    draw_player(last_p1_row, last_p1_column, p1_row, p1_column, maze_origin.Y, maze_origin.X, 1);
-    draw_player(last_p2_row, last_p2_column, p2_row, p2_column, maze_origin.Y, maze_origin.X, 0);
-
-    while(stop_game != TRUE) {
-        //read incoming messages first and foremost.
-        int game_msg_result = receive_mrmp_msg(connect_socket, &msg, &DONT_BLOCK);
-        if(game_msg_result != SUCCESS && game_msg_result != TIMEDOUT) {
-            //TODO: better cleanup logic?
-            stop_game = TRUE; //redunant but consistent.
-            send_leave_pkt(connect_socket);
+//watches a session until it ends or 'q' is pressed. every maze the session races on is drawn as it arrives, and
+//players are moved to wherever the latest POSITIONS snapshot puts them.
+void spectate(SOCKET socket) {
+    send_frame(socket, encode_spectate_pkt(spectate_session_id), protocol_version);
+    printf("sent spectate packet.\n");
+
+    maze_t* maze = NULL;
+    int stop = FALSE;
+    while(stop == FALSE) {
+        char* msg = NULL;
+        int events = platform_wait(socket, INVALID_SOCKET, renderer_wait_ms(renderer, GetTickCount64()));
+        int msg_result = events & PLATFORM_EVENT_TCP ? receive_mrmp_msg(socket, &msg, &DONT_BLOCK, protocol_version) : TIMEDOUT;
+        if(msg_result != SUCCESS && msg_result != TIMEDOUT) {
+            printf("The session is over.\n");
             break;
         }
 
         if(msg != NULL) {
             switch(PHEADER(msg)->opcode) {
-                case MRMP_OPCODE_BAD_MOVE:
-                    p1_row = PMOVE(msg)->row;
-                    p1_column = PMOVE(msg)->column;
+                case MRMP_OPCODE_JOIN_RESP:
+                    //a new race, nobody is our own player so p1 is kept off the maze.
+                    if(maze != NULL) free_maze(maze);
+                    maze = maze_network_to_host(PJOINRE(msg));
+                    reset_positions();
+                    p1_row = p1_column = -1;
+                    printf("\e[1;1H\e[2J");
+                    draw_maze(maze);
                     break;
-                case MRMP_OPCODE_OPPONENT_MOVE:
-                    p2_row = PMOVE(msg)->row;
-                    p2_column = PMOVE(msg)->column;
+                case MRMP_OPCODE_POSITIONS:
+                    for(int i = 0; i < PPOSITIONS(msg)->count && maze != NULL; ++i) {
+                        mrmp_player_t player = PPOSITIONS(msg)->entries[i].player;
+                        if(player >= MAX_OPPONENTS) continue;
+                        p2_row[player] = PPOSITIONS(msg)->entries[i].row;
+                        p2_column[player] = PPOSITIONS(msg)->entries[i].column;
+                        p2_moved[player] = TRUE;
+                    }
+                    break;
+                case MRMP_OPCODE_START:
+                    printf("The race has started.\n");
                     break;
                 case MRMP_OPCODE_RESULT:
-                    if(PRESULT(msg)->winner == 0) {
-                        printf("You lost.\n");
-                    } else {
-                        printf("You won!\n");
-                    }
-                    stop_game = TRUE;
+                    draw_players(TRUE);
+                    printf("Player %d won!\n", PRESULT(msg)->winner);
                     break;
                 case MRMP_OPCODE_TIMEOUT:
-                    printf("Timeout message received due to inactivity, aborting game session.\n");
-                    stop_game = TRUE;
+                    printf("The race timed out.\n");
                     break;
                 case MRMP_OPCODE_ERROR:
-                    printf("Error message received, aborting game session.\n");
-                    send_leave_pkt(connect_socket);
-                    stop_game = TRUE;
+                    if(((mrmp_pkt_error_t*)msg)->error_code <= MRMP_ERR_NO_SESSION)
+                        fprintf(stderr, "server stopped the session: %s\n", code_to_error[((mrmp_pkt_error_t*)msg)->error_code]);
+                    stop = TRUE;
                     break;
                 default:
-                    printf("Unknown message received, aborting game session.\n");
-                    send_leave_pkt(connect_socket);
-                    stop_game = TRUE;
                     break;
             };
+            mrmp_pkt_free(msg);
         }
 
-        free(msg);
-        msg = NULL;
+        if(maze != NULL) draw_players(FALSE);
 
-        if(stop_game == TRUE) break;
+        while(platform_key_pending()) {
+            if(platform_read_key() == 'q') stop = TRUE;
+        }
+    }
 
-        process_input();
-        
-        //render players.
-        if(changed_position(0) == TRUE) {
-            draw_player(last_p2_row, last_p2_column, p2_row, p2_column, maze_origin.Y, maze_origin.X, 0);
-            last_p2_row = p2_row;
-            last_p2_column = p2_column;
+    if(maze != NULL) free_maze(maze);
+}
+
+//plays a recorded race, starting start_ms into it, at the given speed. '+' and '-' double and halve the speed and 'q'
+//stops early. players are drawn the same way spectated ones are.
+int play_replay(const char* path, double speed, uint32_t start_ms) {
+    replay_t* replay = replay_open(path);
+    if(replay == NULL) {
+        fprintf(stderr, "%s is not a readable replay.\n", path);
+        return ERROR;
+    }
+
+    maze_t* maze = replay_maze(replay);
+    if(maze == NULL) {
+        replay_close(replay);
+        return ERROR;
+    }
+
+    replay_cursor_t cursor;
+    replay_cursor_init(&cursor, replay);
+    if(start_ms > 0) replay_seek(&cursor, start_ms);
+
+    printf("\e[1;1H\e[2J");
+    printf("Replay of race %u of session %u, %u players, %u ms long.\n", replay->race, replay->session_id, replay->player_count, replay->duration_ms);
+    draw_maze(maze);
+
+    //the seek may have skipped moves, everyone starts out wherever it left them.
+    reset_positions();
+    p1_row = p1_column = -1;
+    for(int i = 0; i < replay->player_count && i < MAX_OPPONENTS; ++i) {
+        p2_row[i] = cursor.rows[i];
+        p2_column[i] = cursor.columns[i];
+        p2_moved[i] = TRUE;
+    }
+    draw_players(FALSE);
+
+    //replay time advances with the wall clock scaled by the speed, from wherever the seek left the cursor.
+    double replay_ms = start_ms;
+    ULONGLONG last_tick_ms = GetTickCount64();
+    replay_event_t event;
+    int has_event = replay_next(&cursor, &event) == SUCCESS;
+    int stop = FALSE;
+    while(stop == FALSE && (has_event == TRUE || replay_ms < replay->duration_ms)) {
+        ULONGLONG now = GetTickCount64();
+        replay_ms += (now - last_tick_ms) * speed;
+        last_tick_ms = now;
+
+        while(has_event == TRUE && event.time_ms <= replay_ms) {
+            if(event.player < MAX_OPPONENTS && event.kind <= REPLAY_EVENT_STEP_WEST) {
+                p2_row[event.player] = event.row;
+                p2_column[event.player] = event.column;
+            } else if(event.kind == REPLAY_EVENT_LEAVE) {
+                draw_players(TRUE);
+                printf("Player %d left.\n", event.player);
+            }
+            has_event = replay_next(&cursor, &event) == SUCCESS;
         }
 
-        if(changed_position(1) == TRUE) {
-            draw_player(last_p1_row, last_p1_column, p1_row, p1_column, maze_origin.Y, maze_origin.X, 1);
-            send_move_pkt(connect_socket, p1_row, p1_column);
-            last_p1_row = p1_row;
-            last_p1_column = p1_column;
-        }   
+        draw_players(FALSE);
+
+        while(platform_key_pending()) {
+            switch(platform_read_key()) {
+                case 'q':
+                    stop = TRUE;
+                    break;
+                case '+':
+                    if(speed * 2 <= REPLAY_MAX_SPEED) speed *= 2;
+                    break;
+                case '-':
+                    if(speed / 2 >= REPLAY_MIN_SPEED) speed /= 2;
+                    break;
+                default:
+                    break;
+            }
+        }
+
+        //sleep until the next event or frame is due or a key is typed.
+        double due_in_ms = ((has_event == TRUE ? event.time_ms : replay->duration_ms) - replay_ms) / speed;
+        int wait_ms = due_in_ms <= 0 ? 0 : due_in_ms >= REPLAY_MAX_WAIT_MS ? REPLAY_MAX_WAIT_MS : (int) due_in_ms + 1;
+        int frame_wait_ms = renderer_wait_ms(renderer, GetTickCount64());
+        if(frame_wait_ms >= 0 && frame_wait_ms < wait_ms) wait_ms = frame_wait_ms;
+        if(stop == FALSE) platform_wait(INVALID_SOCKET, INVALID_SOCKET, wait_ms);
+    }
+    draw_players(TRUE);
+
+    if(cursor.event < replay->event_count && has_event == FALSE)
+        fprintf(stderr, "the replay is corrupt after event %u.\n", cursor.event);
+
+    if(stop == FALSE) {
+        if(replay->outcome == REPLAY_OUTCOME_WON)
+            printf("Player %d won!\n", replay->winner);
+        else if(replay->outcome == REPLAY_OUTCOME_TIMEOUT)
+            printf("The race timed out.\n");
+        else
+            printf("The race was cut short.\n");
     }
-    
-    shutdown(connect_socket, SD_SEND);
-    closesocket(connect_socket);
 
     free_maze(maze);
-    printf("exiting test client\n");
-    return EXIT_SUCCESS;
+    replay_close(replay);
+    return SUCCESS;
 }
 
-void process_input(void) {
-    int d;
-    if(kbhit()) d = _getch();
-    Sleep(10);
-    // int c;
-    // while(c = getchar() != '\n' && c != EOF); //clear stdin.
+//connects a non-blocking UDP socket to the offered port, so only the server's datagrams are received on it.
+int open_udp(const char* host, mrmp_pkt_udp_offer_t* offer) {
+    if(udp_socket != INVALID_SOCKET) {
+        closesocket(udp_socket);
+        udp_socket = INVALID_SOCKET;
+    }
 
-    switch(d) {
-        case 'w':
-            p1_row -= 1;
-            break;
-        case 'a':
-            p1_column -= 1;
-            break;
-        case 's':
-            p1_row += 1;
-            break;
-        case 'd': 
-            p1_column += 1;
-            break;
-        default:
-            break;
+    char port[8];
+    snprintf(port, sizeof(port), "%u", (unsigned) offer->port);
+
+    struct addrinfo *result = NULL, hints;
+    ZeroMemory(&hints, sizeof(hints));
+    hints.ai_family = AF_INET;
+    hints.ai_socktype = SOCK_DGRAM;
+    hints.ai_protocol = IPPROTO_UDP;
+    if(getaddrinfo(host, port, &hints, &result) != 0) {
+        fprintf(stderr, "failed to resolve the UDP endpoint, moves are sent over TCP.\n");
+        return ERROR;
+    }
+
+    udp_socket = socket(result->ai_family, result->ai_socktype, result->ai_protocol);
+    if(udp_socket == INVALID_SOCKET || connect(udp_socket, result->ai_addr, (int) result->ai_addrlen) == SOCKET_ERROR ||
+       platform_set_non_blocking(udp_socket) == ERROR) {
+        fprintf(stderr, "failed to open a UDP socket, moves are sent over TCP.\n");
+        if(udp_socket != INVALID_SOCKET) closesocket(udp_socket);
+        udp_socket = INVALID_SOCKET;
+        freeaddrinfo(result);
+        return ERROR;
     }
+
+    freeaddrinfo(result);
+    return SUCCESS;
+}
+
+int simulate_datagram_loss(void) {
+    return simulated_loss_percent > 0 && rand() % 100 < simulated_loss_percent;
+}
+
+//sends every unacknowledged move in one datagram, so a lost datagram is made up for by the next one.
+void send_pending_moves(void) {
+    mrmp_dgram_t moves = { .type = MRMP_DGRAM_MOVES, .endpoint = udp_offer.endpoint, .token = udp_offer.token, .seq = move_seq };
+    moves.count = (uint8_t) pending_count;
+    memcpy(moves.entries, pending_moves, pending_count * sizeof(mrmp_dgram_entry_t));
+
+    char datagram[MRMP_DGRAM_MAX_SIZE];
+    int length = encode_dgram(&moves, datagram);
+    last_moves_sent_ms = GetTickCount64();
+    if(simulate_datagram_loss()) return;
+    send(udp_socket, datagram, length, 0);
 }
 
-int changed_position(int is_p1) {
-    if(is_p1 == TRUE)
-        return (p1_row != last_p1_row || p1_column != last_p1_column);
-    else {
-        return (p2_row != last_p2_row || p2_column != last_p2_column);
+//records a predicted move under the next seq, it is sent with the others made during this loop.
+void record_move(int row, int column, uint8_t direction) {
+    //only reachable over TCP, where nothing is acknowledged. the oldest move was judged long ago by now.
+    if(pending_count == MRMP_DGRAM_MAX_ENTRIES) {
+        memmove(pending_moves, pending_moves + 1, (pending_count - 1) * sizeof(mrmp_dgram_entry_t));
+        --pending_count;
     }
+
+    pending_moves[pending_count].player = 0;
+    pending_moves[pending_count].row = (maze_size_t) row;
+    pending_moves[pending_count].column = (maze_size_t) column;
+    ++pending_count;
+    ++move_seq;
+    mrmp_run_set(unsent_codes, unsent_count++, direction);
 }
 
-void draw_player(int old_row, int old_column, int row, int column, int maze_start_row, int maze_start_column, int is_p1) {
-    fflush(stdout);
-    COORD current_pos = get_cursor_position();
-    fflush(stdout);
-    
-    //remove old position
-    move_cursor((old_column * 6 + 2) + maze_start_column, (old_row * 3 + 1) + maze_start_row);
-    
-    if ((is_p1 && (old_row != p2_row || old_column != p2_column)) || (!is_p1 && (old_row != p1_row || old_column != p1_column)))
-        putchar(' ');
-    
-    //draw in new position (6 + 2) horizontally due to format of printed maze.
-    move_cursor((column * 6 + 2) + maze_start_column, (row * 3 + 1) + maze_start_row);
-    putchar(PLAYER_CHAR);
+//sends the moves made during this loop: in the next datagram over UDP, as one direction run if the server supports
+//it, or as one MOVE each otherwise.
+void send_moves(SOCKET socket) {
+    if(unsent_count == 0) return;
+
+    if(udp_active == TRUE) {
+        send_pending_moves();
+    } else if(granted_features & MRMP_FEATURE_DIRECTIONS) {
+        send_frame(socket, encode_directions_pkt(move_seq - (mrmp_move_seq_t)(unsent_count - 1), unsent_codes, (uint8_t) unsent_count), protocol_version);
+    } else {
+        for(int i = pending_count - unsent_count; i < pending_count; ++i) {
+            send_frame(socket, encode_move_pkt(pending_moves[i].row, pending_moves[i].column, move_seq - (mrmp_move_seq_t)(pending_count - 1 - i)), protocol_version);
+        }
+    }
+
+    unsent_count = 0;
+}
+
+//the server judged every move up to the rejected one and left us at row, column. later moves are still on their
+//way and it judges each one on its own from there, so replaying them the same way predicts where we end up.
+void reconcile(maze_t* maze, mrmp_move_seq_t rejected_seq, int row, int column) {
+    int32_t unjudged = (int32_t)(move_seq - rejected_seq);
+    if(unjudged < 0) unjudged = 0;
+    if(unjudged < pending_count) {
+        memmove(pending_moves, pending_moves + (pending_count - unjudged), unjudged * sizeof(mrmp_dgram_entry_t));
+        pending_count = unjudged;
+    }
+
+    p1_row = row;
+    p1_column = column;
+    for(int i = 0; i < pending_count; ++i) {
+        if(maze_is_move_valid(maze, (maze_size_t) p1_row, (maze_size_t) p1_column, pending_moves[i].row, pending_moves[i].column) == TRUE) {
+            p1_row = pending_moves[i].row;
+            p1_column = pending_moves[i].column;
+        }
+    }
+}
 
-    //move back to original position for further message printing.
-    move_cursor(current_pos.X, current_pos.Y);
+//applies whatever the server sent over UDP, positions older than the ones already applied are ignored.
+void receive_dgrams(void) {
+    char buffer[MRMP_DGRAM_MAX_SIZE + 1];
+    while(TRUE) {
+        int length = recv(udp_socket, buffer, sizeof(buffer), 0);
+        if(length == SOCKET_ERROR) {
+            //an earlier datagram bounced off the server, keep reading.
+            if(WSAGetLastError() == WSAECONNRESET) continue;
+            break;
+        }
+
+        mrmp_dgram_t dgram;
+        if(simulate_datagram_loss() || decode_dgram(buffer, length, &dgram) == ERROR) continue;
+
+        if(dgram.type == MRMP_DGRAM_ACK) {
+            //drop the acknowledged moves, the oldest pending move has seq move_seq - (pending_count - 1).
+            int32_t unacked = (int32_t)(move_seq - dgram.seq);
+            if(unacked >= 0 && unacked < pending_count) {
+                memmove(pending_moves, pending_moves + (pending_count - unacked), unacked * sizeof(mrmp_dgram_entry_t));
+                pending_count = unacked;
+            }
+        } else if(dgram.type == MRMP_DGRAM_POSITIONS) {
+            for(int i = 0; i < dgram.count; ++i) {
+                mrmp_player_t player = dgram.entries[i].player;
+                uint32_t seq = dgram.seq - (uint32_t)(dgram.count - 1 - i);
+                if(player >= MAX_OPPONENTS || player == udp_offer.player || (int32_t)(seq - opponent_seq[player]) <= 0) continue;
+
+                opponent_seq[player] = seq;
+                p2_row[player] = dgram.entries[i].row;
+                p2_column[player] = dgram.entries[i].column;
+                p2_moved[player] = TRUE;
+            }
+        }
+    }
 }
 
-COORD get_cursor_position() {
-    CONSOLE_SCREEN_BUFFER_INFO csbi;
-    COORD pos = {0, 0};
+//takes every key typed since the last loop, so quick typing goes out as a single run. moves are checked against
+//our copy of the maze first, bumping into a wall costs no round trip.
+void process_input(maze_t* maze) {
+    //a run never outgrows the pending list, and over UDP a full pending list means the server stopped
+    //acknowledging, so further moves are held until it catches up.
+    while(platform_key_pending() && unsent_count < MRMP_DGRAM_MAX_ENTRIES && (udp_active == FALSE || pending_count < MRMP_DGRAM_MAX_ENTRIES)) {
+        uint8_t direction;
+        switch(platform_read_key()) {
+            case 'w':
+                direction = MRMP_DIR_NORTH;
+                break;
+            case 'a':
+                direction = MRMP_DIR_WEST;
+                break;
+            case 's':
+                direction = MRMP_DIR_SOUTH;
+                break;
+            case 'd': 
+                direction = MRMP_DIR_EAST;
+                break;
+            default:
+                continue;
+        }
+
+        int row = p1_row;
+        int column = p1_column;
+        mrmp_apply_step(direction, &row, &column);
+        if(row < 0 || column < 0 || row >= maze->rows || column >= maze->columns) continue;
+        if(maze_is_move_valid(maze, (maze_size_t) p1_row, (maze_size_t) p1_column, (maze_size_t) row, (maze_size_t) column) == FALSE) continue;
 
-    if (GetConsoleScreenBufferInfo(GetStdHandle(STD_OUTPUT_HANDLE), &csbi)) {
-        pos = csbi.dwCursorPosition;
+        p1_row = row;
+        p1_column = column;
+        record_move(row, column, direction);
     }
+}
+
+//every race starts with all players in the top left cell.
+void reset_positions(void) {
+    p1_row = p1_column = 0;
+    for(int i = 0; i < MAX_OPPONENTS; ++i) {
+        p2_row[i] = p2_column[i] = 0;
+        p2_moved[i] = FALSE;
+    }
+}
 
-    return pos;
+//draws the maze from wherever the cursor is, on a blank screen, leaving the cursor below it.
+void draw_maze(maze_t* maze) {
+    if(renderer_set_maze(renderer, maze, platform_cursor_position()) == SUCCESS) renderer_flush(renderer);
 }
 
-void move_cursor(int x, int y) {
-    COORD pos = {x, y};
-    SetConsoleCursorPosition(GetStdHandle(STD_OUTPUT_HANDLE), pos);
-}
\ No newline at end of file
+//composes a frame out of everyone's position, it is drawn once the frame rate allows or right away if flushing.
+//the renderer works out which cells changed, so players that didn't move cost nothing.
+void draw_players(int flush) {
+    renderer_clear_players(renderer);
+    for(int i = 0; i < MAX_OPPONENTS; ++i) {
+        if(p2_moved[i] == TRUE) renderer_put_player(renderer, p2_row[i], p2_column[i], PLAYER_CHAR);
+    }
+    renderer_put_player(renderer, p1_row, p1_column, PLAYER_CHAR);
+
+    if(flush == TRUE) renderer_flush(renderer);
+    else renderer_present(renderer, GetTickCount64());
+}
@@ -0,0 +1,952 @@
+// Filename: maze_racer_loadgen.c
+// Programmer(s): Abdurrahman Alyajouri
+// Date: 10/19/2026
+// Purpose: To load test the server with thousands of headless bots racing from a single process.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#include <windows.h>
+
+#include "networking_utils.h"
+#include "connection.h"
+#include "histogram.h"
+#include "metrics.h"
+#include "maze.h"
+
+#ifndef EXIT_SUCCESS
+# define EXIT_SUCCESS 0
+#endif //EXIT_SUCCESS
+#ifndef EXIT_FAILURE
+# define EXIT_FAILURE 1
+#endif //EXIT_FAILURE
+
+//defines
+#define DEFAULT_BOTS                100
+#define DEFAULT_STEPS_PER_SECOND    8.0
+#define DEFAULT_JITTER_MS           30
+#define DEFAULT_DURATION_SECONDS    60
+#define MAX_SESSION_PLAYERS         16
+#define CONNECT_TIMEOUT_MS          5000 //older WSAPoll never reports a refused connect, give up on it instead.
+#define RECONNECT_DELAY_MS          1000
+#define MAX_POLL_WAIT_MS            10
+#define REPORT_INTERVAL_MS          1000
+#define RACE_GROUP_BUCKETS          4096
+#define UDP_RESEND_MS               50 //unacknowledged moves are sent again this often, like the client does.
+
+typedef enum bot_state {
+    BOT_IDLE, //not connected, waiting until next_action_us to connect.
+    BOT_CONNECTING,
+    BOT_HELLO, //HELLO sent, waiting for HELLO_ACK.
+    BOT_MATCHING, //JOIN sent, waiting for JOIN_RESP. pipelining bots get here without waiting in BOT_HELLO.
+    BOT_STARTING, //READY sent, waiting for START.
+    BOT_RACING,
+    BOT_FINISHED, //walked the whole path, waiting for RESULT.
+    BOT_WATCHING //spectators only, SPECTATE sent, every frame of the session is read and thrown away.
+} bot_state_t;
+
+typedef struct bot {
+    bot_state_t state;
+    int spectator; //watches the newest session instead of racing, and again once it ends.
+    connection_t* connection;
+    uint64_t next_action_us; //when to connect while idle, when to step while racing.
+    uint64_t connect_started_us;
+    uint64_t join_sent_us;
+    int acknowledged; //HELLO_ACK arrived on this connection.
+    int started; //a race started on this connection, only the first one counts towards connect to START. for
+                 //spectators, the watched session's maze arrived.
+
+    //the race being run, the path is the shortest one from the top left to the bottom right cell.
+    maze_t* maze;
+    uint32_t race_key; //hash of the maze, shared by every bot in the same session.
+    uint32_t races; //started so far, tells a bot's races apart to the bots watching it.
+    uint8_t* path;
+    int path_length;
+    int steps_sent;
+    uint64_t* step_sent_us; //when each step of the path was sent.
+    int row;
+    int column;
+    mrmp_move_seq_t seq;
+
+    //udp fast path, only with -u and once the server offered an endpoint for the race. moves not acknowledged yet
+    //are kept oldest first and resent together, entry i has seq seq - (pending_count - 1 - i).
+    SOCKET udp_socket;
+    mrmp_pkt_udp_offer_t udp_offer;
+    mrmp_dgram_entry_t pending_moves[MRMP_DGRAM_MAX_ENTRIES];
+    int pending_count;
+    uint64_t moves_sent_us;
+    uint32_t opponent_seq[MAX_SESSION_PLAYERS]; //newest position seq applied per opponent.
+
+    //the bots behind the opponents' player ids, found on their first step, so the time from an opponent sending
+    //a step to this bot hearing about it can be measured.
+    struct bot* opponents[MAX_SESSION_PLAYERS];
+    uint32_t opponent_races[MAX_SESSION_PLAYERS];
+    int opponent_steps[MAX_SESSION_PLAYERS];
+
+    struct bot* group_next; //links the racing bots that share a race_key bucket.
+} bot_t;
+
+//counters, everything runs on the main thread so none of them need locking.
+typedef struct loadgen_stats {
+    uint64_t connects_started;
+    uint64_t connects;
+    uint64_t connect_failures;
+    uint64_t handshakes;
+    uint64_t refused; //turned away with an ERROR instead of HELLO_ACK.
+    uint64_t races;
+    uint64_t wins;
+    uint64_t losses;
+    uint64_t timeouts;
+    uint64_t bad_moves;
+    uint64_t server_errors;
+    uint64_t disconnects;
+    uint64_t protocol_errors;
+    uint64_t steps;
+    uint64_t echoes_unmatched; //opponent steps that couldn't be tied to the bot that sent them.
+    uint64_t datagrams_sent;
+    uint64_t datagrams_received;
+    uint64_t datagrams_lost; //dropped on purpose to simulate packet loss, in either direction.
+    uint64_t moves_resent; //MOVES datagrams sent again because they weren't acknowledged in time.
+    uint64_t spectates; //spectators attached to a session, counted on the first maze they are sent.
+    uint64_t spectates_refused; //no session to watch yet, the spectator tries again later.
+    uint64_t spectators_turned_away; //refused before HELLO_ACK, like racing bots are when connects come in too fast.
+    uint64_t spectator_frames;
+} loadgen_stats_t;
+
+static bot_t* bots = NULL;
+static int bot_count = DEFAULT_BOTS;
+static int spectator_count = 0; //kept behind the racing bots in the same array.
+static double steps_per_second = DEFAULT_STEPS_PER_SECOND;
+static int jitter_ms = DEFAULT_JITTER_MS;
+static double connects_per_second = 0.0; //0 connects every bot at once.
+static mrmp_version_t protocol_version = MRMP_VERSION;
+static int pipelined = TRUE; //JOIN goes out along with HELLO, -n waits for HELLO_ACK first like older clients.
+static int udp_requested = FALSE; //-u sends moves over UDP when the server offers it.
+static int simulated_loss_percent = 0; //of datagrams dropped in each direction.
+static struct addrinfo* server_address = NULL;
+static struct sockaddr_in udp_server_address; //the server's address, each offer only names a port.
+static bot_t* race_groups[RACE_GROUP_BUCKETS];
+static loadgen_stats_t stats;
+static histogram_t* connect_histogram = NULL; //microseconds from connect() to the connection being established.
+static histogram_t* match_histogram = NULL; //milliseconds from JOIN to JOIN_RESP.
+static histogram_t* start_histogram = NULL; //milliseconds from connect() to the connection's first START.
+static histogram_t* echo_histogram = NULL; //microseconds from a bot sending a step to an opponent receiving it.
+static slab_pool_t* pkt_pool = NULL; //every frame the bots receive is parsed into a block of it.
+static metrics_t* metrics = NULL;
+static metrics_shard_t* race_metrics = NULL; //bytes and frames of the racing bots' TCP connections.
+static LARGE_INTEGER frequency;
+
+uint64_t now_us(void);
+void bot_connect(bot_t* bot, uint64_t now);
+void bot_disconnect(bot_t* bot, uint64_t now);
+void bot_send(bot_t* bot, mrmp_shared_buffer_t* buffer);
+void bot_join(bot_t* bot, uint64_t now);
+int bot_begin_race(bot_t* bot, mrmp_pkt_join_resp_t* join_resp);
+void bot_end_race(bot_t* bot);
+void bot_step(bot_t* bot, uint64_t now);
+void bot_handle_msg(bot_t* bot, char* msg, uint64_t now);
+void bot_handle_spectator_msg(bot_t* bot, char* msg, uint64_t now);
+void bot_observe_steps(bot_t* bot, mrmp_player_t player, int count, uint64_t now);
+int bot_open_udp(bot_t* bot, mrmp_pkt_udp_offer_t* offer);
+void bot_close_udp(bot_t* bot);
+void bot_send_pending_moves(bot_t* bot, uint64_t now);
+void bot_receive_dgrams(bot_t* bot, uint64_t now);
+void bot_observe_position(bot_t* bot, mrmp_player_t player, int row, int column, uint64_t now);
+int simulate_datagram_loss(void);
+bot_t* find_mover(bot_t* bot, int step);
+uint64_t next_step_delay_us(void);
+int find_path(maze_t* maze, uint8_t* out_path);
+uint32_t maze_key(mrmp_pkt_join_resp_t* join_resp);
+void print_histogram(const char* name, histogram_t* histogram);
+void print_bandwidth(void);
+
+int main(int argc, char* argv[]) {
+    if(argc < 3) {
+        fprintf(stderr, "usage: %s server_address port [-b bots] [-c connects_per_second] [-s steps_per_second] [-j jitter_ms] [-d duration_seconds] [-p protocol_version] [-n] [-u] [-l udp_loss_percent] [-v spectators]\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    int duration_seconds = DEFAULT_DURATION_SECONDS;
+    for(int i = 3; i < argc; ++i) {
+        if(strcmp(argv[i], "-b") == 0 && i + 1 < argc) {
+            bot_count = atoi(argv[++i]);
+        } else if(strcmp(argv[i], "-c") == 0 && i + 1 < argc) {
+            connects_per_second = atof(argv[++i]);
+        } else if(strcmp(argv[i], "-s") == 0 && i + 1 < argc) {
+            steps_per_second = atof(argv[++i]);
+        } else if(strcmp(argv[i], "-j") == 0 && i + 1 < argc) {
+            jitter_ms = atoi(argv[++i]);
+        } else if(strcmp(argv[i], "-d") == 0 && i + 1 < argc) {
+            duration_seconds = atoi(argv[++i]);
+        } else if(strcmp(argv[i], "-p") == 0 && i + 1 < argc) {
+            protocol_version = (mrmp_version_t) atoi(argv[++i]);
+        } else if(strcmp(argv[i], "-n") == 0) {
+            pipelined = FALSE;
+        } else if(strcmp(argv[i], "-u") == 0) {
+            udp_requested = TRUE;
+        } else if(strcmp(argv[i], "-l") == 0 && i + 1 < argc) {
+            simulated_loss_percent = atoi(argv[++i]);
+        } else if(strcmp(argv[i], "-v") == 0 && i + 1 < argc) {
+            spectator_count = atoi(argv[++i]);
+        }
+    }
+    if(bot_count < 1) bot_count = 1;
+    if(spectator_count < 0) spectator_count = 0;
+    int total_count = bot_count + spectator_count;
+    if(steps_per_second <= 0.0) steps_per_second = DEFAULT_STEPS_PER_SECOND;
+    if(jitter_ms < 0) jitter_ms = 0;
+
+    //initialize winsock.
+    WSADATA wsa_data;
+    int wsa_startup_result = WSAStartup(MAKEWORD(2, 2), &wsa_data);
+    if(wsa_startup_result != 0) {
+        fprintf(stderr, "WSAStartup failed: %d\n", wsa_startup_result);
+        return EXIT_FAILURE;
+    }
+
+    struct addrinfo hints;
+    ZeroMemory(&hints, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    hints.ai_protocol = IPPROTO_TCP;
+    int getaddrinfo_result = getaddrinfo(argv[1], argv[2], &hints, &server_address);
+    if(getaddrinfo_result != 0) {
+        fprintf(stderr, "getaddrinfo failed: %d\n", getaddrinfo_result);
+        WSACleanup();
+        return EXIT_FAILURE;
+    }
+
+    //the server's UDP socket is IPv4 only, resolved once so every offer is only a port away.
+    if(udp_requested == TRUE) {
+        struct addrinfo* udp_address = NULL;
+        hints.ai_family = AF_INET;
+        hints.ai_socktype = SOCK_DGRAM;
+        hints.ai_protocol = IPPROTO_UDP;
+        if(getaddrinfo(argv[1], argv[2], &hints, &udp_address) != 0) {
+            fprintf(stderr, "failed to resolve the server for UDP, moves are sent over TCP.\n");
+            udp_requested = FALSE;
+        } else {
+            memcpy(&udp_server_address, udp_address->ai_addr, sizeof(udp_server_address));
+            freeaddrinfo(udp_address);
+        }
+    }
+
+    QueryPerformanceFrequency(&frequency);
+    bots = calloc(total_count, sizeof(bot_t));
+    //every bot polls its TCP connection and, while racing over UDP, its UDP socket.
+    WSAPOLLFD* poll_fds = malloc(2 * total_count * sizeof(WSAPOLLFD));
+    bot_t** polled_bots = malloc(2 * total_count * sizeof(bot_t*));
+    connect_histogram = histogram_init();
+    match_histogram = histogram_init();
+    start_histogram = histogram_init();
+    echo_histogram = histogram_init();
+    pkt_pool = mrmp_pkt_pool_init();
+    metrics = metrics_init();
+    race_metrics = metrics != NULL ? metrics_shard(metrics) : NULL;
+    if(bots == NULL || poll_fds == NULL || polled_bots == NULL || connect_histogram == NULL || match_histogram == NULL || start_histogram == NULL || echo_histogram == NULL || pkt_pool == NULL || race_metrics == NULL) {
+        perror("failed to initialize load generator");
+        return EXIT_FAILURE;
+    }
+    mrmp_pkt_pool_use(pkt_pool);
+
+    uint64_t started_us = now_us();
+    uint64_t end_us = started_us + (uint64_t) duration_seconds * 1000000;
+    uint64_t next_report_us = started_us + REPORT_INTERVAL_MS * 1000;
+    loadgen_stats_t last_report = stats;
+
+    //bots are started in order, spread out over time if a connect rate was given.
+    for(int i = 0; i < bot_count; ++i) {
+        bots[i].state = BOT_IDLE;
+        bots[i].udp_socket = INVALID_SOCKET;
+        bots[i].next_action_us = connects_per_second > 0.0 ? started_us + (uint64_t)(i * 1000000.0 / connects_per_second) : started_us;
+    }
+    //spectators give the first races a moment to start, there is nothing to watch before.
+    for(int i = bot_count; i < total_count; ++i) {
+        bots[i].state = BOT_IDLE;
+        bots[i].spectator = TRUE;
+        bots[i].udp_socket = INVALID_SOCKET;
+        bots[i].next_action_us = started_us + RECONNECT_DELAY_MS * 1000;
+    }
+
+    printf("racing %d bots against %s:%s for %d s, %.1f steps/s with +-%d ms of jitter, %s, moves over %s.\n",
+        bot_count, argv[1], argv[2], duration_seconds, steps_per_second, jitter_ms,
+        pipelined == TRUE ? "joining along with HELLO" : "joining after HELLO_ACK",
+        udp_requested == TRUE ? "UDP" : "TCP");
+    if(udp_requested == TRUE && simulated_loss_percent > 0)
+        printf("dropping %d%% of datagrams in each direction.\n", simulated_loss_percent);
+    if(spectator_count > 0)
+        printf("%d spectators watch the newest session, and the next one once it ends.\n", spectator_count);
+
+    uint64_t now = started_us;
+    while(now < end_us) {
+        //connect idle bots whose turn came, and step every racing bot that is due.
+        uint64_t next_due_us = now + MAX_POLL_WAIT_MS * 1000;
+        int poll_count = 0;
+        for(int i = 0; i < total_count; ++i) {
+            bot_t* bot = &bots[i];
+            if(bot->state == BOT_IDLE && bot->next_action_us <= now) bot_connect(bot, now);
+            if(bot->state == BOT_CONNECTING && now - bot->connect_started_us > CONNECT_TIMEOUT_MS * 1000ULL) {
+                ++stats.connect_failures;
+                bot_disconnect(bot, now);
+            }
+            if(bot->state == BOT_RACING && bot->next_action_us <= now) bot_step(bot, now);
+
+            if((bot->state == BOT_IDLE || bot->state == BOT_RACING) && bot->next_action_us < next_due_us)
+                next_due_us = bot->next_action_us;
+
+            //lost moves are made up for by sending every unacknowledged one again.
+            if(bot->udp_socket != INVALID_SOCKET && bot->pending_count > 0) {
+                uint64_t resend_us = bot->moves_sent_us + UDP_RESEND_MS * 1000;
+                if(resend_us <= now) {
+                    ++stats.moves_resent;
+                    bot_send_pending_moves(bot, now);
+                    resend_us = now + UDP_RESEND_MS * 1000;
+                }
+                if(resend_us < next_due_us) next_due_us = resend_us;
+            }
+            if(bot->udp_socket != INVALID_SOCKET) {
+                poll_fds[poll_count].fd = bot->udp_socket;
+                poll_fds[poll_count].events = POLLRDNORM;
+                poll_fds[poll_count].revents = 0;
+                polled_bots[poll_count++] = bot;
+            }
+
+            if(bot->connection == NULL) continue;
+            poll_fds[poll_count].fd = bot->connection->socket;
+            poll_fds[poll_count].events = POLLRDNORM;
+            if(bot->state == BOT_CONNECTING || connection_has_output(bot->connection)) poll_fds[poll_count].events |= POLLWRNORM;
+            poll_fds[poll_count].revents = 0;
+            polled_bots[poll_count++] = bot;
+        }
+
+        int wait_ms = next_due_us > now ? (int)((next_due_us - now) / 1000) : 0;
+        if(poll_count == 0) {
+            Sleep(wait_ms);
+        } else if(WSAPoll(poll_fds, poll_count, wait_ms) == SOCKET_ERROR) {
+            fprintf(stderr, "WSAPoll failed with error: %d\n", WSAGetLastError());
+            break;
+        }
+
+        now = now_us();
+        for(int i = 0; i < poll_count; ++i) {
+            bot_t* bot = polled_bots[i];
+            short revents = poll_fds[i].revents;
+            if(revents == 0) continue;
+
+            //the bot may have left the race that opened the UDP socket while handling its TCP frames.
+            if(poll_fds[i].fd != (bot->connection != NULL ? bot->connection->socket : INVALID_SOCKET)) {
+                if(poll_fds[i].fd == bot->udp_socket) bot_receive_dgrams(bot, now);
+                continue;
+            }
+
+            if(bot->state == BOT_CONNECTING) {
+                if(revents & (POLLERR | POLLHUP)) {
+                    ++stats.connect_failures;
+                    bot_disconnect(bot, now);
+                    continue;
+                }
+                if((revents & POLLWRNORM) == 0) continue;
+
+                //spectators wait for HELLO_ACK to learn the framing before sending SPECTATE, like the client does.
+                bot->state = BOT_HELLO;
+                if(bot->spectator == TRUE) {
+                    bot_send(bot, encode_hello_pkt(protocol_version, MRMP_FEATURE_DIRECTIONS));
+                    continue;
+                }
+
+                //connected, say hello asking for direction runs so opponents' steps arrive the compact way, and for the
+                //UDP fast path if wanted, which the server prefers over runs once a bot's first datagram arrives.
+                ++stats.connects;
+                histogram_record(connect_histogram, now - bot->connect_started_us);
+                mrmp_features_t features = MRMP_FEATURE_DIRECTIONS | (udp_requested == TRUE ? MRMP_FEATURE_UDP : 0);
+                if(pipelined == FALSE) {
+                    bot_send(bot, encode_hello_pkt(protocol_version, features));
+                    continue;
+                }
+
+                //JOIN is framed for the version asked for, but HELLO_ACK still arrives with version 0 framing.
+                bot_send(bot, encode_hello_pkt(protocol_version, features | MRMP_FEATURE_PIPELINED));
+                bot->connection->version = protocol_version;
+                bot_join(bot, now);
+                bot->connection->version = MRMP_VERSION_0;
+                continue;
+            }
+
+            if(revents & (POLLRDNORM | POLLERR | POLLHUP)) {
+                if(connection_fill(bot->connection) != SUCCESS) {
+                    //the server closes a spectator's connection once its session is over.
+                    if(bot->spectator == FALSE || bot->state != BOT_WATCHING) ++stats.disconnects;
+                    bot_disconnect(bot, now);
+                    continue;
+                }
+
+                char* msg = NULL;
+                int next_result;
+                while(bot->connection != NULL && (next_result = connection_next_msg(bot->connection, &msg)) == SUCCESS) {
+                    bot_handle_msg(bot, msg, now);
+                    mrmp_pkt_free(msg);
+                }
+                if(bot->connection != NULL && next_result == ERROR) {
+                    ++stats.protocol_errors;
+                    bot_disconnect(bot, now);
+                    continue;
+                }
+            }
+
+            if(bot->connection != NULL && connection_flush(bot->connection) == SOCKET_ERROR) {
+                ++stats.disconnects;
+                bot_disconnect(bot, now);
+            }
+        }
+
+        if(now >= next_report_us) {
+            double seconds = (now - next_report_us + REPORT_INTERVAL_MS * 1000) / 1000000.0;
+            int racing = 0, connected = 0, watching = 0;
+            for(int i = 0; i < total_count; ++i) {
+                if(bots[i].spectator == FALSE && bots[i].connection != NULL && bots[i].state != BOT_CONNECTING) ++connected;
+                if(bots[i].state == BOT_RACING || bots[i].state == BOT_FINISHED) ++racing;
+                if(bots[i].state == BOT_WATCHING) ++watching;
+            }
+            printf("%5.1f s: %d connected, %d racing, %d watching, %.0f connects/s, %.0f races/s, %.0f steps/s, %llu errors\n",
+                (now - started_us) / 1000000.0, connected, racing, watching,
+                (stats.connects - last_report.connects) / seconds,
+                (stats.races - last_report.races) / seconds,
+                (stats.steps - last_report.steps) / seconds,
+                (unsigned long long)(stats.connect_failures + stats.refused + stats.disconnects + stats.protocol_errors + stats.server_errors + stats.bad_moves + stats.timeouts));
+            last_report = stats;
+            next_report_us = now + REPORT_INTERVAL_MS * 1000;
+        }
+    }
+
+    double elapsed_seconds = (now - started_us) / 1000000.0;
+    for(int i = 0; i < total_count; ++i) {
+        if(bots[i].connection != NULL) {
+            if(bots[i].state == BOT_RACING || bots[i].state == BOT_FINISHED) {
+                connection_queue(bots[i].connection, encode_empty_pkt(MRMP_OPCODE_LEAVE));
+                connection_flush(bots[i].connection);
+            }
+            bot_disconnect(&bots[i], now);
+        }
+    }
+
+    printf("\n%llu of %llu connects succeeded in %.1f s, %.0f connects/s. %llu handshakes completed, %llu refused.\n",
+        (unsigned long long) stats.connects, (unsigned long long) stats.connects_started, elapsed_seconds,
+        stats.connects / elapsed_seconds, (unsigned long long) stats.handshakes, (unsigned long long) stats.refused);
+    printf("%llu races started, %.1f races/s, %llu won, %llu lost, %llu timed out. %llu steps sent, %.0f steps/s.\n",
+        (unsigned long long) stats.races, stats.races / elapsed_seconds, (unsigned long long) stats.wins, (unsigned long long) stats.losses,
+        (unsigned long long) stats.timeouts, (unsigned long long) stats.steps, stats.steps / elapsed_seconds);
+    printf("errors: %llu failed connects, %llu disconnects, %llu protocol errors, %llu server errors, %llu bad moves.\n",
+        (unsigned long long) stats.connect_failures, (unsigned long long) stats.disconnects, (unsigned long long) stats.protocol_errors,
+        (unsigned long long) stats.server_errors, (unsigned long long) stats.bad_moves);
+    printf("%-16s %-10s %-10s %-10s %-10s %-10s %-10s\n", "", "samples", "p50", "p90", "p99", "p99.9", "max");
+    print_histogram("connect (us)", connect_histogram);
+    print_histogram("match (ms)", match_histogram);
+    print_histogram("to start (ms)", start_histogram);
+    print_histogram("move echo (us)", echo_histogram);
+    if(stats.echoes_unmatched > 0)
+        printf("%llu opponent steps couldn't be tied to the bot that sent them.\n", (unsigned long long) stats.echoes_unmatched);
+    print_bandwidth();
+    if(spectator_count > 0)
+        printf("spectators: %llu attached, %llu turned away, %llu found no session to watch, %llu frames received.\n",
+            (unsigned long long) stats.spectates, (unsigned long long) stats.spectators_turned_away, (unsigned long long) stats.spectates_refused,
+            (unsigned long long) stats.spectator_frames);
+    if(udp_requested == TRUE)
+        printf("udp: %llu datagrams sent, %llu received, %llu dropped on purpose, %llu MOVES resent.\n",
+            (unsigned long long) stats.datagrams_sent, (unsigned long long) stats.datagrams_received,
+            (unsigned long long) stats.datagrams_lost, (unsigned long long) stats.moves_resent);
+    printf("received packet pool:\n");
+    slab_pool_print(pkt_pool, stdout);
+
+    histogram_free(connect_histogram);
+    histogram_free(match_histogram);
+    histogram_free(start_histogram);
+    histogram_free(echo_histogram);
+    metrics_free(metrics);
+    mrmp_pkt_pool_use(NULL);
+    slab_pool_free(pkt_pool);
+    free(polled_bots);
+    free(poll_fds);
+    free(bots);
+    freeaddrinfo(server_address);
+    WSACleanup();
+    return EXIT_SUCCESS;
+}
+
+uint64_t now_us(void) {
+    LARGE_INTEGER counter;
+    QueryPerformanceCounter(&counter);
+    return (uint64_t)(counter.QuadPart / frequency.QuadPart) * 1000000 + (uint64_t)(counter.QuadPart % frequency.QuadPart) * 1000000 / frequency.QuadPart;
+}
+
+//starts a non-blocking connect, the connection is polled for writability until it completes.
+void bot_connect(bot_t* bot, uint64_t now) {
+    if(bot->spectator == FALSE) ++stats.connects_started;
+    bot->connect_started_us = now;
+    bot->acknowledged = FALSE;
+    bot->started = FALSE;
+
+    SOCKET connect_socket = socket(server_address->ai_family, server_address->ai_socktype, server_address->ai_protocol);
+    if(connect_socket == INVALID_SOCKET) {
+        ++stats.connect_failures;
+        bot->next_action_us = now + RECONNECT_DELAY_MS * 1000;
+        return;
+    }
+
+    bot->connection = connection_init(connect_socket);
+    if(bot->connection == NULL) {
+        closesocket(connect_socket);
+        ++stats.connect_failures;
+        bot->next_action_us = now + RECONNECT_DELAY_MS * 1000;
+        return;
+    }
+
+    if(connect(connect_socket, server_address->ai_addr, (int) server_address->ai_addrlen) == SOCKET_ERROR && WSAGetLastError() != WSAEWOULDBLOCK) {
+        ++stats.connect_failures;
+        bot_disconnect(bot, now);
+        return;
+    }
+    bot->connection->peer_is_server = TRUE;
+    if(bot->spectator == FALSE) bot->connection->metrics = race_metrics;
+    bot->state = BOT_CONNECTING;
+}
+
+//closes the bot's connection, it connects again after a short delay.
+void bot_disconnect(bot_t* bot, uint64_t now) {
+    bot_end_race(bot);
+    if(bot->connection != NULL) connection_free(bot->connection);
+    bot->connection = NULL;
+    bot->state = BOT_IDLE;
+    bot->next_action_us = now + RECONNECT_DELAY_MS * 1000;
+}
+
+//queues and releases a new frame, it goes out with the bot's next flush.
+void bot_send(bot_t* bot, mrmp_shared_buffer_t* buffer) {
+    if(buffer == NULL) return;
+    if(connection_queue(bot->connection, buffer) == ERROR) ++stats.protocol_errors;
+    mrmp_shared_buffer_release(buffer);
+}
+
+void bot_join(bot_t* bot, uint64_t now) {
+    bot->state = BOT_MATCHING;
+    bot->join_sent_us = now;
+    bot_send(bot, encode_empty_pkt(MRMP_OPCODE_JOIN));
+}
+
+//plans the race on the maze in JOIN_RESP and joins the bots that share its maze, which are the bot's opponents.
+int bot_begin_race(bot_t* bot, mrmp_pkt_join_resp_t* join_resp) {
+    bot->maze = maze_network_to_host(join_resp);
+    if(bot->maze == NULL) return ERROR;
+
+    int cells = bot->maze->rows * bot->maze->columns;
+    bot->path = malloc(cells);
+    bot->step_sent_us = malloc(cells * sizeof(uint64_t));
+    if(bot->path == NULL || bot->step_sent_us == NULL) {
+        bot_end_race(bot);
+        return ERROR;
+    }
+
+    bot->path_length = find_path(bot->maze, bot->path);
+    bot->steps_sent = 0;
+    bot->row = 0;
+    bot->column = 0;
+    ++bot->races;
+    for(int i = 0; i < MAX_SESSION_PLAYERS; ++i) {
+        bot->opponents[i] = NULL;
+        bot->opponent_steps[i] = 0;
+    }
+
+    bot->race_key = maze_key(join_resp);
+    bot_t** bucket = &race_groups[bot->race_key % RACE_GROUP_BUCKETS];
+    bot->group_next = *bucket;
+    *bucket = bot;
+    return SUCCESS;
+}
+
+void bot_end_race(bot_t* bot) {
+    bot_close_udp(bot);
+    if(bot->maze == NULL) return;
+
+    for(bot_t** link = &race_groups[bot->race_key % RACE_GROUP_BUCKETS]; *link != NULL; link = &(*link)->group_next) {
+        if(*link == bot) {
+            *link = bot->group_next;
+            break;
+        }
+    }
+    bot->group_next = NULL;
+
+    free_maze(bot->maze);
+    free(bot->path);
+    free(bot->step_sent_us);
+    bot->maze = NULL;
+    bot->path = NULL;
+    bot->step_sent_us = NULL;
+}
+
+//sends the next step along the path, then waits for RESULT once the goal is reached.
+void bot_step(bot_t* bot, uint64_t now) {
+    if(bot->steps_sent == bot->path_length) {
+        bot->state = BOT_FINISHED;
+        return;
+    }
+
+    //over UDP a full pending list means the server stopped acknowledging, the step waits until it catches up.
+    if(bot->udp_socket != INVALID_SOCKET && bot->pending_count == MRMP_DGRAM_MAX_ENTRIES) {
+        bot->next_action_us = now + UDP_RESEND_MS * 1000;
+        return;
+    }
+
+    mrmp_apply_step(bot->path[bot->steps_sent], &bot->row, &bot->column);
+    bot->step_sent_us[bot->steps_sent++] = now;
+    ++bot->seq;
+    ++stats.steps;
+    if(bot->udp_socket != INVALID_SOCKET) {
+        bot->pending_moves[bot->pending_count].player = 0;
+        bot->pending_moves[bot->pending_count].row = (maze_size_t) bot->row;
+        bot->pending_moves[bot->pending_count].column = (maze_size_t) bot->column;
+        ++bot->pending_count;
+        bot_send_pending_moves(bot, now);
+    } else {
+        bot_send(bot, encode_move_pkt((maze_size_t) bot->row, (maze_size_t) bot->column, bot->seq));
+    }
+
+    bot->next_action_us = now + next_step_delay_us();
+    if(bot->steps_sent == bot->path_length) bot->state = BOT_FINISHED;
+}
+
+void bot_handle_msg(bot_t* bot, char* msg, uint64_t now) {
+    if(bot->spectator == TRUE) {
+        bot_handle_spectator_msg(bot, msg, now);
+        return;
+    }
+
+    switch(PHEADER(msg)->opcode) {
+        case MRMP_OPCODE_HELLO_ACK:
+            if(bot->acknowledged == TRUE) break;
+            ++stats.handshakes;
+            bot->acknowledged = TRUE;
+            bot->connection->version = protocol_version;
+            if(bot->state == BOT_HELLO) bot_join(bot, now);
+            break;
+        case MRMP_OPCODE_JOIN_RESP:
+            if(bot->state != BOT_MATCHING) break;
+            histogram_record(match_histogram, (now - bot->join_sent_us) / 1000);
+            if(bot_begin_race(bot, PJOINRE(msg)) == ERROR) {
+                ++stats.protocol_errors;
+                bot_disconnect(bot, now);
+                break;
+            }
+            bot->state = BOT_STARTING;
+            bot_send(bot, encode_empty_pkt(MRMP_OPCODE_READY));
+            break;
+        case MRMP_OPCODE_START:
+            if(bot->state != BOT_STARTING) break;
+            ++stats.races;
+            if(bot->started == FALSE) histogram_record(start_histogram, (now - bot->connect_started_us) / 1000);
+            bot->started = TRUE;
+            bot->state = BOT_RACING;
+            bot->next_action_us = now + next_step_delay_us();
+            break;
+        case MRMP_OPCODE_OPPONENT_MOVE:
+            bot_observe_steps(bot, PMOVE(msg)->player, 1, now);
+            break;
+        case MRMP_OPCODE_OPPONENT_DIRECTIONS:
+            bot_observe_steps(bot, PDIRS(msg)->player, PDIRS(msg)->count, now);
+            break;
+        case MRMP_OPCODE_UDP_OFFER:
+            //only asked for with -u, bots that can't open a socket keep moving over TCP.
+            if(bot->state != BOT_STARTING || udp_requested == FALSE) break;
+            if(bot_open_udp(bot, PUDPOFFER(msg)) == SUCCESS) {
+                //an empty MOVES datagram tells the server where to send positions.
+                bot_send_pending_moves(bot, now);
+            }
+            break;
+        case MRMP_OPCODE_BAD_MOVE:
+            //bots only take open paths, the server disagreeing with one is worth knowing about.
+            ++stats.bad_moves;
+            break;
+        case MRMP_OPCODE_RESULT:
+            if(PRESULT(msg)->winner == 0) ++stats.losses;
+            else ++stats.wins;
+            bot_end_race(bot);
+            bot_join(bot, now);
+            break;
+        case MRMP_OPCODE_TIMEOUT:
+            ++stats.timeouts;
+            bot_end_race(bot);
+            bot_join(bot, now);
+            break;
+        case MRMP_OPCODE_ERROR:
+            if(bot->acknowledged == FALSE) ++stats.refused;
+            else ++stats.server_errors;
+            bot_disconnect(bot, now);
+            break;
+        default:
+            break;
+    }
+}
+
+//asks to watch the newest session once HELLO_ACK arrives. the frames the session sends are only counted, the point
+//is the load they put on the server.
+void bot_handle_spectator_msg(bot_t* bot, char* msg, uint64_t now) {
+    switch(PHEADER(msg)->opcode) {
+        case MRMP_OPCODE_HELLO_ACK:
+            if(bot->state != BOT_HELLO) break;
+            bot->acknowledged = TRUE;
+            bot->connection->version = protocol_version;
+            bot->state = BOT_WATCHING;
+            bot_send(bot, encode_spectate_pkt(0));
+            break;
+        case MRMP_OPCODE_ERROR:
+            if(bot->acknowledged == FALSE) ++stats.spectators_turned_away;
+            else if(((mrmp_pkt_error_t*) msg)->error_code == MRMP_ERR_NO_SESSION) ++stats.spectates_refused;
+            else ++stats.server_errors;
+            bot_disconnect(bot, now);
+            break;
+        case MRMP_OPCODE_JOIN_RESP:
+            //the maze comes first, so it marks a spectator as attached.
+            if(bot->started == FALSE) ++stats.spectates;
+            bot->started = TRUE;
+            ++stats.spectator_frames;
+            break;
+        default:
+            ++stats.spectator_frames;
+            break;
+    }
+}
+
+//records how long each of an opponent's steps took to reach this bot. an opponent's steps are matched to the
+//steps its bot sent in order, bots never send a step the server would reject.
+void bot_observe_steps(bot_t* bot, mrmp_player_t player, int count, uint64_t now) {
+    if(bot->maze == NULL || player >= MAX_SESSION_PLAYERS) return;
+
+    for(int i = 0; i < count; ++i) {
+        int step = bot->opponent_steps[player]++;
+        bot_t* mover = bot->opponents[player];
+        if(mover == NULL) {
+            mover = find_mover(bot, step);
+            bot->opponents[player] = mover;
+            if(mover != NULL) bot->opponent_races[player] = mover->races;
+        }
+
+        if(mover == NULL || mover->races != bot->opponent_races[player] || mover->maze == NULL || step >= mover->steps_sent) {
+            ++stats.echoes_unmatched;
+            continue;
+        }
+        histogram_record(echo_histogram, now - mover->step_sent_us[step]);
+    }
+}
+
+//connects a non-blocking UDP socket to the offered port, so only the server's datagrams are received on it.
+int bot_open_udp(bot_t* bot, mrmp_pkt_udp_offer_t* offer) {
+    bot_close_udp(bot);
+
+    struct sockaddr_in address = udp_server_address;
+    address.sin_port = htons(offer->port);
+    u_long non_blocking = 1;
+    SOCKET udp_socket = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+    if(udp_socket == INVALID_SOCKET || connect(udp_socket, (struct sockaddr*) &address, sizeof(address)) == SOCKET_ERROR ||
+       ioctlsocket(udp_socket, FIONBIO, &non_blocking) == SOCKET_ERROR) {
+        if(udp_socket != INVALID_SOCKET) closesocket(udp_socket);
+        return ERROR;
+    }
+
+    bot->udp_socket = udp_socket;
+    bot->udp_offer = *offer;
+    bot->pending_count = 0;
+    for(int i = 0; i < MAX_SESSION_PLAYERS; ++i) bot->opponent_seq[i] = 0;
+    return SUCCESS;
+}
+
+//the next race gets a new endpoint, moves still pending for this one are given up.
+void bot_close_udp(bot_t* bot) {
+    if(bot->udp_socket == INVALID_SOCKET) return;
+    closesocket(bot->udp_socket);
+    bot->udp_socket = INVALID_SOCKET;
+    bot->pending_count = 0;
+}
+
+int simulate_datagram_loss(void) {
+    if(simulated_loss_percent > 0 && rand() % 100 < simulated_loss_percent) {
+        ++stats.datagrams_lost;
+        return TRUE;
+    }
+    return FALSE;
+}
+
+//sends every unacknowledged move in one datagram, so a lost datagram is made up for by the next one.
+void bot_send_pending_moves(bot_t* bot, uint64_t now) {
+    mrmp_dgram_t moves = { .type = MRMP_DGRAM_MOVES, .endpoint = bot->udp_offer.endpoint, .token = bot->udp_offer.token, .seq = bot->seq };
+    moves.count = (uint8_t) bot->pending_count;
+    memcpy(moves.entries, bot->pending_moves, bot->pending_count * sizeof(mrmp_dgram_entry_t));
+
+    char datagram[MRMP_DGRAM_MAX_SIZE];
+    int length = encode_dgram(&moves, datagram);
+    bot->moves_sent_us = now;
+    if(simulate_datagram_loss()) return;
+    if(send(bot->udp_socket, datagram, length, 0) != SOCKET_ERROR) ++stats.datagrams_sent;
+}
+
+//drops acknowledged moves and records opponents' positions as the steps that led to them.
+void bot_receive_dgrams(bot_t* bot, uint64_t now) {
+    char buffer[MRMP_DGRAM_MAX_SIZE + 1];
+    while(bot->udp_socket != INVALID_SOCKET) {
+        int length = recv(bot->udp_socket, buffer, sizeof(buffer), 0);
+        if(length == SOCKET_ERROR) {
+            //an earlier datagram bounced off the server, keep reading.
+            if(WSAGetLastError() == WSAECONNRESET) continue;
+            break;
+        }
+
+        ++stats.datagrams_received;
+        mrmp_dgram_t dgram;
+        if(simulate_datagram_loss() || decode_dgram(buffer, length, &dgram) == ERROR) continue;
+
+        if(dgram.type == MRMP_DGRAM_ACK) {
+            int32_t unacked = (int32_t)(bot->seq - dgram.seq);
+            if(unacked >= 0 && unacked < bot->pending_count) {
+                memmove(bot->pending_moves, bot->pending_moves + (bot->pending_count - unacked), unacked * sizeof(mrmp_dgram_entry_t));
+                bot->pending_count = unacked;
+            }
+        } else if(dgram.type == MRMP_DGRAM_POSITIONS) {
+            for(int i = 0; i < dgram.count; ++i) {
+                mrmp_player_t player = dgram.entries[i].player;
+                uint32_t seq = dgram.seq - (uint32_t)(dgram.count - 1 - i);
+                if(player >= MAX_SESSION_PLAYERS || player == bot->udp_offer.player || (int32_t)(seq - bot->opponent_seq[player]) <= 0) continue;
+
+                bot->opponent_seq[player] = seq;
+                bot_observe_position(bot, player, dgram.entries[i].row, dgram.entries[i].column, now);
+            }
+        }
+    }
+}
+
+//every bot of a session walks the same shortest path, so an opponent's position tells how many of its steps were
+//taken. steps whose own position was lost are counted as heard when a later position covers them.
+void bot_observe_position(bot_t* bot, mrmp_player_t player, int row, int column, uint64_t now) {
+    if(bot->maze == NULL) return;
+
+    int path_row = 0, path_column = 0;
+    for(int step = 0; step < bot->path_length; ++step) {
+        mrmp_apply_step(bot->path[step], &path_row, &path_column);
+        if(path_row != row || path_column != column) continue;
+
+        //a snapshot repeats positions already heard about.
+        if(step >= bot->opponent_steps[player]) bot_observe_steps(bot, player, step + 1 - bot->opponent_steps[player], now);
+        return;
+    }
+}
+
+//finds the bot behind an opponent's player id on its first step. bots racing the same maze are in the same
+//session, the one not yet matched to a player id that sent its first step earliest is taken to be it.
+bot_t* find_mover(bot_t* bot, int step) {
+    bot_t* best = NULL;
+    for(bot_t* candidate = race_groups[bot->race_key % RACE_GROUP_BUCKETS]; candidate != NULL; candidate = candidate->group_next) {
+        if(candidate == bot || candidate->race_key != bot->race_key || candidate->steps_sent <= step) continue;
+
+        int matched = FALSE;
+        for(int i = 0; i < MAX_SESSION_PLAYERS && matched == FALSE; ++i) {
+            matched = bot->opponents[i] == candidate && bot->opponent_races[i] == candidate->races;
+        }
+        if(matched == TRUE) continue;
+
+        if(best == NULL || candidate->step_sent_us[0] < best->step_sent_us[0]) best = candidate;
+    }
+
+    return best;
+}
+
+//the time between steps, spread uniformly by up to the jitter either way.
+uint64_t next_step_delay_us(void) {
+    double delay_ms = 1000.0 / steps_per_second;
+    if(jitter_ms > 0) delay_ms += (rand() % (2 * jitter_ms + 1)) - jitter_ms;
+    return delay_ms > 0.0 ? (uint64_t)(delay_ms * 1000.0) : 0;
+}
+
+//breadth first search from the top left to the bottom right cell, writing the directions of the shortest path
+//into out_path. returns the number of steps.
+int find_path(maze_t* maze, uint8_t* out_path) {
+    int cells = maze->rows * maze->columns;
+    int* previous = malloc(cells * sizeof(int));
+    int* queue = malloc(cells * sizeof(int));
+    if(previous == NULL || queue == NULL) {
+        free(previous);
+        free(queue);
+        return 0;
+    }
+
+    for(int i = 0; i < cells; ++i) previous[i] = -1;
+    int goal = cells - 1;
+    int head = 0, tail = 0;
+    queue[tail++] = 0;
+    previous[0] = 0;
+    while(head < tail && previous[goal] == -1) {
+        int cell = queue[head++];
+        int row = cell / maze->columns, column = cell % maze->columns;
+        for(uint8_t direction = MRMP_DIR_NORTH; direction <= MRMP_DIR_WEST; ++direction) {
+            int next_row = row, next_column = column;
+            mrmp_apply_step(direction, &next_row, &next_column);
+            if(maze_cell_is_valid(maze->rows, maze->columns, next_row, next_column) == FALSE) continue;
+
+            int next = next_row * maze->columns + next_column;
+            if(previous[next] != -1 || maze_is_move_valid(maze, row, column, next_row, next_column) == FALSE) continue;
+            previous[next] = cell;
+            queue[tail++] = next;
+        }
+    }
+
+    //walk back from the goal, then turn the cells into directions.
+    int length = 0;
+    for(int cell = goal; cell != 0 && previous[cell] != -1; cell = previous[cell]) queue[length++] = cell;
+    int row = 0, column = 0;
+    for(int i = 0; i < length; ++i) {
+        int cell = queue[length - 1 - i];
+        mrmp_step_direction(row, column, cell / maze->columns, cell % maze->columns, &out_path[i]);
+        row = cell / maze->columns;
+        column = cell % maze->columns;
+    }
+
+    free(previous);
+    free(queue);
+    return length;
+}
+
+//FNV-1a over the maze, concurrent sessions practically never race on the same one.
+uint32_t maze_key(mrmp_pkt_join_resp_t* join_resp) {
+    uint32_t hash = 2166136261u;
+    int length = join_resp->rows * join_resp->columns;
+    for(int i = 0; i < length; ++i) {
+        hash ^= (uint8_t) join_resp->cells[i];
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+void print_histogram(const char* name, histogram_t* histogram) {
+    printf("%-16s %-10llu %-10llu %-10llu %-10llu %-10llu %-10llu\n", name,
+        (unsigned long long) histogram_count(histogram),
+        (unsigned long long) histogram_percentile(histogram, 50.0),
+        (unsigned long long) histogram_percentile(histogram, 90.0),
+        (unsigned long long) histogram_percentile(histogram, 99.0),
+        (unsigned long long) histogram_percentile(histogram, 99.9),
+        (unsigned long long) histogram->max);
+}
+
+//what the racing bots' connections carried, handshakes included, so -p 0 and -p 1 runs can be compared. datagrams
+//of the UDP fast path aren't counted.
+void print_bandwidth(void) {
+    uint64_t frames_sent = 0, frames_received = 0;
+    for(int i = 0; i < METRICS_MAX_OPCODES; ++i) {
+        frames_sent += (uint64_t) race_metrics->frames_sent[i];
+        frames_received += (uint64_t) race_metrics->frames_received[i];
+    }
+
+    uint64_t bytes_sent = (uint64_t) metrics_read(metrics, METRIC_BYTES_SENT);
+    uint64_t bytes_received = (uint64_t) metrics_read(metrics, METRIC_BYTES_RECEIVED);
+    printf("version %d framing: %llu bytes sent in %llu frames, %llu bytes received in %llu frames, %.0f bytes per race, %.1f per step.\n",
+        (int) protocol_version, (unsigned long long) bytes_sent, (unsigned long long) frames_sent,
+        (unsigned long long) bytes_received, (unsigned long long) frames_received,
+        stats.races == 0 ? 0.0 : (double)(bytes_sent + bytes_received) / stats.races,
+        stats.steps == 0 ? 0.0 : (double)(bytes_sent + bytes_received) / stats.steps);
+}
@@ -0,0 +1,171 @@
+// Filename: maze_racer_parse_bench.c
+// Programmer(s): Abdurrahman Alyajouri
+// Date: 10/19/2026
+// Purpose: To measure how many bytes each frame takes on the wire and how fast frames are parsed in both framings,
+//          into the packet pool the way the handshake thread and the loadgen parse them and into an arena the way
+//          sessions do.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <windows.h>
+
+#include "networking_utils.h"
+#include "slab_pool.h"
+#include "arena.h"
+#include "maze.h"
+
+#ifndef EXIT_SUCCESS
+# define EXIT_SUCCESS 0
+#endif //EXIT_SUCCESS
+#ifndef EXIT_FAILURE
+# define EXIT_FAILURE 1
+#endif //EXIT_FAILURE
+
+//defines
+#define DEFAULT_RUN_MS          500
+#define STREAM_SIZE             (64 * 1024) //copies of a frame parsed back to back, like a busy connection's reads.
+#define ARENA_BLOCK_SIZE        (16 * 1024) //the same block size sessions use.
+#define BENCH_MAZE_ROWS         10 //the server's default maze.
+#define BENCH_MAZE_COLUMNS      20
+
+typedef struct bench_frame {
+    const char* name;
+    mrmp_shared_buffer_t* frame;
+} bench_frame_t;
+
+//a stream of back to back copies of one frame in one framing.
+typedef struct stream {
+    char* data;
+    int length;
+    int frames;
+} stream_t;
+
+int fill_stream(stream_t* stream, mrmp_shared_buffer_t* frame);
+int parse_stream(stream_t* stream, mrmp_version_t version, arena_t* arena);
+double frames_per_second(stream_t* stream, mrmp_version_t version, arena_t* arena, DWORD run_ms);
+
+
+int main(int argc, char* argv[]) {
+    DWORD run_ms = DEFAULT_RUN_MS;
+    for(int i = 1; i < argc; ++i) {
+        if(strcmp(argv[i], "-d") == 0 && i + 1 < argc) {
+            run_ms = (DWORD) atoi(argv[++i]);
+        } else {
+            fprintf(stderr, "usage: %s [-d milliseconds_per_run]\n", argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+    if(run_ms == 0) run_ms = DEFAULT_RUN_MS;
+
+    slab_pool_t* pkt_pool = mrmp_pkt_pool_init();
+    arena_t* arena = arena_init(ARENA_BLOCK_SIZE);
+    maze_t* maze = generate_maze(BENCH_MAZE_ROWS, BENCH_MAZE_COLUMNS);
+    stream_t stream = { malloc(STREAM_SIZE), 0, 0 };
+    if(pkt_pool == NULL || arena == NULL || maze == NULL || stream.data == NULL) {
+        perror("failed to initialize parse benchmark");
+        return EXIT_FAILURE;
+    }
+    mrmp_pkt_pool_use(pkt_pool);
+
+    //the frames a race is made of, from the one sent per game to the ones sent per step.
+    uint8_t codes[8] = { 0, 1, 1, 2, 2, 1, 3, 0 };
+    mrmp_dgram_entry_t entries[2] = { { 0, 3, 4 }, { 1, 7, 2 } };
+    bench_frame_t frames[] = {
+        { "JOIN_RESP", encode_join_resp_pkt(maze) },
+        { "MOVE", encode_move_pkt(3, 4, 17) },
+        { "OPPONENT_MOVE", encode_opponent_move_pkt(3, 4, 1) },
+        { "DIRECTIONS", encode_directions_pkt(17, codes, 8) },
+        { "POSITIONS", encode_positions_pkt(entries, 2) },
+        { "PING", encode_ping_pkt(MRMP_OPCODE_PING, 123456) },
+        { "READY", encode_empty_pkt(MRMP_OPCODE_READY) }
+    };
+    int frame_count = sizeof(frames) / sizeof(frames[0]);
+
+    printf("parsing %d KB streams of each frame for %lu ms per run.\n", STREAM_SIZE / 1024, (unsigned long) run_ms);
+    printf("%-15s %-9s %-8s %-16s %-16s\n", "frame", "version", "bytes", "pool frames/s", "arena frames/s");
+
+    for(int i = 0; i < frame_count; ++i) {
+        if(frames[i].frame == NULL) {
+            fprintf(stderr, "failed to encode a %s frame.\n", frames[i].name);
+            return EXIT_FAILURE;
+        }
+
+        for(mrmp_version_t version = MRMP_VERSION_0; version <= MRMP_VERSION_1; ++version) {
+            //frames that can't be framed compactly are sent with version 0 framing on every connection.
+            mrmp_shared_buffer_t* framed = mrmp_shared_buffer_for_version(frames[i].frame, version);
+            if(framed == NULL || fill_stream(&stream, framed) == ERROR) continue;
+
+            double pool_rate = frames_per_second(&stream, version, NULL, run_ms);
+            double arena_rate = frames_per_second(&stream, version, arena, run_ms);
+            if(pool_rate < 0 || arena_rate < 0) {
+                fprintf(stderr, "failed to parse the %s frames back.\n", frames[i].name);
+                return EXIT_FAILURE;
+            }
+
+            printf("%-15s %-9d %-8d %-16.0f %-16.0f\n", frames[i].name, version, framed->length, pool_rate, arena_rate);
+        }
+        mrmp_shared_buffer_release(frames[i].frame);
+    }
+
+    mrmp_pkt_pool_use(NULL);
+    slab_pool_free(pkt_pool);
+    arena_free(arena);
+    free_maze(maze);
+    free(stream.data);
+    return EXIT_SUCCESS;
+}
+
+int fill_stream(stream_t* stream, mrmp_shared_buffer_t* frame) {
+    if(frame->length > STREAM_SIZE) return ERROR;
+
+    stream->length = 0;
+    stream->frames = 0;
+    while(stream->length + frame->length <= STREAM_SIZE) {
+        memcpy(stream->data + stream->length, frame->data, frame->length);
+        stream->length += frame->length;
+        ++stream->frames;
+    }
+    return SUCCESS;
+}
+
+//parses every frame of the stream once, returns how many were parsed or ERROR if one couldn't be.
+int parse_stream(stream_t* stream, mrmp_version_t version, arena_t* arena) {
+    int offset = 0;
+    int parsed = 0;
+    while(offset < stream->length) {
+        mrmp_pkt_header_t header;
+        int header_length;
+        if(mrmp_parse_frame_header(stream->data + offset, stream->length - offset, version, &header, &header_length) != SUCCESS)
+            return ERROR;
+
+        char* msg = mrmp_payload_to_pkt_struct_in(arena, header, stream->data + offset + header_length);
+        if(msg == NULL) return ERROR;
+        if(arena == NULL) mrmp_pkt_free(msg);
+
+        offset += header_length + header.length;
+        ++parsed;
+    }
+
+    //a session's arena is rewound every tick, here after every pass.
+    if(arena != NULL) arena_reset(arena);
+    return parsed;
+}
+
+//parses the stream over and over for run_ms milliseconds, returns a negative rate if parsing failed.
+double frames_per_second(stream_t* stream, mrmp_version_t version, arena_t* arena, DWORD run_ms) {
+    LARGE_INTEGER frequency, start, now;
+    QueryPerformanceFrequency(&frequency);
+    QueryPerformanceCounter(&start);
+
+    LONGLONG run_ticks = frequency.QuadPart * run_ms / 1000;
+    uint64_t parsed = 0;
+    do {
+        int result = parse_stream(stream, version, arena);
+        if(result != stream->frames) return -1.0;
+        parsed += result;
+        QueryPerformanceCounter(&now);
+    } while(now.QuadPart - start.QuadPart < run_ticks);
+
+    return parsed / ((double)(now.QuadPart - start.QuadPart) / frequency.QuadPart);
+}
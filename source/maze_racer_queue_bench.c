@@ -0,0 +1,181 @@
+// Filename: maze_racer_queue_bench.c
+// Programmer(s): Abdurrahman Alyajouri
+// Date: 10/19/2026
+// Purpose: To measure how the player queue holds up under contention, with a growing number of producer threads
+//          pushing into it while a single consumer drains it, the way the handshake threads and the matchmaker do.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <process.h>
+#include <windows.h>
+
+#include "player_queue.h"
+
+#ifndef EXIT_SUCCESS
+# define EXIT_SUCCESS 0
+#endif //EXIT_SUCCESS
+#ifndef EXIT_FAILURE
+# define EXIT_FAILURE 1
+#endif //EXIT_FAILURE
+
+//defines
+#define MAX_PRODUCERS           64 //WaitForMultipleObjects() waits on at most this many threads at once.
+#define DEFAULT_RUN_MS          1000
+
+//every producer counts into its own cache line, so counting doesn't add contention of its own.
+typedef struct producer {
+    HANDLE thread;
+    uint64_t pushes;
+    uint64_t full; //pushes turned away because the consumer fell a whole queue behind.
+    char pad[PLAYER_QUEUE_CACHE_LINE];
+} producer_t;
+
+static player_queue_t* queue = NULL;
+static volatile LONG running = FALSE; //producers and the consumer spin until the run starts.
+static volatile LONG stopping = FALSE; //tells the producers to stop pushing.
+static volatile LONG producers_done = FALSE; //the consumer drains what is left once it is set.
+static uint64_t pops = 0; //written by the consumer only.
+
+unsigned __stdcall produce(void* data);
+unsigned __stdcall consume(void* data);
+int run(int producer_count, DWORD run_ms, uint64_t* out_pushes, uint64_t* out_full, double* out_seconds);
+
+
+int main(int argc, char* argv[]) {
+    DWORD run_ms = DEFAULT_RUN_MS;
+    int max_producers = MAX_PRODUCERS;
+    for(int i = 1; i < argc; ++i) {
+        if(strcmp(argv[i], "-d") == 0 && i + 1 < argc) {
+            run_ms = (DWORD) atoi(argv[++i]);
+        } else if(strcmp(argv[i], "-p") == 0 && i + 1 < argc) {
+            max_producers = atoi(argv[++i]);
+        } else {
+            fprintf(stderr, "usage: %s [-d milliseconds_per_run] [-p max_producers]\n", argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+    if(run_ms == 0) run_ms = DEFAULT_RUN_MS;
+    if(max_producers < 1) max_producers = 1;
+    if(max_producers > MAX_PRODUCERS) max_producers = MAX_PRODUCERS;
+
+    SYSTEM_INFO system_info;
+    GetSystemInfo(&system_info);
+    printf("pushing players into a %d slot queue for %lu ms per run on %lu processors, one consumer draining it.\n",
+        PLAYER_QUEUE_CAPACITY, (unsigned long) run_ms, (unsigned long) system_info.dwNumberOfProcessors);
+    printf("%-10s %-16s %-16s %-14s\n", "producers", "enqueues/s", "per producer/s", "full pushes");
+
+    for(int producer_count = 1; producer_count <= max_producers; producer_count *= 2) {
+        uint64_t pushes, full;
+        double seconds;
+        if(run(producer_count, run_ms, &pushes, &full, &seconds) == ERROR) return EXIT_FAILURE;
+
+        printf("%-10d %-16.0f %-16.0f %-14llu\n", producer_count, pushes / seconds, pushes / seconds / producer_count,
+            (unsigned long long) full);
+    }
+
+    return EXIT_SUCCESS;
+}
+
+//runs producer_count producers and one consumer against a fresh queue for run_ms milliseconds.
+int run(int producer_count, DWORD run_ms, uint64_t* out_pushes, uint64_t* out_full, double* out_seconds) {
+    queue = player_queue_init();
+    producer_t* producers = calloc(producer_count, sizeof(producer_t));
+    if(queue == NULL || producers == NULL) {
+        perror("failed to initialize queue benchmark");
+        return ERROR;
+    }
+
+    running = FALSE;
+    stopping = FALSE;
+    producers_done = FALSE;
+    pops = 0;
+
+    HANDLE consumer = (HANDLE)_beginthreadex(NULL, 0, &consume, NULL, 0, NULL);
+    HANDLE handles[MAX_PRODUCERS];
+    int started = 0;
+    for(; started < producer_count; ++started) {
+        producers[started].thread = (HANDLE)_beginthreadex(NULL, 0, &produce, &producers[started], 0, NULL);
+        if(producers[started].thread == NULL) break;
+        handles[started] = producers[started].thread;
+    }
+    if(consumer == NULL || started < producer_count) {
+        fprintf(stderr, "failed to start the benchmark threads.\n");
+        InterlockedExchange(&stopping, TRUE);
+        InterlockedExchange(&running, TRUE);
+        if(started > 0) WaitForMultipleObjects(started, handles, TRUE, INFINITE);
+        InterlockedExchange(&producers_done, TRUE);
+        if(consumer != NULL) WaitForSingleObject(consumer, INFINITE);
+        return ERROR;
+    }
+
+    LARGE_INTEGER frequency, start, end;
+    QueryPerformanceFrequency(&frequency);
+    QueryPerformanceCounter(&start);
+    InterlockedExchange(&running, TRUE);
+    Sleep(run_ms);
+    InterlockedExchange(&stopping, TRUE);
+    WaitForMultipleObjects(producer_count, handles, TRUE, INFINITE);
+    QueryPerformanceCounter(&end);
+    InterlockedExchange(&producers_done, TRUE);
+    WaitForSingleObject(consumer, INFINITE);
+
+    *out_pushes = 0;
+    *out_full = 0;
+    for(int i = 0; i < producer_count; ++i) {
+        *out_pushes += producers[i].pushes;
+        *out_full += producers[i].full;
+        CloseHandle(producers[i].thread);
+    }
+    *out_seconds = (double)(end.QuadPart - start.QuadPart) / frequency.QuadPart;
+
+    CloseHandle(consumer);
+    free(producers);
+    player_queue_free(queue);
+
+    //every player pushed has to come out exactly once, anything else means the queue lost or duplicated one.
+    if(pops != *out_pushes) {
+        fprintf(stderr, "%d producers pushed %llu players but %llu were popped.\n", producer_count,
+            (unsigned long long) *out_pushes, (unsigned long long) pops);
+        return ERROR;
+    }
+    return SUCCESS;
+}
+
+unsigned __stdcall produce(void* data) {
+    producer_t* producer = (producer_t*) data;
+    player_t player;
+    memset(&player, 0, sizeof(player_t));
+
+    while(running == FALSE) SwitchToThread(); //more threads than processors is the point of the larger runs.
+    while(stopping == FALSE) {
+        player.queued_at_ms = producer->pushes;
+        if(player_queue_push(queue, player) == SUCCESS) {
+            ++producer->pushes;
+        } else {
+            //give the consumer a chance to catch up instead of hammering a full queue.
+            ++producer->full;
+            SwitchToThread();
+        }
+    }
+
+    _endthreadex(0);
+    return 0;
+}
+
+unsigned __stdcall consume(void* data) {
+    while(running == FALSE) SwitchToThread();
+
+    //keeps draining after the producers stopped, so every push is accounted for.
+    while(producers_done == FALSE || player_queue_is_empty(queue) == FALSE) {
+        if(player_queue_is_empty(queue) == TRUE) {
+            SwitchToThread();
+            continue;
+        }
+        player_queue_pop(queue);
+        ++pops;
+    }
+
+    _endthreadex(0);
+    return 0;
+}
@@ -3,6 +3,7 @@
 // Date: 5/19/2025
 // Purpose: To implement the server side of the application.
 
+#define _CRT_RAND_S //declares rand_s, the UDP tokens are drawn from the system's cryptographic generator.
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -13,6 +14,14 @@
 
 #include "player_queue.h"
 #include "networking_utils.h"
+#include "token_bucket.h"
+#include "histogram.h"
+#include "connection.h"
+#include "timer_wheel.h"
+#include "replay.h"
+#include "metrics.h"
+#include "trace.h"
+#include "arena.h"
 
 #ifndef EXIT_SUCCESS
 # define EXIT_SUCCESS 0
@@ -29,18 +38,66 @@
 #endif //FALSE
 
 //defines
-#define MAX_SESSION_THREADS         10
-#define MAX_CLIENT_CONNECTIONS      (MAX_SESSION_THREADS * 2)
-#define DEFAULT_TIMEOUT_SECONDS     1
+#define MAX_SESSIONS                4096
+#define MAX_SCHEDULER_WORKERS       64 //the most threads cleanup() can wait on at once.
+#define SCHEDULER_TICK_MS           10
+#define SESSION_LINGER_MS           200
+#define SESSION_MAZE_ROWS           10
+#define SESSION_MAZE_COLUMNS        20
+#define MIN_SESSION_PLAYERS         2
+#define MAX_SESSION_PLAYERS         16
+#define MAX_CLIENT_CONNECTIONS      (MAX_SESSIONS * session_players)
+#define MAX_SPECTATORS              16384 //admitted on top of the players' connections.
+#define SPECTATOR_SNAPSHOT_MS       30 //spectators are sent at most one POSITIONS frame per session this often.
+#define SPECTATOR_MAX_BACKLOG       2 //frames a spectator may have queued before snapshots skip over them.
+#define HANDSHAKE_HELLO_TIMEOUT_MS  1000 //HELLO arrives right after the connection is accepted.
 #define ACTIVITY_TIMEOUT_SECONDS    20
-#define MRMP_VERSION                0
+#define HANDSHAKE_JOIN_TIMEOUT_MS   3000 //as long as TCP's initial timeout. both are only used if no round trip was measured.
+#define RTO_MIN_MS                  200 //bounds of the timeouts derived from a connection's round trip time.
+#define RTO_MAX_MS                  10000
+#define READY_GRACE_MS              500 //time a client may take to draw the maze before sending READY.
+#define HEARTBEAT_MIN_INTERVAL_MS   250 //PING goes out every two round trips within these bounds.
+#define HEARTBEAT_MAX_INTERVAL_MS   2000
+#define LIVENESS_TIMEOUTS           3 //timeouts a player may stay silent past a PING interval before being dropped.
+#define REMATCH_WINDOW_SECONDS      15
+#define SERVER_FEATURES             (MRMP_FEATURE_UDP | MRMP_FEATURE_DIRECTIONS | MRMP_FEATURE_HEARTBEAT | MRMP_FEATURE_PIPELINED)
+#define UDP_NO_ENDPOINT             0xFFFFFFFF
+#define UDP_SNAPSHOT_MS             100 //how often lost position datagrams are healed by resending every position.
+#define UDP_RECEIVE_BUDGET          256 //datagrams read per tick, so a flood can't starve the worker's sessions.
+#define MAX_HANDSHAKES_PER_SECOND   50.0
+#define MAX_HANDSHAKE_BURST         100.0
+#define REJECT_LINGER_MS            250 //time a turned away client has to read its ERROR before the socket is closed.
+#define REJECT_POLL_MS              10 //how often lingering rejected sockets are checked for their client's FIN.
+#define MAX_LINGERING_REJECTS       256 //rejected sockets past this many are closed right away.
+#define RTT_BUCKET_COUNT            5
+#define MATCH_RELAX_WAIT_MS         5000
+#define MATCHMAKER_STALL_MS         10 //least a matchmaker that could neither drain the queue nor pair anyone sleeps.
+#define REPLAY_FLUSH_MS             250 //how often the writer thread saves the replays finished since.
+#define REPLAY_MAX_PENDING_BYTES    (64 * 1024 * 1024) //replays finished while this much is unsaved are dropped.
+#define METRICS_POLL_MS             250 //how often the metrics endpoint checks whether the server is quitting.
+#define METRICS_REQUEST_SIZE        2048 //larger requests are cut off, only the request line is looked at.
+#define METRICS_RESPONSE_SIZE       (64 * 1024)
+#define SESSION_ARENA_BLOCK_SIZE    (16 * 1024) //a session, its maze and the frames of a tick fit into one block.
+#define MAX_POOLED_ARENAS           1024 //arenas of ended sessions kept for reuse, more than that are freed.
 
 #define CMD_EXIT    "exit"
 #define CMD_STAT    "stat"
 #define CMD_HELP    "help"
 #define CMD_PQUE    "pque"
+#define CMD_MTCH    "mtch"
+#define CMD_TICK    "tick"
+#define CMD_RMCH    "rmch"
+#define CMD_UDP     "udp"
+#define CMD_SPEC    "spec"
+#define CMD_RPLY    "rply"
+#define CMD_LTCY    "ltcy"
+#define CMD_LJSN    "ljsn"
+#define CMD_TRCE    "trce"
+#define CMD_MEM     "mem"
 #define CMD_PPV     "++v"
 #define CMD_MMV     "--v"
+#define CMD_PPT     "++t"
+#define CMD_MMT     "--t"
 #define CMD_MAX_LEN 4
 
 //help message for server ui
@@ -49,69 +106,477 @@ const char* SERVER_UI_HELP =    "Below are a list of available commands:\n"
                                 "\tstat : Display the # of total and active\n" 
                                 "\t       connections and sessions.\n"
                                 "\tpque : Display the # of clients waiting in the player queue.\n"
+                                "\tmtch : Display time-to-match percentiles for each RTT bucket.\n"
+                                "\ttick : Display session load and tick durations for each worker.\n"
+                                "\trmch : Display requeues, rematches, accept rate and time-to-maze\n"
+                                "\t       for new versus reused connections.\n"
+                                "\tudp  : Display datagram counts of the UDP fast path.\n"
+                                "\tspec : Display spectators and the snapshots sent to them.\n"
+                                "\trply : Display how many race replays were recorded and saved.\n"
+                                "\tltcy : Display latency percentiles of each stage of a player's lifecycle.\n"
+                                "\tljsn : Print the same latencies as a single line of JSON.\n"
+                                "\tmem  : Display the memory sessions used, how often it came\n"
+                                "\t       from the heap and the packet pool's occupancy.\n"
                                 "\thelp : Display this very same help message.\n"
+                                "\ttrce : Save the traced events to a Chrome trace JSON file.\n"
                                 "\t++v  : Enable verbosity.\n"
                                 "\t--v  : Disable verbosity.\n"
+                                "\t++t  : Enable tracing of handshakes, mazes, moves and teardowns.\n"
+                                "\t--t  : Disable tracing.\n"
                                 "\texit : Exit the server process, shutting down everything.\n";
 
+//stages of a player's lifecycle whose latency is recorded, in microseconds.
+typedef enum latency_stage {
+    LATENCY_ACCEPT_TO_HELLO,
+    LATENCY_HELLO_TO_JOIN,
+    LATENCY_JOIN_TO_PAIRED, //time spent waiting in matchmaking.
+    LATENCY_PAIRED_TO_START,
+    LATENCY_MOVE_TO_BROADCAST, //from a move being read until it was sent to the opponents.
+    LATENCY_MAZE_GENERATION,
+    LATENCY_STAGE_COUNT
+} latency_stage_t;
+
+static const char* LATENCY_STAGE_NAMES[LATENCY_STAGE_COUNT] = {
+    "accept_to_hello",
+    "hello_to_join",
+    "join_to_paired",
+    "paired_to_start",
+    "move_to_broadcast",
+    "maze_generation"
+};
+
+typedef enum session_state {
+    SESSION_WAITING_READY,  //JOIN_RESP was sent, waiting for every player's READY.
+    SESSION_RACING,
+    SESSION_AWAITING_REMATCH, //RESULT was sent, players may JOIN to be requeued or REMATCH the same opponents.
+    SESSION_FINISHED        //the outcome was sent, lingering briefly so the last frames go out before closing.
+} session_state_t;
+
+typedef struct session_player {
+    connection_t* connection; //NULL once the player has left the session.
+    uint32_t rtt_ms;
+    maze_size_t row;
+    maze_size_t column;
+    int ready;
+    int wants_rematch;
+    ULONGLONG requested_at_ms; //when the player asked for this race.
+    int reused; //TRUE if the player's connection already hosted a race.
+    mrmp_features_t features;
+
+    //udp fast path for positions, only used if the player negotiated it.
+    uint32_t udp_endpoint; //index into the worker's endpoint table, UDP_NO_ENDPOINT if none.
+    uint32_t udp_token;
+    struct sockaddr_in udp_address; //learned from the player's latest authenticated datagram.
+    int udp_bound; //TRUE once udp_address is known, until then positions go over TCP.
+    uint32_t last_move_seq; //newest move applied from a datagram.
+    int ack_pending;
+
+    //heartbeats, only sent if the player negotiated them. the round trip estimate lives on the connection.
+    ULONGLONG last_heard_ms; //when the newest frame or datagram arrived from the player.
+    ULONGLONG next_ping_ms;
+    uint32_t ping_stamp; //of the newest PING, a PONG echoing any other stamp is ignored.
+    int ping_outstanding;
+
+    //steps taken during this tick, sent as one OPPONENT_DIRECTIONS frame to opponents that negotiated directions.
+    uint8_t run_codes[MRMP_RUN_BYTES(MRMP_MAX_RUN_STEPS)];
+    uint8_t run_count;
+} session_player_t;
+
+//only ever sent to, spectators aren't polled and a closed one is noticed when sending to it fails.
+typedef struct spectator {
+    connection_t* connection; //NULL once the spectator was dropped, until the list is compacted.
+    int stale; //hasn't been sent the latest snapshot yet.
+} spectator_t;
+
+typedef struct session {
+    session_state_t state;
+    int player_count;
+    session_player_t players[MAX_SESSION_PLAYERS];
+    maze_t* maze;
+    ULONGLONG deadline_ms; //when the current state times out.
+    timer_wheel_timer_t deadline_timer; //armed on the hosting worker's wheel for deadline_ms.
+    timer_wheel_timer_t heartbeat_timer; //armed for the next PING due or player to be declared dead.
+    struct scheduler_worker* worker; //the hosting worker, set once the session is taken from the inbox.
+    int needs_service; //set when input arrived or the deadline passed during this tick.
+    uint32_t positions_seq; //of the newest POSITIONS datagram sent to the session's players.
+    int positions_dirty; //a position changed since the last snapshot.
+    ULONGLONG last_snapshot_ms;
+    mrmp_session_id_t id; //named by SPECTATE, never 0.
+
+    //spectators share every frame sent to them, positions only ever go out as a full snapshot so a spectator that
+    //falls behind skips straight to the latest one instead of holding up the players.
+    spectator_t* spectators;
+    int spectator_count;
+    int spectator_capacity;
+    mrmp_shared_buffer_t* maze_frame; //JOIN_RESP of the current race, for spectators joining mid race.
+    mrmp_shared_buffer_t* spectator_snapshot; //latest POSITIONS frame, NULL until the race's first one.
+    int spectators_dirty; //a position changed since the last spectator snapshot.
+    ULONGLONG last_spectator_snapshot_ms;
+    replay_recorder_t* replay; //of the race being run, NULL unless recording and racing.
+    uint32_t races; //started so far, counting rematches.
+    ULONGLONG race_started_ms; //when START was sent.
+    uint64_t paired_at_us; //when the matchmaker formed the session, 0 once its first START was sent.
+    int moves_unsent; //moves applied this tick that haven't been flushed to the opponents yet.
+    struct session* next; //links the sessions waiting in a worker's inbox.
+
+    //the session itself, its maze and the frames read during a tick are allocated from the arena and given back
+    //together when the session ends. frames sent are shared with other sessions' connections and stay on the heap.
+    arena_t* arena;
+    arena_mark_t race_mark; //where the current race's maze starts, a rematch rewinds to it.
+} session_t;
+
+//a finished replay waiting for the writer thread to save it.
+typedef struct replay_file {
+    uint8_t* data;
+    size_t length;
+    mrmp_session_id_t session_id;
+    uint32_t race;
+    uint64_t started_at_ms;
+    struct replay_file* next;
+} replay_file_t;
+
+//a connection that asked to watch a session, handed by the limbo thread to the worker hosting the session.
+typedef struct spectate_request {
+    connection_t* connection;
+    mrmp_session_id_t session_id;
+    struct spectate_request* next;
+} spectate_request_t;
+
+typedef struct udp_endpoint {
+    struct session* session; //NULL while the slot is free.
+    int player;
+} udp_endpoint_t;
+
+//sessions are multiplexed onto a fixed pool of workers, each one servicing all of its sessions once per tick.
+typedef struct scheduler_worker {
+    HANDLE thread;
+    HANDLE wake_event; //signaled when a session is handed to the worker.
+    CRITICAL_SECTION inbox_critsec;
+    session_t* inbox; //handed over by the matchmaker, not yet started by the worker.
+    spectate_request_t* spectate_inbox; //handed over by the limbo thread, not yet attached to their session.
+    CRITICAL_SECTION replay_critsec;
+    replay_file_t* replay_outbox; //finished replays, newest first, taken by the writer thread.
+    volatile LONG session_count; //includes the inbox, used to pick the least loaded worker.
+
+    //only touched by the worker thread.
+    session_t** sessions;
+    int running_count;
+    WSAPOLLFD* poll_fds;
+    session_t** poll_sessions; //session and player index owning each polled socket.
+    int* poll_players;
+    timer_wheel_t* timers; //ready, inactivity and linger deadlines of every session.
+
+    //one UDP socket carries the position datagrams of every session on the worker, players are told which slot
+    //of the endpoint table and which token to put into their datagrams.
+    SOCKET udp_socket;
+    uint16_t udp_port;
+    udp_endpoint_t* udp_endpoints;
+    uint32_t* free_endpoints;
+    uint32_t free_endpoint_count;
+    uint32_t max_endpoints;
+
+    //written by the worker and read without locking by the user interface.
+    uint64_t ticks;
+    uint64_t overruns; //ticks whose work took longer than SCHEDULER_TICK_MS.
+    uint64_t frames_handled;
+    uint64_t datagrams_received;
+    uint64_t datagrams_sent;
+    uint64_t datagrams_lost; //dropped on purpose to simulate packet loss.
+    uint64_t stale_moves; //moves that arrived again in a redundant datagram.
+    int spectator_count;
+    uint64_t spectator_snapshots; //POSITIONS frames encoded for spectators.
+    uint64_t spectator_frames; //snapshots queued, every spectator shares the same encoded frame.
+    uint64_t spectator_skips; //snapshots replaced before a slow spectator could be sent them.
+    uint64_t replays_recorded;
+    uint64_t replays_dropped; //the writer thread fell too far behind.
+    uint64_t arena_sessions; //ended on this worker, with the arena counters below summed over them.
+    uint64_t arena_races;
+    uint64_t arena_bytes_peak; //summed over sessions, the most any single session used is kept separately.
+    uint64_t arena_bytes_max;
+    uint64_t arena_allocations;
+    uint64_t arena_heap_allocations;
+    histogram_t* tick_histogram; //microseconds of work per tick.
+    histogram_t* fresh_maze_histogram; //milliseconds from accept() to JOIN_RESP for new connections.
+    histogram_t* reused_maze_histogram; //milliseconds from JOIN or REMATCH to JOIN_RESP on reused connections.
+    histogram_t* latency[LATENCY_STAGE_COUNT]; //this worker's shard of the lifecycle latencies.
+    metrics_shard_t* metrics; //owned by the metrics registry.
+    trace_ring_t* trace; //owned by the trace.
+    uint64_t polled_at_us; //when this tick's input was read.
+} scheduler_worker_t;
+
+typedef enum handshake_stage {
+    HANDSHAKE_AWAITING_HELLO,
+    HANDSHAKE_AWAITING_JOIN
+} handshake_stage_t;
+
+//a connection that was accepted but hasn't joined the player queue yet.
+typedef struct handshake {
+    connection_t* connection; //NULL once the connection was closed or handed to the matchmaker.
+    handshake_stage_t stage;
+    timer_wheel_timer_t deadline_timer; //absolute deadline of the current stage.
+    LARGE_INTEGER hello_ack_sent;
+    uint64_t hello_at_us;
+    ULONGLONG accepted_at_ms;
+    uint64_t accepted_at_us;
+    mrmp_features_t features; //requested by the client and supported by the server.
+    struct handshake* next; //links the handshakes waiting in the limbo inbox.
+} handshake_t;
+
+//a turned away connection that is kept open until its client read the ERROR and closed its side.
+typedef struct lingering_reject {
+    SOCKET socket;
+    ULONGLONG deadline_ms;
+} lingering_reject_t;
+
+//a session that can be spectated and the worker hosting it.
+typedef struct watchable_session {
+    mrmp_session_id_t id;
+    scheduler_worker_t* worker;
+} watchable_session_t;
+
 //for client connection/ready player tracking purposes.
-static player_queue_t* player_queue = NULL;
-static SOCKET listen_socket = INVALID_SOCKET;
-static HANDLE session_thread_tracker[MAX_SESSION_THREADS];
+static player_queue_t* player_queue = NULL; //pushed to by the limbo thread, drained by the matchmaker.
+static player_queue_t* pending_players[RTT_BUCKET_COUNT]; //only touched by the matchmaker.
+static histogram_t* match_wait_histograms[RTT_BUCKET_COUNT]; //time-to-match in milliseconds, written by the matchmaker.
 
-//for statistical/debug purposes.
-static int total_connections = 0;
-static volatile int active_connections = 0; //needs concurrency.
-static int total_sessions = 0;
-static volatile int active_sessions = 0; //needs concurrency.
+//upper bounds (exclusive) of each RTT bucket in milliseconds, the last bucket is unbounded.
+static const uint32_t RTT_BUCKET_BOUNDS_MS[RTT_BUCKET_COUNT - 1] = { 20, 50, 100, 200 };
+
+//how long a player may wait alone in their RTT bucket before being paired with a neighboring bucket.
+static ULONGLONG match_relax_wait_ms = MATCH_RELAX_WAIT_MS;
+
+//number of players raced against each other in a session.
+static int session_players = MIN_SESSION_PLAYERS;
+static int simulated_loss_percent = 0; //of datagrams dropped in each direction, for testing the UDP fast path.
+static SOCKET listen_socket = INVALID_SOCKET;
+static scheduler_worker_t* scheduler_workers[MAX_SCHEDULER_WORKERS];
+static int scheduler_worker_count = 0; //defaults to one worker per processor.
+
+//for statistical/debug purposes. every thread counts into its own shard, readers sum the shards without locking.
+static metrics_t* metrics = NULL;
+static metrics_shard_t* accept_metrics = NULL; //written by the main thread.
+static metrics_shard_t* limbo_metrics = NULL;
+static metrics_shard_t* matchmaker_metrics = NULL;
+static unsigned short metrics_port = 0; //the Prometheus endpoint is only served if a port was given.
+static HANDLE metrics_server_thread = NULL;
+
+//events are recorded into one ring per thread, only while tracing is enabled from the user interface.
+static trace_t* trace = NULL;
+static trace_ring_t* limbo_trace = NULL;
+static trace_ring_t* matchmaker_trace = NULL;
 
 //other server specific variables.
 static int verbose = FALSE;
 static volatile int quit = FALSE;
+static HANDLE quit_event = NULL; //signaled once by the user interface thread to wake up blocking waits.
+static WSAEVENT accept_event = WSA_INVALID_EVENT;
+static token_bucket_t* handshake_bucket = NULL;
+static lingering_reject_t lingering_rejects[MAX_LINGERING_REJECTS]; //only touched by the main thread.
+static int lingering_reject_count = 0;
 static HANDLE server_ui_thread;
 static HANDLE create_sessions_thread;
-static CRITICAL_SECTION player_queue_critsec;
-static CRITICAL_SECTION server_state_critsec;
-
-typedef struct session {
-    SOCKET player_one;
-    SOCKET player_two;
-    uint8_t player_one_row;
-    uint8_t player_one_column;
-    uint8_t player_two_row;
-    uint8_t player_two_column;
-} session_t;
-
-static struct timeval DEFAULT_TIMEOUT = {
-    .tv_sec = DEFAULT_TIMEOUT_SECONDS,
-    .tv_usec = 0
-};
-
-static struct timeval ACTIVITY_TIMEOUT = {
-    .tv_sec = ACTIVITY_TIMEOUT_SECONDS,
-    .tv_usec = 0
-};
+static HANDLE client_limbo_thread;
+static HANDLE limbo_wake_event = NULL; //signaled when a connection is handed to the limbo thread.
+static CRITICAL_SECTION limbo_inbox_critsec;
+static handshake_t* limbo_inbox = NULL; //accepted connections not yet picked up by the limbo thread.
+static timer_wheel_t* limbo_timers = NULL; //handshake stage deadlines, only touched by the limbo thread.
+static slab_pool_t* limbo_pkt_pool = NULL; //frames read by the limbo thread, sessions parse theirs into their arena.
+static CRITICAL_SECTION matchmaker_critsec; //only used to sleep on matchmaker_cv, the player queue itself is lock-free.
+static CONDITION_VARIABLE matchmaker_cv; //signaled under matchmaker_critsec when players queue up or a session slot frees.
+static watchable_session_t watchable_sessions[MAX_SESSIONS]; //oldest first, guarded by watchable_critsec.
+static int watchable_count = 0;
+static CRITICAL_SECTION watchable_critsec;
+static mrmp_session_id_t last_session_id = 0; //matchmaker only.
+static const char* replay_directory = NULL; //races are only recorded if one was given.
+static HANDLE replay_writer_thread = NULL;
+static volatile LONG replay_pending_bytes = 0; //finished replays not yet saved.
+static uint64_t replays_written = 0; //written by the writer thread and read without locking by the user interface.
+static uint64_t replay_write_errors = 0;
+static CRITICAL_SECTION arena_critsec; //guards the free-list, arenas are taken by the matchmaker and given back by workers.
+static arena_t* free_arenas = NULL;
+static int free_arena_count = 0;
+static volatile LONG arenas_created = 0;
+
+//lifecycle latencies are sharded by the thread recording them, so recording never takes a lock or contends on a
+//cache line. each shard has exactly one writer, readers merge every shard without locking.
+static LARGE_INTEGER performance_frequency;
+static histogram_t* limbo_latency[LATENCY_STAGE_COUNT]; //written by the limbo thread.
+static histogram_t* matchmaker_latency[LATENCY_STAGE_COUNT]; //written by the matchmaker.
 
 //functions
-SOCKET socket_complement(SOCKET socket, session_t* session); //get the other players socket relative to the given socket.
-void init_session_thread_tracker(void);
-void cleanup_bad_session(session_t* session, maze_t* maze, SOCKET notify_socket, int notify_error);
+uint64_t now_us(void);
+int latency_shard_init(histogram_t** shard);
+void latency_shard_free(histogram_t** shard);
+int latency_snapshot(histogram_t** merged);
+void print_latency_json(histogram_t** merged);
+int format_latency_prometheus(char* buffer, size_t size);
+void serve_metrics_request(SOCKET socket, char* response);
+void save_trace(void);
+void start_handshake(SOCKET socket);
+void handshake_send_pkt(handshake_t* handshake, mrmp_shared_buffer_t* buffer); //queues and releases a new frame.
+void close_handshake(handshake_t* handshake);
+void handshake_handle_msg(handshake_t* handshake, char* msg, ULONGLONG now);
+void handshake_timed_out(timer_wheel_timer_t* timer, void* timeout_pkt);
+ULONGLONG handshake_timeout_ms(handshake_t* handshake, ULONGLONG fallback_ms);
+void handshake_spectate(handshake_t* handshake, mrmp_session_id_t session_id);
+void register_watchable(session_t* session);
+void unregister_watchable(session_t* session);
+scheduler_worker_t* find_watchable(mrmp_session_id_t* session_id);
+int session_add_spectator(session_t* session, connection_t* connection);
+void session_send_spectators(session_t* session, mrmp_shared_buffer_t* buffer);
+void session_send_spectators_pkt(session_t* session, mrmp_shared_buffer_t* buffer); //sends and releases a new frame.
+void session_snapshot_spectators(session_t* session, ULONGLONG now);
+void session_flush_spectators(session_t* session, ULONGLONG now);
+void drop_spectator(session_t* session, int spectator);
+void session_start_replay(session_t* session, ULONGLONG now);
+void session_finish_replay(session_t* session, uint8_t outcome, int winner, ULONGLONG now);
+void write_replays(void);
+uint64_t unix_time_ms(void);
+void close_spectator_connection(connection_t* connection);
+void session_set_deadline(session_t* session, ULONGLONG deadline_ms);
+void session_deadline_passed(timer_wheel_timer_t* timer, void* context);
+int session_remaining_players(session_t* session);
+int session_all_ready(session_t* session);
+void session_send(session_t* session, int player, mrmp_shared_buffer_t* buffer);
+void session_send_pkt(session_t* session, int player, mrmp_shared_buffer_t* buffer); //sends and releases a new frame.
+void session_broadcast(session_t* session, int except_player, mrmp_shared_buffer_t* buffer);
+void drop_session_player(session_t* session, int player);
+void session_finish(session_t* session, ULONGLONG now);
+void session_await_rematch(session_t* session, ULONGLONG now);
+int session_all_want_rematch(session_t* session);
+void session_requeue_player(session_t* session, int player_index, ULONGLONG now);
+void session_rematch(session_t* session, ULONGLONG now);
+int session_apply_move(session_t* session, int player_index, maze_size_t row, maze_size_t column, mrmp_move_seq_t seq, ULONGLONG now);
+void session_offer_udp(session_t* session, int player_index);
+void session_release_udp(session_t* session, int player_index);
+void session_send_dgram(session_t* session, int player_index, const char* buffer, int length);
+void session_flush_udp(session_t* session, ULONGLONG now);
+void session_flush_runs(session_t* session);
+int session_wants_run(session_t* session, int receiver);
+int simulate_datagram_loss(void);
+void scheduler_receive_dgrams(scheduler_worker_t* worker, ULONGLONG now);
+void session_abort(session_t* session, int failed_player, mrmp_error_t notify_error, ULONGLONG now);
+void session_begin(session_t* session, ULONGLONG now);
+ULONGLONG session_ready_timeout_ms(session_t* session);
+uint32_t heartbeat_interval_ms(connection_t* connection);
+void session_start_heartbeats(session_t* session, ULONGLONG now);
+void session_heartbeat(session_t* session, ULONGLONG now);
+void session_handle_pong(session_t* session, int player_index, uint32_t stamp, ULONGLONG now);
+void session_handle_msg(session_t* session, int player_index, char* msg, ULONGLONG now);
+int session_process(session_t* session, ULONGLONG now); //returns the number of frames handled.
+void session_end(session_t* session);
+scheduler_worker_t* scheduler_worker_init(int max_sessions);
+void scheduler_worker_free(scheduler_worker_t* worker);
+int start_scheduler_workers(int count);
+void scheduler_take_inbox(scheduler_worker_t* worker, ULONGLONG now);
+void scheduler_take_spectators(scheduler_worker_t* worker);
+void scheduler_poll(scheduler_worker_t* worker, ULONGLONG now);
+void scheduler_flush(scheduler_worker_t* worker, ULONGLONG now);
+void scheduler_reap(scheduler_worker_t* worker, ULONGLONG now);
+void notify_matchmaker(void);
+int rtt_bucket(uint32_t rtt_ms);
+int nearest_waiting_bucket(int bucket);
+size_t total_pending_players(void);
+DWORD matchmaker_sleep_time(void);
+session_t* form_session(int bucket, ULONGLONG now);
+arena_t* session_arena_acquire(void);
+void session_arena_release(arena_t* arena);
+void start_session(session_t* session);
+void reject_connection(SOCKET socket, mrmp_error_t error);
+int drain_rejected_socket(SOCKET socket);
+DWORD linger_rejected_sockets(ULONGLONG now); //returns how long the accept loop may sleep.
+int admit_connection(void);
 void cleanup(void);
 
 unsigned __stdcall server_ui(void* data);
 unsigned __stdcall client_limbo(void* data);
-unsigned __stdcall do_session(void* session_state);
+unsigned __stdcall scheduler_worker(void* data);
 unsigned __stdcall create_sessions(void* data);
+unsigned __stdcall replay_writer(void* data);
+unsigned __stdcall metrics_server(void* data);
+
+int main(int argc, char* argv[]) {
+    //parse optional arguments.
+    for(int i = 1; i < argc; ++i) {
+        if(strcmp(argv[i], "-w") == 0 && i + 1 < argc) {
+            match_relax_wait_ms = strtoull(argv[++i], NULL, 10);
+        } else if(strcmp(argv[i], "-n") == 0 && i + 1 < argc) {
+            session_players = atoi(argv[++i]);
+            if(session_players < MIN_SESSION_PLAYERS || session_players > MAX_SESSION_PLAYERS) {
+                fprintf(stderr, "players per session must be between %d and %d.\n", MIN_SESSION_PLAYERS, MAX_SESSION_PLAYERS);
+                return EXIT_FAILURE;
+            }
+        } else if(strcmp(argv[i], "-t") == 0 && i + 1 < argc) {
+            scheduler_worker_count = atoi(argv[++i]);
+            if(scheduler_worker_count < 1 || scheduler_worker_count > MAX_SCHEDULER_WORKERS) {
+                fprintf(stderr, "scheduler workers must be between 1 and %d.\n", MAX_SCHEDULER_WORKERS);
+                return EXIT_FAILURE;
+            }
+        } else if(strcmp(argv[i], "-l") == 0 && i + 1 < argc) {
+            simulated_loss_percent = atoi(argv[++i]);
+        } else if(strcmp(argv[i], "-r") == 0 && i + 1 < argc) {
+            replay_directory = argv[++i];
+        } else if(strcmp(argv[i], "-m") == 0 && i + 1 < argc) {
+            int port = atoi(argv[++i]);
+            if(port < 1 || port > 65535) {
+                fprintf(stderr, "metrics port must be between 1 and 65535.\n");
+                return EXIT_FAILURE;
+            }
+            metrics_port = (unsigned short) port;
+        } else {
+            fprintf(stderr, "usage: %s [-w match_relax_wait_ms] [-n players_per_session] [-t scheduler_workers] [-l udp_loss_percent] [-r replay_directory] [-m metrics_port]\n", argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
 
-int main(void) {
     //register functions to be called at exit().
     atexit(cleanup);
+    QueryPerformanceFrequency(&performance_frequency);
+
+    InitializeCriticalSection(&matchmaker_critsec);
+    InitializeCriticalSection(&limbo_inbox_critsec);
+    InitializeCriticalSection(&watchable_critsec);
+    InitializeCriticalSection(&arena_critsec);
+    InitializeConditionVariable(&matchmaker_cv);
+
+    //manual reset so every thread waiting on it sees the quit request.
+    quit_event = CreateEvent(NULL, TRUE, FALSE, NULL);
+    if(quit_event == NULL) {
+        fprintf(stderr, "failed to create quit event.\n");
+        return EXIT_FAILURE;
+    }
+
+    handshake_bucket = token_bucket_init(MAX_HANDSHAKES_PER_SECOND, MAX_HANDSHAKE_BURST);
+    if(handshake_bucket == NULL) {
+        return EXIT_FAILURE;
+    }
+
+    //every thread that counts something gets its shard before it starts.
+    metrics = metrics_init();
+    if(metrics == NULL) {
+        return EXIT_FAILURE;
+    }
+    accept_metrics = metrics_shard(metrics);
+    limbo_metrics = metrics_shard(metrics);
+    matchmaker_metrics = metrics_shard(metrics);
+    if(accept_metrics == NULL || limbo_metrics == NULL || matchmaker_metrics == NULL) {
+        return EXIT_FAILURE;
+    }
 
-    //initialize the session thread tracker array.
-    init_session_thread_tracker();
+    trace = trace_init();
+    if(trace == NULL) {
+        return EXIT_FAILURE;
+    }
+    limbo_trace = trace_ring(trace, "limbo");
+    matchmaker_trace = trace_ring(trace, "matchmaker");
+    if(limbo_trace == NULL || matchmaker_trace == NULL) {
+        return EXIT_FAILURE;
+    }
 
-    InitializeCriticalSection(&player_queue_critsec);
-    InitializeCriticalSection(&server_state_critsec);
+    limbo_pkt_pool = mrmp_pkt_pool_init();
+    if(limbo_pkt_pool == NULL) {
+        return EXIT_FAILURE;
+    }
 
     //start up minimal user interface thread.
     server_ui_thread = (HANDLE)_beginthreadex(NULL, 0, &server_ui, NULL, 0, NULL);
@@ -120,17 +585,24 @@ int main(void) {
         return EXIT_FAILURE;
     }
 
-    //initialize player queue.
+    //initialize player queues, one per RTT bucket for players waiting on the matchmaker.
     player_queue = player_queue_init();
+    if(player_queue == NULL) {
+        return EXIT_FAILURE;
+    }
 
-    //start up session creation thread.
-    create_sessions_thread = (HANDLE)_beginthreadex(NULL, 0, &create_sessions, NULL, 0, NULL);
-    if(create_sessions_thread == NULL) {
-        fprintf(stderr, "failed to create create sessions thread.\n");
+    for(int i = 0; i < RTT_BUCKET_COUNT; ++i) {
+        pending_players[i] = player_queue_init();
+        match_wait_histograms[i] = histogram_init();
+        if(pending_players[i] == NULL || match_wait_histograms[i] == NULL) {
+            return EXIT_FAILURE;
+        }
+    }
+    if(latency_shard_init(limbo_latency) == ERROR || latency_shard_init(matchmaker_latency) == ERROR) {
         return EXIT_FAILURE;
     }
 
-    //initialize winsock.
+    //initialize winsock, the workers open their UDP sockets as they start.
     WSADATA wsa_data;
     int wsa_startup_result = WSAStartup(MAKEWORD(2, 2), &wsa_data);
     if(wsa_startup_result != 0) {
@@ -138,6 +610,62 @@ int main(void) {
         return EXIT_FAILURE;
     }
 
+    //start up the workers hosting sessions, one per processor unless told otherwise.
+    int worker_count = scheduler_worker_count;
+    if(worker_count == 0) {
+        SYSTEM_INFO system_info;
+        GetSystemInfo(&system_info);
+        worker_count = system_info.dwNumberOfProcessors < MAX_SCHEDULER_WORKERS ? (int) system_info.dwNumberOfProcessors : MAX_SCHEDULER_WORKERS;
+    }
+
+    scheduler_worker_count = 0;
+    if(start_scheduler_workers(worker_count) == ERROR) {
+        return EXIT_FAILURE;
+    }
+
+    //start up the thread saving replays, so workers never wait on the disk.
+    if(replay_directory != NULL) {
+        if(CreateDirectoryA(replay_directory, NULL) == FALSE && GetLastError() != ERROR_ALREADY_EXISTS) {
+            fprintf(stderr, "failed to create replay directory %s: %lu\n", replay_directory, GetLastError());
+            return EXIT_FAILURE;
+        }
+
+        replay_writer_thread = (HANDLE)_beginthreadex(NULL, 0, &replay_writer, NULL, 0, NULL);
+        if(replay_writer_thread == NULL) {
+            fprintf(stderr, "failed to create replay writer thread.\n");
+            return EXIT_FAILURE;
+        }
+    }
+
+    //start up the Prometheus endpoint, it only reads the shards so it never slows down the threads counting.
+    if(metrics_port != 0) {
+        metrics_server_thread = (HANDLE)_beginthreadex(NULL, 0, &metrics_server, NULL, 0, NULL);
+        if(metrics_server_thread == NULL) {
+            fprintf(stderr, "failed to create metrics server thread.\n");
+            return EXIT_FAILURE;
+        }
+    }
+
+    //start up session creation thread.
+    create_sessions_thread = (HANDLE)_beginthreadex(NULL, 0, &create_sessions, NULL, 0, NULL);
+    if(create_sessions_thread == NULL) {
+        fprintf(stderr, "failed to create create sessions thread.\n");
+        return EXIT_FAILURE;
+    }
+
+    //start up the thread walking every accepted connection through its handshake.
+    limbo_wake_event = CreateEvent(NULL, FALSE, FALSE, NULL);
+    if(limbo_wake_event == NULL) {
+        fprintf(stderr, "failed to create limbo wake event.\n");
+        return EXIT_FAILURE;
+    }
+
+    client_limbo_thread = (HANDLE)_beginthreadex(NULL, 0, &client_limbo, NULL, 0, NULL);
+    if(client_limbo_thread == NULL) {
+        fprintf(stderr, "failed to create client limbo thread.\n");
+        return EXIT_FAILURE;
+    }
+
     struct addrinfo* result = NULL, *ptr = NULL, hints;
 
     ZeroMemory(&hints, sizeof(hints));
@@ -181,123 +709,215 @@ int main(void) {
         return EXIT_FAILURE;
     }
 
-    //make listen socket non-blocking for accept.
-    u_long mode = 1; 
-    int ioctl_result = ioctlsocket(listen_socket, FIONBIO, &mode);
-    if(ioctl_result != NO_ERROR) {
-        fprintf(stderr, "ioctlsocket failed with error: %ld\n", ioctl_result);
+    //have winsock signal an event when connections are pending, this also makes the listen socket non-blocking.
+    accept_event = WSACreateEvent();
+    if(accept_event == WSA_INVALID_EVENT) {
+        fprintf(stderr, "WSACreateEvent failed with error: %d\n", WSAGetLastError());
+        return EXIT_FAILURE;
+    }
+
+    if(WSAEventSelect(listen_socket, accept_event, FD_ACCEPT) == SOCKET_ERROR) {
+        fprintf(stderr, "WSAEventSelect failed with error: %d\n", WSAGetLastError());
+        return EXIT_FAILURE;
     }
 
-    //client connection listen loop.
+    HANDLE wait_events[2] = { quit_event, accept_event };
+
+    //client connection listen loop, sleeps until a connection is pending or the server is quitting.
     while(quit != TRUE) {
-        if(active_connections > MAX_CLIENT_CONNECTIONS) continue;
-        
-        SOCKET* client_socket = malloc(sizeof(SOCKET));
-        if(client_socket == NULL) {
-            fprintf(stderr, "failed to malloc() client socket pointer.\n");
+        DWORD wait_result = WaitForMultipleObjects(2, wait_events, FALSE, linger_rejected_sockets(GetTickCount64()));
+        if(wait_result == WAIT_TIMEOUT) {
             continue;
+        } else if(wait_result == WAIT_OBJECT_0) {
+            break;
+        } else if(wait_result != WAIT_OBJECT_0 + 1) {
+            fprintf(stderr, "failed to wait on accept event: %lu\n", GetLastError());
+            break;
         }
 
-        *client_socket = accept(listen_socket, NULL, NULL);
-        if (*client_socket == INVALID_SOCKET) {
-            //fprintf(stderr, "accept() failed: %d\n", WSAGetLastError());
-            free(client_socket);
-            continue;
-        }
+        WSAResetEvent(accept_event);
+
+        //drain every pending connection, each accept() call re-enables FD_ACCEPT if more are waiting.
+        while(quit != TRUE) {
+            SOCKET client_socket = accept(listen_socket, NULL, NULL);
+            if(client_socket == INVALID_SOCKET) {
+                if(WSAGetLastError() != WSAEWOULDBLOCK)
+                    fprintf(stderr, "accept() failed: %d\n", WSAGetLastError());
+                break;
+            }
 
-        //increment active connections
-        EnterCriticalSection(&server_state_critsec);
-        ++active_connections;
-        ++total_connections;
-        LeaveCriticalSection(&server_state_critsec);
+            //accepted sockets inherit the listen socket's event selection and non-blocking mode, undo both.
+            u_long blocking = 0;
+            WSAEventSelect(client_socket, NULL, 0);
+            ioctlsocket(client_socket, FIONBIO, &blocking);
 
-        // struct linger sl = {1, 2}; //wait max 2 seconds to send remaining data
-        // int setsockopt_result = setsockopt(*client_socket, SOL_SOCKET, SO_LINGER, (char*)&sl, sizeof(sl));
-        // if(setsockopt_result == SOCKET_ERROR) {
-        //     fprintf(stderr, "setsockopt failed with %u\n", WSAGetLastError());
-        //     send_error_pkt(*client_socket, MRMP_ERR_UNKNOWN);
-        //     shutdown(*client_socket, SD_SEND);
-        //     closesocket(*client_socket);
-        //     free(client_socket);
-        // }
+            //turn away connections we can't serve right now instead of letting them time out.
+            if(admit_connection() == FALSE) {
+                reject_connection(client_socket, MRMP_ERR_FULL_QUEUE);
+                continue;
+            }
 
-        //create a new thread to house client connection.
-        HANDLE limbo_thread = (HANDLE)_beginthreadex(NULL, 0, &client_limbo, client_socket, 0, NULL);
-        if(limbo_thread == NULL) {
-            fprintf(stderr, "failed to create client limbo thread.\n");
-            send_error_pkt(*client_socket, MRMP_ERR_UNKNOWN);
-            shutdown(*client_socket, SD_SEND);
-            closesocket(*client_socket);
-            free(client_socket);
+            start_handshake(client_socket);
         }
-
-        CloseHandle(limbo_thread);
     }
 
     return EXIT_SUCCESS;
 }
 
-SOCKET socket_complement(SOCKET socket, session_t* session) {
-    if(socket == session->player_one) return session->player_two;
-    else if(socket == session->player_two) return session->player_one;
-    return INVALID_SOCKET;
+//a connection is admitted only if there is room for it and the handshake rate limit allows it.
+int admit_connection(void) {
+    if(metrics_read(metrics, METRIC_CONNECTIONS_ACTIVE) >= MAX_CLIENT_CONNECTIONS + MAX_SPECTATORS) return FALSE;
+    return token_bucket_take(handshake_bucket);
 }
 
-void init_session_thread_tracker(void) {
-    for(size_t i = 0; i < MAX_SESSION_THREADS; ++i) {
-        session_thread_tracker[i] = NULL;
+//closing a socket with unread HELLO and JOIN in it resets the connection, and the reset can reach the client before
+//the ERROR does. so the ERROR is followed by a FIN, and the socket is only closed once the client answered with its
+//own FIN or REJECT_LINGER_MS passed, reading and discarding whatever the client sent meanwhile.
+void reject_connection(SOCKET socket, mrmp_error_t error) {
+    send_error_pkt(socket, error);
+    shutdown(socket, SD_SEND);
+
+    u_long non_blocking = 1;
+    if(ioctlsocket(socket, FIONBIO, &non_blocking) == SOCKET_ERROR || drain_rejected_socket(socket) == FALSE
+    || lingering_reject_count == MAX_LINGERING_REJECTS) {
+        closesocket(socket);
+    } else {
+        lingering_rejects[lingering_reject_count].socket = socket;
+        lingering_rejects[lingering_reject_count].deadline_ms = GetTickCount64() + REJECT_LINGER_MS;
+        ++lingering_reject_count;
     }
+
+    metrics_add(accept_metrics, METRIC_CONNECTIONS_REJECTED, 1);
+
+    if(verbose == TRUE)
+        printf("Rejected a connection with error code %d\n", error);
 }
 
-void cleanup_bad_session(session_t* session, maze_t* maze, SOCKET notify_socket, int notify_error) {
-    if (session->player_one != INVALID_SOCKET) {
-        shutdown(session->player_one, SD_SEND);
-        closesocket(session->player_one);
-        EnterCriticalSection(&server_state_critsec);
-        --active_connections;
-        LeaveCriticalSection(&server_state_critsec);
+//discards what the client sent so far, returns FALSE once it closed its side or the connection failed.
+int drain_rejected_socket(SOCKET socket) {
+    char discard[256];
+    while(1) {
+        int bytes_received = recv(socket, discard, sizeof(discard), 0);
+        if(bytes_received > 0) continue;
+        return bytes_received == SOCKET_ERROR && WSAGetLastError() == WSAEWOULDBLOCK;
     }
-    if (session->player_two != INVALID_SOCKET) {
-        shutdown(session->player_two, SD_SEND);
-        closesocket(session->player_two);
-        EnterCriticalSection(&server_state_critsec);
-        --active_connections;
-        LeaveCriticalSection(&server_state_critsec);
-    }
-    if (notify_socket != INVALID_SOCKET) {
-        send_error_pkt(notify_socket, notify_error);
+}
+
+DWORD linger_rejected_sockets(ULONGLONG now) {
+    for(int i = 0; i < lingering_reject_count;) {
+        if(drain_rejected_socket(lingering_rejects[i].socket) == FALSE || now >= lingering_rejects[i].deadline_ms) {
+            closesocket(lingering_rejects[i].socket);
+            lingering_rejects[i] = lingering_rejects[--lingering_reject_count];
+        } else {
+            ++i;
+        }
     }
 
-    EnterCriticalSection(&server_state_critsec);
-    --active_sessions;
-    LeaveCriticalSection(&server_state_critsec);
+    return lingering_reject_count > 0 ? REJECT_POLL_MS : INFINITE;
+}
 
-    free(session);
-    free_maze(maze);
-    _endthreadex(0);
+//waking under the lock guarantees the matchmaker either sees the new state or is already asleep.
+void notify_matchmaker(void) {
+    EnterCriticalSection(&matchmaker_critsec);
+    WakeConditionVariable(&matchmaker_cv);
+    LeaveCriticalSection(&matchmaker_critsec);
+}
+
+int start_scheduler_workers(int count) {
+    for(int i = 0; i < count; ++i) {
+        scheduler_worker_t* worker = scheduler_worker_init(MAX_SESSIONS);
+        if(worker == NULL) return ERROR;
+
+        char trace_name[TRACE_MAX_NAME];
+        snprintf(trace_name, sizeof(trace_name), "worker %d", scheduler_worker_count);
+        worker->trace = trace_ring(trace, trace_name);
+        if(worker->trace == NULL) {
+            scheduler_worker_free(worker);
+            return ERROR;
+        }
+
+        worker->thread = (HANDLE)_beginthreadex(NULL, 0, &scheduler_worker, (void*) worker, 0, NULL);
+        if(worker->thread == NULL) {
+            fprintf(stderr, "failed to create scheduler worker thread.\n");
+            scheduler_worker_free(worker);
+            return ERROR;
+        }
+
+        scheduler_workers[scheduler_worker_count++] = worker;
+    }
+
+    return SUCCESS;
 }
 
 void cleanup(void) {
     closesocket(listen_socket);
-    WSACleanup();
+    WSACloseEvent(accept_event);
+
+    if(metrics_server_thread != NULL) {
+        WaitForSingleObject(metrics_server_thread, INFINITE);
+        CloseHandle(metrics_server_thread);
+    }
 
     WaitForSingleObject(create_sessions_thread, INFINITE);
     CloseHandle(create_sessions_thread);
 
-    WaitForMultipleObjects(MAX_SESSION_THREADS, session_thread_tracker, TRUE, INFINITE);
+    WaitForSingleObject(client_limbo_thread, INFINITE);
+    CloseHandle(client_limbo_thread);
+    CloseHandle(limbo_wake_event);
+
+    //workers close their remaining sessions once they see the quit event.
+    HANDLE worker_threads[MAX_SCHEDULER_WORKERS];
+    for(int i = 0; i < scheduler_worker_count; ++i) {
+        worker_threads[i] = scheduler_workers[i]->thread;
+    }
+    if(scheduler_worker_count > 0)
+        WaitForMultipleObjects(scheduler_worker_count, worker_threads, TRUE, INFINITE);
+
+    //the workers recorded the races they cut short on their way out, save those too.
+    if(replay_writer_thread != NULL) {
+        WaitForSingleObject(replay_writer_thread, INFINITE);
+        CloseHandle(replay_writer_thread);
+        write_replays();
+    }
+    for(int i = 0; i < scheduler_worker_count; ++i) {
+        scheduler_worker_free(scheduler_workers[i]);
+    }
+    //every thread that touches a socket has exited, winsock can go now.
+    WSACleanup();
 
     //TODO: make sure this is the right way to clean up a critical section.
-    DeleteCriticalSection(&player_queue_critsec);
-    DeleteCriticalSection(&server_state_critsec);
+    DeleteCriticalSection(&matchmaker_critsec);
+    DeleteCriticalSection(&limbo_inbox_critsec);
+    DeleteCriticalSection(&watchable_critsec);
+    while(free_arenas != NULL) {
+        arena_t* next = free_arenas->next;
+        arena_free(free_arenas);
+        free_arenas = next;
+    }
+    DeleteCriticalSection(&arena_critsec);
 
     player_queue_free(player_queue);
+    for(int i = 0; i < RTT_BUCKET_COUNT; ++i) {
+        player_queue_free(pending_players[i]);
+        histogram_free(match_wait_histograms[i]);
+    }
+    latency_shard_free(limbo_latency);
+    latency_shard_free(matchmaker_latency);
 
     WaitForSingleObject(server_ui_thread, INFINITE);
     CloseHandle(server_ui_thread);
+    if(limbo_pkt_pool != NULL) slab_pool_free(limbo_pkt_pool);
+
+    token_bucket_free(handshake_bucket);
+    if(metrics != NULL) metrics_free(metrics);
+    if(trace != NULL) trace_free(trace);
+    CloseHandle(quit_event);
 }
 
 unsigned __stdcall server_ui(void* data) {
     char cmd_buffer[CMD_MAX_LEN + 2]; //+2 for new line and null byte.
+    ULONGLONG last_rmch_ms = GetTickCount64();
+    int64_t last_rmch_connections = 0;
 
     //introduction.
     printf("%s\n%s\n", SERVER_UI_WELCOME, SERVER_UI_HELP);
@@ -317,13 +937,186 @@ unsigned __stdcall server_ui(void* data) {
             break;
         } else if(strncmp(cmd_buffer, CMD_STAT, 4) == 0) {
             printf(
-                "Total connections since startup    : %d\n"
-                "Active connections                 : %d\n\n"
-                "Total sessions since startup       : %d\n"
-                "Active sessions                    : %d\n",
-            total_connections, active_connections, total_sessions, active_sessions);
+                "Total connections since startup    : %lld\n"
+                "Active connections                 : %lld\n\n"
+                "Total sessions since startup       : %lld\n"
+                "Active sessions                    : %lld\n\n"
+                "Total spectators since startup     : %lld\n"
+                "Active spectators                  : %lld\n\n"
+                "Rejected connections (overload)    : %lld\n",
+            (long long) metrics_read(metrics, METRIC_CONNECTIONS_TOTAL),
+            (long long) metrics_read(metrics, METRIC_CONNECTIONS_ACTIVE),
+            (long long) metrics_read(metrics, METRIC_SESSIONS_TOTAL),
+            (long long) metrics_read(metrics, METRIC_SESSIONS_ACTIVE),
+            (long long) metrics_read(metrics, METRIC_SPECTATORS_TOTAL),
+            (long long) metrics_read(metrics, METRIC_SPECTATORS_ACTIVE),
+            (long long) metrics_read(metrics, METRIC_CONNECTIONS_REJECTED));
         } else if(strncmp(cmd_buffer, CMD_PQUE, 4) == 0) {
-            printf("%d clients currently waiting in the player queue\n", player_queue_size(player_queue));
+            size_t waiting = player_queue_size(player_queue);
+            for(int i = 0; i < RTT_BUCKET_COUNT; ++i) waiting += player_queue_size(pending_players[i]);
+            printf("%d clients currently waiting in the player queue\n", (int) waiting);
+        } else if(strncmp(cmd_buffer, CMD_MTCH, 4) == 0) {
+            //read without locking, the numbers may be slightly stale while the matchmaker is running.
+            printf("RTT bucket (ms)    waiting   matched   p50 (ms)   p90 (ms)   p99 (ms)\n");
+            for(int i = 0; i < RTT_BUCKET_COUNT; ++i) {
+                uint32_t lower = i == 0 ? 0 : RTT_BUCKET_BOUNDS_MS[i - 1];
+                char range[32];
+                if(i == RTT_BUCKET_COUNT - 1) snprintf(range, sizeof(range), "%u+", lower);
+                else snprintf(range, sizeof(range), "%u-%u", lower, RTT_BUCKET_BOUNDS_MS[i] - 1);
+
+                printf("%-18s %-9d %-9llu %-10llu %-10llu %-10llu\n", range,
+                    (int) player_queue_size(pending_players[i]),
+                    (unsigned long long) histogram_count(match_wait_histograms[i]),
+                    (unsigned long long) histogram_percentile(match_wait_histograms[i], 50.0),
+                    (unsigned long long) histogram_percentile(match_wait_histograms[i], 90.0),
+                    (unsigned long long) histogram_percentile(match_wait_histograms[i], 99.0));
+            }
+            printf("Players are paired across buckets after waiting %llu ms.\n", (unsigned long long) match_relax_wait_ms);
+        } else if(strncmp(cmd_buffer, CMD_TICK, 4) == 0) {
+            //read without locking, the numbers may be slightly stale while the workers are running.
+            printf("worker   sessions   ticks        overruns   frames       p50 (us)   p99 (us)   max (us)\n");
+            for(int i = 0; i < scheduler_worker_count; ++i) {
+                scheduler_worker_t* worker = scheduler_workers[i];
+                printf("%-8d %-10ld %-12llu %-10llu %-12llu %-10llu %-10llu %-10llu\n", i,
+                    (long) worker->session_count,
+                    (unsigned long long) worker->ticks,
+                    (unsigned long long) worker->overruns,
+                    (unsigned long long) worker->frames_handled,
+                    (unsigned long long) histogram_percentile(worker->tick_histogram, 50.0),
+                    (unsigned long long) histogram_percentile(worker->tick_histogram, 99.0),
+                    (unsigned long long) worker->tick_histogram->max);
+            }
+            printf("Sessions are ticked every %d ms.\n", SCHEDULER_TICK_MS);
+        } else if(strncmp(cmd_buffer, CMD_RMCH, 4) == 0) {
+            //accept rate since the last time this command was run.
+            ULONGLONG now = GetTickCount64();
+            double elapsed_seconds = (double)(now - last_rmch_ms) / 1000.0;
+            int64_t total_connections = metrics_read(metrics, METRIC_CONNECTIONS_TOTAL);
+            double accepts_per_second = elapsed_seconds > 0.0 ? (double)(total_connections - last_rmch_connections) / elapsed_seconds : 0.0;
+            last_rmch_ms = now;
+            last_rmch_connections = total_connections;
+
+            //each worker records its own histograms, combine them for display.
+            histogram_t* fresh = histogram_init();
+            histogram_t* reused = histogram_init();
+            if(fresh != NULL && reused != NULL) {
+                for(int i = 0; i < scheduler_worker_count; ++i) {
+                    histogram_merge(fresh, scheduler_workers[i]->fresh_maze_histogram);
+                    histogram_merge(reused, scheduler_workers[i]->reused_maze_histogram);
+                }
+
+                printf(
+                    "Requeues on the same connection    : %lld\n"
+                    "Rematches against the same players : %lld\n"
+                    "Accepted connections per second    : %.2f\n\n",
+                (long long) metrics_read(metrics, METRIC_REQUEUES), (long long) metrics_read(metrics, METRIC_REMATCHES), accepts_per_second);
+
+                printf("time-to-maze       races     p50 (ms)   p90 (ms)   p99 (ms)\n");
+                const char* names[2] = { "new connection", "reused" };
+                histogram_t* histograms[2] = { fresh, reused };
+                for(int i = 0; i < 2; ++i) {
+                    printf("%-18s %-9llu %-10llu %-10llu %-10llu\n", names[i],
+                        (unsigned long long) histogram_count(histograms[i]),
+                        (unsigned long long) histogram_percentile(histograms[i], 50.0),
+                        (unsigned long long) histogram_percentile(histograms[i], 90.0),
+                        (unsigned long long) histogram_percentile(histograms[i], 99.0));
+                }
+            }
+            if(fresh != NULL) histogram_free(fresh);
+            if(reused != NULL) histogram_free(reused);
+        } else if(strncmp(cmd_buffer, CMD_UDP, 3) == 0) {
+            //read without locking, the numbers may be slightly stale while the workers are running.
+            printf("worker   port     received     sent         lost         stale moves\n");
+            for(int i = 0; i < scheduler_worker_count; ++i) {
+                scheduler_worker_t* worker = scheduler_workers[i];
+                printf("%-8d %-8u %-12llu %-12llu %-12llu %-12llu\n", i,
+                    (unsigned) worker->udp_port,
+                    (unsigned long long) worker->datagrams_received,
+                    (unsigned long long) worker->datagrams_sent,
+                    (unsigned long long) worker->datagrams_lost,
+                    (unsigned long long) worker->stale_moves);
+            }
+            printf("Simulated datagram loss: %d%%\n", simulated_loss_percent);
+        } else if(strncmp(cmd_buffer, CMD_SPEC, 4) == 0) {
+            //read without locking, the numbers may be slightly stale while the workers are running.
+            printf("worker   spectators   snapshots    queued       skipped\n");
+            for(int i = 0; i < scheduler_worker_count; ++i) {
+                scheduler_worker_t* worker = scheduler_workers[i];
+                printf("%-8d %-12d %-12llu %-12llu %-12llu\n", i,
+                    worker->spectator_count,
+                    (unsigned long long) worker->spectator_snapshots,
+                    (unsigned long long) worker->spectator_frames,
+                    (unsigned long long) worker->spectator_skips);
+            }
+            EnterCriticalSection(&watchable_critsec);
+            int watchable = watchable_count;
+            mrmp_session_id_t newest = watchable == 0 ? 0 : watchable_sessions[watchable - 1].id;
+            LeaveCriticalSection(&watchable_critsec);
+            printf("%d sessions can be spectated, the newest is session %u.\n", watchable, newest);
+            printf("Spectators are sent at most one snapshot per session every %d ms.\n", SPECTATOR_SNAPSHOT_MS);
+        } else if(strncmp(cmd_buffer, CMD_LTCY, 4) == 0 || strncmp(cmd_buffer, CMD_LJSN, 4) == 0) {
+            histogram_t* merged[LATENCY_STAGE_COUNT];
+            if(latency_snapshot(merged) == SUCCESS) {
+                if(strncmp(cmd_buffer, CMD_LJSN, 4) == 0) {
+                    print_latency_json(merged);
+                } else {
+                    printf("stage                samples      p50 (us)   p90 (us)   p99 (us)   p99.9 (us) max (us)\n");
+                    for(int i = 0; i < LATENCY_STAGE_COUNT; ++i) {
+                        printf("%-20s %-12llu %-10llu %-10llu %-10llu %-10llu %-10llu\n", LATENCY_STAGE_NAMES[i],
+                            (unsigned long long) histogram_count(merged[i]),
+                            (unsigned long long) histogram_percentile(merged[i], 50.0),
+                            (unsigned long long) histogram_percentile(merged[i], 90.0),
+                            (unsigned long long) histogram_percentile(merged[i], 99.0),
+                            (unsigned long long) histogram_percentile(merged[i], 99.9),
+                            (unsigned long long) merged[i]->max);
+                    }
+                    printf("Percentiles are accurate to about 6%%.\n");
+                }
+                latency_shard_free(merged);
+            }
+        } else if(strncmp(cmd_buffer, CMD_RPLY, 4) == 0) {
+            if(replay_directory == NULL) {
+                printf("Races aren't recorded, start the server with -r <directory> to record them.\n");
+            } else {
+                //read without locking, the numbers may be slightly stale while the workers are running.
+                printf("worker   recorded     dropped\n");
+                for(int i = 0; i < scheduler_worker_count; ++i) {
+                    printf("%-8d %-12llu %-12llu\n", i,
+                        (unsigned long long) scheduler_workers[i]->replays_recorded,
+                        (unsigned long long) scheduler_workers[i]->replays_dropped);
+                }
+                printf("Saved %llu replays to %s, %llu failed to save, %ld bytes waiting to be saved.\n",
+                    (unsigned long long) replays_written, replay_directory, (unsigned long long) replay_write_errors, (long) replay_pending_bytes);
+            }
+        } else if(strncmp(cmd_buffer, CMD_MEM, 3) == 0) {
+            //read without locking, the numbers may be slightly stale while the workers are running.
+            printf("worker   sessions     races        avg bytes    max bytes    allocs/race  heap/race\n");
+            for(int i = 0; i < scheduler_worker_count; ++i) {
+                scheduler_worker_t* worker = scheduler_workers[i];
+                uint64_t sessions = worker->arena_sessions;
+                uint64_t races = worker->arena_races;
+                printf("%-8d %-12llu %-12llu %-12llu %-12llu %-12.1f %-12.2f\n", i,
+                    (unsigned long long) sessions,
+                    (unsigned long long) races,
+                    (unsigned long long)(sessions == 0 ? 0 : worker->arena_bytes_peak / sessions),
+                    (unsigned long long) worker->arena_bytes_max,
+                    races == 0 ? 0.0 : (double) worker->arena_allocations / races,
+                    races == 0 ? 0.0 : (double) worker->arena_heap_allocations / races);
+            }
+            EnterCriticalSection(&arena_critsec);
+            int pooled = free_arena_count;
+            LeaveCriticalSection(&arena_critsec);
+            printf("%ld session arenas exist, %d of them are free for the next sessions.\n", (long) arenas_created, pooled);
+            printf("frames read while handshaking:\n");
+            slab_pool_print(limbo_pkt_pool, stdout);
+        } else if(strncmp(cmd_buffer, CMD_TRCE, 4) == 0) {
+            save_trace();
+        } else if(strncmp(cmd_buffer, CMD_PPT, 3) == 0) {
+            trace_set_enabled(trace, TRUE);
+            printf("Enabled tracing, each thread keeps its last %d events.\n", TRACE_RING_SIZE);
+        } else if(strncmp(cmd_buffer, CMD_MMT, 3) == 0) {
+            trace_set_enabled(trace, FALSE);
+            printf("Disabled tracing, the events recorded so far can still be saved.\n");
         } else if(strncmp(cmd_buffer, CMD_HELP, 4) == 0) {
             printf("%s", SERVER_UI_HELP);
         } else if(strncmp(cmd_buffer, CMD_PPV, 3) == 0) {
@@ -347,348 +1140,2109 @@ unsigned __stdcall server_ui(void* data) {
     }
 
     quit = TRUE;
+    for(int i = 0; i < lingering_reject_count; ++i)
+        closesocket(lingering_rejects[i].socket);
+    lingering_reject_count = 0;
+
+    SetEvent(quit_event);
+    notify_matchmaker();
 
     _endthreadex(0);
     return 0;
 }
 
-unsigned __stdcall client_limbo(void* client_socket) {
-    SOCKET socket = *(SOCKET*) client_socket;
-    
-    //temporary fix to repetitive cleanup code.
-    int exit_flag = FALSE;
-
-    //try to receive a hello packet, if it's not received correctly or in time, send an error packet 
-    //and or shutdown and close the socket.
-    mrmp_pkt_hello_t* hello_msg = NULL;
-    int hello_result = receive_mrmp_msg(socket, (char**) &hello_msg, &DEFAULT_TIMEOUT);
-    
-    switch(hello_result) {
-        case GRACEFUL_DC:
-            send_error_pkt(socket, MRMP_ERR_UNKNOWN); //TODO: do we need this?
-            shutdown(socket, SD_SEND);
-            exit_flag = TRUE;
-            printf("GRACEFUL DC\n");
-            break;
-        case DISGRACEFUL_DC:
-            exit_flag = TRUE;
-            printf("DISGRACEFUL DC\n");
-            break;
-        case TIMEDOUT:
-            send_timeout_pkt(socket);
-            shutdown(socket, SD_SEND);
-            exit_flag = TRUE;
-            printf("TIMEDOUT\n");
-            break;
-        default:
-            break;
-    };
+//how long the handshake may wait for the client's next frame, the fixed fallback if TCP measured no round trip.
+ULONGLONG handshake_timeout_ms(handshake_t* handshake, ULONGLONG fallback_ms) {
+    if(handshake->connection->rtt.samples == 0) return fallback_ms;
+    return rtt_estimator_timeout_ms(&handshake->connection->rtt, RTO_MIN_MS, RTO_MAX_MS);
+}
 
-    if(!exit_flag && hello_msg->header.opcode != MRMP_OPCODE_HELLO) {
-        send_error_pkt(socket, MRMP_ERR_ILLEGAL_OPCODE);
-        shutdown(socket, SD_SEND);
-        exit_flag = TRUE;
-    } else if(!exit_flag && hello_msg->version != MRMP_VERSION) {
-        if(verbose == TRUE)
-            printf("Recieved hello packet, version %d\n", hello_msg->version);
-        send_error_pkt(socket, MRMP_ERR_VERSION_MISMATCH);
-        shutdown(socket, SD_SEND);
-        exit_flag = TRUE;
-        printf("wrong version\n");
+//hands a freshly accepted connection to the limbo thread, which walks it through HELLO and JOIN.
+void start_handshake(SOCKET socket) {
+    handshake_t* handshake = malloc(sizeof(handshake_t));
+    connection_t* connection = handshake == NULL ? NULL : connection_init(socket);
+    if(connection == NULL) {
+        fprintf(stderr, "failed to start a handshake.\n");
+        free(handshake);
+        reject_connection(socket, MRMP_ERR_UNKNOWN);
+        return;
     }
 
-    if(exit_flag == TRUE) {
-        closesocket(socket);
-        EnterCriticalSection(&server_state_critsec);
-        --active_connections;
-        LeaveCriticalSection(&server_state_critsec);
-        free(hello_msg);
-        free(client_socket);
-        _endthreadex(0);
-        
-    }
+    handshake->connection = connection;
+    handshake->stage = HANDSHAKE_AWAITING_HELLO;
+    timer_wheel_timer_init(&handshake->deadline_timer, handshake);
+    handshake->accepted_at_ms = GetTickCount64();
+    handshake->accepted_at_us = now_us();
+    connection->metrics = limbo_metrics;
+
+    //the TCP handshake just measured a round trip, the deadlines for HELLO and JOIN are derived from it.
+    uint32_t rtt_us;
+    if(get_tcp_rtt_us(socket, &rtt_us) == SUCCESS) rtt_estimator_sample(&connection->rtt, rtt_us);
+
+    metrics_add(accept_metrics, METRIC_CONNECTIONS_ACTIVE, 1);
+    metrics_add(accept_metrics, METRIC_CONNECTIONS_TOTAL, 1);
+
+    EnterCriticalSection(&limbo_inbox_critsec);
+    handshake->next = limbo_inbox;
+    limbo_inbox = handshake;
+    LeaveCriticalSection(&limbo_inbox_critsec);
+    SetEvent(limbo_wake_event);
+}
 
-    free(hello_msg);
+void handshake_send_pkt(handshake_t* handshake, mrmp_shared_buffer_t* buffer) {
+    if(buffer == NULL) return;
+    connection_queue(handshake->connection, buffer);
+    mrmp_shared_buffer_release(buffer);
+}
 
-    //succesful hello performed, send an app layer acknowledgment.
-    send_hello_ack_pkt(socket);
+//pushes out whatever is still queued and closes the connection, the handshake itself is freed by the limbo thread.
+void close_handshake(handshake_t* handshake) {
+    if(handshake->connection == NULL) return;
 
-    //exact same code but for the ready packet. TODO: find a better less repetitive way to handle this?
-    mrmp_pkt_header_t* join_msg = NULL;
-    int join_result = receive_mrmp_msg(socket, (char**) &join_msg, &DEFAULT_TIMEOUT);
+    timer_wheel_cancel(limbo_timers, &handshake->deadline_timer);
+    connection_flush(handshake->connection);
+    connection_free(handshake->connection);
+    handshake->connection = NULL;
+    metrics_add(limbo_metrics, METRIC_CONNECTIONS_ACTIVE, -1);
+}
 
-    switch(join_result) {
-        case GRACEFUL_DC:
-            send_error_pkt(socket, MRMP_ERR_UNKNOWN); //TODO: do we need this?
-            fprintf(stderr, "sent unknown error packet.\n");
-            shutdown(socket, SD_SEND);
-            exit_flag = TRUE;
-            break;
-        case DISGRACEFUL_DC:
-            exit_flag = TRUE;
-            break;
-        case TIMEDOUT:
-            send_timeout_pkt(socket);
-            fprintf(stderr, "sent timeout packet.\n");
-            shutdown(socket, SD_SEND);
-            exit_flag = TRUE;
-            break;
-        default:
-            break;
+void handshake_handle_msg(handshake_t* handshake, char* msg, ULONGLONG now) {
+    if(handshake->stage == HANDSHAKE_AWAITING_HELLO) {
+        if(PHEADER(msg)->opcode != MRMP_OPCODE_HELLO) {
+            handshake_send_pkt(handshake, encode_error_pkt(MRMP_ERR_ILLEGAL_OPCODE));
+            close_handshake(handshake);
+            return;
+        } else if(PHELLO(msg)->version > MRMP_VERSION) {
+            if(verbose == TRUE)
+                printf("Recieved hello packet, version %d\n", PHELLO(msg)->version);
+            handshake_send_pkt(handshake, encode_error_pkt(MRMP_ERR_VERSION_MISMATCH));
+            close_handshake(handshake);
+            return;
+        }
+
+        //succesful hello performed, send an app layer acknowledgment carrying the features both sides support. the
+        //client answers it with JOIN right away, so the time until JOIN arrives doubles as a round trip time
+        //measurement for matchmaking. pipelining clients sent JOIN along with HELLO, it is parsed right after this.
+        handshake->features = PHELLO(msg)->features & SERVER_FEATURES;
+        handshake_send_pkt(handshake, encode_hello_ack_pkt(handshake->features));
+
+        //HELLO_ACK was queued with version 0 framing, everything after it uses the client's version.
+        handshake->connection->version = PHELLO(msg)->version;
+        QueryPerformanceCounter(&handshake->hello_ack_sent);
+        handshake->hello_at_us = now_us();
+        histogram_record(limbo_latency[LATENCY_ACCEPT_TO_HELLO], handshake->hello_at_us - handshake->accepted_at_us);
+        trace_complete(limbo_trace, "await_hello", 0, handshake->accepted_at_us);
+        handshake->stage = HANDSHAKE_AWAITING_JOIN;
+        timer_wheel_arm(limbo_timers, &handshake->deadline_timer, now + handshake_timeout_ms(handshake, HANDSHAKE_JOIN_TIMEOUT_MS));
+        return;
+    }
+
+    if(PHEADER(msg)->opcode == MRMP_OPCODE_SPECTATE) {
+        handshake_spectate(handshake, PSPECTATE(msg)->session_id);
+        return;
+    } else if(PHEADER(msg)->opcode != MRMP_OPCODE_JOIN) {
+        handshake_send_pkt(handshake, encode_error_pkt(MRMP_ERR_ILLEGAL_OPCODE));
+        close_handshake(handshake);
+        return;
+    }
+
+    LARGE_INTEGER frequency, join_received;
+    QueryPerformanceFrequency(&frequency);
+    QueryPerformanceCounter(&join_received);
+    timer_wheel_cancel(limbo_timers, &handshake->deadline_timer);
+    trace_complete(limbo_trace, "await_join", 0, handshake->hello_at_us);
+    uint64_t hello_to_join_us = (uint64_t)((join_received.QuadPart - handshake->hello_ack_sent.QuadPart) * 1000000 / frequency.QuadPart);
+    histogram_record(limbo_latency[LATENCY_HELLO_TO_JOIN], hello_to_join_us);
+
+    //refines the round trip measured at accept, every later timeout of the connection is derived from the estimate.
+    //a pipelined JOIN never waited for HELLO_ACK, so the TCP stack's own measurement is used instead. without one
+    //the player is matched by the accept time sample, or as if its round trip was 0 ms if there is none either.
+    uint32_t rtt_us = (uint32_t) hello_to_join_us;
+    int rtt_known = TRUE;
+    if(handshake->features & MRMP_FEATURE_PIPELINED) {
+        rtt_known = get_tcp_rtt_us(handshake->connection->socket, &rtt_us) == SUCCESS;
+        if(rtt_known == FALSE) rtt_us = handshake->connection->rtt.srtt_us;
+    }
+    if(rtt_known == TRUE) rtt_estimator_sample(&handshake->connection->rtt, rtt_us);
+
+    //HELLO_ACK is still queued when JOIN was pipelined, send it before the matchmaker takes over the connection.
+    connection_flush(handshake->connection);
+
+    player_t player = {
+        .connection = handshake->connection,
+        .rtt_ms = rtt_us / 1000,
+        .queued_at_ms = now,
+        .queued_at_us = now_us(),
+        .requested_at_ms = handshake->accepted_at_ms,
+        .reused = FALSE,
+        .features = handshake->features
     };
 
-    if(!exit_flag && join_msg->opcode != MRMP_OPCODE_JOIN) {
-        send_error_pkt(socket, MRMP_ERR_ILLEGAL_OPCODE);
-        fprintf(stderr, "sent illegal opcode error packet due to received opcode %d\n", join_msg->opcode);
-        shutdown(socket, SD_SEND);
-        exit_flag = TRUE;
+    if(verbose == TRUE)
+        printf("Queueing player with a %u ms round trip time\n", player.rtt_ms);
+
+    //successful join request, add them to the player queue. from here on the connection belongs to the matchmaker.
+    if(player_queue_push(player_queue, player) == ERROR) {
+        handshake_send_pkt(handshake, encode_error_pkt(MRMP_ERR_FULL_QUEUE));
+        close_handshake(handshake);
+        return;
     }
 
-    if(exit_flag == TRUE) {
-        closesocket(socket);
-        EnterCriticalSection(&server_state_critsec);
-        --active_connections;
-        LeaveCriticalSection(&server_state_critsec);
-        free(join_msg);
-        free(client_socket);
-        _endthreadex(0);
+    handshake->connection = NULL;
+    notify_matchmaker();
+}
+
+//hands the connection to the worker hosting the session it wants to watch, the worker attaches it on its next tick.
+void handshake_spectate(handshake_t* handshake, mrmp_session_id_t session_id) {
+    spectate_request_t* request = malloc(sizeof(spectate_request_t));
+    if(request == NULL) {
+        handshake_send_pkt(handshake, encode_error_pkt(MRMP_ERR_UNKNOWN));
+        close_handshake(handshake);
+        return;
     }
 
-    free(join_msg);
+    scheduler_worker_t* worker = find_watchable(&session_id);
+    if(worker == NULL) {
+        free(request);
+        handshake_send_pkt(handshake, encode_error_pkt(MRMP_ERR_NO_SESSION));
+        close_handshake(handshake);
+        return;
+    }
 
-    //successful join request, add them to the player queue and end this thread.
-    EnterCriticalSection(&player_queue_critsec);
-    player_queue_push(player_queue, socket);
-    LeaveCriticalSection(&player_queue_critsec);
+    if(verbose == TRUE)
+        printf("Sending a spectator to session %u\n", session_id);
 
-    free(client_socket);
-    _endthreadex(0);
-    return 0;
+    timer_wheel_cancel(limbo_timers, &handshake->deadline_timer);
+    request->connection = handshake->connection;
+    request->session_id = session_id;
+    handshake->connection = NULL;
+
+    EnterCriticalSection(&worker->inbox_critsec);
+    request->next = worker->spectate_inbox;
+    worker->spectate_inbox = request;
+    LeaveCriticalSection(&worker->inbox_critsec);
+    SetEvent(worker->wake_event);
 }
 
-//TODO: more error handling on send functions.
-unsigned __stdcall do_session(void* session_state) {
-    session_t* session = (session_t*) session_state;
-    int stop_session = FALSE;
-
-    //generate a maze for the session. 
-    maze_size_t rows = 10;
-    maze_size_t columns = 20; 
-    maze_t* maze = generate_maze(rows, columns);
-    maze_size_t winning_row = rows - 1;
-    maze_size_t winning_column = columns - 1;
-
-    //respond to both connected clients previously sent JOIN packets.
-    send_join_resp_pkt(session->player_one, maze);
-    send_join_resp_pkt(session->player_two, maze);
-
-    //wait for ready packets.
-    char* msg = NULL;
-    int p1_receive_result = receive_mrmp_msg(session->player_one, &msg, &DEFAULT_TIMEOUT);
-    if(p1_receive_result != SUCCESS) {
-        if(p1_receive_result == TIMEDOUT) send_timeout_pkt(session->player_one);
-        free(msg);
-        cleanup_bad_session(session, maze, session->player_two, MRMP_ERR_UNKNOWN);
-    }
-
-    free(msg);
-
-    int p2_receive_result = receive_mrmp_msg(session->player_two, &msg, &DEFAULT_TIMEOUT);
-    if(p2_receive_result != SUCCESS) {
-        if(p2_receive_result == TIMEDOUT) send_timeout_pkt(session->player_two);
-        free(msg);
-        cleanup_bad_session(session, maze, session->player_one, MRMP_ERR_UNKNOWN);
-    }
-
-    free(msg);
-
-    //at this point, both clients have verified they are ready to start the race, so send a start packet to both.
-    //I assume that there won't be too much delay between sequential sends.
-    //TODO: would randomized send order make it slightly more fair?
-    send_start_pkt(session->player_one);
-    send_start_pkt(session->player_two);
-
-    //start the session loop, wait for move or leave messages, any other message is considered illegal at this point in time.
-    while(stop_session != TRUE) {
-        fd_set read_fds;
-        FD_ZERO(&read_fds);
-        FD_SET(session->player_one, &read_fds);
-        FD_SET(session->player_two, &read_fds);
-
-        // Wait for socket to become readable.
-        int select_result = select(0, &read_fds, NULL, NULL, &ACTIVITY_TIMEOUT);
-        if(select_result == 0) {
-            send_timeout_pkt(session->player_one);
-            send_timeout_pkt(session->player_two);
-            fprintf(stderr, "a session is timing out due to player inactivity\n.");
-            stop_session = TRUE;
-        } else if(select_result == SOCKET_ERROR) {
-            fprintf(stderr, "a session is timing out due to a socket connection error.\n.");
-            stop_session = TRUE;
-        } else {
-            for(u_int i = 0; i < read_fds.fd_count; ++i) {
-                if(stop_session == TRUE) {
+//makes a session spectatable once its worker started it.
+void register_watchable(session_t* session) {
+    EnterCriticalSection(&watchable_critsec);
+    watchable_sessions[watchable_count].id = session->id;
+    watchable_sessions[watchable_count].worker = session->worker;
+    ++watchable_count;
+    LeaveCriticalSection(&watchable_critsec);
+}
+
+void unregister_watchable(session_t* session) {
+    EnterCriticalSection(&watchable_critsec);
+    for(int i = 0; i < watchable_count; ++i) {
+        if(watchable_sessions[i].id != session->id) continue;
+        memmove(&watchable_sessions[i], &watchable_sessions[i + 1], (watchable_count - 1 - i) * sizeof(watchable_session_t));
+        --watchable_count;
+        break;
+    }
+    LeaveCriticalSection(&watchable_critsec);
+}
+
+//returns the worker hosting the session, or NULL if it isn't running. a session id of 0 is replaced with the id of
+//the session that started most recently.
+scheduler_worker_t* find_watchable(mrmp_session_id_t* session_id) {
+    scheduler_worker_t* worker = NULL;
+    EnterCriticalSection(&watchable_critsec);
+    for(int i = watchable_count - 1; i >= 0; --i) {
+        if(*session_id != 0 && watchable_sessions[i].id != *session_id) continue;
+        *session_id = watchable_sessions[i].id;
+        worker = watchable_sessions[i].worker;
+        break;
+    }
+    LeaveCriticalSection(&watchable_critsec);
+    return worker;
+}
+
+//called by the limbo thread's timer wheel for a connection that missed its stage deadline. every handshake timing
+//out in the same tick shares a single encoded TIMEOUT frame.
+void handshake_timed_out(timer_wheel_timer_t* timer, void* timeout_pkt) {
+    handshake_t* handshake = (handshake_t*) timer->data;
+    if(timeout_pkt != NULL) connection_queue(handshake->connection, (mrmp_shared_buffer_t*) timeout_pkt);
+    close_handshake(handshake);
+    metrics_add(limbo_metrics, METRIC_HANDSHAKE_TIMEOUTS, 1);
+    trace_instant(limbo_trace, "handshake_timeout", 0);
+
+    if(verbose == TRUE)
+        printf("A handshake timed out\n");
+}
+
+//services every connection that is still handshaking from this one thread. each stage has an absolute deadline,
+//so a client trickling in bytes can't hold on to its slot past it.
+unsigned __stdcall client_limbo(void* data) {
+    int max_handshakes = MAX_CLIENT_CONNECTIONS + MAX_SPECTATORS;
+    handshake_t** handshakes = malloc(max_handshakes * sizeof(handshake_t*));
+    WSAPOLLFD* poll_fds = malloc(max_handshakes * sizeof(WSAPOLLFD));
+    mrmp_shared_buffer_t* timeout_pkt = encode_empty_pkt(MRMP_OPCODE_TIMEOUT);
+    limbo_timers = timer_wheel_init(GetTickCount64(), SCHEDULER_TICK_MS);
+    mrmp_pkt_pool_use(limbo_pkt_pool);
+
+    if(handshakes == NULL || poll_fds == NULL || timeout_pkt == NULL || limbo_timers == NULL) {
+        //no connection could ever be served, take the whole server down.
+        fprintf(stderr, "failed to initialize the client limbo thread.\n");
+        quit = TRUE;
+        SetEvent(quit_event);
+    }
+
+    HANDLE wait_events[2] = { quit_event, limbo_wake_event };
+    int handshake_count = 0;
+
+    while(quit != TRUE) {
+        //nothing to do, sleep until a connection is accepted.
+        if(handshake_count == 0 && limbo_inbox == NULL) {
+            WaitForMultipleObjects(2, wait_events, FALSE, INFINITE);
+            continue;
+        }
+
+        //pick up newly accepted connections and start the clock on their HELLO.
+        EnterCriticalSection(&limbo_inbox_critsec);
+        handshake_t* accepted = limbo_inbox;
+        limbo_inbox = NULL;
+        LeaveCriticalSection(&limbo_inbox_critsec);
+
+        ULONGLONG now = GetTickCount64();
+        while(accepted != NULL) {
+            handshake_t* next = accepted->next;
+            if(handshake_count == max_handshakes) {
+                handshake_send_pkt(accepted, encode_error_pkt(MRMP_ERR_FULL_QUEUE));
+                close_handshake(accepted);
+                free(accepted);
+            } else {
+                timer_wheel_arm(limbo_timers, &accepted->deadline_timer, now + handshake_timeout_ms(accepted, HANDSHAKE_HELLO_TIMEOUT_MS));
+                handshakes[handshake_count++] = accepted;
+            }
+            accepted = next;
+        }
+
+        //wait up to a tick for any of them to send something.
+        for(int i = 0; i < handshake_count; ++i) {
+            poll_fds[i].fd = handshakes[i]->connection->socket;
+            poll_fds[i].events = POLLRDNORM;
+            poll_fds[i].revents = 0;
+        }
+
+        int ready_count = handshake_count == 0 ? 0 : WSAPoll(poll_fds, handshake_count, SCHEDULER_TICK_MS);
+        if(ready_count == SOCKET_ERROR) {
+            fprintf(stderr, "WSAPoll failed with error: %d\n", WSAGetLastError());
+            ready_count = 0;
+        }
+
+        now = GetTickCount64();
+        for(int i = 0; i < handshake_count && ready_count > 0; ++i) {
+            if(poll_fds[i].revents == 0) continue;
+            --ready_count;
+
+            handshake_t* handshake = handshakes[i];
+            if(connection_fill(handshake->connection) != SUCCESS) {
+                close_handshake(handshake);
+                continue;
+            }
+
+            while(handshake->connection != NULL) {
+                char* msg = NULL;
+                int parse_result = connection_next_msg(handshake->connection, &msg);
+                if(parse_result == TIMEDOUT) break;
+                if(parse_result == ERROR) {
+                    handshake_send_pkt(handshake, encode_error_pkt(MRMP_ERR_ILLEGAL_OPCODE));
+                    close_handshake(handshake);
                     break;
                 }
 
-                SOCKET socket = read_fds.fd_array[i];
-                maze_size_t* row_ptr = NULL;
-                maze_size_t* column_ptr = NULL;
+                handshake_handle_msg(handshake, msg, now);
+                mrmp_pkt_free(msg);
+            }
+        }
 
-                if(socket == session->player_one) {
-                    row_ptr = &session->player_one_row;
-                    column_ptr = &session->player_one_column; 
-                } else if(socket == session->player_two) {
-                    row_ptr = &session->player_two_row;
-                    column_ptr = &session->player_two_column; 
-                }
+        timer_wheel_advance(limbo_timers, now, handshake_timed_out, timeout_pkt);
 
-                if(FD_ISSET(socket, &read_fds)) {
-                    //read in message and interpret.
-                    int receive_result = receive_mrmp_msg(socket, &msg, NULL);
-                    if(receive_result != SUCCESS && receive_result != TIMEDOUT) {
-                        stop_session = TRUE;
-                    }
-                    if(msg != NULL) {
-                        switch(PHEADER(msg)->opcode) {
-                            case MRMP_OPCODE_MOVE:
-                                if(maze_is_move_valid(maze, *row_ptr, *column_ptr, PMOVE(msg)->row, PMOVE(msg)->column) == FALSE) {
-                                    send_bad_move_pkt(socket, *row_ptr, *column_ptr);
-                                    fprintf(stderr, "sent bad move packet.\n");
-                                    free(msg);
-                                    msg = NULL;
-                                    continue;
-                                }
-                
-                                //move was valid, update session state to reflect successful move, then notify other player socket to update
-                                //their perspective of the current player socket's position in the maze.
-                                *row_ptr = PMOVE(msg)->row;
-                                *column_ptr = PMOVE(msg)->column;
-
-                                send_opponent_move_pkt(socket_complement(socket, session), *row_ptr, *column_ptr);
-
-                                if(*row_ptr == winning_row && *column_ptr == winning_column) {
-                                    send_result_pkt(socket, 1);
-                                    send_result_pkt(socket_complement(socket, session), 0);
-                                    Sleep(200);
-                                    stop_session = TRUE;
-                                    break;
-                                }
-                                break;
-                            case MRMP_OPCODE_LEAVE:
-                                //notify other socket of current sockets desire to leave, give an unknown error due to unknown leave reason.
-                                send_error_pkt(socket_complement(socket, session), MRMP_ERR_UNKNOWN);
-                                stop_session = TRUE;
-                                break;
-                            default:
-                                //illegal opcode received.
-                                send_error_pkt(socket, MRMP_ERR_ILLEGAL_OPCODE);
-                                stop_session = TRUE;
-                                break;
-                        };
-
-                        free(msg);
-                        msg = NULL;
-                    }
-                }
+        //send what was queued this round and forget the handshakes that are done, one way or another.
+        int kept = 0;
+        for(int i = 0; i < handshake_count; ++i) {
+            handshake_t* handshake = handshakes[i];
+            if(handshake->connection != NULL && connection_flush(handshake->connection) == SOCKET_ERROR) {
+                close_handshake(handshake);
             }
+
+            if(handshake->connection == NULL) free(handshake);
+            else handshakes[kept++] = handshake;
         }
+        handshake_count = kept;
     }
 
-    //TODO: wait for another JOIN packet if the client wants to play again.
-    shutdown(session->player_one, SD_SEND);
-    closesocket(session->player_one);
-    EnterCriticalSection(&server_state_critsec);
-    --active_connections;
-    LeaveCriticalSection(&server_state_critsec);
-
-    shutdown(session->player_two, SD_SEND);
-    EnterCriticalSection(&server_state_critsec);
-    --active_connections;
-    LeaveCriticalSection(&server_state_critsec);
-    closesocket(session->player_two);
+    //the server is shutting down, close every connection still handshaking.
+    EnterCriticalSection(&limbo_inbox_critsec);
+    handshake_t* accepted = limbo_inbox;
+    limbo_inbox = NULL;
+    LeaveCriticalSection(&limbo_inbox_critsec);
+    while(accepted != NULL) {
+        handshake_t* next = accepted->next;
+        close_handshake(accepted);
+        free(accepted);
+        accepted = next;
+    }
 
-    EnterCriticalSection(&server_state_critsec);
-    --active_sessions;
-    LeaveCriticalSection(&server_state_critsec);
+    for(int i = 0; i < handshake_count; ++i) {
+        close_handshake(handshakes[i]);
+        free(handshakes[i]);
+    }
 
-    free(msg);
-    free(session);
-    free_maze(maze);
+    if(timeout_pkt != NULL) mrmp_shared_buffer_release(timeout_pkt);
+    if(limbo_timers != NULL) timer_wheel_free(limbo_timers);
+    free(handshakes);
+    free(poll_fds);
+    mrmp_pkt_pool_use(NULL);
 
     _endthreadex(0);
     return 0;
 }
 
-unsigned __stdcall create_sessions(void* data) {
-    //TODO: look into windows condition variables to conditionally enter critical sections here.
-    while(quit != TRUE) {
-        EnterCriticalSection(&player_queue_critsec);
-        //check if there is at least 2 players waiting in queue.
-        //TODO: does reading active_sessions need to be locked?
-        while(player_queue_size(player_queue) >= 2 && active_sessions < MAX_SESSION_THREADS) {
-            SOCKET player_one_sock = *player_queue_front(player_queue);
-            player_queue_pop(player_queue);
-            SOCKET player_two_sock = *player_queue_front(player_queue);
-            player_queue_pop(player_queue);
+int session_remaining_players(session_t* session) {
+    int remaining = 0;
+    for(int i = 0; i < session->player_count; ++i) {
+        if(session->players[i].connection != NULL) ++remaining;
+    }
+    return remaining;
+}
 
-            //initialize the session's state. ownership of this pointer is passed onto the session thread that will be made.
-            session_t* session = malloc(sizeof(session_t));
-            session->player_one = player_one_sock;
-            session->player_two = player_two_sock;
-            session->player_one_row = session->player_one_column = session->player_two_row = session->player_two_column = 0;
-
-            //find next available cell to store the upcoming thread handle.
-            int next_session_idx = -1;
-            EnterCriticalSection(&server_state_critsec);
-            for(int i = 0; i < MAX_SESSION_THREADS; ++i) {
-                if(session_thread_tracker[i] == NULL) {
-                    next_session_idx = i;
-                } else {
-                    if(WaitForSingleObject(session_thread_tracker[i], 0) == WAIT_OBJECT_0) {
-                        CloseHandle(session_thread_tracker[i]);
-                        next_session_idx = i;
-                        break;
-                    }
-                }
-            }
-            LeaveCriticalSection(&server_state_critsec);
+int session_all_ready(session_t* session) {
+    for(int i = 0; i < session->player_count; ++i) {
+        if(session->players[i].connection != NULL && session->players[i].ready == FALSE) return FALSE;
+    }
+    return TRUE;
+}
 
-            if(next_session_idx == -1) {
-                fprintf(stderr, "failed to startup a session thread, session threads at user defined capacity.\n");
-                free(session);
-                
-                //push sockets back into player queue.
-                player_queue_push(player_queue, player_one_sock);
-                player_queue_push(player_queue, player_two_sock);
+//queues a frame for one player. a player that fell this far behind isn't reading, so they are dropped instead
+//of holding up every other session on the worker.
+void session_send(session_t* session, int player, mrmp_shared_buffer_t* buffer) {
+    connection_t* connection = session->players[player].connection;
+    if(connection == NULL) return;
 
-                continue;
-            }
+    if(connection_queue(connection, buffer) == ERROR) {
+        fprintf(stderr, "dropping a player whose output queue is full.\n");
+        drop_session_player(session, player);
+    }
+}
+
+void session_send_pkt(session_t* session, int player, mrmp_shared_buffer_t* buffer) {
+    if(buffer == NULL) return;
+    session_send(session, player, buffer);
+    mrmp_shared_buffer_release(buffer);
+}
+
+//sends an already encoded frame to every player still in the session except one, pass -1 to send to everyone.
+void session_broadcast(session_t* session, int except_player, mrmp_shared_buffer_t* buffer) {
+    for(int i = 0; i < session->player_count; ++i) {
+        if(i == except_player) continue;
+        session_send(session, i, buffer);
+    }
+}
+
+//pushes out whatever is still queued for the player without blocking, then closes their connection.
+void drop_session_player(session_t* session, int player) {
+    connection_t* connection = session->players[player].connection;
+    if(connection == NULL) return;
+
+    metrics_add(connection->metrics, METRIC_CONNECTIONS_ACTIVE, -1);
+    connection_flush(connection);
+    connection_free(connection);
+    session->players[player].connection = NULL;
+    session_release_udp(session, player);
+    if(session->replay != NULL) replay_record_leave(session->replay, (uint32_t)(GetTickCount64() - session->race_started_ms), player);
+}
+
+//starts sending the session's frames to a new spectator: the current maze right away, then the latest snapshot.
+int session_add_spectator(session_t* session, connection_t* connection) {
+    if(session->spectator_count == session->spectator_capacity) {
+        int capacity = session->spectator_capacity == 0 ? 16 : session->spectator_capacity * 2;
+        if(capacity > MAX_SPECTATORS) capacity = MAX_SPECTATORS;
+        if(capacity == session->spectator_capacity) return ERROR;
+
+        spectator_t* spectators = realloc(session->spectators, capacity * sizeof(spectator_t));
+        if(spectators == NULL) return ERROR;
+        session->spectators = spectators;
+        session->spectator_capacity = capacity;
+    }
+
+    if(session->maze_frame != NULL && connection_queue(connection, session->maze_frame) == ERROR) return ERROR;
 
-            //spin up a thread to host the session for the 2 sockets.
-            HANDLE session_thread = (HANDLE)_beginthreadex(NULL, 0, do_session, (void*) session, 0, NULL);
-            if(session_thread == NULL) {
-                fprintf(stderr, "failed to startup a session thread\n");
-                free(session);
-                
-                //push sockets back into player queue.
-                player_queue_push(player_queue, player_one_sock);
-                player_queue_push(player_queue, player_two_sock);
+    session->spectators[session->spectator_count].connection = connection;
+    session->spectators[session->spectator_count].stale = TRUE;
+    ++session->spectator_count;
+    ++session->worker->spectator_count;
 
+    metrics_add(session->worker->metrics, METRIC_SPECTATORS_ACTIVE, 1);
+    metrics_add(session->worker->metrics, METRIC_SPECTATORS_TOTAL, 1);
+    return SUCCESS;
+}
+
+//queues a frame every spectator has to see, like START or RESULT. spectators behind on positions get the latest
+//snapshot first, so the frame never arrives ahead of the positions that led to it.
+void session_send_spectators(session_t* session, mrmp_shared_buffer_t* buffer) {
+    for(int i = 0; i < session->spectator_count; ++i) {
+        spectator_t* spectator = &session->spectators[i];
+        if(spectator->connection == NULL) continue;
+
+        if(spectator->stale == TRUE && session->spectator_snapshot != NULL) {
+            if(connection_queue(spectator->connection, session->spectator_snapshot) == ERROR) {
+                drop_spectator(session, i);
                 continue;
             }
+            spectator->stale = FALSE;
+            ++session->worker->spectator_frames;
+        }
 
-            session_thread_tracker[next_session_idx] = session_thread;
+        if(connection_queue(spectator->connection, buffer) == ERROR) drop_spectator(session, i);
+    }
+}
+
+void session_send_spectators_pkt(session_t* session, mrmp_shared_buffer_t* buffer) {
+    if(buffer == NULL) return;
+    session_send_spectators(session, buffer);
+    mrmp_shared_buffer_release(buffer);
+}
+
+//encodes every player's position once into the snapshot all spectators share, replacing the previous one.
+void session_snapshot_spectators(session_t* session, ULONGLONG now) {
+    mrmp_dgram_entry_t entries[MRMP_DGRAM_MAX_ENTRIES];
+    uint8_t count = 0;
+    for(int i = 0; i < session->player_count && count < MRMP_DGRAM_MAX_ENTRIES; ++i) {
+        if(session->players[i].connection == NULL) continue;
+        entries[count].player = (mrmp_player_t) i;
+        entries[count].row = session->players[i].row;
+        entries[count].column = session->players[i].column;
+        ++count;
+    }
+
+    mrmp_shared_buffer_t* snapshot = encode_positions_pkt(entries, count);
+    if(snapshot == NULL) return;
+
+    if(session->spectator_snapshot != NULL) mrmp_shared_buffer_release(session->spectator_snapshot);
+    session->spectator_snapshot = snapshot;
+    session->spectators_dirty = FALSE;
+    session->last_spectator_snapshot_ms = now;
+    ++session->worker->spectator_snapshots;
 
-            EnterCriticalSection(&server_state_critsec);
-            ++active_sessions;
-            ++total_sessions;
-            LeaveCriticalSection(&server_state_critsec);
+    for(int i = 0; i < session->spectator_count; ++i) {
+        if(session->spectators[i].stale == TRUE) ++session->worker->spectator_skips;
+        session->spectators[i].stale = TRUE;
+    }
+}
+
+//sends spectators the latest snapshot and whatever else is queued for them. a spectator with frames still waiting
+//in its queue is skipped, it is sent whichever snapshot is newest once it catches up.
+void session_flush_spectators(session_t* session, ULONGLONG now) {
+    if(session->spectator_count == 0) return;
+
+    if(session->spectators_dirty == TRUE && now - session->last_spectator_snapshot_ms >= SPECTATOR_SNAPSHOT_MS)
+        session_snapshot_spectators(session, now);
+
+    int kept = 0;
+    for(int i = 0; i < session->spectator_count; ++i) {
+        spectator_t* spectator = &session->spectators[i];
+        if(spectator->connection != NULL && spectator->stale == TRUE && session->spectator_snapshot != NULL &&
+           spectator->connection->output_count < SPECTATOR_MAX_BACKLOG) {
+            if(connection_queue(spectator->connection, session->spectator_snapshot) == ERROR) {
+                drop_spectator(session, i);
+            } else {
+                spectator->stale = FALSE;
+                ++session->worker->spectator_frames;
+            }
+        }
+
+        if(spectator->connection != NULL && connection_has_output(spectator->connection) == TRUE &&
+           connection_flush(spectator->connection) == SOCKET_ERROR) {
+            drop_spectator(session, i);
         }
 
-        LeaveCriticalSection(&player_queue_critsec);
+        if(spectator->connection != NULL) session->spectators[kept++] = *spectator;
+    }
+    session->spectator_count = kept;
+}
+
+//closes the spectator's connection, the list is compacted by the next flush.
+void drop_spectator(session_t* session, int spectator) {
+    if(session->spectators[spectator].connection == NULL) return;
+
+    close_spectator_connection(session->spectators[spectator].connection);
+    session->spectators[spectator].connection = NULL;
+    --session->worker->spectator_count;
+    metrics_add(session->worker->metrics, METRIC_SPECTATORS_ACTIVE, -1);
+}
+
+//pushes out whatever is still queued without blocking, then closes the connection.
+void close_spectator_connection(connection_t* connection) {
+    metrics_add(connection->metrics, METRIC_CONNECTIONS_ACTIVE, -1);
+    connection_flush(connection);
+    connection_free(connection);
+}
+
+uint64_t now_us(void) {
+    LARGE_INTEGER counter;
+    QueryPerformanceCounter(&counter);
+    return (uint64_t)(counter.QuadPart / performance_frequency.QuadPart) * 1000000 +
+        (uint64_t)(counter.QuadPart % performance_frequency.QuadPart) * 1000000 / performance_frequency.QuadPart;
+}
+
+int latency_shard_init(histogram_t** shard) {
+    int result = SUCCESS;
+    for(int i = 0; i < LATENCY_STAGE_COUNT; ++i) {
+        shard[i] = histogram_init();
+        if(shard[i] == NULL) result = ERROR;
+    }
+    return result;
+}
+
+void latency_shard_free(histogram_t** shard) {
+    for(int i = 0; i < LATENCY_STAGE_COUNT; ++i) {
+        if(shard[i] != NULL) histogram_free(shard[i]);
+        shard[i] = NULL;
+    }
+}
+
+//merges every thread's shard into a new set of histograms, to be freed with latency_shard_free(). shards are read
+//while they are being written, so a snapshot may miss the samples recorded during it.
+int latency_snapshot(histogram_t** merged) {
+    if(latency_shard_init(merged) == ERROR) {
+        latency_shard_free(merged);
+        return ERROR;
+    }
+
+    for(int i = 0; i < LATENCY_STAGE_COUNT; ++i) {
+        histogram_merge(merged[i], limbo_latency[i]);
+        histogram_merge(merged[i], matchmaker_latency[i]);
+        for(int j = 0; j < scheduler_worker_count; ++j) {
+            histogram_merge(merged[i], scheduler_workers[j]->latency[i]);
+        }
+    }
+    return SUCCESS;
+}
+
+//one JSON object per line, so the output can be scraped from the server's stdout.
+void print_latency_json(histogram_t** merged) {
+    printf("{\"unit\":\"us\",\"stages\":{");
+    for(int i = 0; i < LATENCY_STAGE_COUNT; ++i) {
+        printf("%s\"%s\":{\"count\":%llu,\"p50\":%llu,\"p90\":%llu,\"p99\":%llu,\"p999\":%llu,\"max\":%llu}",
+            i == 0 ? "" : ",", LATENCY_STAGE_NAMES[i],
+            (unsigned long long) histogram_count(merged[i]),
+            (unsigned long long) histogram_percentile(merged[i], 50.0),
+            (unsigned long long) histogram_percentile(merged[i], 90.0),
+            (unsigned long long) histogram_percentile(merged[i], 99.0),
+            (unsigned long long) histogram_percentile(merged[i], 99.9),
+            (unsigned long long) merged[i]->max);
+    }
+    printf("}}\n");
+}
+
+//the lifecycle latencies as a Prometheus summary, returns the length written or -1 if it didn't fit.
+int format_latency_prometheus(char* buffer, size_t size) {
+    histogram_t* merged[LATENCY_STAGE_COUNT];
+    if(latency_snapshot(merged) == ERROR) return -1;
+
+    static const double quantiles[4] = { 0.5, 0.9, 0.99, 0.999 };
+    int length = snprintf(buffer, size,
+        "# HELP mrmp_latency_microseconds Latency of each stage of a player's lifecycle, accurate to about 6%%.\n"
+        "# TYPE mrmp_latency_microseconds summary\n");
+    for(int i = 0; i < LATENCY_STAGE_COUNT && length >= 0 && (size_t) length < size; ++i) {
+        for(int j = 0; j < 4 && length >= 0 && (size_t) length < size; ++j) {
+            length += snprintf(buffer + length, size - length, "mrmp_latency_microseconds{stage=\"%s\",quantile=\"%g\"} %llu\n",
+                LATENCY_STAGE_NAMES[i], quantiles[j], (unsigned long long) histogram_percentile(merged[i], quantiles[j] * 100.0));
+        }
+        //the histograms don't keep a sum, so only the count is exported alongside the quantiles.
+        if(length >= 0 && (size_t) length < size) {
+            length += snprintf(buffer + length, size - length, "mrmp_latency_microseconds_count{stage=\"%s\"} %llu\n",
+                LATENCY_STAGE_NAMES[i], (unsigned long long) histogram_count(merged[i]));
+        }
+    }
+    latency_shard_free(merged);
+
+    if(length < 0 || (size_t) length >= size) return -1;
+    return length;
+}
+
+uint64_t unix_time_ms(void) {
+    FILETIME file_time;
+    GetSystemTimeAsFileTime(&file_time);
+    uint64_t intervals = ((uint64_t) file_time.dwHighDateTime << 32) | file_time.dwLowDateTime;
+    return (intervals - 116444736000000000ULL) / 10000; //100 ns intervals since 1601.
+}
+
+//starts recording the race that was just started, if races are recorded.
+void session_start_replay(session_t* session, ULONGLONG now) {
+    session->race_started_ms = now;
+    if(replay_directory == NULL) return;
+
+    session->replay = replay_recorder_init(session->maze, session->player_count, session->id, session->races - 1, unix_time_ms());
+}
+
+//hands the finished replay to the writer thread, or drops it if the writer is too far behind to take it.
+void session_finish_replay(session_t* session, uint8_t outcome, int winner, ULONGLONG now) {
+    if(session->replay == NULL) return;
+
+    uint64_t started_at_ms = unix_time_ms() - (now - session->race_started_ms);
+    size_t length = 0;
+    uint8_t* data = replay_recorder_finish(session->replay, outcome, winner == -1 ? REPLAY_NO_WINNER : (uint8_t) winner, (uint32_t)(now - session->race_started_ms), &length);
+    session->replay = NULL;
+
+    scheduler_worker_t* worker = session->worker;
+    replay_file_t* file = data == NULL ? NULL : malloc(sizeof(replay_file_t));
+    if(file == NULL || InterlockedExchangeAdd(&replay_pending_bytes, (LONG) length) + (LONG) length > REPLAY_MAX_PENDING_BYTES) {
+        if(file != NULL) InterlockedExchangeAdd(&replay_pending_bytes, -(LONG) length);
+        free(file);
+        free(data);
+        ++worker->replays_dropped;
+        return;
+    }
+
+    file->data = data;
+    file->length = length;
+    file->session_id = session->id;
+    file->race = session->races - 1;
+    file->started_at_ms = started_at_ms;
+
+    EnterCriticalSection(&worker->replay_critsec);
+    file->next = worker->replay_outbox;
+    worker->replay_outbox = file;
+    LeaveCriticalSection(&worker->replay_critsec);
+    ++worker->replays_recorded;
+}
+
+//saves every replay the workers finished since the last call, oldest first, one file per race.
+void write_replays(void) {
+    for(int i = 0; i < scheduler_worker_count; ++i) {
+        scheduler_worker_t* worker = scheduler_workers[i];
+        EnterCriticalSection(&worker->replay_critsec);
+        replay_file_t* newest = worker->replay_outbox;
+        worker->replay_outbox = NULL;
+        LeaveCriticalSection(&worker->replay_critsec);
+
+        replay_file_t* oldest = NULL;
+        while(newest != NULL) {
+            replay_file_t* next = newest->next;
+            newest->next = oldest;
+            oldest = newest;
+            newest = next;
+        }
+
+        while(oldest != NULL) {
+            replay_file_t* next = oldest->next;
+            char path[MAX_PATH];
+            snprintf(path, sizeof(path), "%s\\%llu-%u-%u" REPLAY_FILE_EXTENSION, replay_directory,
+                (unsigned long long) oldest->started_at_ms, oldest->session_id, oldest->race);
+
+            FILE* file = fopen(path, "wb");
+            if(file == NULL || fwrite(oldest->data, 1, oldest->length, file) != oldest->length) {
+                fprintf(stderr, "failed to save replay %s\n", path);
+                ++replay_write_errors;
+            } else {
+                ++replays_written;
+            }
+            if(file != NULL) fclose(file);
+
+            InterlockedExchangeAdd(&replay_pending_bytes, -(LONG) oldest->length);
+            free(oldest->data);
+            free(oldest);
+            oldest = next;
+        }
+    }
+}
+
+//saves finished replays in the background every REPLAY_FLUSH_MS until the server quits.
+unsigned __stdcall replay_writer(void* data) {
+    while(quit != TRUE) {
+        WaitForSingleObject(quit_event, REPLAY_FLUSH_MS);
+        write_replays();
+    }
+
+    _endthreadex(0);
+    return 0;
+}
+
+//writes every event the threads still hold into a new file in the working directory, named after the current time.
+void save_trace(void) {
+    char path[64];
+    snprintf(path, sizeof(path), "trace-%llu.json", (unsigned long long) unix_time_ms());
+
+    FILE* file = fopen(path, "w");
+    if(file == NULL) {
+        perror("failed to open trace file");
+        return;
+    }
+
+    long long events = trace_write_chrome(trace, file);
+    if(fclose(file) != 0 || events < 0) {
+        fprintf(stderr, "failed to save trace to %s\n", path);
+        return;
+    }
+    printf("Saved %lld events to %s, open it in chrome://tracing or ui.perfetto.dev.\n", events, path);
+}
+
+//answers a single HTTP request, only GET /metrics is served. the response buffer is reused across requests.
+void serve_metrics_request(SOCKET socket, char* response) {
+    char request[METRICS_REQUEST_SIZE];
+    int request_length = 0;
+
+    //scrapers send the whole request at once, wait for the end of its headers and ignore anything after them.
+    DWORD receive_timeout_ms = 1000;
+    setsockopt(socket, SOL_SOCKET, SO_RCVTIMEO, (const char*) &receive_timeout_ms, sizeof(receive_timeout_ms));
+    while(request_length < METRICS_REQUEST_SIZE - 1) {
+        int bytes_received = recv(socket, request + request_length, METRICS_REQUEST_SIZE - 1 - request_length, 0);
+        if(bytes_received <= 0) break;
+        request_length += bytes_received;
+        request[request_length] = '\0';
+        if(strstr(request, "\r\n\r\n") != NULL) break;
+    }
+    request[request_length] = '\0';
+
+    //leave room in front of the body for the headers, which need to know its length.
+    const int header_room = 256;
+    char* body = response + header_room;
+    int body_length = -1;
+    const char* status = "404 Not Found";
+    if(strncmp(request, "GET /metrics ", 13) == 0 || strncmp(request, "GET /metrics?", 13) == 0) {
+        int counters_length = metrics_format_prometheus(metrics, body, METRICS_RESPONSE_SIZE - header_room);
+        int latency_length = counters_length < 0 ? -1 : format_latency_prometheus(body + counters_length, METRICS_RESPONSE_SIZE - header_room - counters_length);
+        if(latency_length >= 0) {
+            body_length = counters_length + latency_length;
+            status = "200 OK";
+        } else {
+            status = "500 Internal Server Error";
+        }
+    }
+    if(body_length < 0) body_length = snprintf(body, METRICS_RESPONSE_SIZE - header_room, "%s\n", status);
+
+    char header[256];
+    int header_length = snprintf(header, sizeof(header),
+        "HTTP/1.0 %s\r\n"
+        "Content-Type: text/plain; version=0.0.4; charset=utf-8\r\n"
+        "Content-Length: %d\r\n"
+        "Connection: close\r\n\r\n", status, body_length);
+    memcpy(body - header_length, header, header_length);
+
+    send_buffer(socket, body - header_length, header_length + body_length);
+    shutdown(socket, SD_SEND);
+    closesocket(socket);
+}
+
+//serves the metrics over HTTP on the loopback interface only, one request at a time. scrapes are rare, so a
+//single blocking thread is plenty and none of the counting threads ever wait on it.
+unsigned __stdcall metrics_server(void* data) {
+    SOCKET http_socket = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+    char* response = malloc(METRICS_RESPONSE_SIZE);
+    if(http_socket == INVALID_SOCKET || response == NULL) {
+        fprintf(stderr, "failed to initialize the metrics server.\n");
+        if(http_socket != INVALID_SOCKET) closesocket(http_socket);
+        free(response);
+        _endthreadex(0);
+        return 0;
+    }
+
+    struct sockaddr_in address;
+    ZeroMemory(&address, sizeof(address));
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    address.sin_port = htons(metrics_port);
+
+    if(bind(http_socket, (struct sockaddr*) &address, sizeof(address)) == SOCKET_ERROR || listen(http_socket, SOMAXCONN) == SOCKET_ERROR) {
+        fprintf(stderr, "failed to serve metrics on port %u, error: %d\n", (unsigned) metrics_port, WSAGetLastError());
+        closesocket(http_socket);
+        free(response);
+        _endthreadex(0);
+        return 0;
+    }
+
+    while(quit != TRUE) {
+        WSAPOLLFD poll_fd = { .fd = http_socket, .events = POLLRDNORM, .revents = 0 };
+        int ready_count = WSAPoll(&poll_fd, 1, METRICS_POLL_MS);
+        if(ready_count == SOCKET_ERROR) {
+            fprintf(stderr, "WSAPoll failed with error: %d\n", WSAGetLastError());
+            break;
+        } else if(ready_count == 0) {
+            continue;
+        }
+
+        SOCKET client_socket = accept(http_socket, NULL, NULL);
+        if(client_socket == INVALID_SOCKET) continue;
+        serve_metrics_request(client_socket, response);
+    }
+
+    closesocket(http_socket);
+    free(response);
+    _endthreadex(0);
+    return 0;
+}
+
+void session_set_deadline(session_t* session, ULONGLONG deadline_ms) {
+    session->deadline_ms = deadline_ms;
+    timer_wheel_arm(session->worker->timers, &session->deadline_timer, deadline_ms);
+}
+
+//called by the worker's timer wheel, the session is processed later in the same tick.
+void session_deadline_passed(timer_wheel_timer_t* timer, void* context) {
+    session_t* session = (session_t*) timer->data;
+    session->needs_service = TRUE;
+}
+
+//the session lingers for a moment so its last frames reach the players before the connections are closed.
+void session_finish(session_t* session, ULONGLONG now) {
+    session->state = SESSION_FINISHED;
+    session_set_deadline(session, now + SESSION_LINGER_MS);
+}
+
+//keeps the connections open for a while after the result, so players can race again without reconnecting.
+void session_await_rematch(session_t* session, ULONGLONG now) {
+    session->state = SESSION_AWAITING_REMATCH;
+    for(int i = 0; i < session->player_count; ++i) {
+        session->players[i].wants_rematch = FALSE;
+    }
+    session_set_deadline(session, now + REMATCH_WINDOW_SECONDS * 1000);
+}
+
+int session_all_want_rematch(session_t* session) {
+    for(int i = 0; i < session->player_count; ++i) {
+        if(session->players[i].connection != NULL && session->players[i].wants_rematch == FALSE) return FALSE;
+    }
+    return TRUE;
+}
+
+//puts a player back into matchmaking on their open connection, skipping the reconnect and handshake. anything
+//still queued on the connection goes out with the next session that picks it up.
+void session_requeue_player(session_t* session, int player_index, ULONGLONG now) {
+    session_player_t* session_player = &session->players[player_index];
+    player_t player = {
+        .connection = session_player->connection,
+        .rtt_ms = session_player->rtt_ms,
+        .queued_at_ms = now,
+        .queued_at_us = now_us(),
+        .requested_at_ms = now,
+        .reused = TRUE,
+        .features = session_player->features
+    };
+
+    if(player_queue_push(player_queue, player) == ERROR) {
+        session_send_pkt(session, player_index, encode_error_pkt(MRMP_ERR_FULL_QUEUE));
+        drop_session_player(session, player_index);
+        return;
+    }
+
+    session_player->connection = NULL;
+    session_release_udp(session, player_index);
+    metrics_add(session->worker->metrics, METRIC_REQUEUES, 1);
+    notify_matchmaker();
+}
+
+//races everyone still in the session again on a fresh maze, as if they had just been matched together.
+void session_rematch(session_t* session, ULONGLONG now) {
+    int remaining = 0;
+    for(int i = 0; i < session->player_count; ++i) {
+        //compacting renumbers the players, so their endpoints are offered again with the new ids.
+        session_release_udp(session, i);
+
+        session_player_t player = session->players[i];
+        if(player.connection == NULL) continue;
+
+        player.row = player.column = 0;
+        player.run_count = 0;
+        player.ready = FALSE;
+        player.wants_rematch = FALSE;
+        player.reused = TRUE;
+        session->players[remaining++] = player;
+    }
+    session->player_count = remaining;
+
+    //the previous maze is the last thing the race allocated, rewinding gives it back.
+    arena_rewind(session->arena, session->race_mark);
+    session->maze = NULL;
+    metrics_add(session->worker->metrics, METRIC_REMATCHES, 1);
+
+    session_begin(session, now);
+}
+
+//drops the player that failed, pass -1 if there is none, and notifies everyone else before ending the session.
+void session_abort(session_t* session, int failed_player, mrmp_error_t notify_error, ULONGLONG now) {
+    if(failed_player != -1) drop_session_player(session, failed_player);
+    session_finish_replay(session, REPLAY_OUTCOME_ABORTED, -1, now);
+
+    mrmp_shared_buffer_t* error = encode_error_pkt(notify_error);
+    if(error != NULL) {
+        session_broadcast(session, -1, error);
+        session_send_spectators(session, error);
+        mrmp_shared_buffer_release(error);
+    }
+
+    session_finish(session, now);
+}
+
+//generates the session's maze and responds to every player's previously sent JOIN packet.
+void session_begin(session_t* session, ULONGLONG now) {
+    session->state = SESSION_WAITING_READY;
+    ++session->races;
+    session_set_deadline(session, now + session_ready_timeout_ms(session));
+    session_start_heartbeats(session, now);
+
+    //a rematch starts over, positions of the previous race are never sent to spectators again.
+    if(session->maze_frame != NULL) mrmp_shared_buffer_release(session->maze_frame);
+    if(session->spectator_snapshot != NULL) mrmp_shared_buffer_release(session->spectator_snapshot);
+    session->maze_frame = NULL;
+    session->spectator_snapshot = NULL;
+    for(int i = 0; i < session->spectator_count; ++i) {
+        session->spectators[i].stale = TRUE;
+    }
+
+    uint64_t generation_started_us = now_us();
+    trace_begin(session->worker->trace, "generate_maze", session->id);
+    session->maze = generate_maze_in(session->arena, SESSION_MAZE_ROWS, SESSION_MAZE_COLUMNS);
+    trace_end(session->worker->trace, "generate_maze", session->id);
+    histogram_record(session->worker->latency[LATENCY_MAZE_GENERATION], now_us() - generation_started_us);
+    trace_begin(session->worker->trace, "join_resp", session->id);
+    mrmp_shared_buffer_t* join_resp = session->maze == NULL ? NULL : encode_join_resp_pkt(session->maze);
+    if(join_resp == NULL) {
+        trace_end(session->worker->trace, "join_resp", session->id);
+        session_abort(session, -1, MRMP_ERR_UNKNOWN, now);
+        return;
+    }
+
+    //the maze is only encoded once for all players and spectators, and kept for spectators that join later.
+    session_broadcast(session, -1, join_resp);
+    session_send_spectators(session, join_resp);
+    trace_end(session->worker->trace, "join_resp", session->id);
+    session->maze_frame = join_resp;
+    session->spectators_dirty = TRUE;
+
+    //players that negotiated UDP learn where to send their moves, they keep using TCP until their first datagram.
+    session->positions_dirty = FALSE;
+    session->last_snapshot_ms = now;
+    for(int i = 0; i < session->player_count; ++i) {
+        if(session->players[i].features & MRMP_FEATURE_UDP) session_offer_udp(session, i);
+    }
+
+    //how long each player waited for their maze, reused connections skip the connect and handshake.
+    for(int i = 0; i < session->player_count; ++i) {
+        histogram_t* histogram = session->players[i].reused == TRUE ? session->worker->reused_maze_histogram : session->worker->fresh_maze_histogram;
+        histogram_record(histogram, now - session->players[i].requested_at_ms);
+    }
+}
+
+//JOIN_RESP to READY takes a round trip plus however long the client takes to draw the maze, the slowest player's
+//timeout decides for everyone.
+ULONGLONG session_ready_timeout_ms(session_t* session) {
+    uint32_t slowest_ms = RTO_MIN_MS;
+    for(int i = 0; i < session->player_count; ++i) {
+        if(session->players[i].connection == NULL) continue;
+        uint32_t timeout_ms = rtt_estimator_timeout_ms(&session->players[i].connection->rtt, RTO_MIN_MS, RTO_MAX_MS);
+        if(timeout_ms > slowest_ms) slowest_ms = timeout_ms;
+    }
+    return slowest_ms + READY_GRACE_MS;
+}
+
+//two round trips between pings keeps at most one PING in flight on a healthy connection.
+uint32_t heartbeat_interval_ms(connection_t* connection) {
+    uint32_t interval_ms = connection->rtt.srtt_us / 500;
+    if(interval_ms < HEARTBEAT_MIN_INTERVAL_MS) return HEARTBEAT_MIN_INTERVAL_MS;
+    if(interval_ms > HEARTBEAT_MAX_INTERVAL_MS) return HEARTBEAT_MAX_INTERVAL_MS;
+    return interval_ms;
+}
+
+//every race starts with a fresh PING to everyone that negotiated heartbeats, players have been quiet since JOIN.
+void session_start_heartbeats(session_t* session, ULONGLONG now) {
+    for(int i = 0; i < session->player_count; ++i) {
+        session_player_t* player = &session->players[i];
+        player->last_heard_ms = now;
+        player->next_ping_ms = now;
+        player->ping_outstanding = FALSE;
+    }
+    session->needs_service = TRUE;
+}
+
+//pings players that negotiated heartbeats and drops those that went silent for longer than a PING interval plus
+//LIVENESS_TIMEOUTS timeouts, then arms the session's heartbeat timer for whatever is due next.
+void session_heartbeat(session_t* session, ULONGLONG now) {
+    if(session->state == SESSION_FINISHED) {
+        timer_wheel_cancel(session->worker->timers, &session->heartbeat_timer);
+        return;
+    }
+
+    ULONGLONG next_due_ms = 0;
+    for(int i = 0; i < session->player_count; ++i) {
+        session_player_t* player = &session->players[i];
+        if(player->connection == NULL || (player->features & MRMP_FEATURE_HEARTBEAT) == 0) continue;
+
+        uint32_t interval_ms = heartbeat_interval_ms(player->connection);
+        ULONGLONG dead_at_ms = player->last_heard_ms + interval_ms +
+            (ULONGLONG) LIVENESS_TIMEOUTS * rtt_estimator_timeout_ms(&player->connection->rtt, RTO_MIN_MS, RTO_MAX_MS);
+        if(now >= dead_at_ms) {
+            if(verbose == TRUE)
+                printf("Dropping a player of session %u that stopped answering PING\n", session->id);
+            metrics_add(session->worker->metrics, METRIC_LIVENESS_TIMEOUTS, 1);
+            trace_instant(session->worker->trace, "liveness_timeout", session->id);
+            drop_session_player(session, i);
+            continue;
+        }
+
+        if(now >= player->next_ping_ms) {
+            player->ping_stamp = (uint32_t) now_us();
+            player->ping_outstanding = TRUE;
+            player->next_ping_ms = now + interval_ms;
+            session_send_pkt(session, i, encode_ping_pkt(MRMP_OPCODE_PING, player->ping_stamp));
+        }
+
+        if(next_due_ms == 0 || player->next_ping_ms < next_due_ms) next_due_ms = player->next_ping_ms;
+        if(dead_at_ms < next_due_ms) next_due_ms = dead_at_ms;
+    }
+
+    if(next_due_ms != 0) timer_wheel_arm(session->worker->timers, &session->heartbeat_timer, next_due_ms);
+    else timer_wheel_cancel(session->worker->timers, &session->heartbeat_timer);
+}
+
+//folds the round trip of the newest PING into the connection's estimate, late answers to older pings are ignored
+//since their round trip can't be told apart from the newest one's.
+void session_handle_pong(session_t* session, int player_index, uint32_t stamp, ULONGLONG now) {
+    session_player_t* player = &session->players[player_index];
+    if(player->ping_outstanding == FALSE || stamp != player->ping_stamp) return;
+
+    player->ping_outstanding = FALSE;
+    rtt_estimator_sample(&player->connection->rtt, (uint32_t) now_us() - stamp);
+}
+
+void session_handle_msg(session_t* session, int player_index, char* msg, ULONGLONG now) {
+    session_player_t* player = &session->players[player_index];
+    player->last_heard_ms = now;
+
+    //heartbeats are answered in every state, they never count as activity in the race.
+    if(PHEADER(msg)->opcode == MRMP_OPCODE_PONG) {
+        session_handle_pong(session, player_index, PPING(msg)->stamp, now);
+        return;
+    }
+
+    //nothing but READY is expected before the race, anything else fails the whole session.
+    if(session->state == SESSION_WAITING_READY) {
+        if(PHEADER(msg)->opcode == MRMP_OPCODE_READY) {
+            player->ready = TRUE;
+        } else {
+            if(PHEADER(msg)->opcode != MRMP_OPCODE_LEAVE)
+                session_send_pkt(session, player_index, encode_error_pkt(MRMP_ERR_ILLEGAL_OPCODE));
+            session_abort(session, player_index, MRMP_ERR_UNKNOWN, now);
+        }
+        return;
+    }
+
+    //after the race, players either go back into matchmaking or ask to race the same opponents again.
+    if(session->state == SESSION_AWAITING_REMATCH) {
+        switch(PHEADER(msg)->opcode) {
+            case MRMP_OPCODE_JOIN:
+                session_requeue_player(session, player_index, now);
+                break;
+            case MRMP_OPCODE_REMATCH:
+                player->wants_rematch = TRUE;
+                player->requested_at_ms = now;
+                break;
+            case MRMP_OPCODE_LEAVE:
+                drop_session_player(session, player_index);
+                break;
+            case MRMP_OPCODE_MOVE:
+            case MRMP_OPCODE_DIRECTIONS:
+                //moves sent before the player saw the result.
+                break;
+            default:
+                session_send_pkt(session, player_index, encode_error_pkt(MRMP_ERR_ILLEGAL_OPCODE));
+                drop_session_player(session, player_index);
+                break;
+        };
+        return;
+    }
+
+    //wait for move or leave messages, any other message is considered illegal at this point in time.
+    session_set_deadline(session, now + ACTIVITY_TIMEOUT_SECONDS * 1000);
+
+    switch(PHEADER(msg)->opcode) {
+        case MRMP_OPCODE_MOVE:
+            session_apply_move(session, player_index, PMOVE(msg)->row, PMOVE(msg)->column, PMOVE(msg)->seq, now);
+            break;
+        case MRMP_OPCODE_DIRECTIONS:
+            //every step is judged on its own, exactly like a MOVE to the cell it leads to.
+            for(int i = 0; i < PDIRS(msg)->count && session->state == SESSION_RACING && player->connection != NULL; ++i) {
+                int row = player->row;
+                int column = player->column;
+                mrmp_apply_step(mrmp_run_get(PDIRS(msg)->codes, i), &row, &column);
+                session_apply_move(session, player_index, (maze_size_t) row, (maze_size_t) column, PDIRS(msg)->seq + (mrmp_move_seq_t) i, now);
+            }
+            break;
+        case MRMP_OPCODE_LEAVE:
+            //the player is dropped, the race goes on as long as someone is left to race against.
+            drop_session_player(session, player_index);
+            break;
+        default:
+            //illegal opcode received.
+            session_send_pkt(session, player_index, encode_error_pkt(MRMP_ERR_ILLEGAL_OPCODE));
+            drop_session_player(session, player_index);
+            break;
+    };
+}
+
+//moves a player and tells everyone else, whether the move arrived over TCP or UDP. an invalid move is answered
+//over TCP with its seq and the player's actual position, every later move is still judged on its own from there,
+//which is exactly how the client replays them. returns FALSE if the move was rejected.
+int session_apply_move(session_t* session, int player_index, maze_size_t row, maze_size_t column, mrmp_move_seq_t seq, ULONGLONG now) {
+    session_player_t* player = &session->players[player_index];
+    trace_begin(session->worker->trace, "move", session->id);
+    if(maze_is_move_valid(session->maze, player->row, player->column, row, column) == FALSE) {
+        if(session->replay != NULL) replay_record_rejected(session->replay, (uint32_t)(now - session->race_started_ms), player_index, row, column);
+        session_send_pkt(session, player_index, encode_bad_move_pkt(player->row, player->column, seq));
+        metrics_add(session->worker->metrics, METRIC_BAD_MOVES, 1);
+        if(verbose == TRUE)
+            printf("sent bad move packet.\n");
+        trace_end(session->worker->trace, "move", session->id);
+        return FALSE;
+    }
+
+    //move was valid, update session state to reflect successful move, then notify every other player to update
+    //their perspective of this player's position in the maze. players with a bound UDP endpoint get a POSITIONS
+    //datagram, those that negotiated directions get the step with the rest of this tick's run, and the rest an
+    //OPPONENT_MOVE frame, each encoded only once.
+    uint8_t direction;
+    int is_step = mrmp_step_direction(player->row, player->column, row, column, &direction) == SUCCESS;
+    if(is_step && session->replay != NULL) replay_record_step(session->replay, (uint32_t)(now - session->race_started_ms), player_index, direction);
+    player->row = row;
+    player->column = column;
+    session->positions_dirty = TRUE;
+    session->spectators_dirty = TRUE;
+    ++session->moves_unsent;
+
+    mrmp_shared_buffer_t* opponent_move = NULL;
+    char datagram[MRMP_DGRAM_MAX_SIZE];
+    int datagram_length = 0;
+    int run_appended = FALSE;
+    for(int i = 0; i < session->player_count; ++i) {
+        if(i == player_index || session->players[i].connection == NULL) continue;
+
+        if(is_step && session_wants_run(session, i) == TRUE) {
+            if(run_appended == FALSE) {
+                mrmp_run_set(player->run_codes, player->run_count++, direction);
+                run_appended = TRUE;
+            }
+        } else if(session->players[i].udp_bound == TRUE) {
+            if(datagram_length == 0) {
+                mrmp_dgram_t positions = { .type = MRMP_DGRAM_POSITIONS, .seq = ++session->positions_seq, .count = 1 };
+                positions.entries[0].player = (mrmp_player_t) player_index;
+                positions.entries[0].row = row;
+                positions.entries[0].column = column;
+                datagram_length = encode_dgram(&positions, datagram);
+            }
+            session_send_dgram(session, i, datagram, datagram_length);
+        } else {
+            if(opponent_move == NULL) opponent_move = encode_opponent_move_pkt(row, column, (mrmp_player_t) player_index);
+            if(opponent_move != NULL) session_send(session, i, opponent_move);
+        }
+    }
+    if(opponent_move != NULL) mrmp_shared_buffer_release(opponent_move);
+    if(player->run_count == MRMP_MAX_RUN_STEPS) session_flush_runs(session);
+
+    if(player->row == session->maze->rows - 1 && player->column == session->maze->columns - 1) {
+        //opponents see the winning step before the result.
+        session_flush_runs(session);
+
+        mrmp_shared_buffer_t* lost = encode_result_pkt(0);
+        if(lost != NULL) {
+            session_broadcast(session, player_index, lost);
+            mrmp_shared_buffer_release(lost);
+        }
+        session_send_pkt(session, player_index, encode_result_pkt(1));
+
+        //spectators are told who won, after a snapshot with the winning step.
+        if(session->spectator_count > 0) {
+            session_snapshot_spectators(session, now);
+            session_send_spectators_pkt(session, encode_result_pkt((mrmp_winner_t) player_index));
+        }
+        session_finish_replay(session, REPLAY_OUTCOME_WON, player_index, now);
+        session_await_rematch(session, now);
+    }
+
+    trace_end(session->worker->trace, "move", session->id);
+    return TRUE;
+}
+
+//TRUE if the player hears about opponents' steps through OPPONENT_DIRECTIONS, UDP takes precedence.
+int session_wants_run(session_t* session, int receiver) {
+    session_player_t* player = &session->players[receiver];
+    return player->connection != NULL && (player->features & MRMP_FEATURE_DIRECTIONS) && player->udp_bound == FALSE;
+}
+
+//sends every player's steps of this tick to their opponents, one frame per player encoded only once.
+void session_flush_runs(session_t* session) {
+    for(int i = 0; i < session->player_count; ++i) {
+        session_player_t* player = &session->players[i];
+        if(player->run_count == 0) continue;
+
+        mrmp_shared_buffer_t* run = encode_opponent_directions_pkt((mrmp_player_t) i, player->run_codes, player->run_count);
+        player->run_count = 0;
+        if(run == NULL) continue;
+
+        for(int j = 0; j < session->player_count; ++j) {
+            if(j != i && session_wants_run(session, j) == TRUE) session_send(session, j, run);
+        }
+        mrmp_shared_buffer_release(run);
+    }
+}
+
+//gives the player a slot in the worker's endpoint table and tells them where to send their datagrams.
+void session_offer_udp(session_t* session, int player_index) {
+    scheduler_worker_t* worker = session->worker;
+    session_player_t* player = &session->players[player_index];
+    if(worker->udp_socket == INVALID_SOCKET || player->udp_endpoint != UDP_NO_ENDPOINT || worker->free_endpoint_count == 0) return;
+
+    //the token is all that binds datagrams to the player, whoever guesses it can move their address. without an
+    //unpredictable one the player just stays on TCP.
+    unsigned int token;
+    if(rand_s(&token) != 0) {
+        fprintf(stderr, "failed to draw a UDP token, player %d stays on TCP.\n", player_index);
+        return;
+    }
+
+    player->udp_endpoint = worker->free_endpoints[--worker->free_endpoint_count];
+    player->udp_token = (uint32_t) token;
+    player->udp_bound = FALSE;
+    player->ack_pending = FALSE;
+    worker->udp_endpoints[player->udp_endpoint].session = session;
+    worker->udp_endpoints[player->udp_endpoint].player = player_index;
+
+    session_send_pkt(session, player_index, encode_udp_offer_pkt(worker->udp_port, player->udp_endpoint, player->udp_token, (mrmp_player_t) player_index));
+}
+
+//returns the player's endpoint to the worker, datagrams still carrying it are rejected from now on.
+void session_release_udp(session_t* session, int player_index) {
+    session_player_t* player = &session->players[player_index];
+    if(player->udp_endpoint == UDP_NO_ENDPOINT || session->worker == NULL) return;
+
+    scheduler_worker_t* worker = session->worker;
+    worker->udp_endpoints[player->udp_endpoint].session = NULL;
+    worker->free_endpoints[worker->free_endpoint_count++] = player->udp_endpoint;
+    player->udp_endpoint = UDP_NO_ENDPOINT;
+    player->udp_bound = FALSE;
+    player->ack_pending = FALSE;
+}
+
+int simulate_datagram_loss(void) {
+    return simulated_loss_percent > 0 && rand() % 100 < simulated_loss_percent;
+}
+
+void session_send_dgram(session_t* session, int player_index, const char* buffer, int length) {
+    scheduler_worker_t* worker = session->worker;
+    session_player_t* player = &session->players[player_index];
+    if(simulate_datagram_loss()) {
+        ++worker->datagrams_lost;
+        return;
+    }
+
+    //a full send buffer loses the datagram like the network would, the next snapshot makes up for it.
+    if(sendto(worker->udp_socket, buffer, length, 0, (struct sockaddr*) &player->udp_address, sizeof(player->udp_address)) != SOCKET_ERROR)
+        ++worker->datagrams_sent;
+}
+
+//acknowledges the moves received this tick and periodically resends every position, so a lost POSITIONS datagram
+//is healed without retransmitting it.
+void session_flush_udp(session_t* session, ULONGLONG now) {
+    for(int i = 0; i < session->player_count; ++i) {
+        session_player_t* player = &session->players[i];
+        if(player->ack_pending == FALSE || player->connection == NULL) continue;
+
+        mrmp_dgram_t ack = { .type = MRMP_DGRAM_ACK, .endpoint = player->udp_endpoint, .token = player->udp_token, .seq = player->last_move_seq, .count = 0 };
+        char datagram[MRMP_DGRAM_MAX_SIZE];
+        session_send_dgram(session, i, datagram, encode_dgram(&ack, datagram));
+        player->ack_pending = FALSE;
+    }
+
+    if(session->state != SESSION_RACING || session->positions_dirty == FALSE || now - session->last_snapshot_ms < UDP_SNAPSHOT_MS) return;
+    session->positions_dirty = FALSE;
+    session->last_snapshot_ms = now;
+
+    //every entry of a snapshot gets its own seq, newer than any position sent before it.
+    mrmp_dgram_t snapshot = { .type = MRMP_DGRAM_POSITIONS, .count = 0 };
+    for(int i = 0; i < session->player_count && snapshot.count < MRMP_DGRAM_MAX_ENTRIES; ++i) {
+        if(session->players[i].connection == NULL) continue;
+        snapshot.entries[snapshot.count].player = (mrmp_player_t) i;
+        snapshot.entries[snapshot.count].row = session->players[i].row;
+        snapshot.entries[snapshot.count].column = session->players[i].column;
+        ++snapshot.count;
+    }
+    session->positions_seq += snapshot.count;
+    snapshot.seq = session->positions_seq;
+
+    char datagram[MRMP_DGRAM_MAX_SIZE];
+    int datagram_length = encode_dgram(&snapshot, datagram);
+    for(int i = 0; i < session->player_count; ++i) {
+        if(session->players[i].connection != NULL && session->players[i].udp_bound == TRUE)
+            session_send_dgram(session, i, datagram, datagram_length);
+    }
+}
+
+//handles every complete frame the players sent since the last tick, then advances the session if its players
+//are all ready, gone or past their deadline.
+int session_process(session_t* session, ULONGLONG now) {
+    int frames_handled = 0;
+    session->needs_service = FALSE;
+
+    for(int i = 0; i < session->player_count; ++i) {
+        while(session->players[i].connection != NULL) {
+            //every frame is parsed into the arena and given back once handled, nothing handling it keeps the frame.
+            char* msg = NULL;
+            arena_mark_t frame_mark = arena_mark(session->arena);
+            int parse_result = connection_next_msg_in(session->players[i].connection, session->arena, &msg);
+            if(parse_result == TIMEDOUT) break;
+            if(parse_result == ERROR) {
+                arena_rewind(session->arena, frame_mark);
+                session_send_pkt(session, i, encode_error_pkt(MRMP_ERR_ILLEGAL_OPCODE));
+                drop_session_player(session, i);
+                break;
+            }
+
+            //frames arriving after the outcome was decided are read and ignored.
+            if(session->state != SESSION_FINISHED) session_handle_msg(session, i, msg, now);
+            arena_rewind(session->arena, frame_mark);
+            ++frames_handled;
+        }
+    }
+
+    //dead players are dropped before the state is looked at, so the session reacts to them in this same tick.
+    session_heartbeat(session, now);
+
+    if(session->state == SESSION_WAITING_READY) {
+        if(session_remaining_players(session) < session->player_count) {
+            //someone left before the race even started.
+            session_abort(session, -1, MRMP_ERR_UNKNOWN, now);
+        } else if(session_all_ready(session) == TRUE) {
+            //at this point, every client has verified they are ready to start the race, so send a start packet to all.
+            //they all go out in the same flush at the end of this tick.
+            mrmp_shared_buffer_t* start = encode_empty_pkt(MRMP_OPCODE_START);
+            if(start == NULL) {
+                session_abort(session, -1, MRMP_ERR_UNKNOWN, now);
+                return frames_handled;
+            }
+            session_broadcast(session, -1, start);
+            session_send_spectators(session, start);
+            mrmp_shared_buffer_release(start);
+
+            session->state = SESSION_RACING;
+            session_set_deadline(session, now + ACTIVITY_TIMEOUT_SECONDS * 1000);
+            session_start_replay(session, now);
+            trace_instant(session->worker->trace, "start", session->id);
+
+            //rematches weren't paired by the matchmaker, only a session's first race counts.
+            if(session->paired_at_us != 0) {
+                histogram_record(session->worker->latency[LATENCY_PAIRED_TO_START], now_us() - session->paired_at_us);
+                session->paired_at_us = 0;
+            }
+        } else if(now >= session->deadline_ms) {
+            //players that never became ready time out, the others are told the session failed.
+            for(int i = 0; i < session->player_count; ++i) {
+                if(session->players[i].ready == TRUE) session_send_pkt(session, i, encode_error_pkt(MRMP_ERR_UNKNOWN));
+                else session_send_pkt(session, i, encode_empty_pkt(MRMP_OPCODE_TIMEOUT));
+            }
+            metrics_add(session->worker->metrics, METRIC_READY_TIMEOUTS, 1);
+            trace_instant(session->worker->trace, "ready_timeout", session->id);
+            session_finish(session, now);
+        }
+    } else if(session->state == SESSION_AWAITING_REMATCH) {
+        int remaining = session_remaining_players(session);
+        int all_want_rematch = session_all_want_rematch(session);
+        if(remaining >= 2 && all_want_rematch == TRUE) {
+            session_rematch(session, now);
+        } else if(remaining == 0) {
+            session_finish(session, now);
+        } else if(all_want_rematch == TRUE || now >= session->deadline_ms) {
+            //no opponent is left to rematch, whoever asked for one is put back into matchmaking instead.
+            for(int i = 0; i < session->player_count; ++i) {
+                if(session->players[i].connection != NULL && session->players[i].wants_rematch == TRUE)
+                    session_requeue_player(session, i, now);
+            }
+            session_finish(session, now);
+        }
+    } else if(session->state == SESSION_RACING) {
+        if(session_remaining_players(session) < 2) {
+            //notify the last player standing with an unknown error due to the unknown leave reason of the others.
+            session_abort(session, -1, MRMP_ERR_UNKNOWN, now);
+        } else if(now >= session->deadline_ms) {
+            mrmp_shared_buffer_t* timeout = encode_empty_pkt(MRMP_OPCODE_TIMEOUT);
+            if(timeout != NULL) {
+                session_broadcast(session, -1, timeout);
+                session_send_spectators(session, timeout);
+                mrmp_shared_buffer_release(timeout);
+            }
+            fprintf(stderr, "a session is timing out due to player inactivity.\n");
+            metrics_add(session->worker->metrics, METRIC_RACE_TIMEOUTS, 1);
+            trace_instant(session->worker->trace, "race_timeout", session->id);
+            session_finish_replay(session, REPLAY_OUTCOME_TIMEOUT, -1, now);
+            session_finish(session, now);
+        }
+    }
+
+    return frames_handled;
+}
+
+//closes every remaining connection and frees the session, making room for the matchmaker to start another.
+void session_end(session_t* session) {
+    //sessions handed to a worker that was already shutting down never ran on it.
+    trace_ring_t* ring = session->worker != NULL ? session->worker->trace : NULL;
+    mrmp_session_id_t id = session->id;
+    trace_begin(ring, "teardown", id);
+
+    for(int i = 0; i < session->player_count; ++i) {
+        drop_session_player(session, i);
+    }
+    for(int i = 0; i < session->spectator_count; ++i) {
+        drop_spectator(session, i);
+    }
+    if(session->replay != NULL) session_finish_replay(session, REPLAY_OUTCOME_ABORTED, -1, GetTickCount64());
+
+    if(session->worker != NULL) {
+        timer_wheel_cancel(session->worker->timers, &session->deadline_timer);
+        timer_wheel_cancel(session->worker->timers, &session->heartbeat_timer);
+        unregister_watchable(session);
+    }
+    if(session->maze_frame != NULL) mrmp_shared_buffer_release(session->maze_frame);
+    if(session->spectator_snapshot != NULL) mrmp_shared_buffer_release(session->spectator_snapshot);
+    metrics_add(session->worker != NULL ? session->worker->metrics : matchmaker_metrics, METRIC_SESSIONS_ACTIVE, -1);
+    free(session->spectators);
+
+    //the session lives in its arena, so the arena goes last.
+    scheduler_worker_t* worker = session->worker;
+    arena_t* arena = session->arena;
+    if(worker != NULL) {
+        ++worker->arena_sessions;
+        worker->arena_races += session->races;
+        worker->arena_bytes_peak += arena->bytes_peak;
+        if(arena->bytes_peak > worker->arena_bytes_max) worker->arena_bytes_max = arena->bytes_peak;
+        worker->arena_allocations += arena->allocations;
+        worker->arena_heap_allocations += arena->heap_allocations;
+    }
+    session_arena_release(arena);
+    trace_end(ring, "teardown", id);
+    notify_matchmaker();
+}
+
+scheduler_worker_t* scheduler_worker_init(int max_sessions) {
+    scheduler_worker_t* worker = calloc(1, sizeof(scheduler_worker_t));
+    if(!worker) {
+        perror("failed to initialize scheduler worker");
+        return NULL;
+    }
+
+    InitializeCriticalSection(&worker->inbox_critsec);
+    InitializeCriticalSection(&worker->replay_critsec);
+
+    int max_sockets = max_sessions * session_players;
+    //+1 for the UDP socket, which is polled alongside the connections.
+    worker->wake_event = CreateEvent(NULL, FALSE, FALSE, NULL);
+    worker->sessions = malloc(max_sessions * sizeof(session_t*));
+    worker->poll_fds = malloc((max_sockets + 1) * sizeof(WSAPOLLFD));
+    worker->poll_sessions = malloc((max_sockets + 1) * sizeof(session_t*));
+    worker->poll_players = malloc((max_sockets + 1) * sizeof(int));
+    worker->tick_histogram = histogram_init();
+    worker->fresh_maze_histogram = histogram_init();
+    worker->reused_maze_histogram = histogram_init();
+    int latency_result = latency_shard_init(worker->latency);
+    worker->metrics = metrics_shard(metrics);
+    worker->timers = timer_wheel_init(GetTickCount64(), SCHEDULER_TICK_MS);
+    worker->max_endpoints = (uint32_t) max_sockets;
+    worker->udp_endpoints = calloc(max_sockets, sizeof(udp_endpoint_t));
+    worker->free_endpoints = malloc(max_sockets * sizeof(uint32_t));
+    worker->udp_socket = INVALID_SOCKET;
+
+    if(worker->wake_event == NULL || worker->sessions == NULL || worker->poll_fds == NULL || worker->poll_sessions == NULL ||
+       worker->poll_players == NULL || worker->tick_histogram == NULL || worker->fresh_maze_histogram == NULL ||
+       worker->reused_maze_histogram == NULL || latency_result == ERROR || worker->timers == NULL || worker->udp_endpoints == NULL ||
+       worker->free_endpoints == NULL || worker->metrics == NULL) {
+        fprintf(stderr, "failed to initialize scheduler worker.\n");
+        scheduler_worker_free(worker);
+        return NULL;
+    }
+
+    //lowest endpoints are handed out first.
+    for(uint32_t i = 0; i < worker->max_endpoints; ++i) {
+        worker->free_endpoints[i] = worker->max_endpoints - 1 - i;
+    }
+    worker->free_endpoint_count = worker->max_endpoints;
+
+    //the UDP fast path is optional, without a socket every player simply stays on TCP.
+    worker->udp_socket = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+    if(worker->udp_socket != INVALID_SOCKET) {
+        struct sockaddr_in address;
+        ZeroMemory(&address, sizeof(address));
+        address.sin_family = AF_INET;
+        address.sin_addr.s_addr = htonl(INADDR_ANY);
+        address.sin_port = 0;
+        int address_length = sizeof(address);
+        u_long non_blocking = 1;
+
+        if(bind(worker->udp_socket, (struct sockaddr*) &address, sizeof(address)) == SOCKET_ERROR ||
+           getsockname(worker->udp_socket, (struct sockaddr*) &address, &address_length) == SOCKET_ERROR ||
+           ioctlsocket(worker->udp_socket, FIONBIO, &non_blocking) == SOCKET_ERROR) {
+            fprintf(stderr, "failed to open a UDP socket, error: %d\n", WSAGetLastError());
+            closesocket(worker->udp_socket);
+            worker->udp_socket = INVALID_SOCKET;
+        } else {
+            worker->udp_port = ntohs(address.sin_port);
+        }
+    }
+
+    return worker;
+}
+
+void scheduler_worker_free(scheduler_worker_t* worker) {
+    //sessions handed over while the worker was already shutting down.
+    while(worker->inbox != NULL) {
+        session_t* next = worker->inbox->next;
+        session_end(worker->inbox);
+        worker->inbox = next;
+    }
+    while(worker->spectate_inbox != NULL) {
+        spectate_request_t* next = worker->spectate_inbox->next;
+        close_spectator_connection(worker->spectate_inbox->connection);
+        free(worker->spectate_inbox);
+        worker->spectate_inbox = next;
+    }
+
+    //replays the writer thread never got to.
+    while(worker->replay_outbox != NULL) {
+        replay_file_t* next = worker->replay_outbox->next;
+        free(worker->replay_outbox->data);
+        free(worker->replay_outbox);
+        worker->replay_outbox = next;
+    }
+
+    if(worker->thread != NULL) CloseHandle(worker->thread);
+    if(worker->wake_event != NULL) CloseHandle(worker->wake_event);
+    DeleteCriticalSection(&worker->inbox_critsec);
+    DeleteCriticalSection(&worker->replay_critsec);
+    free(worker->sessions);
+    free(worker->poll_fds);
+    free(worker->poll_sessions);
+    free(worker->poll_players);
+    if(worker->tick_histogram != NULL) histogram_free(worker->tick_histogram);
+    if(worker->fresh_maze_histogram != NULL) histogram_free(worker->fresh_maze_histogram);
+    if(worker->reused_maze_histogram != NULL) histogram_free(worker->reused_maze_histogram);
+    latency_shard_free(worker->latency);
+    if(worker->timers != NULL) timer_wheel_free(worker->timers);
+    if(worker->udp_socket != INVALID_SOCKET) closesocket(worker->udp_socket);
+    free(worker->udp_endpoints);
+    free(worker->free_endpoints);
+    free(worker);
+}
+
+//starts every session the matchmaker handed over since the last tick.
+void scheduler_take_inbox(scheduler_worker_t* worker, ULONGLONG now) {
+    EnterCriticalSection(&worker->inbox_critsec);
+    session_t* session = worker->inbox;
+    worker->inbox = NULL;
+    LeaveCriticalSection(&worker->inbox_critsec);
+
+    while(session != NULL) {
+        session_t* next = session->next;
+        session->worker = worker;
+        for(int i = 0; i < session->player_count; ++i) {
+            if(session->players[i].connection != NULL) session->players[i].connection->metrics = worker->metrics;
+        }
+        session_begin(session, now);
+        worker->sessions[worker->running_count++] = session;
+        register_watchable(session);
+        session = next;
+    }
+
+    scheduler_take_spectators(worker);
+}
+
+//attaches every spectator the limbo thread handed over to the session it asked for, the session may have ended
+//in the meantime.
+void scheduler_take_spectators(scheduler_worker_t* worker) {
+    EnterCriticalSection(&worker->inbox_critsec);
+    spectate_request_t* request = worker->spectate_inbox;
+    worker->spectate_inbox = NULL;
+    LeaveCriticalSection(&worker->inbox_critsec);
+
+    while(request != NULL) {
+        spectate_request_t* next = request->next;
+        request->connection->metrics = worker->metrics;
+        session_t* session = NULL;
+        for(int i = 0; i < worker->running_count; ++i) {
+            if(worker->sessions[i]->id == request->session_id && worker->sessions[i]->state != SESSION_FINISHED) {
+                session = worker->sessions[i];
+                break;
+            }
+        }
+
+        if(session == NULL || session_add_spectator(session, request->connection) == ERROR) {
+            mrmp_shared_buffer_t* error = encode_error_pkt(MRMP_ERR_NO_SESSION);
+            if(error != NULL) {
+                connection_queue(request->connection, error);
+                mrmp_shared_buffer_release(error);
+            }
+            close_spectator_connection(request->connection);
+        }
+
+        free(request);
+        request = next;
+    }
+}
+
+//polls the connections of every session at once without blocking and reads whatever arrived on them.
+void scheduler_poll(scheduler_worker_t* worker, ULONGLONG now) {
+    ULONG fd_count = 0;
+    if(worker->udp_socket != INVALID_SOCKET) {
+        worker->poll_fds[fd_count].fd = worker->udp_socket;
+        worker->poll_fds[fd_count].events = POLLRDNORM;
+        worker->poll_fds[fd_count].revents = 0;
+        worker->poll_sessions[fd_count] = NULL;
+        ++fd_count;
+    }
+
+    for(int i = 0; i < worker->running_count; ++i) {
+        session_t* session = worker->sessions[i];
+        for(int j = 0; j < session->player_count; ++j) {
+            if(session->players[j].connection == NULL) continue;
+
+            worker->poll_fds[fd_count].fd = session->players[j].connection->socket;
+            worker->poll_fds[fd_count].events = POLLRDNORM;
+            worker->poll_fds[fd_count].revents = 0;
+            worker->poll_sessions[fd_count] = session;
+            worker->poll_players[fd_count] = j;
+            ++fd_count;
+        }
+    }
+
+    if(fd_count == 0) return;
+
+    int ready_count = WSAPoll(worker->poll_fds, fd_count, 0);
+    worker->polled_at_us = now_us();
+    if(ready_count == SOCKET_ERROR) {
+        fprintf(stderr, "WSAPoll failed with error: %d\n", WSAGetLastError());
+        return;
+    }
+
+    for(ULONG i = 0; i < fd_count && ready_count > 0; ++i) {
+        if(worker->poll_fds[i].revents == 0) continue;
+        --ready_count;
+
+        session_t* session = worker->poll_sessions[i];
+        if(session == NULL) {
+            scheduler_receive_dgrams(worker, now);
+            continue;
+        }
+
+        //hang ups and errors are reported by the read itself.
+        int player = worker->poll_players[i];
+        session->needs_service = TRUE;
+        if(connection_fill(session->players[player].connection) != SUCCESS) {
+            drop_session_player(session, player);
+        }
+    }
+}
+
+//applies the moves in every datagram that arrived since the last tick. datagrams are matched to players by their
+//endpoint and token, the address they came from is only learned from them.
+void scheduler_receive_dgrams(scheduler_worker_t* worker, ULONGLONG now) {
+    char buffer[MRMP_DGRAM_MAX_SIZE + 1]; //+1 so an oversized datagram shows up as one.
+    for(int received = 0; received < UDP_RECEIVE_BUDGET; ++received) {
+        struct sockaddr_in from;
+        int from_length = sizeof(from);
+        int length = recvfrom(worker->udp_socket, buffer, sizeof(buffer), 0, (struct sockaddr*) &from, &from_length);
+        if(length == SOCKET_ERROR) {
+            //an earlier datagram bounced off a closed port, that doesn't affect the socket itself.
+            if(WSAGetLastError() == WSAECONNRESET) continue;
+            break;
+        }
+
+        ++worker->datagrams_received;
+        if(simulate_datagram_loss()) {
+            ++worker->datagrams_lost;
+            continue;
+        }
+
+        mrmp_dgram_t dgram;
+        if(decode_dgram(buffer, length, &dgram) == ERROR || dgram.type != MRMP_DGRAM_MOVES || dgram.endpoint >= worker->max_endpoints) continue;
+
+        udp_endpoint_t* endpoint = &worker->udp_endpoints[dgram.endpoint];
+        session_t* session = endpoint->session;
+        if(session == NULL) continue;
+        session_player_t* player = &session->players[endpoint->player];
+        if(player->connection == NULL || player->udp_token != dgram.token) continue;
+
+        //any authenticated datagram binds the player's address, so a rebinding NAT doesn't cut them off.
+        player->udp_address = from;
+        player->udp_bound = TRUE;
+        player->ack_pending = TRUE;
+        player->last_heard_ms = now;
+        session->needs_service = TRUE;
+        if(session->state != SESSION_RACING) continue;
+
+        session_set_deadline(session, now + ACTIVITY_TIMEOUT_SECONDS * 1000);
+        for(int i = 0; i < dgram.count && session->state == SESSION_RACING; ++i) {
+            uint32_t seq = dgram.seq - (uint32_t)(dgram.count - 1 - i);
+            if((int32_t)(seq - player->last_move_seq) <= 0) {
+                ++worker->stale_moves;
+                continue;
+            }
+
+            player->last_move_seq = seq;
+            session_apply_move(session, endpoint->player, dgram.entries[i].row, dgram.entries[i].column, seq, now);
+        }
+    }
+}
+
+//sends everything queued during this tick, one gathered send per connection, and the tick's datagrams. every
+//player's frames go out before any spectator's, so spectators never delay the race.
+void scheduler_flush(scheduler_worker_t* worker, ULONGLONG now) {
+    for(int i = 0; i < worker->running_count; ++i) {
+        session_t* session = worker->sessions[i];
+        session_flush_runs(session);
+        if(worker->udp_socket != INVALID_SOCKET) session_flush_udp(session, now);
+
+        for(int j = 0; j < session->player_count; ++j) {
+            connection_t* connection = session->players[j].connection;
+            if(connection == NULL || connection_has_output(connection) == FALSE) continue;
+
+            if(connection_flush(connection) == SOCKET_ERROR) {
+                drop_session_player(session, j);
+                session->needs_service = TRUE; //re-evaluate the session next tick.
+            }
+        }
+
+        //every move of the tick was read by the same poll and went out in the same flush.
+        if(session->moves_unsent > 0) {
+            uint64_t broadcast_us = now_us() - worker->polled_at_us;
+            for(int j = 0; j < session->moves_unsent; ++j) {
+                histogram_record(worker->latency[LATENCY_MOVE_TO_BROADCAST], broadcast_us);
+            }
+            session->moves_unsent = 0;
+        }
+    }
+
+    for(int i = 0; i < worker->running_count; ++i) {
+        session_flush_spectators(worker->sessions[i], now);
+    }
+}
+
+//ends finished sessions once they are done lingering, keeping the running ones packed at the front.
+void scheduler_reap(scheduler_worker_t* worker, ULONGLONG now) {
+    int kept = 0;
+    for(int i = 0; i < worker->running_count; ++i) {
+        session_t* session = worker->sessions[i];
+        if(session->state == SESSION_FINISHED && (now >= session->deadline_ms || session_remaining_players(session) == 0)) {
+            session_end(session);
+            InterlockedDecrement(&worker->session_count);
+        } else {
+            worker->sessions[kept++] = session;
+        }
+    }
+    worker->running_count = kept;
+}
+
+//services every session owned by this worker once per tick, sessions without input or an expired deadline cost
+//nothing but a poll entry. deadlines live on a timer wheel, so they aren't scanned either.
+unsigned __stdcall scheduler_worker(void* data) {
+    scheduler_worker_t* worker = (scheduler_worker_t*) data;
+    //rand() state is per thread, seed it so every worker generates different mazes and simulates different losses.
+    srand((unsigned) GetTickCount64() ^ (unsigned) GetCurrentThreadId());
+    HANDLE wait_events[2] = { quit_event, worker->wake_event };
+
+    LARGE_INTEGER frequency, tick_start, tick_end;
+    QueryPerformanceFrequency(&frequency);
+
+    while(quit != TRUE) {
+        //nothing to run, sleep until the matchmaker hands over a session. the inbox is filled before the event is
+        //signaled, so a session handed over right after this check still wakes the worker up.
+        if(worker->running_count == 0 && worker->inbox == NULL && worker->spectate_inbox == NULL) {
+            WaitForMultipleObjects(2, wait_events, FALSE, INFINITE);
+            continue;
+        }
+
+        QueryPerformanceCounter(&tick_start);
+        ULONGLONG now = GetTickCount64();
+
+        scheduler_take_inbox(worker, now);
+        scheduler_poll(worker, now);
+        timer_wheel_advance(worker->timers, now, session_deadline_passed, NULL);
+
+        for(int i = 0; i < worker->running_count; ++i) {
+            session_t* session = worker->sessions[i];
+            if(session->needs_service == TRUE) {
+                worker->frames_handled += session_process(session, now);
+            }
+        }
+
+        scheduler_flush(worker, now);
+        scheduler_reap(worker, now);
+
+        QueryPerformanceCounter(&tick_end);
+        uint64_t elapsed_us = (uint64_t)((tick_end.QuadPart - tick_start.QuadPart) * 1000000 / frequency.QuadPart);
+        histogram_record(worker->tick_histogram, elapsed_us);
+        ++worker->ticks;
+
+        //sleep out the rest of the tick, an overrunning tick starts the next one right away.
+        if(elapsed_us >= SCHEDULER_TICK_MS * 1000) {
+            ++worker->overruns;
+        } else {
+            WaitForSingleObject(quit_event, (DWORD)(SCHEDULER_TICK_MS - elapsed_us / 1000));
+        }
+    }
+
+    //the server is shutting down, close every session this worker still owns.
+    for(int i = 0; i < worker->running_count; ++i) {
+        session_end(worker->sessions[i]);
+    }
+    worker->running_count = 0;
+
+    _endthreadex(0);
+    return 0;
+}
+
+int rtt_bucket(uint32_t rtt_ms) {
+    for(int i = 0; i < RTT_BUCKET_COUNT - 1; ++i) {
+        if(rtt_ms < RTT_BUCKET_BOUNDS_MS[i]) return i;
+    }
+    return RTT_BUCKET_COUNT - 1;
+}
+
+//returns the closest bucket with a player waiting in it, or -1 if there is none. matchmaker only.
+int nearest_waiting_bucket(int bucket) {
+    if(player_queue_is_empty(pending_players[bucket]) == FALSE) return bucket;
+
+    for(int distance = 1; distance < RTT_BUCKET_COUNT; ++distance) {
+        if(bucket - distance >= 0 && player_queue_is_empty(pending_players[bucket - distance]) == FALSE)
+            return bucket - distance;
+        if(bucket + distance < RTT_BUCKET_COUNT && player_queue_is_empty(pending_players[bucket + distance]) == FALSE)
+            return bucket + distance;
+    }
+    return -1;
+}
+
+size_t total_pending_players(void) {
+    size_t total_waiting = 0;
+    for(int i = 0; i < RTT_BUCKET_COUNT; ++i) {
+        total_waiting += player_queue_size(pending_players[i]);
+    }
+    return total_waiting;
+}
+
+//returns how long the matchmaker may sleep before it has work to do: 0 if a session can be formed right now,
+//INFINITE if only a newly queued player or a freed session slot could change that. matchmaker only.
+DWORD matchmaker_sleep_time(void) {
+    if(metrics_read(metrics, METRIC_SESSIONS_ACTIVE) >= MAX_SESSIONS) return INFINITE;
+
+    for(int i = 0; i < RTT_BUCKET_COUNT; ++i) {
+        if(player_queue_size(pending_players[i]) >= (size_t) session_players) return 0;
+    }
+
+    if(total_pending_players() < (size_t) session_players) return INFINITE;
+
+    //no bucket can fill a session by itself, wake up when the first waiting player may be matched across buckets.
+    ULONGLONG now = GetTickCount64();
+    DWORD sleep_ms = INFINITE;
+    for(int i = 0; i < RTT_BUCKET_COUNT; ++i) {
+        if(player_queue_is_empty(pending_players[i]) == TRUE) continue;
+
+        ULONGLONG waited = now - player_queue_front(pending_players[i])->queued_at_ms;
+        if(waited >= match_relax_wait_ms) return 0;
+        if(match_relax_wait_ms - waited < sleep_ms) sleep_ms = (DWORD)(match_relax_wait_ms - waited);
+    }
+
+    return sleep_ms;
+}
+
+//takes an arena off the free-list, or creates one if the list is empty.
+arena_t* session_arena_acquire(void) {
+    EnterCriticalSection(&arena_critsec);
+    arena_t* arena = free_arenas;
+    if(arena != NULL) {
+        free_arenas = arena->next;
+        --free_arena_count;
+    }
+    LeaveCriticalSection(&arena_critsec);
+
+    if(arena == NULL) {
+        arena = arena_init(SESSION_ARENA_BLOCK_SIZE);
+        if(arena != NULL) InterlockedIncrement(&arenas_created);
+    }
+    return arena;
+}
+
+//gives every allocation of an ended session back at once and keeps the arena's blocks for the next session.
+void session_arena_release(arena_t* arena) {
+    arena_reset(arena);
+
+    EnterCriticalSection(&arena_critsec);
+    int pooled = free_arena_count < MAX_POOLED_ARENAS;
+    if(pooled) {
+        arena->next = free_arenas;
+        free_arenas = arena;
+        ++free_arena_count;
+    }
+    LeaveCriticalSection(&arena_critsec);
+
+    if(!pooled) {
+        arena_free(arena);
+        InterlockedDecrement(&arenas_created);
+    }
+}
+
+//fills a new session with players from the given bucket, then from the closest neighboring buckets, recording
+//how long each of them waited. callers make sure enough players are pending. matchmaker only.
+session_t* form_session(int bucket, ULONGLONG now) {
+    //initialize the session's state. ownership of this pointer is passed onto the worker that will host it.
+    arena_t* arena = session_arena_acquire();
+    session_t* session = arena == NULL ? NULL : arena_alloc(arena, sizeof(session_t));
+    if(session == NULL) {
+        fprintf(stderr, "failed to allocate a session.\n");
+        if(arena != NULL) session_arena_release(arena);
+        return NULL;
+    }
+
+    session->arena = arena;
+    session->race_mark = arena_mark(arena);
+
+    session->state = SESSION_WAITING_READY;
+    session->player_count = 0;
+    session->maze = NULL;
+    session->deadline_ms = now;
+    session->needs_service = FALSE;
+    session->positions_seq = 0;
+    session->positions_dirty = FALSE;
+    session->last_snapshot_ms = now;
+    if(++last_session_id == 0) ++last_session_id; //0 is reserved for SPECTATE to mean any session.
+    session->id = last_session_id;
+    session->spectators = NULL;
+    session->spectator_count = 0;
+    session->spectator_capacity = 0;
+    session->maze_frame = NULL;
+    session->spectator_snapshot = NULL;
+    session->spectators_dirty = FALSE;
+    session->last_spectator_snapshot_ms = now;
+    session->replay = NULL;
+    session->races = 0;
+    session->race_started_ms = now;
+    session->paired_at_us = now_us();
+    session->moves_unsent = 0;
+    timer_wheel_timer_init(&session->deadline_timer, session);
+    timer_wheel_timer_init(&session->heartbeat_timer, session);
+    session->worker = NULL;
+    session->next = NULL;
+    while(session->player_count < session_players) {
+        int source = nearest_waiting_bucket(bucket);
+        if(source == -1) break;
+
+        player_t player = *player_queue_front(pending_players[source]);
+        player_queue_pop(pending_players[source]);
+
+        histogram_record(match_wait_histograms[source], now - player.queued_at_ms);
+        histogram_record(matchmaker_latency[LATENCY_JOIN_TO_PAIRED], session->paired_at_us - player.queued_at_us);
+
+        session_player_t* session_player = &session->players[session->player_count];
+        session_player->connection = player.connection;
+        session_player->rtt_ms = player.rtt_ms;
+        session_player->row = session_player->column = 0;
+        session_player->ready = FALSE;
+        session_player->wants_rematch = FALSE;
+        session_player->requested_at_ms = player.requested_at_ms;
+        session_player->reused = player.reused;
+        session_player->features = player.features;
+        session_player->udp_endpoint = UDP_NO_ENDPOINT;
+        session_player->udp_bound = FALSE;
+        session_player->last_move_seq = 0;
+        session_player->ack_pending = FALSE;
+        session_player->run_count = 0;
+        session_player->last_heard_ms = now;
+        session_player->next_ping_ms = 0;
+        session_player->ping_outstanding = FALSE;
+        ++session->player_count;
+    }
+
+    return session;
+}
+
+//hands a paired session to the least loaded worker, which starts it on its next tick.
+void start_session(session_t* session) {
+    scheduler_worker_t* worker = scheduler_workers[0];
+    for(int i = 1; i < scheduler_worker_count; ++i) {
+        if(scheduler_workers[i]->session_count < worker->session_count) worker = scheduler_workers[i];
+    }
+
+    metrics_add(matchmaker_metrics, METRIC_SESSIONS_ACTIVE, 1);
+    metrics_add(matchmaker_metrics, METRIC_SESSIONS_TOTAL, 1);
+    trace_instant(matchmaker_trace, "paired", session->id);
+
+    InterlockedIncrement(&worker->session_count);
+    EnterCriticalSection(&worker->inbox_critsec);
+    session->next = worker->inbox;
+    worker->inbox = session;
+    LeaveCriticalSection(&worker->inbox_critsec);
+    SetEvent(worker->wake_event);
+}
+
+unsigned __stdcall create_sessions(void* data) {
+    session_t* batch[MAX_SESSIONS];
+    int stalled = FALSE; //the last pass left players in the queue but moved and paired no one.
+
+    while(quit != TRUE) {
+        EnterCriticalSection(&matchmaker_critsec);
+
+        //sleep until new players were queued, a bucket can be paired or a lonely player's wait runs out. producers
+        //and scheduler workers notify under this lock after publishing their change, so no wakeup can be missed.
+        //players left in the queue only keep the matchmaker awake while it can make progress on them, a full bucket
+        //with every session slot taken has to wait for a slot to free up like everyone else.
+        if(stalled == TRUE && quit != TRUE) {
+            DWORD sleep_ms = matchmaker_sleep_time();
+            SleepConditionVariableCS(&matchmaker_cv, &matchmaker_critsec, sleep_ms == 0 ? MATCHMAKER_STALL_MS : sleep_ms);
+        }
+
+        DWORD sleep_ms;
+        while(quit != TRUE && player_queue_is_empty(player_queue) && (sleep_ms = matchmaker_sleep_time()) != 0) {
+            SleepConditionVariableCS(&matchmaker_cv, &matchmaker_critsec, sleep_ms);
+        }
+
+        LeaveCriticalSection(&matchmaker_critsec);
+
+        //move everyone who finished their handshake into the bucket for their round trip time.
+        int moved = 0;
+        while(player_queue_is_empty(player_queue) == FALSE) {
+            player_t player = *player_queue_front(player_queue);
+            if(player_queue_push(pending_players[rtt_bucket(player.rtt_ms)], player) == ERROR) break;
+            player_queue_pop(player_queue);
+            ++moved;
+        }
+
+        int batch_size = 0;
+        int free_slots = MAX_SESSIONS - (int) metrics_read(metrics, METRIC_SESSIONS_ACTIVE);
+        ULONGLONG now = GetTickCount64();
+
+        //fill sessions from within the same bucket first, as many as there are free slots.
+        for(int bucket = 0; bucket < RTT_BUCKET_COUNT; ++bucket) {
+            while(quit != TRUE && batch_size < free_slots && player_queue_size(pending_players[bucket]) >= (size_t) session_players) {
+                session_t* session = form_session(bucket, now);
+                if(session == NULL) break;
+                batch[batch_size++] = session;
+            }
+        }
+
+        //then relax the bucket boundary for players who have been waiting for too long.
+        for(int bucket = 0; bucket < RTT_BUCKET_COUNT && batch_size < free_slots; ++bucket) {
+            if(total_pending_players() < (size_t) session_players) break;
+            if(player_queue_is_empty(pending_players[bucket]) == TRUE) continue;
+            if(now - player_queue_front(pending_players[bucket])->queued_at_ms < match_relax_wait_ms) continue;
+
+            session_t* session = form_session(bucket, now);
+            if(session == NULL) break;
+            batch[batch_size++] = session;
+        }
+
+        for(int i = 0; i < batch_size; ++i) {
+            start_session(batch[i]);
+        }
+
+        stalled = moved == 0 && batch_size == 0 && player_queue_is_empty(player_queue) == FALSE;
     }
 
     _endthreadex(0);
     return 0;
-}
\ No newline at end of file
+}
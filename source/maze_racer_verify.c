@@ -0,0 +1,321 @@
+// Filename: maze_racer_verify.c
+// Programmer(s): Abdurrahman Alyajouri
+// Date: 10/19/2026
+// Purpose: To audit recorded races offline, re-simulating every replay against its maze and the server's rules.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <process.h>
+#include <windows.h>
+
+#include "maze.h"
+#include "replay.h"
+
+#ifndef EXIT_SUCCESS
+# define EXIT_SUCCESS 0
+#endif //EXIT_SUCCESS
+#ifndef EXIT_FAILURE
+# define EXIT_FAILURE 1
+#endif //EXIT_FAILURE
+
+//defines
+#define MAX_VERIFY_THREADS          64
+#define DEFAULT_MAX_STEPS_PER_SEC   40 //faster than anyone can press keys, steps arriving faster were not typed.
+#define MAX_STEPS_PER_SEC_LIMIT     256
+#define STEP_RATE_WINDOW_MS         1000
+
+//why a replay failed verification, a replay is only ever counted under its first problem.
+typedef enum verdict {
+    VERDICT_OK = 0,
+    VERDICT_UNREADABLE, //not a replay, truncated or its events don't decode.
+    VERDICT_MISMATCH, //a move or the outcome disagrees with the maze and the rules.
+    VERDICT_IMPOSSIBLE_TIMING, //moves no player could have made in the time they were recorded at.
+    VERDICT_COUNT
+} verdict_t;
+
+static const char* verdict_names[VERDICT_COUNT] = {
+    "ok",
+    "unreadable",
+    "mismatch",
+    "impossible timing"
+};
+
+//every verifying thread takes the next unclaimed file until none are left, so slow files don't hold up the rest.
+typedef struct verify_thread {
+    HANDLE thread;
+    uint64_t verdicts[VERDICT_COUNT];
+    uint64_t events;
+    uint64_t bytes;
+    //times of each player's last steps, to find max_steps_per_second + 1 steps within one window.
+    uint32_t step_times[REPLAY_MAX_PLAYERS][MAX_STEPS_PER_SEC_LIMIT];
+} verify_thread_t;
+
+static char** paths = NULL;
+static int path_count = 0;
+static int path_capacity = 0;
+static volatile LONG next_path = 0;
+static int max_steps_per_second = DEFAULT_MAX_STEPS_PER_SEC;
+static int verbose = FALSE;
+static CRITICAL_SECTION print_critsec; //keeps reports from different threads on separate lines.
+
+int add_path(const char* path);
+int add_directory(const char* directory);
+verdict_t verify_replay(const replay_t* replay, verify_thread_t* stats, char* reason, size_t reason_size);
+verdict_t verify_file(const char* path, verify_thread_t* stats);
+unsigned __stdcall verify_files(void* data);
+
+int main(int argc, char* argv[]) {
+    int thread_count = 0;
+    for(int i = 1; i < argc; ++i) {
+        if(strcmp(argv[i], "-t") == 0 && i + 1 < argc) {
+            thread_count = atoi(argv[++i]);
+        } else if(strcmp(argv[i], "-m") == 0 && i + 1 < argc) {
+            max_steps_per_second = atoi(argv[++i]);
+        } else if(strcmp(argv[i], "-v") == 0) {
+            verbose = TRUE;
+        } else {
+            //a directory is expanded into the replays in it, anything else is taken as a replay.
+            DWORD attributes = GetFileAttributesA(argv[i]);
+            int result = attributes != INVALID_FILE_ATTRIBUTES && (attributes & FILE_ATTRIBUTE_DIRECTORY)
+                ? add_directory(argv[i]) : add_path(argv[i]);
+            if(result == ERROR) return EXIT_FAILURE;
+        }
+    }
+
+    if(path_count == 0) {
+        fprintf(stderr, "usage: %s [-t threads] [-m max_steps_per_second] [-v] replay_file_or_directory...\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+    if(max_steps_per_second < 1) max_steps_per_second = 1;
+    if(max_steps_per_second > MAX_STEPS_PER_SEC_LIMIT) max_steps_per_second = MAX_STEPS_PER_SEC_LIMIT;
+
+    //one thread per processor by default, never more threads than files.
+    if(thread_count <= 0) {
+        SYSTEM_INFO system_info;
+        GetSystemInfo(&system_info);
+        thread_count = (int) system_info.dwNumberOfProcessors;
+    }
+    if(thread_count > MAX_VERIFY_THREADS) thread_count = MAX_VERIFY_THREADS;
+    if(thread_count > path_count) thread_count = path_count;
+
+    InitializeCriticalSection(&print_critsec);
+    static verify_thread_t threads[MAX_VERIFY_THREADS]; //too large for the stack.
+    HANDLE handles[MAX_VERIFY_THREADS];
+
+    ULONGLONG started_ms = GetTickCount64();
+    int started = 0;
+    for(; started < thread_count; ++started) {
+        threads[started].thread = (HANDLE)_beginthreadex(NULL, 0, &verify_files, &threads[started], 0, NULL);
+        if(threads[started].thread == NULL) {
+            fprintf(stderr, "failed to create verify thread %d.\n", started);
+            break;
+        }
+        handles[started] = threads[started].thread;
+    }
+
+    //the calling thread pitches in too if no thread could be started.
+    if(started == 0) {
+        verify_files(&threads[0]);
+        started = 1;
+    } else {
+        WaitForMultipleObjects(started, handles, TRUE, INFINITE);
+    }
+    ULONGLONG elapsed_ms = GetTickCount64() - started_ms;
+
+    verify_thread_t total;
+    memset(&total, 0, sizeof(total));
+    for(int i = 0; i < started; ++i) {
+        for(int v = 0; v < VERDICT_COUNT; ++v) total.verdicts[v] += threads[i].verdicts[v];
+        total.events += threads[i].events;
+        total.bytes += threads[i].bytes;
+        if(threads[i].thread != NULL) CloseHandle(threads[i].thread);
+    }
+
+    double elapsed_seconds = elapsed_ms > 0 ? elapsed_ms / 1000.0 : 0.001;
+    printf("verified %d races (%llu events, %.1f MB) in %.3f s on %d threads: %.0f races/sec, %.0f events/sec.\n",
+        path_count, (unsigned long long) total.events, total.bytes / (1024.0 * 1024.0), elapsed_seconds, started,
+        path_count / elapsed_seconds, total.events / elapsed_seconds);
+    for(int v = 0; v < VERDICT_COUNT; ++v) {
+        printf("%-18s %llu\n", verdict_names[v], (unsigned long long) total.verdicts[v]);
+    }
+
+    DeleteCriticalSection(&print_critsec);
+    for(int i = 0; i < path_count; ++i) free(paths[i]);
+    free(paths);
+
+    return total.verdicts[VERDICT_OK] == (uint64_t) path_count ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+int add_path(const char* path) {
+    if(path_count == path_capacity) {
+        int new_capacity = path_capacity == 0 ? 256 : path_capacity * 2;
+        char** grown = realloc(paths, new_capacity * sizeof(char*));
+        if(grown == NULL) {
+            perror("failed to grow the replay list");
+            return ERROR;
+        }
+        paths = grown;
+        path_capacity = new_capacity;
+    }
+
+    size_t length = strlen(path) + 1;
+    paths[path_count] = malloc(length);
+    if(paths[path_count] == NULL) {
+        perror("failed to grow the replay list");
+        return ERROR;
+    }
+    memcpy(paths[path_count], path, length);
+    ++path_count;
+    return SUCCESS;
+}
+
+//adds every replay file directly inside the directory.
+int add_directory(const char* directory) {
+    char pattern[MAX_PATH];
+    snprintf(pattern, sizeof(pattern), "%s\\*" REPLAY_FILE_EXTENSION, directory);
+
+    WIN32_FIND_DATAA find_data;
+    HANDLE find = FindFirstFileA(pattern, &find_data);
+    if(find == INVALID_HANDLE_VALUE) return SUCCESS; //nothing recorded there yet.
+
+    int result = SUCCESS;
+    do {
+        if(find_data.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) continue;
+
+        char path[MAX_PATH];
+        snprintf(path, sizeof(path), "%s\\%s", directory, find_data.cFileName);
+        result = add_path(path);
+    } while(result == SUCCESS && FindNextFileA(find, &find_data) != FALSE);
+
+    FindClose(find);
+    return result;
+}
+
+//re-runs the race event by event. every step must pass maze_is_move_valid() from where the player stood, every
+//rejected move must fail it, nobody may act after leaving, and the first player to reach the bottom right cell
+//must be the recorded winner, on the last event. steps may not come faster than max_steps_per_second per player,
+//nor after the recorded end of the race.
+verdict_t verify_replay(const replay_t* replay, verify_thread_t* stats, char* reason, size_t reason_size) {
+    maze_t* maze = replay_maze(replay);
+    if(maze == NULL) {
+        snprintf(reason, reason_size, "maze can't be built");
+        return VERDICT_UNREADABLE;
+    }
+
+    int rows[REPLAY_MAX_PLAYERS] = {0};
+    int columns[REPLAY_MAX_PLAYERS] = {0};
+    uint16_t left = 0;
+    int winner = -1;
+    uint32_t step_counts[REPLAY_MAX_PLAYERS] = {0};
+
+    replay_cursor_t cursor;
+    replay_cursor_init(&cursor, replay);
+    replay_event_t event;
+    verdict_t verdict = VERDICT_OK;
+    while(verdict == VERDICT_OK && replay_next(&cursor, &event) == SUCCESS) {
+        int p = event.player;
+        if(winner != -1) {
+            snprintf(reason, reason_size, "event %u by player %d after player %d won", cursor.event - 1, p, winner);
+            verdict = VERDICT_MISMATCH;
+        } else if(event.time_ms > replay->duration_ms) {
+            snprintf(reason, reason_size, "event %u at %u ms, after the race ended at %u ms", cursor.event - 1, event.time_ms, replay->duration_ms);
+            verdict = VERDICT_IMPOSSIBLE_TIMING;
+        } else if(left & (1 << p)) {
+            snprintf(reason, reason_size, "event %u by player %d after they left", cursor.event - 1, p);
+            verdict = VERDICT_MISMATCH;
+        } else if(event.kind <= REPLAY_EVENT_STEP_WEST) {
+            if(maze_cell_is_valid(maze->rows, maze->columns, event.row, event.column) == FALSE
+                || maze_is_move_valid(maze, rows[p], columns[p], event.row, event.column) == FALSE) {
+                snprintf(reason, reason_size, "player %d stepped from (%d, %d) to (%d, %d) through a wall at %u ms",
+                    p, rows[p], columns[p], event.row, event.column, event.time_ms);
+                verdict = VERDICT_MISMATCH;
+                continue;
+            }
+
+            uint32_t* times = stats->step_times[p];
+            uint32_t count = step_counts[p]++;
+            uint32_t slot = count % max_steps_per_second;
+            if(count >= (uint32_t) max_steps_per_second && event.time_ms - times[slot] < STEP_RATE_WINDOW_MS) {
+                snprintf(reason, reason_size, "player %d took %d steps between %u and %u ms",
+                    p, max_steps_per_second + 1, times[slot], event.time_ms);
+                verdict = VERDICT_IMPOSSIBLE_TIMING;
+            }
+            times[slot] = event.time_ms;
+
+            rows[p] = event.row;
+            columns[p] = event.column;
+            if(rows[p] == maze->rows - 1 && columns[p] == maze->columns - 1) winner = p;
+        } else if(event.kind == REPLAY_EVENT_REJECTED) {
+            //diagonal moves are rejected before maze_is_move_valid() would complain about them on stderr.
+            int diagonal = event.row != rows[p] && event.column != columns[p];
+            if(diagonal == FALSE && maze_is_move_valid(maze, rows[p], columns[p], event.row, event.column) == TRUE) {
+                snprintf(reason, reason_size, "player %d was refused the open move from (%d, %d) to (%d, %d) at %u ms",
+                    p, rows[p], columns[p], event.row, event.column, event.time_ms);
+                verdict = VERDICT_MISMATCH;
+            }
+        } else if(event.kind == REPLAY_EVENT_LEAVE) {
+            left |= (uint16_t)(1 << p);
+        }
+    }
+
+    if(verdict == VERDICT_OK && cursor.event < replay->event_count) {
+        snprintf(reason, reason_size, "event %u of %u doesn't decode", cursor.event, replay->event_count);
+        verdict = VERDICT_UNREADABLE;
+    }
+
+    //the outcome must follow from the moves.
+    if(verdict == VERDICT_OK) {
+        if(replay->outcome == REPLAY_OUTCOME_WON && winner != replay->winner) {
+            if(winner == -1) snprintf(reason, reason_size, "player %d is recorded as the winner but nobody reached the goal", replay->winner);
+            else snprintf(reason, reason_size, "player %d is recorded as the winner but player %d reached the goal", replay->winner, winner);
+            verdict = VERDICT_MISMATCH;
+        } else if(replay->outcome != REPLAY_OUTCOME_WON && winner != -1) {
+            snprintf(reason, reason_size, "player %d reached the goal but the race is recorded as %s", winner,
+                replay->outcome == REPLAY_OUTCOME_TIMEOUT ? "timed out" : "cut short");
+            verdict = VERDICT_MISMATCH;
+        } else if(replay->outcome > REPLAY_OUTCOME_ABORTED) {
+            snprintf(reason, reason_size, "unknown outcome %u", replay->outcome);
+            verdict = VERDICT_UNREADABLE;
+        }
+    }
+
+    free_maze(maze);
+    return verdict;
+}
+
+verdict_t verify_file(const char* path, verify_thread_t* stats) {
+    char reason[256] = "";
+    verdict_t verdict;
+
+    replay_t* replay = replay_open(path);
+    if(replay == NULL) {
+        snprintf(reason, sizeof(reason), "not a readable replay");
+        verdict = VERDICT_UNREADABLE;
+    } else {
+        verdict = verify_replay(replay, stats, reason, sizeof(reason));
+        stats->events += replay->event_count;
+        stats->bytes += replay->length;
+        replay_close(replay);
+    }
+
+    ++stats->verdicts[verdict];
+    if(verdict != VERDICT_OK || verbose == TRUE) {
+        EnterCriticalSection(&print_critsec);
+        printf("%s: %s%s%s\n", path, verdict_names[verdict], verdict != VERDICT_OK ? ", " : "", reason);
+        LeaveCriticalSection(&print_critsec);
+    }
+
+    return verdict;
+}
+
+unsigned __stdcall verify_files(void* data) {
+    verify_thread_t* stats = (verify_thread_t*) data;
+
+    LONG claimed;
+    while((claimed = InterlockedIncrement(&next_path) - 1) < path_count) {
+        verify_file(paths[claimed], stats);
+    }
+
+    return 0;
+}
@@ -0,0 +1,167 @@
+// Filename: metrics.c
+// Programmer(s): Abdurrahman Alyajouri
+// Date: 10/19/2026
+// Purpose: To implement the api functions defined in metrics.h
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "metrics.h"
+
+typedef struct metric_description {
+    const char* name;
+    const char* type;
+    const char* help;
+} metric_description_t;
+
+static const metric_description_t METRIC_DESCRIPTIONS[METRIC_COUNT] = {
+    { "mrmp_connections_total", "counter", "Connections accepted since startup." },
+    { "mrmp_connections_active", "gauge", "Connections currently open, spectators included." },
+    { "mrmp_connections_rejected_total", "counter", "Connections turned away because the server was overloaded." },
+    { "mrmp_sessions_total", "counter", "Sessions formed since startup." },
+    { "mrmp_sessions_active", "gauge", "Sessions currently hosted by a worker." },
+    { "mrmp_spectators_total", "counter", "Spectators attached to a session since startup." },
+    { "mrmp_spectators_active", "gauge", "Spectators currently watching a session." },
+    { "mrmp_requeues_total", "counter", "Players that sent JOIN again after a race instead of reconnecting." },
+    { "mrmp_rematches_total", "counter", "Sessions that raced the same players again." },
+    { "mrmp_received_bytes_total", "counter", "Bytes read from TCP connections." },
+    { "mrmp_sent_bytes_total", "counter", "Bytes written to TCP connections." },
+    { "mrmp_bad_moves_total", "counter", "Moves rejected with BAD_MOVE." },
+    { "mrmp_handshake_timeouts_total", "counter", "Connections that didn't finish HELLO or JOIN in time." },
+    { "mrmp_ready_timeouts_total", "counter", "Sessions whose players didn't all send READY in time." },
+    { "mrmp_race_timeouts_total", "counter", "Races ended because nobody moved for too long." },
+    { "mrmp_liveness_timeouts_total", "counter", "Players dropped for not answering PING in time." }
+};
+
+static const char* OPCODE_NAMES[METRICS_MAX_OPCODES] = {
+    "unknown", "error", "hello", "join", "leave", "move", "bad_move", "result", "join_resp", "start", "ready",
+    "timeout", "opponent_move", "hello_ack", "rematch", "udp_offer", "directions", "opponent_directions",
+    "spectate", "positions", "ping", "pong"
+};
+
+metrics_t* metrics_init(void) {
+    metrics_t* metrics = calloc(1, sizeof(metrics_t));
+    if(!metrics) {
+        perror("failed to initialize metrics");
+        return NULL;
+    }
+
+    return metrics;
+}
+
+int metrics_free(metrics_t* metrics) {
+    if(!metrics) {
+        fprintf(stderr, "cannot free invalid metrics\n");
+        return ERROR;
+    }
+
+    for(int i = 0; i < METRICS_MAX_SHARDS; ++i) {
+        free(metrics->shards[i]);
+    }
+    free(metrics);
+    return SUCCESS;
+}
+
+metrics_shard_t* metrics_shard(metrics_t* metrics) {
+    metrics_shard_t* shard = calloc(1, sizeof(metrics_shard_t));
+    if(!shard) {
+        perror("failed to initialize metrics shard");
+        return NULL;
+    }
+
+    //readers skip a claimed slot until its pointer is stored.
+    LONG index = InterlockedIncrement(&metrics->shard_count) - 1;
+    if(index >= METRICS_MAX_SHARDS) {
+        InterlockedDecrement(&metrics->shard_count);
+        fprintf(stderr, "cannot hand out more than %d metrics shards\n", METRICS_MAX_SHARDS);
+        free(shard);
+        return NULL;
+    }
+
+    InterlockedExchangePointer((PVOID volatile*) &metrics->shards[index], shard);
+    return shard;
+}
+
+void metrics_add(metrics_shard_t* shard, metric_t metric, int64_t delta) {
+    if(shard == NULL) return;
+    InterlockedExchangeAdd64(&shard->values[metric], delta);
+}
+
+void metrics_count_frame_received(metrics_shard_t* shard, uint8_t opcode) {
+    if(shard == NULL) return;
+    InterlockedIncrement64(&shard->frames_received[opcode < METRICS_MAX_OPCODES ? opcode : 0]);
+}
+
+void metrics_count_frame_sent(metrics_shard_t* shard, uint8_t opcode) {
+    if(shard == NULL) return;
+    InterlockedIncrement64(&shard->frames_sent[opcode < METRICS_MAX_OPCODES ? opcode : 0]);
+}
+
+int64_t metrics_read(metrics_t* metrics, metric_t metric) {
+    int64_t total = 0;
+    LONG count = metrics->shard_count < METRICS_MAX_SHARDS ? metrics->shard_count : METRICS_MAX_SHARDS;
+    for(LONG i = 0; i < count; ++i) {
+        metrics_shard_t* shard = metrics->shards[i];
+        if(shard != NULL) total += shard->values[metric];
+    }
+    return total;
+}
+
+//sums the frame counters of one direction for a single opcode.
+static int64_t metrics_read_frames(metrics_t* metrics, int sent, int opcode) {
+    int64_t total = 0;
+    LONG count = metrics->shard_count < METRICS_MAX_SHARDS ? metrics->shard_count : METRICS_MAX_SHARDS;
+    for(LONG i = 0; i < count; ++i) {
+        metrics_shard_t* shard = metrics->shards[i];
+        if(shard != NULL) total += sent ? shard->frames_sent[opcode] : shard->frames_received[opcode];
+    }
+    return total;
+}
+
+//appends to the buffer like snprintf, remembering whether anything didn't fit.
+static void append(char* buffer, size_t size, size_t* length, int* overflowed, const char* format, ...) {
+    if(*overflowed == TRUE) return;
+
+    va_list args;
+    va_start(args, format);
+    int written = vsnprintf(buffer + *length, size - *length, format, args);
+    va_end(args);
+
+    if(written < 0 || (size_t) written >= size - *length) *overflowed = TRUE;
+    else *length += (size_t) written;
+}
+
+int metrics_format_prometheus(metrics_t* metrics, char* buffer, size_t size) {
+    size_t length = 0;
+    int overflowed = size == 0;
+
+    for(int i = 0; i < METRIC_COUNT; ++i) {
+        const metric_description_t* description = &METRIC_DESCRIPTIONS[i];
+        append(buffer, size, &length, &overflowed, "# HELP %s %s\n# TYPE %s %s\n%s %lld\n",
+            description->name, description->help, description->name, description->type,
+            description->name, (long long) metrics_read(metrics, (metric_t) i));
+    }
+
+    //only opcodes that were ever seen are listed, so the output stays short.
+    const char* frame_metrics[2] = { "mrmp_frames_received_total", "mrmp_frames_sent_total" };
+    const char* frame_help[2] = { "MRMP frames parsed from TCP connections, by opcode.", "MRMP frames queued on TCP connections, by opcode." };
+    for(int sent = 0; sent < 2; ++sent) {
+        append(buffer, size, &length, &overflowed, "# HELP %s %s\n# TYPE %s counter\n", frame_metrics[sent], frame_help[sent], frame_metrics[sent]);
+        for(int opcode = 0; opcode < METRICS_MAX_OPCODES; ++opcode) {
+            int64_t frames = metrics_read_frames(metrics, sent, opcode);
+            if(frames == 0) continue;
+
+            char unnamed[8];
+            const char* name = OPCODE_NAMES[opcode];
+            if(name == NULL) {
+                snprintf(unnamed, sizeof(unnamed), "%d", opcode);
+                name = unnamed;
+            }
+            append(buffer, size, &length, &overflowed, "%s{opcode=\"%s\"} %lld\n", frame_metrics[sent], name, (long long) frames);
+        }
+    }
+
+    return overflowed == TRUE ? -1 : (int) length;
+}
@@ -4,9 +4,11 @@
 // Purpose: 
 
 #include <stdio.h>
-#include <winsock2.h>
-#include <ws2tcpip.h>
-#include <process.h>
+#include <stdlib.h>
+#include <string.h>
+#ifdef _WIN32
+# include <mstcpip.h>
+#endif //_WIN32
 
 #include "networking_utils.h"
 
@@ -15,9 +17,23 @@ const char* code_to_error[] = {
     "unknown error occurred at server",
     "illegal operation code used",
     "version mismatch",
-    "player queue has reached maximum capacity"
+    "player queue has reached maximum capacity",
+    "no session to spectate"
 };
 
+//the fixed sizes come first, every frame but JOIN_RESP fits one of them or the smallest size class. JOIN_RESP's
+//maze, and payloads read off a socket, take the smallest size class they fit in.
+static const size_t pkt_class_sizes[] = {
+    sizeof(mrmp_pkt_header_t),
+    sizeof(mrmp_pkt_error_t),
+    sizeof(mrmp_pkt_hello_t),
+    sizeof(mrmp_pkt_result_t),
+    sizeof(mrmp_pkt_move_t),
+    256, 1024, 4096, 16 * 1024, 64 * 1024
+};
+
+static PLATFORM_THREAD_LOCAL slab_pool_t* thread_pkt_pool = NULL;
+
 int send_buffer(SOCKET socket, const char* buffer, int buffer_length) {
     int total_bytes_sent = 0;
     int bytes_expected = buffer_length;
@@ -39,51 +55,201 @@ char* buffer_to_mrmp_pkt_struct(char* buffer) {
     memcpy(&header.length, buffer + sizeof(mrmp_opcode_t), sizeof(mrmp_payload_size_t));
 
     header.length = ntohl(header.length);
+    return mrmp_payload_to_pkt_struct(header, buffer + MRMP_PKT_HEADER_SIZE);
+}
+
+//packet structs come from the arena if one is given, otherwise from the thread's packet pool for the caller to free.
+static char* alloc_pkt(arena_t* arena, size_t size) {
+    return arena != NULL ? arena_alloc(arena, size) : slab_pool_alloc(thread_pkt_pool, size);
+}
+
+//the fewest payload bytes each opcode's fields are read from, anything shorter is malformed. optional trailing
+//fields are only read if the payload is long enough for them.
+static mrmp_payload_size_t minimum_payload_length(mrmp_opcode_t opcode) {
+    switch(opcode) {
+        case MRMP_OPCODE_ERROR:
+            return sizeof(mrmp_error_t);
+        case MRMP_OPCODE_HELLO:
+            return sizeof(mrmp_version_t);
+        case MRMP_OPCODE_RESULT:
+            return sizeof(mrmp_winner_t);
+        case MRMP_OPCODE_MOVE:
+        case MRMP_OPCODE_BAD_MOVE:
+        case MRMP_OPCODE_OPPONENT_MOVE:
+        case MRMP_OPCODE_JOIN_RESP:
+            return sizeof(maze_size_t) * 2;
+        case MRMP_OPCODE_UDP_OFFER:
+            return MRMP_PKT_UDP_OFFER_SIZE - MRMP_PKT_HEADER_SIZE;
+        default:
+            return 0;
+    }
+}
 
+static char* payload_to_pkt_struct(mrmp_pkt_header_t header, const char* payload, arena_t* arena) {
     char* pkt = NULL;
+    if(header.length < minimum_payload_length(header.opcode)) return NULL;
 
     switch(header.opcode) {
-        case MRMP_OPCODE_HELLO_ACK:
         case MRMP_OPCODE_JOIN:
+        case MRMP_OPCODE_READY:
         case MRMP_OPCODE_START:
         case MRMP_OPCODE_LEAVE:
         case MRMP_OPCODE_TIMEOUT:
-            pkt = malloc(sizeof(mrmp_pkt_header_t));
+        case MRMP_OPCODE_REMATCH:
+            pkt = alloc_pkt(arena, sizeof(mrmp_pkt_header_t));
+            if(pkt == NULL) break;
             memcpy(pkt, &header, sizeof(mrmp_pkt_header_t));
             break;
         case MRMP_OPCODE_ERROR:
-            pkt = malloc(sizeof(mrmp_pkt_error_t));
+            pkt = alloc_pkt(arena, sizeof(mrmp_pkt_error_t));
+            if(pkt == NULL) break;
             memcpy(pkt, &header, sizeof(mrmp_pkt_header_t));
-            memcpy(&((mrmp_pkt_error_t*)pkt)->error_code, buffer + MRMP_PKT_HEADER_SIZE, sizeof(mrmp_error_t));
+            memcpy(&((mrmp_pkt_error_t*)pkt)->error_code, payload, sizeof(mrmp_error_t));
             break;
         case MRMP_OPCODE_HELLO:
-            pkt = malloc(sizeof(mrmp_pkt_hello_t));
+            pkt = alloc_pkt(arena, sizeof(mrmp_pkt_hello_t));
+            if(pkt == NULL) break;
+            memcpy(pkt, &header, sizeof(mrmp_pkt_header_t));
+            memcpy(&PHELLO(pkt)->version, payload, sizeof(mrmp_version_t));
+            PHELLO(pkt)->features = 0;
+            if(header.length >= sizeof(mrmp_version_t) + sizeof(mrmp_features_t))
+                memcpy(&PHELLO(pkt)->features, payload + sizeof(mrmp_version_t), sizeof(mrmp_features_t));
+            break;
+        case MRMP_OPCODE_HELLO_ACK:
+            pkt = alloc_pkt(arena, sizeof(mrmp_pkt_hello_ack_t));
+            if(pkt == NULL) break;
+            memcpy(pkt, &header, sizeof(mrmp_pkt_header_t));
+            PHELLOACK(pkt)->features = 0;
+            if(header.length >= sizeof(mrmp_features_t))
+                memcpy(&PHELLOACK(pkt)->features, payload, sizeof(mrmp_features_t));
+            break;
+        case MRMP_OPCODE_UDP_OFFER:
+            {
+                pkt = alloc_pkt(arena, sizeof(mrmp_pkt_udp_offer_t));
+                if(pkt == NULL) break;
+                memcpy(pkt, &header, sizeof(mrmp_pkt_header_t));
+
+                int field_address = 0;
+                memcpy(&PUDPOFFER(pkt)->port, payload + field_address, sizeof(uint16_t));
+                field_address += sizeof(uint16_t);
+                memcpy(&PUDPOFFER(pkt)->endpoint, payload + field_address, sizeof(uint32_t));
+                field_address += sizeof(uint32_t);
+                memcpy(&PUDPOFFER(pkt)->token, payload + field_address, sizeof(uint32_t));
+                field_address += sizeof(uint32_t);
+                memcpy(&PUDPOFFER(pkt)->player, payload + field_address, sizeof(mrmp_player_t));
+
+                PUDPOFFER(pkt)->port = ntohs(PUDPOFFER(pkt)->port);
+                PUDPOFFER(pkt)->endpoint = ntohl(PUDPOFFER(pkt)->endpoint);
+                PUDPOFFER(pkt)->token = ntohl(PUDPOFFER(pkt)->token);
+            }
+            break;
+        case MRMP_OPCODE_SPECTATE:
+            pkt = alloc_pkt(arena, sizeof(mrmp_pkt_spectate_t));
+            if(pkt == NULL) break;
+            memcpy(pkt, &header, sizeof(mrmp_pkt_header_t));
+            PSPECTATE(pkt)->session_id = 0;
+            if(header.length >= sizeof(mrmp_session_id_t)) {
+                memcpy(&PSPECTATE(pkt)->session_id, payload, sizeof(mrmp_session_id_t));
+                PSPECTATE(pkt)->session_id = ntohl(PSPECTATE(pkt)->session_id);
+            }
+            break;
+        case MRMP_OPCODE_PING:
+        case MRMP_OPCODE_PONG:
+            pkt = alloc_pkt(arena, sizeof(mrmp_pkt_ping_t));
+            if(pkt == NULL) break;
             memcpy(pkt, &header, sizeof(mrmp_pkt_header_t));
-            memcpy(&PHELLO(pkt)->version, buffer + MRMP_PKT_HEADER_SIZE, sizeof(mrmp_version_t));
+            PPING(pkt)->stamp = 0;
+            if(header.length >= sizeof(uint32_t)) {
+                memcpy(&PPING(pkt)->stamp, payload, sizeof(uint32_t));
+                PPING(pkt)->stamp = ntohl(PPING(pkt)->stamp);
+            }
+            break;
+        case MRMP_OPCODE_POSITIONS:
+            {
+                uint8_t count;
+                if(header.length < sizeof(uint8_t)) break;
+                memcpy(&count, payload, sizeof(uint8_t));
+                if(count > MRMP_DGRAM_MAX_ENTRIES || header.length < sizeof(uint8_t) + MRMP_DGRAM_ENTRY_SIZE * count) break;
+
+                pkt = alloc_pkt(arena, sizeof(mrmp_pkt_positions_t));
+                if(pkt == NULL) break;
+                memcpy(pkt, &header, sizeof(mrmp_pkt_header_t));
+                PPOSITIONS(pkt)->count = count;
+
+                int field_address = sizeof(uint8_t);
+                for(int i = 0; i < count; ++i) {
+                    memcpy(&PPOSITIONS(pkt)->entries[i].player, payload + field_address, sizeof(mrmp_player_t));
+                    field_address += sizeof(mrmp_player_t);
+                    memcpy(&PPOSITIONS(pkt)->entries[i].row, payload + field_address, sizeof(maze_size_t));
+                    field_address += sizeof(maze_size_t);
+                    memcpy(&PPOSITIONS(pkt)->entries[i].column, payload + field_address, sizeof(maze_size_t));
+                    field_address += sizeof(maze_size_t);
+                }
+            }
             break;
         case MRMP_OPCODE_RESULT:
-            pkt = malloc(sizeof(mrmp_pkt_result_t));
+            pkt = alloc_pkt(arena, sizeof(mrmp_pkt_result_t));
+            if(pkt == NULL) break;
             memcpy(pkt, &header, sizeof(mrmp_pkt_header_t));
-            memcpy(&PRESULT(pkt)->winner, buffer + MRMP_PKT_HEADER_SIZE, sizeof(mrmp_winner_t));
+            memcpy(&PRESULT(pkt)->winner, payload, sizeof(mrmp_winner_t));
             break;
         case MRMP_OPCODE_MOVE:
         case MRMP_OPCODE_BAD_MOVE:
         case MRMP_OPCODE_OPPONENT_MOVE:
-            pkt = malloc(sizeof(mrmp_pkt_move_t));
+            pkt = alloc_pkt(arena, sizeof(mrmp_pkt_move_t));
+            if(pkt == NULL) break;
             memcpy(pkt, &header, sizeof(mrmp_pkt_header_t));
-            memcpy(&PMOVE(pkt)->row, buffer + MRMP_PKT_HEADER_SIZE, sizeof(maze_size_t));
-            memcpy(&PMOVE(pkt)->column, buffer + MRMP_PKT_HEADER_SIZE + sizeof(maze_size_t), sizeof(maze_size_t));
+            memcpy(&PMOVE(pkt)->row, payload, sizeof(maze_size_t));
+            memcpy(&PMOVE(pkt)->column, payload + sizeof(maze_size_t), sizeof(maze_size_t));
+            PMOVE(pkt)->player = 0;
+            PMOVE(pkt)->seq = 0;
+            if(header.opcode == MRMP_OPCODE_OPPONENT_MOVE) {
+                if(header.length >= sizeof(maze_size_t) * 2 + sizeof(mrmp_player_t))
+                    memcpy(&PMOVE(pkt)->player, payload + sizeof(maze_size_t) * 2, sizeof(mrmp_player_t));
+            } else if(header.length >= sizeof(maze_size_t) * 2 + sizeof(mrmp_move_seq_t)) {
+                memcpy(&PMOVE(pkt)->seq, payload + sizeof(maze_size_t) * 2, sizeof(mrmp_move_seq_t));
+                PMOVE(pkt)->seq = ntohl(PMOVE(pkt)->seq);
+            }
+            break;
+        case MRMP_OPCODE_DIRECTIONS:
+        case MRMP_OPCODE_OPPONENT_DIRECTIONS:
+            {
+                //a run that is longer than the frame, or longer than the protocol allows, is malformed.
+                mrmp_payload_size_t prefix_length = header.opcode == MRMP_OPCODE_DIRECTIONS ? sizeof(mrmp_move_seq_t) : sizeof(mrmp_player_t);
+                if(header.length < prefix_length + sizeof(uint8_t)) break;
+
+                uint8_t count;
+                memcpy(&count, payload + prefix_length, sizeof(uint8_t));
+                if(count > MRMP_MAX_RUN_STEPS || header.length < prefix_length + sizeof(uint8_t) + MRMP_RUN_BYTES(count)) break;
+
+                pkt = alloc_pkt(arena, sizeof(mrmp_pkt_directions_t));
+                if(pkt == NULL) break;
+                memset(pkt, 0, sizeof(mrmp_pkt_directions_t));
+                memcpy(pkt, &header, sizeof(mrmp_pkt_header_t));
+                if(header.opcode == MRMP_OPCODE_DIRECTIONS) {
+                    memcpy(&PDIRS(pkt)->seq, payload, sizeof(mrmp_move_seq_t));
+                    PDIRS(pkt)->seq = ntohl(PDIRS(pkt)->seq);
+                } else {
+                    memcpy(&PDIRS(pkt)->player, payload, sizeof(mrmp_player_t));
+                }
+                PDIRS(pkt)->count = count;
+                memcpy(PDIRS(pkt)->codes, payload + prefix_length + sizeof(uint8_t), MRMP_RUN_BYTES(count));
+            }
             break;
         case MRMP_OPCODE_JOIN_RESP:
             {
+                //the maze has to fit in the frame, or the cells would be read from past its end.
                 maze_size_t rows, columns;
-                memcpy(&rows, buffer + MRMP_PKT_HEADER_SIZE, sizeof(maze_size_t));
-                memcpy(&columns, buffer + MRMP_PKT_HEADER_SIZE + sizeof(maze_size_t), sizeof(maze_size_t));
-                pkt = malloc(sizeof(mrmp_pkt_join_resp_t) + (rows * columns) * sizeof(maze_cell_t));
+                memcpy(&rows, payload, sizeof(maze_size_t));
+                memcpy(&columns, payload + sizeof(maze_size_t), sizeof(maze_size_t));
+                if(header.length < sizeof(maze_size_t) * 2 + (rows * columns) * sizeof(maze_cell_t)) break;
+
+                pkt = alloc_pkt(arena, sizeof(mrmp_pkt_join_resp_t) + (rows * columns) * sizeof(maze_cell_t));
+                if(pkt == NULL) break;
                 memcpy(pkt, &header, sizeof(mrmp_pkt_header_t));
-                memcpy(&PJOINRE(pkt)->rows, buffer + MRMP_PKT_HEADER_SIZE, sizeof(maze_size_t));
-                memcpy(&PJOINRE(pkt)->columns, buffer + MRMP_PKT_HEADER_SIZE + sizeof(maze_size_t), sizeof(maze_size_t));
-                memcpy(PJOINRE(pkt)->cells, buffer + MRMP_PKT_HEADER_SIZE + sizeof(maze_size_t) * 2, (rows * columns) * sizeof(maze_cell_t));
+                memcpy(&PJOINRE(pkt)->rows, payload, sizeof(maze_size_t));
+                memcpy(&PJOINRE(pkt)->columns, payload + sizeof(maze_size_t), sizeof(maze_size_t));
+                memcpy(PJOINRE(pkt)->cells, payload + sizeof(maze_size_t) * 2, (rows * columns) * sizeof(maze_cell_t));
             }
             break;
         default:
@@ -93,379 +259,591 @@ char* buffer_to_mrmp_pkt_struct(char* buffer) {
     return pkt;
 }
 
-int send_error_pkt(SOCKET socket, mrmp_error_t error) {
-    mrmp_pkt_error_t msg = {
-        {
-            .opcode = MRMP_OPCODE_ERROR,
-            .length = sizeof(mrmp_error_t)
-        },
-        .error_code = error
-    };
+char* mrmp_payload_to_pkt_struct(mrmp_pkt_header_t header, const char* payload) {
+    return payload_to_pkt_struct(header, payload, NULL);
+}
 
-    msg.header.length = htonl(msg.header.length);
+char* mrmp_payload_to_pkt_struct_in(arena_t* arena, mrmp_pkt_header_t header, const char* payload) {
+    return payload_to_pkt_struct(header, payload, arena);
+}
 
-    int field_address = 0;
- 
-    char* buffer = malloc(MRMP_PKT_ERROR_SIZE);
-    memcpy(buffer, &msg.header.opcode, sizeof(mrmp_opcode_t));
-    field_address += sizeof(mrmp_opcode_t);
-    memcpy(buffer + field_address, &msg.header.length, sizeof(mrmp_payload_size_t));
-    field_address += sizeof(mrmp_payload_size_t);
-    memcpy(buffer + field_address, &msg.error_code, sizeof(mrmp_error_t));
+void mrmp_pkt_free(char* msg) {
+    slab_pool_release(msg);
+}
 
-    int send_buffer_result = send_buffer(socket, buffer, MRMP_PKT_ERROR_SIZE);
+slab_pool_t* mrmp_pkt_pool_init(void) {
+    return slab_pool_init(pkt_class_sizes, sizeof(pkt_class_sizes) / sizeof(pkt_class_sizes[0]));
+}
 
-    if(send_buffer_result == SOCKET_ERROR) {
-        fprintf(stderr, "failed to send error packet.\n");
-    }
+void mrmp_pkt_pool_use(slab_pool_t* pool) {
+    thread_pkt_pool = pool;
+}
 
-    free(buffer);
+//payload sizes of version 1 opcodes that omit the length, -1 if the length is sent, -2 if the opcode is unknown.
+static int compact_payload_length(mrmp_opcode_t opcode) {
+    switch(opcode) {
+        case MRMP_OPCODE_JOIN:
+        case MRMP_OPCODE_READY:
+        case MRMP_OPCODE_START:
+        case MRMP_OPCODE_LEAVE:
+        case MRMP_OPCODE_TIMEOUT:
+        case MRMP_OPCODE_REMATCH:
+            return 0;
+        case MRMP_OPCODE_ERROR:
+            return sizeof(mrmp_error_t);
+        case MRMP_OPCODE_RESULT:
+            return sizeof(mrmp_winner_t);
+        case MRMP_OPCODE_HELLO_ACK:
+            return sizeof(mrmp_features_t);
+        case MRMP_OPCODE_MOVE:
+        case MRMP_OPCODE_BAD_MOVE:
+            return MRMP_PKT_SEQ_MOVE_SIZE - MRMP_PKT_HEADER_SIZE;
+        case MRMP_OPCODE_OPPONENT_MOVE:
+            return MRMP_PKT_OPPONENT_MOVE_SIZE - MRMP_PKT_HEADER_SIZE;
+        case MRMP_OPCODE_UDP_OFFER:
+            return MRMP_PKT_UDP_OFFER_SIZE - MRMP_PKT_HEADER_SIZE;
+        case MRMP_OPCODE_SPECTATE:
+            return MRMP_PKT_SPECTATE_SIZE - MRMP_PKT_HEADER_SIZE;
+        case MRMP_OPCODE_PING:
+        case MRMP_OPCODE_PONG:
+            return MRMP_PKT_PING_SIZE - MRMP_PKT_HEADER_SIZE;
+        case MRMP_OPCODE_HELLO:
+        case MRMP_OPCODE_JOIN_RESP:
+        case MRMP_OPCODE_DIRECTIONS:
+        case MRMP_OPCODE_OPPONENT_DIRECTIONS:
+        case MRMP_OPCODE_POSITIONS:
+            return -1;
+        default:
+            return -2;
+    }
+}
 
-    return send_buffer_result;
+int mrmp_opcode_from_client(mrmp_opcode_t opcode) {
+    switch(opcode) {
+        case MRMP_OPCODE_HELLO:
+        case MRMP_OPCODE_JOIN:
+        case MRMP_OPCODE_LEAVE:
+        case MRMP_OPCODE_MOVE:
+        case MRMP_OPCODE_READY:
+        case MRMP_OPCODE_REMATCH:
+        case MRMP_OPCODE_DIRECTIONS:
+        case MRMP_OPCODE_SPECTATE:
+        case MRMP_OPCODE_PONG:
+            return TRUE;
+        default:
+            return FALSE;
+    }
 }
 
-int send_hello_pkt(SOCKET socket, mrmp_version_t version) {
-    mrmp_pkt_hello_t msg = {
-        {
-            .opcode = MRMP_OPCODE_HELLO,
-            .length = sizeof(mrmp_version_t)
-        },
-        .version = version
-    };
+int mrmp_parse_frame_header(const char* buffer, int length, mrmp_version_t version, mrmp_pkt_header_t* out_header, int* out_header_length) {
+    if(version == MRMP_VERSION_0) {
+        if(length < (int) MRMP_PKT_HEADER_SIZE) return TIMEDOUT;
+        memcpy(&out_header->opcode, buffer, sizeof(mrmp_opcode_t));
+        memcpy(&out_header->length, buffer + sizeof(mrmp_opcode_t), sizeof(mrmp_payload_size_t));
+        out_header->length = ntohl(out_header->length);
+        *out_header_length = MRMP_PKT_HEADER_SIZE;
+        return SUCCESS;
+    }
 
-    msg.header.length = htonl(msg.header.length);
+    if(length < (int) sizeof(mrmp_opcode_t)) return TIMEDOUT;
+    memcpy(&out_header->opcode, buffer, sizeof(mrmp_opcode_t));
 
-    int field_address = 0;
- 
-    char* buffer = malloc(MRMP_PKT_HELLO_SIZE);
-    memcpy(buffer, &msg.header.opcode, sizeof(mrmp_opcode_t));
-    field_address += sizeof(mrmp_opcode_t);
-    memcpy(buffer + field_address, &msg.header.length, sizeof(mrmp_payload_size_t));
-    field_address += sizeof(mrmp_payload_size_t);
-    memcpy(buffer + field_address, &msg.version, sizeof(mrmp_version_t));
+    int fixed_length = compact_payload_length(out_header->opcode);
+    if(fixed_length == -2) return ERROR;
+    if(fixed_length >= 0) {
+        out_header->length = (mrmp_payload_size_t) fixed_length;
+        *out_header_length = sizeof(mrmp_opcode_t);
+        return SUCCESS;
+    }
 
-    int send_buffer_result = send_buffer(socket, buffer, MRMP_PKT_HELLO_SIZE);
+    //little endian base 128, 7 bits per byte with the high bit set on every byte but the last.
+    mrmp_payload_size_t payload_length = 0;
+    for(int i = 0; i < 5; ++i) {
+        if(length < (int) sizeof(mrmp_opcode_t) + i + 1) return TIMEDOUT;
+        uint8_t byte = (uint8_t) buffer[sizeof(mrmp_opcode_t) + i];
+        payload_length |= (mrmp_payload_size_t)(byte & 0x7F) << (7 * i);
+        if((byte & 0x80) == 0) {
+            out_header->length = payload_length;
+            *out_header_length = sizeof(mrmp_opcode_t) + i + 1;
+            return SUCCESS;
+        }
+    }
 
-    if(send_buffer_result == SOCKET_ERROR) {
-        fprintf(stderr, "failed to send hello packet.\n");
+    return ERROR;
+}
+
+mrmp_shared_buffer_t* mrmp_shared_buffer_create(int length) {
+    mrmp_shared_buffer_t* buffer = malloc(sizeof(mrmp_shared_buffer_t) + length);
+    if(buffer == NULL) {
+        fprintf(stderr, "failed to malloc() a shared buffer.\n");
+        return NULL;
     }
 
-    free(buffer);
+    buffer->references = 1;
+    buffer->compact = NULL;
+    buffer->length = length;
+    return buffer;
+}
 
-    return send_buffer_result;
+mrmp_shared_buffer_t* mrmp_shared_buffer_acquire(mrmp_shared_buffer_t* buffer) {
+    InterlockedIncrement(&buffer->references);
+    return buffer;
 }
 
-int send_hello_ack_pkt(SOCKET socket) {
-    mrmp_pkt_header_t msg = {
-        .opcode = MRMP_OPCODE_HELLO_ACK,
-        .length = 0
-    };
+void mrmp_shared_buffer_release(mrmp_shared_buffer_t* buffer) {
+    if(buffer == NULL) return;
+    if(InterlockedDecrement(&buffer->references) == 0) {
+        mrmp_shared_buffer_release(buffer->compact);
+        free(buffer);
+    }
+}
 
-    int field_address = 0;
- 
-    char* buffer = malloc(MRMP_PKT_HEADER_SIZE);
-    memcpy(buffer, &msg.opcode, sizeof(mrmp_opcode_t));
-    field_address += sizeof(mrmp_opcode_t);
-    memcpy(buffer + field_address, &msg.length, sizeof(mrmp_payload_size_t));
+int send_shared_buffer(SOCKET socket, mrmp_shared_buffer_t* buffer) {
+    return send_buffer(socket, buffer->data, buffer->length);
+}
 
-    printf("sending hello pkt ack\n");
-    int send_buffer_result = send_buffer(socket, buffer, MRMP_PKT_HEADER_SIZE);
+mrmp_shared_buffer_t* mrmp_shared_buffer_for_version(mrmp_shared_buffer_t* buffer, mrmp_version_t version) {
+    if(version == MRMP_VERSION_0) return buffer;
+    if(buffer->compact != NULL) return buffer->compact;
 
-    if(send_buffer_result == SOCKET_ERROR) {
-        fprintf(stderr, "failed to send error packet.\n");
+    mrmp_pkt_header_t header;
+    int header_length;
+    mrmp_parse_frame_header(buffer->data, buffer->length, MRMP_VERSION_0, &header, &header_length);
+
+    //a fixed size opcode can only be framed compactly if its payload has exactly that size.
+    int fixed_length = compact_payload_length(header.opcode);
+    if(fixed_length == -2 || (fixed_length >= 0 && (mrmp_payload_size_t) fixed_length != header.length)) {
+        fprintf(stderr, "can't frame opcode %d with a %u byte payload compactly.\n", header.opcode, (unsigned) header.length);
+        return NULL;
     }
 
-    free(buffer);
+    char compact_header[MRMP_MAX_FRAME_HEADER_SIZE];
+    int compact_header_length = 0;
+    compact_header[compact_header_length++] = (char) header.opcode;
+    if(fixed_length == -1) {
+        mrmp_payload_size_t remaining = header.length;
+        do {
+            uint8_t byte = remaining & 0x7F;
+            remaining >>= 7;
+            if(remaining != 0) byte |= 0x80;
+            compact_header[compact_header_length++] = (char) byte;
+        } while(remaining != 0);
+    }
 
-    return send_buffer_result;
+    mrmp_shared_buffer_t* compact = mrmp_shared_buffer_create(compact_header_length + header.length);
+    if(compact == NULL) {
+        return NULL;
+    }
+
+    memcpy(compact->data, compact_header, compact_header_length);
+    memcpy(compact->data + compact_header_length, buffer->data + header_length, header.length);
+    buffer->compact = compact;
+    return compact;
 }
 
-int send_join_pkt(SOCKET socket) {
-    mrmp_pkt_header_t msg = {
-        .opcode = MRMP_OPCODE_JOIN,
-        .length = 0
-    };
+int send_frame(SOCKET socket, mrmp_shared_buffer_t* buffer, mrmp_version_t version) {
+    if(buffer == NULL) return SOCKET_ERROR;
+
+    mrmp_shared_buffer_t* framed = mrmp_shared_buffer_for_version(buffer, version);
+    int result = framed == NULL ? SOCKET_ERROR : send_shared_buffer(socket, framed);
+    mrmp_shared_buffer_release(buffer);
+    return result;
+}
+
+//allocates a frame with room for the given payload and writes its header, returns the address of the payload.
+static mrmp_shared_buffer_t* encode_header(mrmp_opcode_t opcode, mrmp_payload_size_t payload_length, char** out_payload) {
+    mrmp_shared_buffer_t* shared = mrmp_shared_buffer_create(MRMP_PKT_HEADER_SIZE + payload_length);
+    if(shared == NULL) {
+        return NULL;
+    }
+
+    mrmp_payload_size_t network_length = htonl(payload_length);
 
     int field_address = 0;
- 
-    char* buffer = malloc(MRMP_PKT_HEADER_SIZE);
-    memcpy(buffer, &msg.opcode, sizeof(mrmp_opcode_t));
+    memcpy(shared->data, &opcode, sizeof(mrmp_opcode_t));
     field_address += sizeof(mrmp_opcode_t);
-    memcpy(buffer + field_address, &msg.length, sizeof(mrmp_payload_size_t));
+    memcpy(shared->data + field_address, &network_length, sizeof(mrmp_payload_size_t));
     field_address += sizeof(mrmp_payload_size_t);
 
-    int send_buffer_result = send_buffer(socket, buffer, MRMP_PKT_HEADER_SIZE);
+    if(out_payload != NULL) *out_payload = shared->data + field_address;
+    return shared;
+}
 
-    if(send_buffer_result == SOCKET_ERROR) {
-        fprintf(stderr, "failed to send error packet.\n");
+//move and bad move frames share the same layout, a position followed by the move's sequence number.
+static mrmp_shared_buffer_t* encode_position(mrmp_opcode_t opcode, maze_size_t row, maze_size_t column, mrmp_move_seq_t seq) {
+    char* payload = NULL;
+    mrmp_shared_buffer_t* shared = encode_header(opcode, sizeof(maze_size_t) * 2 + sizeof(mrmp_move_seq_t), &payload);
+    if(shared == NULL) {
+        return NULL;
     }
 
-    free(buffer);
+    seq = htonl(seq);
+    memcpy(payload, &row, sizeof(maze_size_t));
+    memcpy(payload + sizeof(maze_size_t), &column, sizeof(maze_size_t));
+    memcpy(payload + sizeof(maze_size_t) * 2, &seq, sizeof(mrmp_move_seq_t));
+    return shared;
+}
 
-    return send_buffer_result;
+mrmp_shared_buffer_t* encode_error_pkt(mrmp_error_t error) {
+    char* payload = NULL;
+    mrmp_shared_buffer_t* shared = encode_header(MRMP_OPCODE_ERROR, sizeof(mrmp_error_t), &payload);
+    if(shared != NULL) memcpy(payload, &error, sizeof(mrmp_error_t));
+    return shared;
 }
 
-int send_join_resp_pkt(SOCKET socket, maze_t* maze) {
-    mrmp_pkt_header_t msg = {
-        .opcode = MRMP_OPCODE_JOIN_RESP,
-        .length = sizeof(maze_size_t) * 2 + sizeof(maze_cell_t) * (maze->rows * maze->columns) 
-    };
+mrmp_shared_buffer_t* encode_hello_pkt(mrmp_version_t version, mrmp_features_t features) {
+    char* payload = NULL;
+    mrmp_shared_buffer_t* shared = encode_header(MRMP_OPCODE_HELLO, sizeof(mrmp_version_t) + sizeof(mrmp_features_t), &payload);
+    if(shared != NULL) {
+        memcpy(payload, &version, sizeof(mrmp_version_t));
+        memcpy(payload + sizeof(mrmp_version_t), &features, sizeof(mrmp_features_t));
+    }
+    return shared;
+}
 
-    int field_address = 0;
-    int host_length = msg.length;
-    msg.length = htonl(msg.length);
+mrmp_shared_buffer_t* encode_hello_ack_pkt(mrmp_features_t features) {
+    char* payload = NULL;
+    mrmp_shared_buffer_t* shared = encode_header(MRMP_OPCODE_HELLO_ACK, sizeof(mrmp_features_t), &payload);
+    if(shared != NULL) memcpy(payload, &features, sizeof(mrmp_features_t));
+    return shared;
+}
 
-    char* buffer = malloc(MRMP_PKT_HEADER_SIZE + host_length);
-    memcpy(buffer, &msg.opcode, sizeof(mrmp_opcode_t));
-    field_address += sizeof(mrmp_opcode_t);
-    memcpy(buffer + field_address, &msg.length, sizeof(mrmp_payload_size_t));
-    field_address += sizeof(mrmp_payload_size_t);
-    memcpy(buffer + field_address, &maze->rows, sizeof(maze_size_t));
+mrmp_shared_buffer_t* encode_empty_pkt(mrmp_opcode_t opcode) {
+    return encode_header(opcode, 0, NULL);
+}
+
+mrmp_shared_buffer_t* encode_join_resp_pkt(maze_t* maze) {
+    char* payload = NULL;
+    mrmp_shared_buffer_t* shared = encode_header(MRMP_OPCODE_JOIN_RESP,
+        sizeof(maze_size_t) * 2 + sizeof(maze_cell_t) * (maze->rows * maze->columns), &payload);
+    if(shared == NULL) {
+        return NULL;
+    }
+
+    int field_address = 0;
+    memcpy(payload + field_address, &maze->rows, sizeof(maze_size_t));
     field_address += sizeof(maze_size_t);
-    memcpy(buffer + field_address, &maze->columns, sizeof(maze_size_t));
+    memcpy(payload + field_address, &maze->columns, sizeof(maze_size_t));
     field_address += sizeof(maze_size_t);
 
     //copy maze cells.
     for(maze_size_t row = 0; row < maze->rows; ++row) {
-        memcpy(buffer + field_address, maze->cells[row], sizeof(maze_cell_t) * maze->columns);
+        memcpy(payload + field_address, maze->cells[row], sizeof(maze_cell_t) * maze->columns);
         field_address += sizeof(maze_cell_t) * maze->columns;
     }
 
-    int send_buffer_result = send_buffer(socket, buffer, MRMP_PKT_HEADER_SIZE + host_length);
-
-    if(send_buffer_result == SOCKET_ERROR) {
-        fprintf(stderr, "failed to send join resp packet.\n");
-    }
+    return shared;
+}
 
-    free(buffer);
+mrmp_shared_buffer_t* encode_move_pkt(maze_size_t row, maze_size_t column, mrmp_move_seq_t seq) {
+    return encode_position(MRMP_OPCODE_MOVE, row, column, seq);
+}
 
-    return send_buffer_result;
+mrmp_shared_buffer_t* encode_bad_move_pkt(maze_size_t last_row, maze_size_t last_column, mrmp_move_seq_t seq) {
+    return encode_position(MRMP_OPCODE_BAD_MOVE, last_row, last_column, seq);
 }
 
-int send_ready_pkt(SOCKET socket) {
-    mrmp_pkt_header_t msg = {
-        .opcode = MRMP_OPCODE_READY,
-        .length = 0
-    };
+mrmp_shared_buffer_t* encode_opponent_move_pkt(maze_size_t row, maze_size_t column, mrmp_player_t player) {
+    char* payload = NULL;
+    mrmp_shared_buffer_t* shared = encode_header(MRMP_OPCODE_OPPONENT_MOVE, sizeof(maze_size_t) * 2 + sizeof(mrmp_player_t), &payload);
+    if(shared == NULL) {
+        return NULL;
+    }
 
     int field_address = 0;
- 
-    char* buffer = malloc(MRMP_PKT_HEADER_SIZE);
-    memcpy(buffer, &msg.opcode, sizeof(mrmp_opcode_t));
-    field_address += sizeof(mrmp_opcode_t);
-    memcpy(buffer + field_address, &msg.length, sizeof(mrmp_payload_size_t));
+    memcpy(payload + field_address, &row, sizeof(maze_size_t));
+    field_address += sizeof(maze_size_t);
+    memcpy(payload + field_address, &column, sizeof(maze_size_t));
+    field_address += sizeof(maze_size_t);
+    memcpy(payload + field_address, &player, sizeof(mrmp_player_t));
 
-    int send_buffer_result = send_buffer(socket, buffer, MRMP_PKT_HEADER_SIZE);
+    return shared;
+}
 
-    if(send_buffer_result == SOCKET_ERROR) {
-        fprintf(stderr, "failed to send ready packet.\n");
+mrmp_shared_buffer_t* encode_result_pkt(mrmp_winner_t winner) {
+    char* payload = NULL;
+    mrmp_shared_buffer_t* shared = encode_header(MRMP_OPCODE_RESULT, sizeof(mrmp_winner_t), &payload);
+    if(shared != NULL) memcpy(payload, &winner, sizeof(mrmp_winner_t));
+    return shared;
+}
+
+mrmp_shared_buffer_t* encode_udp_offer_pkt(uint16_t port, uint32_t endpoint, uint32_t token, mrmp_player_t player) {
+    char* payload = NULL;
+    mrmp_shared_buffer_t* shared = encode_header(MRMP_OPCODE_UDP_OFFER, MRMP_PKT_UDP_OFFER_SIZE - MRMP_PKT_HEADER_SIZE, &payload);
+    if(shared == NULL) {
+        return NULL;
     }
 
-    free(buffer);
+    port = htons(port);
+    endpoint = htonl(endpoint);
+    token = htonl(token);
 
-    return send_buffer_result;
+    int field_address = 0;
+    memcpy(payload + field_address, &port, sizeof(uint16_t));
+    field_address += sizeof(uint16_t);
+    memcpy(payload + field_address, &endpoint, sizeof(uint32_t));
+    field_address += sizeof(uint32_t);
+    memcpy(payload + field_address, &token, sizeof(uint32_t));
+    field_address += sizeof(uint32_t);
+    memcpy(payload + field_address, &player, sizeof(mrmp_player_t));
+
+    return shared;
 }
 
-int send_start_pkt(SOCKET socket) {
-    mrmp_pkt_header_t msg = {
-        .opcode = MRMP_OPCODE_START,
-        .length = 0
-    };
+//both run frames are a fixed prefix followed by the step count and the packed steps.
+static mrmp_shared_buffer_t* encode_run(mrmp_opcode_t opcode, const void* prefix, int prefix_length, const uint8_t* codes, uint8_t count) {
+    if(count > MRMP_MAX_RUN_STEPS) count = MRMP_MAX_RUN_STEPS;
 
-    int field_address = 0;
- 
-    char* buffer = malloc(MRMP_PKT_HEADER_SIZE);
-    memcpy(buffer, &msg.opcode, sizeof(mrmp_opcode_t));
-    field_address += sizeof(mrmp_opcode_t);
-    memcpy(buffer + field_address, &msg.length, sizeof(mrmp_payload_size_t));
+    char* payload = NULL;
+    mrmp_shared_buffer_t* shared = encode_header(opcode, prefix_length + sizeof(uint8_t) + MRMP_RUN_BYTES(count), &payload);
+    if(shared == NULL) {
+        return NULL;
+    }
 
-    int send_buffer_result = send_buffer(socket, buffer, MRMP_PKT_HEADER_SIZE);
+    memcpy(payload, prefix, prefix_length);
+    memcpy(payload + prefix_length, &count, sizeof(uint8_t));
+    memcpy(payload + prefix_length + sizeof(uint8_t), codes, MRMP_RUN_BYTES(count));
+    return shared;
+}
 
-    if(send_buffer_result == SOCKET_ERROR) {
-        fprintf(stderr, "failed to send start packet.\n");
-    }
+mrmp_shared_buffer_t* encode_directions_pkt(mrmp_move_seq_t seq, const uint8_t* codes, uint8_t count) {
+    seq = htonl(seq);
+    return encode_run(MRMP_OPCODE_DIRECTIONS, &seq, sizeof(mrmp_move_seq_t), codes, count);
+}
 
-    free(buffer);
+mrmp_shared_buffer_t* encode_opponent_directions_pkt(mrmp_player_t player, const uint8_t* codes, uint8_t count) {
+    return encode_run(MRMP_OPCODE_OPPONENT_DIRECTIONS, &player, sizeof(mrmp_player_t), codes, count);
+}
 
-    return send_buffer_result;
+mrmp_shared_buffer_t* encode_spectate_pkt(mrmp_session_id_t session_id) {
+    char* payload = NULL;
+    mrmp_shared_buffer_t* shared = encode_header(MRMP_OPCODE_SPECTATE, sizeof(mrmp_session_id_t), &payload);
+    if(shared != NULL) {
+        session_id = htonl(session_id);
+        memcpy(payload, &session_id, sizeof(mrmp_session_id_t));
+    }
+    return shared;
 }
 
-int send_leave_pkt(SOCKET socket) {
-    mrmp_pkt_header_t msg = {
-        .opcode = MRMP_OPCODE_LEAVE,
-        .length = 0
-    };
+mrmp_shared_buffer_t* encode_ping_pkt(mrmp_opcode_t opcode, uint32_t stamp) {
+    char* payload = NULL;
+    mrmp_shared_buffer_t* shared = encode_header(opcode, sizeof(uint32_t), &payload);
+    if(shared != NULL) {
+        stamp = htonl(stamp);
+        memcpy(payload, &stamp, sizeof(uint32_t));
+    }
+    return shared;
+}
 
-    int field_address = 0;
- 
-    char* buffer = malloc(MRMP_PKT_HEADER_SIZE);
-    memcpy(buffer, &msg.opcode, sizeof(mrmp_opcode_t));
-    field_address += sizeof(mrmp_opcode_t);
-    memcpy(buffer + field_address, &msg.length, sizeof(mrmp_payload_size_t));
+mrmp_shared_buffer_t* encode_positions_pkt(const mrmp_dgram_entry_t* entries, uint8_t count) {
+    if(count > MRMP_DGRAM_MAX_ENTRIES) count = MRMP_DGRAM_MAX_ENTRIES;
 
-    int send_buffer_result = send_buffer(socket, buffer, MRMP_PKT_HEADER_SIZE);
+    char* payload = NULL;
+    mrmp_shared_buffer_t* shared = encode_header(MRMP_OPCODE_POSITIONS, sizeof(uint8_t) + MRMP_DGRAM_ENTRY_SIZE * count, &payload);
+    if(shared == NULL) {
+        return NULL;
+    }
 
-    if(send_buffer_result == SOCKET_ERROR) {
-        fprintf(stderr, "failed to send leave packet.\n");
+    int field_address = 0;
+    memcpy(payload + field_address, &count, sizeof(uint8_t));
+    field_address += sizeof(uint8_t);
+    for(int i = 0; i < count; ++i) {
+        memcpy(payload + field_address, &entries[i].player, sizeof(mrmp_player_t));
+        field_address += sizeof(mrmp_player_t);
+        memcpy(payload + field_address, &entries[i].row, sizeof(maze_size_t));
+        field_address += sizeof(maze_size_t);
+        memcpy(payload + field_address, &entries[i].column, sizeof(maze_size_t));
+        field_address += sizeof(maze_size_t);
     }
 
-    free(buffer);
+    return shared;
+}
 
-    return send_buffer_result;
+void mrmp_run_set(uint8_t* codes, int step, uint8_t direction) {
+    int shift = 6 - (step % 4) * 2;
+    codes[step / 4] = (uint8_t)((codes[step / 4] & ~(0b11 << shift)) | ((direction & 0b11) << shift));
 }
 
-int send_move_pkt(SOCKET socket, maze_size_t row, maze_size_t column) {
-    mrmp_pkt_move_t msg = {
-        {
-            .opcode = MRMP_OPCODE_MOVE,
-            .length = sizeof(maze_size_t) * 2
-        },
-        .row = row,
-        .column = column
-    };
+uint8_t mrmp_run_get(const uint8_t* codes, int step) {
+    return (codes[step / 4] >> (6 - (step % 4) * 2)) & 0b11;
+}
 
-    msg.header.length = htonl(msg.header.length);
+int mrmp_step_direction(maze_size_t row, maze_size_t column, maze_size_t new_row, maze_size_t new_column, uint8_t* out_direction) {
+    if(new_column == column && new_row == row - 1) *out_direction = MRMP_DIR_NORTH;
+    else if(new_row == row && new_column == column + 1) *out_direction = MRMP_DIR_EAST;
+    else if(new_column == column && new_row == row + 1) *out_direction = MRMP_DIR_SOUTH;
+    else if(new_row == row && new_column == column - 1) *out_direction = MRMP_DIR_WEST;
+    else return ERROR;
+    return SUCCESS;
+}
 
-    int field_address = 0;
- 
-    char* buffer = malloc(MRMP_PKT_MOVE_SIZE);
-    memcpy(buffer, &msg.header.opcode, sizeof(mrmp_opcode_t));
-    field_address += sizeof(mrmp_opcode_t);
-    memcpy(buffer + field_address, &msg.header.length, sizeof(mrmp_payload_size_t));
-    field_address += sizeof(mrmp_payload_size_t);
-    memcpy(buffer + field_address, &msg.row, sizeof(maze_size_t));
-    field_address += sizeof(maze_size_t);
-    memcpy(buffer + field_address, &msg.column, sizeof(maze_size_t));
+void mrmp_apply_step(uint8_t direction, int* row, int* column) {
+    switch(direction) {
+        case MRMP_DIR_NORTH: --*row; break;
+        case MRMP_DIR_EAST: ++*column; break;
+        case MRMP_DIR_SOUTH: ++*row; break;
+        default: --*column; break;
+    }
+}
 
-    int send_buffer_result = send_buffer(socket, buffer, MRMP_PKT_MOVE_SIZE);
+int encode_dgram(mrmp_dgram_t* dgram, char* buffer) {
+    uint32_t endpoint = htonl(dgram->endpoint);
+    uint32_t token = htonl(dgram->token);
+    uint32_t seq = htonl(dgram->seq);
+    uint8_t count = dgram->count > MRMP_DGRAM_MAX_ENTRIES ? MRMP_DGRAM_MAX_ENTRIES : dgram->count;
 
-    if(send_buffer_result == SOCKET_ERROR) {
-        fprintf(stderr, "failed to send move packet.\n");
+    int field_address = 0;
+    memcpy(buffer + field_address, &dgram->type, sizeof(uint8_t));
+    field_address += sizeof(uint8_t);
+    memcpy(buffer + field_address, &endpoint, sizeof(uint32_t));
+    field_address += sizeof(uint32_t);
+    memcpy(buffer + field_address, &token, sizeof(uint32_t));
+    field_address += sizeof(uint32_t);
+    memcpy(buffer + field_address, &seq, sizeof(uint32_t));
+    field_address += sizeof(uint32_t);
+    memcpy(buffer + field_address, &count, sizeof(uint8_t));
+    field_address += sizeof(uint8_t);
+
+    for(int i = 0; i < count; ++i) {
+        memcpy(buffer + field_address, &dgram->entries[i].player, sizeof(mrmp_player_t));
+        field_address += sizeof(mrmp_player_t);
+        memcpy(buffer + field_address, &dgram->entries[i].row, sizeof(maze_size_t));
+        field_address += sizeof(maze_size_t);
+        memcpy(buffer + field_address, &dgram->entries[i].column, sizeof(maze_size_t));
+        field_address += sizeof(maze_size_t);
     }
 
-    free(buffer);
-
-    return send_buffer_result;
+    return field_address;
 }
 
-int send_opponent_move_pkt(SOCKET socket, maze_size_t row, maze_size_t column) {
-    mrmp_pkt_move_t msg = {
-        {
-            .opcode = MRMP_OPCODE_OPPONENT_MOVE,
-            .length = sizeof(maze_size_t) * 2
-        },
-        .row = row,
-        .column = column
-    };
-
-    msg.header.length = htonl(msg.header.length);
+int decode_dgram(const char* buffer, int length, mrmp_dgram_t* dgram) {
+    if(length < (int) MRMP_DGRAM_HEADER_SIZE) return ERROR;
 
     int field_address = 0;
- 
-    char* buffer = malloc(MRMP_PKT_MOVE_SIZE);
-    memcpy(buffer, &msg.header.opcode, sizeof(mrmp_opcode_t));
-    field_address += sizeof(mrmp_opcode_t);
-    memcpy(buffer + field_address, &msg.header.length, sizeof(mrmp_payload_size_t));
-    field_address += sizeof(mrmp_payload_size_t);
-    memcpy(buffer + field_address, &msg.row, sizeof(maze_size_t));
-    field_address += sizeof(maze_size_t);
-    memcpy(buffer + field_address, &msg.column, sizeof(maze_size_t));
+    memcpy(&dgram->type, buffer + field_address, sizeof(uint8_t));
+    field_address += sizeof(uint8_t);
+    memcpy(&dgram->endpoint, buffer + field_address, sizeof(uint32_t));
+    field_address += sizeof(uint32_t);
+    memcpy(&dgram->token, buffer + field_address, sizeof(uint32_t));
+    field_address += sizeof(uint32_t);
+    memcpy(&dgram->seq, buffer + field_address, sizeof(uint32_t));
+    field_address += sizeof(uint32_t);
+    memcpy(&dgram->count, buffer + field_address, sizeof(uint8_t));
+    field_address += sizeof(uint8_t);
+
+    dgram->endpoint = ntohl(dgram->endpoint);
+    dgram->token = ntohl(dgram->token);
+    dgram->seq = ntohl(dgram->seq);
+
+    //a truncated or oversized datagram is dropped as a whole.
+    if(dgram->count > MRMP_DGRAM_MAX_ENTRIES || length != field_address + dgram->count * (int) MRMP_DGRAM_ENTRY_SIZE) return ERROR;
+
+    for(int i = 0; i < dgram->count; ++i) {
+        memcpy(&dgram->entries[i].player, buffer + field_address, sizeof(mrmp_player_t));
+        field_address += sizeof(mrmp_player_t);
+        memcpy(&dgram->entries[i].row, buffer + field_address, sizeof(maze_size_t));
+        field_address += sizeof(maze_size_t);
+        memcpy(&dgram->entries[i].column, buffer + field_address, sizeof(maze_size_t));
+        field_address += sizeof(maze_size_t);
+    }
 
-    int send_buffer_result = send_buffer(socket, buffer, MRMP_PKT_MOVE_SIZE);
+    return SUCCESS;
+}
+
+//encodes, sends and frees a single frame, logging failures with the given packet name.
+static int send_encoded(SOCKET socket, mrmp_shared_buffer_t* buffer, const char* packet_name) {
+    if(buffer == NULL) {
+        return SOCKET_ERROR;
+    }
+
+    int send_buffer_result = send_shared_buffer(socket, buffer);
 
     if(send_buffer_result == SOCKET_ERROR) {
-        fprintf(stderr, "failed to send opponent move packet.\n");
+        fprintf(stderr, "failed to send %s packet.\n", packet_name);
     }
 
-    free(buffer);
+    mrmp_shared_buffer_release(buffer);
 
     return send_buffer_result;
 }
 
-int send_bad_move_pkt(SOCKET socket, maze_size_t last_row, maze_size_t last_column) {
-    mrmp_pkt_move_t msg = {
-        {
-            .opcode = MRMP_OPCODE_BAD_MOVE,
-            .length = sizeof(maze_size_t) * 2
-        },
-        .row = last_row,
-        .column = last_column
-    };
-
-    msg.header.length = htonl(msg.header.length);
+int send_error_pkt(SOCKET socket, mrmp_error_t error) {
+    return send_encoded(socket, encode_error_pkt(error), "error");
+}
 
-    int field_address = 0;
- 
-    char* buffer = malloc(MRMP_PKT_MOVE_SIZE);
-    memcpy(buffer, &msg.header.opcode, sizeof(mrmp_opcode_t));
-    field_address += sizeof(mrmp_opcode_t);
-    memcpy(buffer + field_address, &msg.header.length, sizeof(mrmp_payload_size_t));
-    field_address += sizeof(mrmp_payload_size_t);
-    memcpy(buffer + field_address, &msg.row, sizeof(maze_size_t));
-    field_address += sizeof(maze_size_t);
-    memcpy(buffer + field_address, &msg.column, sizeof(maze_size_t));
+int send_hello_pkt(SOCKET socket, mrmp_version_t version, mrmp_features_t features) {
+    return send_encoded(socket, encode_hello_pkt(version, features), "hello");
+}
 
-    int send_buffer_result = send_buffer(socket, buffer, MRMP_PKT_MOVE_SIZE);
+//both frames go out in one send, so they usually share a segment and the server reads them in the same pass.
+int send_hello_join_pkts(SOCKET socket, mrmp_version_t version, mrmp_features_t features) {
+    mrmp_shared_buffer_t* hello = encode_hello_pkt(version, features);
+    mrmp_shared_buffer_t* join = encode_empty_pkt(MRMP_OPCODE_JOIN);
+    mrmp_shared_buffer_t* framed_join = join == NULL ? NULL : mrmp_shared_buffer_for_version(join, version);
+
+    int send_buffer_result = SOCKET_ERROR;
+    char frames[MRMP_PKT_HELLO_SIZE + sizeof(mrmp_features_t) + MRMP_PKT_HEADER_SIZE];
+    if(hello != NULL && framed_join != NULL && hello->length + framed_join->length <= (int) sizeof(frames)) {
+        memcpy(frames, hello->data, hello->length);
+        memcpy(frames + hello->length, framed_join->data, framed_join->length);
+        send_buffer_result = send_buffer(socket, frames, hello->length + framed_join->length);
+    }
 
     if(send_buffer_result == SOCKET_ERROR) {
-        fprintf(stderr, "failed to send bad move packet.\n");
+        fprintf(stderr, "failed to send hello and join packets.\n");
     }
 
-    free(buffer);
-
+    if(hello != NULL) mrmp_shared_buffer_release(hello);
+    if(join != NULL) mrmp_shared_buffer_release(join);
     return send_buffer_result;
 }
 
-int send_result_pkt(SOCKET socket, mrmp_winner_t winner) {
-    mrmp_pkt_result_t msg = {
-        {
-            .opcode = MRMP_OPCODE_RESULT,
-            .length = sizeof(mrmp_winner_t)
-        },
-        .winner = winner
-    };
+int send_hello_ack_pkt(SOCKET socket, mrmp_features_t features) {
+    return send_encoded(socket, encode_hello_ack_pkt(features), "hello ack");
+}
 
-    msg.header.length = htonl(msg.header.length);
+int send_join_pkt(SOCKET socket) {
+    return send_encoded(socket, encode_empty_pkt(MRMP_OPCODE_JOIN), "join");
+}
 
-    int field_address = 0;
- 
-    char* buffer = malloc(MRMP_PKT_RESULT_SIZE);
-    memcpy(buffer, &msg.header.opcode, sizeof(mrmp_opcode_t));
-    field_address += sizeof(mrmp_opcode_t);
-    memcpy(buffer + field_address, &msg.header.length, sizeof(mrmp_payload_size_t));
-    field_address += sizeof(mrmp_payload_size_t);
-    memcpy(buffer + field_address, &msg.winner, sizeof(mrmp_winner_t));
+int send_join_resp_pkt(SOCKET socket, maze_t* maze) {
+    return send_encoded(socket, encode_join_resp_pkt(maze), "join resp");
+}
 
-    int send_buffer_result = send_buffer(socket, buffer, MRMP_PKT_RESULT_SIZE);
+int send_ready_pkt(SOCKET socket) {
+    return send_encoded(socket, encode_empty_pkt(MRMP_OPCODE_READY), "ready");
+}
 
-    if(send_buffer_result == SOCKET_ERROR) {
-        fprintf(stderr, "failed to send result packet.\n");
-    }
+int send_start_pkt(SOCKET socket) {
+    return send_encoded(socket, encode_empty_pkt(MRMP_OPCODE_START), "start");
+}
 
-    free(buffer);
+int send_leave_pkt(SOCKET socket) {
+    return send_encoded(socket, encode_empty_pkt(MRMP_OPCODE_LEAVE), "leave");
+}
 
-    return send_buffer_result;
+int send_move_pkt(SOCKET socket, maze_size_t row, maze_size_t column, mrmp_move_seq_t seq) {
+    return send_encoded(socket, encode_move_pkt(row, column, seq), "move");
 }
 
-int send_timeout_pkt(SOCKET socket) {
-    mrmp_pkt_header_t msg = {
-        .opcode = MRMP_OPCODE_TIMEOUT,
-        .length = 0
-    };
+int send_bad_move_pkt(SOCKET socket, maze_size_t last_row, maze_size_t last_column, mrmp_move_seq_t seq) {
+    return send_encoded(socket, encode_bad_move_pkt(last_row, last_column, seq), "bad move");
+}
 
-    int total_bytes_sent = 0;
-    int bytes_expected = sizeof(msg);
+int send_directions_pkt(SOCKET socket, mrmp_move_seq_t seq, const uint8_t* codes, uint8_t count) {
+    return send_encoded(socket, encode_directions_pkt(seq, codes, count), "directions");
+}
 
-    while(total_bytes_sent < bytes_expected) {
-        int bytes_sent = send(socket, (const char*) &msg + total_bytes_sent, bytes_expected - total_bytes_sent, 0);
-        if(bytes_sent == SOCKET_ERROR) {
-            fprintf(stderr, "failed to send timeout packet\n");
-            return DISGRACEFUL_DC;
-        }
-        total_bytes_sent += bytes_sent;
-    }
+int send_result_pkt(SOCKET socket, mrmp_winner_t winner) {
+    return send_encoded(socket, encode_result_pkt(winner), "result");
+}
+
+int send_timeout_pkt(SOCKET socket) {
+    return send_encoded(socket, encode_empty_pkt(MRMP_OPCODE_TIMEOUT), "timeout");
+}
 
-    return SUCCESS; 
+int send_rematch_pkt(SOCKET socket) {
+    return send_encoded(socket, encode_empty_pkt(MRMP_OPCODE_REMATCH), "rematch");
 }
 
 maze_t* maze_network_to_host(mrmp_pkt_join_resp_t* msg) {
@@ -501,7 +879,8 @@ int recv_w_timeout(SOCKET socket, char* buffer, int length, int flags, struct ti
     FD_SET(socket, &readfds);
 
     // Wait for socket to become readable
-    int select_result = select(0, &readfds, NULL, NULL, timeout);
+    //winsock ignores the descriptor count, posix needs it.
+    int select_result = select((int) socket + 1, &readfds, NULL, NULL, timeout);
 
     if(select_result == SOCKET_ERROR) {
         return SOCKET_ERROR;
@@ -512,70 +891,116 @@ int recv_w_timeout(SOCKET socket, char* buffer, int length, int flags, struct ti
     return recv(socket, buffer, length, flags);
 }
 
-int receive_mrmp_msg(SOCKET socket, char** out_msg, struct timeval* timeout) {
-    //first try to read enough bytes for the fields in mrmp_pkt_header_t to get the operation code.
-    char* bytes = malloc(MRMP_PKT_HEADER_SIZE);
+int get_tcp_rtt_us(SOCKET socket, uint32_t* out_rtt_us) {
+#if defined(_WIN32)
+    DWORD version = 0;
+    TCP_INFO_v0 info;
+    DWORD bytes_returned = 0;
+
+    //SIO_TCP_INFO needs windows 10 1703 or newer, older stacks fail the call.
+    if(WSAIoctl(socket, SIO_TCP_INFO, &version, sizeof(version), &info, sizeof(info), &bytes_returned, NULL, NULL) == SOCKET_ERROR)
+        return ERROR;
+
+    *out_rtt_us = (uint32_t) info.RttUs;
+    return SUCCESS;
+#elif defined(__linux__)
+    struct tcp_info info;
+    socklen_t info_length = sizeof(info);
+    if(getsockopt(socket, IPPROTO_TCP, TCP_INFO, &info, &info_length) == -1) return ERROR;
+
+    *out_rtt_us = (uint32_t) info.tcpi_rtt;
+    return SUCCESS;
+#else
+    return ERROR;
+#endif
+}
+
+//time left until the deadline as a select() timeout, NULL stays NULL to block indefinitely.
+static struct timeval* time_left(struct timeval* timeout, ULONGLONG deadline_ms, struct timeval* remaining) {
+    if(timeout == NULL) return NULL;
+
+    ULONGLONG now = GetTickCount64();
+    ULONGLONG left_ms = now >= deadline_ms ? 0 : deadline_ms - now;
+    remaining->tv_sec = (long)(left_ms / 1000);
+    remaining->tv_usec = (long)(left_ms % 1000) * 1000;
+    return remaining;
+}
 
+//reads exactly length bytes before the deadline, returns SUCCESS, GRACEFUL_DC, DISGRACEFUL_DC or TIMEDOUT.
+static int receive_exact(SOCKET socket, char* buffer, int length, struct timeval* timeout, ULONGLONG deadline_ms, const char* part) {
+    struct timeval remaining;
     int total_bytes_received = 0;
-    int expected_bytes = MRMP_PKT_HEADER_SIZE;
 
-    while(total_bytes_received < expected_bytes) {
-        int bytes_received = recv_w_timeout(socket, bytes + total_bytes_received, expected_bytes - total_bytes_received, 0, timeout);
+    while(total_bytes_received < length) {
+        int bytes_received = recv_w_timeout(socket, buffer + total_bytes_received, length - total_bytes_received, 0, time_left(timeout, deadline_ms, &remaining));
         //error handle
         if(bytes_received == 0) {
-            fprintf(stderr, "failed to receive message header, other end disconnected gracefully.\n");
-            free(bytes);
+            fprintf(stderr, "failed to receive message %s, other end disconnected gracefully.\n", part);
             return GRACEFUL_DC;
-        } else if(bytes_received == SOCKET_ERROR && WSAGetLastError() == WSAECONNRESET) {
-            fprintf(stderr, "failed to receive message header, other end disconnected ungracefully.\n");
-            free(bytes);
+        } else if(bytes_received == SOCKET_ERROR) {
+            fprintf(stderr, "failed to receive message %s, other end disconnected ungracefully.\n", part);
             return DISGRACEFUL_DC;
         } else if(bytes_received == TIMEDOUT) {
             if(!(timeout->tv_sec == 0 && timeout->tv_usec == 0))
-                fprintf(stderr, "failed to receive message header, other end timed out.\n");
-            free(bytes);
+                fprintf(stderr, "failed to receive message %s, other end timed out.\n", part);
             return TIMEDOUT;
         }
 
         total_bytes_received += bytes_received;
     }
-    
-    mrmp_payload_size_t payload_length;
-    memcpy(&payload_length, bytes + sizeof(mrmp_opcode_t), sizeof(mrmp_payload_size_t));
-    payload_length = ntohl(payload_length);
 
-    //reset variables.
-    expected_bytes += payload_length;
+    return SUCCESS;
+}
 
-    //fprintf(stderr, "%d byte message received\n", payload_length);
+int receive_mrmp_msg(SOCKET socket, char** out_msg, struct timeval* timeout, mrmp_version_t version) {
+    *out_msg = NULL;
 
-    //try to receive rest of message.
-    bytes = realloc(bytes, expected_bytes);
-    
-    while(total_bytes_received < expected_bytes) {
-        int bytes_received = recv_w_timeout(socket, bytes + total_bytes_received, expected_bytes - total_bytes_received, 0, timeout);
+    //one absolute deadline spans every partial read, so a peer trickling in bytes can't keep extending the timeout.
+    ULONGLONG deadline_ms = 0;
+    if(timeout != NULL)
+        deadline_ms = GetTickCount64() + (ULONGLONG) timeout->tv_sec * 1000 + timeout->tv_usec / 1000;
 
-        //error handle
-        if(bytes_received == 0) {
-            fprintf(stderr, "failed to receive message payload, other end disconnected gracefully.\n");
-            free(bytes);
-            return GRACEFUL_DC;
-        } else if(bytes_received == SOCKET_ERROR && WSAGetLastError() == WSAECONNRESET) {
-            fprintf(stderr, "failed to receive message payload, other end disconnected ungracefully.\n");
-            free(bytes);
+    //read the opcode, then as much of the header as the version needs to tell the payload's length. a version 1
+    //header is read a byte at a time since its length isn't known up front.
+    char header_bytes[MRMP_MAX_FRAME_HEADER_SIZE];
+    int header_received = 0;
+    int header_expected = version == MRMP_VERSION_0 ? MRMP_PKT_HEADER_SIZE : sizeof(mrmp_opcode_t);
+    mrmp_pkt_header_t header;
+    int header_length;
+
+    while(1) {
+        int receive_result = receive_exact(socket, header_bytes + header_received, header_expected - header_received, timeout, deadline_ms, "header");
+        if(receive_result != SUCCESS) return receive_result;
+        header_received = header_expected;
+
+        //once a frame started arriving it is finished, even if the caller didn't want to wait for one. giving up
+        //halfway would lose its first bytes and the stream along with them.
+        if(timeout != NULL && deadline_ms < GetTickCount64() + MRMP_FRAME_COMPLETION_MS)
+            deadline_ms = GetTickCount64() + MRMP_FRAME_COMPLETION_MS;
+
+        int parse_result = mrmp_parse_frame_header(header_bytes, header_received, version, &header, &header_length);
+        if(parse_result == SUCCESS) break;
+        if(parse_result == ERROR) {
+            fprintf(stderr, "received a malformed message header.\n");
             return DISGRACEFUL_DC;
-        } else if(bytes_received == TIMEDOUT) {
-            if(!(timeout->tv_sec == 0 && timeout->tv_usec == 0))
-                fprintf(stderr, "failed to receive message payload, other end timed out.\n");
-            free(bytes);
-            return TIMEDOUT;
         }
+        ++header_expected;
+    }
 
-        total_bytes_received += bytes_received;
+    //try to receive rest of message.
+    char* payload = slab_pool_alloc(thread_pkt_pool, header.length > 0 ? header.length : 1);
+    if(payload == NULL) {
+        return DISGRACEFUL_DC;
+    }
+
+    int receive_result = receive_exact(socket, payload, header.length, timeout, deadline_ms, "payload");
+    if(receive_result != SUCCESS) {
+        slab_pool_release(payload);
+        return receive_result;
     }
 
-    *out_msg = buffer_to_mrmp_pkt_struct(bytes);
-    free(bytes);
+    *out_msg = mrmp_payload_to_pkt_struct(header, payload);
+    slab_pool_release(payload);
 
     return SUCCESS;
 }
@@ -0,0 +1,410 @@
+// Filename: platform.c
+// Programmer(s): Abdurrahman Alyajouri
+// Date: 10/19/2026
+// Purpose: To implement the api functions defined in platform.h
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "platform.h"
+
+#ifdef _WIN32
+# include <conio.h>
+#else
+# include <fcntl.h>
+# include <poll.h>
+# include <signal.h>
+# include <termios.h>
+# include <time.h>
+# include <sys/ioctl.h>
+# include <sys/mman.h>
+# include <sys/stat.h>
+#endif //_WIN32
+
+#ifdef _WIN32
+
+static WSAEVENT tcp_event = WSA_INVALID_EVENT;
+static WSAEVENT udp_event = WSA_INVALID_EVENT;
+
+int platform_init(void) {
+    WSADATA wsa_data;
+    int wsa_startup_result = WSAStartup(MAKEWORD(2, 2), &wsa_data);
+    if(wsa_startup_result != 0) {
+        fprintf(stderr, "WSAStartup failed: %d\n", wsa_startup_result);
+        return ERROR;
+    }
+
+    tcp_event = WSACreateEvent();
+    udp_event = WSACreateEvent();
+    if(tcp_event == WSA_INVALID_EVENT || udp_event == WSA_INVALID_EVENT) {
+        fprintf(stderr, "WSACreateEvent failed: %d\n", WSAGetLastError());
+        platform_cleanup();
+        return ERROR;
+    }
+
+    //the client draws with ANSI escape sequences, older consoles without them just print them as text.
+    HANDLE output = GetStdHandle(STD_OUTPUT_HANDLE);
+    DWORD mode;
+    if(GetConsoleMode(output, &mode)) SetConsoleMode(output, mode | ENABLE_VIRTUAL_TERMINAL_PROCESSING);
+    return SUCCESS;
+}
+
+void platform_cleanup(void) {
+    if(tcp_event != WSA_INVALID_EVENT) WSACloseEvent(tcp_event);
+    if(udp_event != WSA_INVALID_EVENT) WSACloseEvent(udp_event);
+    tcp_event = udp_event = WSA_INVALID_EVENT;
+    WSACleanup();
+}
+
+ULONGLONG platform_now_ms(void) {
+    return GetTickCount64();
+}
+
+//key releases, focus and mouse events signal the console as well. they are dropped before waiting, so the console
+//handle is only signaled while a typed key is waiting to be read.
+static void drop_non_key_events(HANDLE input) {
+    INPUT_RECORD record;
+    DWORD count = 0;
+    while(PeekConsoleInputA(input, &record, 1, &count) && count == 1) {
+        if(record.EventType == KEY_EVENT && record.Event.KeyEvent.bKeyDown && record.Event.KeyEvent.uChar.AsciiChar != 0) break;
+        ReadConsoleInputA(input, &record, 1, &count);
+    }
+}
+
+//true if the socket has something to read, or was closed.
+static int socket_readable(SOCKET socket) {
+    if(socket == INVALID_SOCKET) return FALSE;
+
+    fd_set readfds;
+    FD_ZERO(&readfds);
+    FD_SET(socket, &readfds);
+    struct timeval dont_block = { .tv_sec = 0, .tv_usec = 0 };
+    return select(0, &readfds, NULL, NULL, &dont_block) == 1;
+}
+
+//sockets are only tied to the events while waiting. WSAEventSelect makes a socket non-blocking, the TCP socket is
+//switched back afterwards since the rest of the client reads and writes it with blocking calls.
+int platform_wait(SOCKET tcp_socket, SOCKET udp_socket, int timeout_ms) {
+    HANDLE input = GetStdHandle(STD_INPUT_HANDLE);
+    drop_non_key_events(input);
+    if(_kbhit()) return PLATFORM_EVENT_KEY;
+
+    HANDLE handles[3];
+    DWORD handle_count = 0;
+    handles[handle_count++] = input;
+    if(tcp_socket != INVALID_SOCKET && WSAEventSelect(tcp_socket, tcp_event, FD_READ | FD_CLOSE) == 0) handles[handle_count++] = tcp_event;
+    if(udp_socket != INVALID_SOCKET && WSAEventSelect(udp_socket, udp_event, FD_READ) == 0) handles[handle_count++] = udp_event;
+
+    WaitForMultipleObjects(handle_count, handles, FALSE, timeout_ms < 0 ? INFINITE : (DWORD) timeout_ms);
+
+    if(tcp_socket != INVALID_SOCKET) {
+        u_long blocking = 0;
+        WSAEventSelect(tcp_socket, NULL, 0);
+        ioctlsocket(tcp_socket, FIONBIO, &blocking);
+        WSAResetEvent(tcp_event);
+    }
+    if(udp_socket != INVALID_SOCKET) {
+        WSAEventSelect(udp_socket, NULL, 0);
+        WSAResetEvent(udp_event);
+    }
+
+    int events = 0;
+    if(socket_readable(tcp_socket) == TRUE) events |= PLATFORM_EVENT_TCP;
+    if(socket_readable(udp_socket) == TRUE) events |= PLATFORM_EVENT_UDP;
+    drop_non_key_events(input);
+    if(_kbhit()) events |= PLATFORM_EVENT_KEY;
+    return events;
+}
+
+int platform_key_pending(void) {
+    return _kbhit() != 0;
+}
+
+int platform_read_key(void) {
+    return _getch();
+}
+
+int platform_set_non_blocking(SOCKET socket) {
+    u_long non_blocking = 1;
+    return ioctlsocket(socket, FIONBIO, &non_blocking) == SOCKET_ERROR ? ERROR : SUCCESS;
+}
+
+//in window coordinates, the ones ANSI cursor movement uses, not those of the whole screen buffer.
+platform_point_t platform_cursor_position(void) {
+    CONSOLE_SCREEN_BUFFER_INFO csbi;
+    platform_point_t position = {0, 0};
+
+    fflush(stdout);
+    if(GetConsoleScreenBufferInfo(GetStdHandle(STD_OUTPUT_HANDLE), &csbi)) {
+        position.x = csbi.dwCursorPosition.X - csbi.srWindow.Left;
+        position.y = csbi.dwCursorPosition.Y - csbi.srWindow.Top;
+    }
+
+    return position;
+}
+
+platform_point_t platform_terminal_size(void) {
+    CONSOLE_SCREEN_BUFFER_INFO csbi;
+    platform_point_t size = {PLATFORM_DEFAULT_COLUMNS, PLATFORM_DEFAULT_ROWS};
+
+    if(GetConsoleScreenBufferInfo(GetStdHandle(STD_OUTPUT_HANDLE), &csbi)) {
+        size.x = csbi.srWindow.Right - csbi.srWindow.Left + 1;
+        size.y = csbi.srWindow.Bottom - csbi.srWindow.Top + 1;
+    }
+
+    return size;
+}
+
+int platform_write_terminal(const char* data, size_t length) {
+    //whatever was printed so far has to reach the console first.
+    fflush(stdout);
+    HANDLE output = GetStdHandle(STD_OUTPUT_HANDLE);
+    while(length > 0) {
+        DWORD written = 0;
+        if(!WriteFile(output, data, (DWORD) length, &written, NULL)) return ERROR;
+        data += written;
+        length -= written;
+    }
+    return SUCCESS;
+}
+
+int platform_map_file(const char* path, platform_mapping_t* mapping) {
+    LARGE_INTEGER size;
+    mapping->data = NULL;
+    mapping->mapping = NULL;
+    mapping->file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if(mapping->file == INVALID_HANDLE_VALUE || GetFileSizeEx(mapping->file, &size) == FALSE || size.QuadPart == 0) {
+        platform_unmap_file(mapping);
+        return ERROR;
+    }
+
+    //the file is read in place, pages are only faulted in as they are read.
+    mapping->length = (size_t) size.QuadPart;
+    mapping->mapping = CreateFileMappingA(mapping->file, NULL, PAGE_READONLY, 0, 0, NULL);
+    mapping->data = mapping->mapping == NULL ? NULL : MapViewOfFile(mapping->mapping, FILE_MAP_READ, 0, 0, 0);
+    if(mapping->data == NULL) {
+        platform_unmap_file(mapping);
+        return ERROR;
+    }
+    return SUCCESS;
+}
+
+void platform_unmap_file(platform_mapping_t* mapping) {
+    if(mapping->data != NULL) UnmapViewOfFile(mapping->data);
+    if(mapping->mapping != NULL) CloseHandle(mapping->mapping);
+    if(mapping->file != NULL && mapping->file != INVALID_HANDLE_VALUE) CloseHandle(mapping->file);
+    mapping->data = NULL;
+    mapping->mapping = NULL;
+    mapping->file = INVALID_HANDLE_VALUE;
+}
+
+#else
+
+#define PENDING_KEYS_SIZE 64
+
+static struct termios original_termios;
+static int terminal_raw = FALSE;
+static int stdin_closed = FALSE;
+
+//keys read while looking for the answer to a cursor position query, handed out before anything read later.
+static char pending_keys[PENDING_KEYS_SIZE];
+static int pending_key_count = 0;
+
+static void restore_terminal(void) {
+    if(terminal_raw == TRUE) tcsetattr(STDIN_FILENO, TCSAFLUSH, &original_termios);
+    terminal_raw = FALSE;
+}
+
+//puts the terminal back before the signal takes the process down, nothing else in here is safe to call.
+static void restore_terminal_and_raise(int signal_number) {
+    if(terminal_raw == TRUE) tcsetattr(STDIN_FILENO, TCSAFLUSH, &original_termios);
+    signal(signal_number, SIG_DFL);
+    raise(signal_number);
+}
+
+int platform_init(void) {
+    //a closed connection is reported by send() instead of killing the process.
+    signal(SIGPIPE, SIG_IGN);
+    if(isatty(STDIN_FILENO) == 0) return SUCCESS;
+
+    if(tcgetattr(STDIN_FILENO, &original_termios) == -1) {
+        perror("failed to read the terminal settings");
+        return ERROR;
+    }
+
+    //keys arrive one at a time without echo, ctrl-c still interrupts.
+    struct termios raw = original_termios;
+    raw.c_lflag &= ~(ICANON | ECHO);
+    raw.c_cc[VMIN] = 1;
+    raw.c_cc[VTIME] = 0;
+    if(tcsetattr(STDIN_FILENO, TCSAFLUSH, &raw) == -1) {
+        perror("failed to switch the terminal to raw mode");
+        return ERROR;
+    }
+
+    terminal_raw = TRUE;
+    atexit(restore_terminal);
+    signal(SIGINT, restore_terminal_and_raise);
+    signal(SIGTERM, restore_terminal_and_raise);
+    return SUCCESS;
+}
+
+void platform_cleanup(void) {
+    restore_terminal();
+}
+
+ULONGLONG platform_now_ms(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (ULONGLONG) now.tv_sec * 1000 + (ULONGLONG) now.tv_nsec / 1000000;
+}
+
+int platform_wait(SOCKET tcp_socket, SOCKET udp_socket, int timeout_ms) {
+    if(pending_key_count > 0) return PLATFORM_EVENT_KEY;
+
+    //a skipped descriptor is negative, poll() leaves those out.
+    struct pollfd poll_fds[3] = {
+        { .fd = tcp_socket, .events = POLLIN },
+        { .fd = udp_socket, .events = POLLIN },
+        { .fd = stdin_closed == TRUE ? -1 : STDIN_FILENO, .events = POLLIN }
+    };
+
+    int poll_result;
+    do {
+        poll_result = poll(poll_fds, 3, timeout_ms < 0 ? -1 : timeout_ms);
+    } while(poll_result == -1 && errno == EINTR);
+    if(poll_result <= 0) return 0;
+
+    //a hang up or error is reported as readable, reading is what tells the caller the connection is gone.
+    int events = 0;
+    if(poll_fds[0].revents != 0) events |= PLATFORM_EVENT_TCP;
+    if(poll_fds[1].revents != 0) events |= PLATFORM_EVENT_UDP;
+    if(poll_fds[2].revents != 0) events |= PLATFORM_EVENT_KEY;
+    return events;
+}
+
+int platform_key_pending(void) {
+    if(pending_key_count > 0) return TRUE;
+    if(stdin_closed == TRUE) return FALSE;
+
+    struct pollfd stdin_fd = { .fd = STDIN_FILENO, .events = POLLIN };
+    return poll(&stdin_fd, 1, 0) == 1;
+}
+
+int platform_read_key(void) {
+    if(pending_key_count > 0) {
+        int key = (unsigned char) pending_keys[0];
+        memmove(pending_keys, pending_keys + 1, --pending_key_count);
+        return key;
+    }
+    if(stdin_closed == TRUE) return EOF;
+
+    unsigned char key;
+    ssize_t read_result;
+    do {
+        read_result = read(STDIN_FILENO, &key, 1);
+    } while(read_result == -1 && errno == EINTR);
+
+    //input was redirected from a file that ran out, stop waiting on it.
+    if(read_result != 1) {
+        stdin_closed = TRUE;
+        return EOF;
+    }
+    return key;
+}
+
+int platform_set_non_blocking(SOCKET socket) {
+    int flags = fcntl(socket, F_GETFL, 0);
+    return flags == -1 || fcntl(socket, F_SETFL, flags | O_NONBLOCK) == -1 ? ERROR : SUCCESS;
+}
+
+//asks the terminal where the cursor is, the answer arrives on stdin as ESC [ row ; column R. keys typed in the
+//meantime are kept for platform_read_key().
+platform_point_t platform_cursor_position(void) {
+    platform_point_t position = {0, 0};
+    if(terminal_raw == FALSE) return position;
+
+    fputs("\x1b[6n", stdout);
+    fflush(stdout);
+
+    char answer[32];
+    int answer_length = 0;
+    ULONGLONG deadline_ms = platform_now_ms() + 100;
+    while(platform_now_ms() < deadline_ms) {
+        struct pollfd stdin_fd = { .fd = STDIN_FILENO, .events = POLLIN };
+        if(poll(&stdin_fd, 1, (int)(deadline_ms - platform_now_ms())) != 1) break;
+
+        char c;
+        if(read(STDIN_FILENO, &c, 1) != 1) break;
+
+        if(answer_length == 0 && c != '\x1b') {
+            if(pending_key_count < PENDING_KEYS_SIZE) pending_keys[pending_key_count++] = c;
+            continue;
+        }
+
+        answer[answer_length++] = c;
+        if(c == 'R' || answer_length == (int) sizeof(answer) - 1) break;
+    }
+    answer[answer_length] = '\0';
+
+    int row, column;
+    if(sscanf(answer, "\x1b[%d;%dR", &row, &column) == 2) {
+        position.x = column - 1;
+        position.y = row - 1;
+    }
+    return position;
+}
+
+platform_point_t platform_terminal_size(void) {
+    platform_point_t size = {PLATFORM_DEFAULT_COLUMNS, PLATFORM_DEFAULT_ROWS};
+    struct winsize window;
+    if(ioctl(STDOUT_FILENO, TIOCGWINSZ, &window) == 0 && window.ws_col > 0 && window.ws_row > 0) {
+        size.x = window.ws_col;
+        size.y = window.ws_row;
+    }
+    return size;
+}
+
+int platform_write_terminal(const char* data, size_t length) {
+    //whatever was printed so far has to reach the terminal first.
+    fflush(stdout);
+    while(length > 0) {
+        ssize_t written = write(STDOUT_FILENO, data, length);
+        if(written == -1) {
+            if(errno == EINTR) continue;
+            return ERROR;
+        }
+        data += written;
+        length -= (size_t) written;
+    }
+    return SUCCESS;
+}
+
+int platform_map_file(const char* path, platform_mapping_t* mapping) {
+    mapping->data = NULL;
+    mapping->length = 0;
+
+    int fd = open(path, O_RDONLY);
+    struct stat file_stat;
+    if(fd == -1 || fstat(fd, &file_stat) == -1 || file_stat.st_size == 0) {
+        if(fd != -1) close(fd);
+        return ERROR;
+    }
+
+    //the file is read in place, pages are only faulted in as they are read. the mapping outlives the descriptor.
+    void* data = mmap(NULL, (size_t) file_stat.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if(data == MAP_FAILED) return ERROR;
+
+    mapping->data = data;
+    mapping->length = (size_t) file_stat.st_size;
+    return SUCCESS;
+}
+
+void platform_unmap_file(platform_mapping_t* mapping) {
+    if(mapping->data != NULL) munmap((void*) mapping->data, mapping->length);
+    mapping->data = NULL;
+    mapping->length = 0;
+}
+
+#endif //_WIN32
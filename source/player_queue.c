@@ -15,8 +15,20 @@ player_queue_t* player_queue_init() {
         return NULL;
     }
 
-    queue->front = queue->back = NULL;
-    queue->size = 0;
+    queue->slots = malloc(sizeof(player_queue_slot_t) * PLAYER_QUEUE_CAPACITY);
+    if(!queue->slots) {
+        perror("failed to initialize player queue slots");
+        free(queue);
+        return NULL;
+    }
+
+    for(LONG64 i = 0; i < PLAYER_QUEUE_CAPACITY; ++i) {
+        queue->slots[i].sequence = i;
+    }
+
+    queue->mask = PLAYER_QUEUE_CAPACITY - 1;
+    queue->enqueue_position = 0;
+    queue->dequeue_position = 0;
     return queue;
 }
 
@@ -26,23 +38,36 @@ int player_queue_free(player_queue_t* queue) {
         return ERROR;
     }
 
-    player_queue_clear(queue);
+    free(queue->slots);
     free(queue);
     return SUCCESS;
 }
 
+//returns the front slot if a push into it has been completed, NULL otherwise. consumer only.
+static player_queue_slot_t* player_queue_ready_slot(player_queue_t* queue) {
+    LONG64 position = queue->dequeue_position;
+    player_queue_slot_t* slot = &queue->slots[position & queue->mask];
+
+    if(slot->sequence != position + 1) return NULL;
+
+    //make sure the data is read after the sequence that published it.
+    MemoryBarrier();
+    return slot;
+}
+
 player_queue_type_t* player_queue_front(player_queue_t* queue) {
     if(!queue) {
         fprintf(stderr, "cannot query front of an invalid queue\n");
         return NULL;
     }
 
-    if(!queue->front) {
+    player_queue_slot_t* slot = player_queue_ready_slot(queue);
+    if(!slot) {
         fprintf(stderr, "cannot query front of an empty queue\n");
         return NULL;
     }
 
-    return &queue->front->data;
+    return &slot->data;
 }
 
 int player_queue_push(player_queue_t* queue, player_queue_type_t data) {
@@ -51,24 +76,30 @@ int player_queue_push(player_queue_t* queue, player_queue_type_t data) {
         return ERROR; 
     }
 
-    player_queue_node_t* new_node = malloc(sizeof(player_queue_node_t));
-    if(!new_node) {
-        perror("failed to push to player queue");
-        return ERROR;
-    }
-    
-    new_node->data = data;
-    new_node->next = NULL;
-
-    if(!queue->front) {
-        queue->front = new_node;
-        queue->back = new_node;
-    } else {
-        queue->back->next = new_node;
-        queue->back = new_node;
+    //claim a slot by advancing the enqueue position, retrying if another producer got there first.
+    LONG64 position = queue->enqueue_position;
+    player_queue_slot_t* slot;
+    for(;;) {
+        slot = &queue->slots[position & queue->mask];
+        LONG64 difference = slot->sequence - position;
+
+        if(difference == 0) {
+            LONG64 observed = InterlockedCompareExchange64(&queue->enqueue_position, position + 1, position);
+            if(observed == position) break;
+            position = observed;
+        } else if(difference < 0) {
+            //the slot still holds an element from the previous lap, the queue is full.
+            return ERROR;
+        } else {
+            position = queue->enqueue_position;
+        }
     }
 
-    ++queue->size;
+    slot->data = data;
+
+    //publish the data before the sequence so the consumer never sees a half written slot.
+    MemoryBarrier();
+    slot->sequence = position + 1;
     
     return SUCCESS;
 }
@@ -79,15 +110,17 @@ int player_queue_pop(player_queue_t* queue) {
         return ERROR;
     }
 
-    if(!queue->front) {
+    player_queue_slot_t* slot = player_queue_ready_slot(queue);
+    if(!slot) {
         fprintf(stderr, "cannot pop an empty queue\n");
         return ERROR;
     }
 
-    player_queue_node_t* temp_node = queue->front;
-    queue->front = temp_node->next;
-    free(temp_node);
-    --queue->size;
+    //hand the slot back to producers for the next lap around the ring.
+    LONG64 position = queue->dequeue_position;
+    MemoryBarrier();
+    slot->sequence = position + queue->mask + 1;
+    queue->dequeue_position = position + 1;
 
     return SUCCESS;
 }
@@ -98,16 +131,10 @@ int player_queue_clear(player_queue_t* queue) {
         return ERROR; 
     }
     
-    player_queue_node_t* current_node = queue->front;
-    while(current_node) {
-        player_queue_node_t* next_node = current_node->next;
-        free(current_node);
-        current_node = next_node;
+    while(player_queue_ready_slot(queue)) {
+        player_queue_pop(queue);
     }
 
-    queue->front = queue->back = NULL;
-    queue->size = 0;
-
     return SUCCESS;
 }
 
@@ -117,7 +144,7 @@ int player_queue_is_empty(player_queue_t* queue) {
         return ERROR;
     }
 
-    if(queue->size > 0) return FALSE;
+    if(player_queue_ready_slot(queue)) return FALSE;
     return TRUE;
 }
 
@@ -127,5 +154,6 @@ size_t player_queue_size(player_queue_t* queue) {
         return ERROR;
     }
 
-    return queue->size;
+    LONG64 size = queue->enqueue_position - queue->dequeue_position;
+    return size > 0 ? (size_t) size : 0;
 }
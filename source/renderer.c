@@ -0,0 +1,238 @@
+// Filename: renderer.c
+// Programmer(s): Abdurrahman Alyajouri
+// Date: 10/19/2026
+// Purpose: To implement the api functions defined in renderer.h
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "renderer.h"
+
+#define WALL_CHAR 'x'
+
+renderer_t* renderer_init(int frames_per_second) {
+    renderer_t* renderer = calloc(1, sizeof(renderer_t));
+    if(!renderer) {
+        perror("failed to initialize renderer");
+        return NULL;
+    }
+
+    renderer->frame_interval_ms = frames_per_second > 0 ? 1000 / (ULONGLONG) frames_per_second : 0;
+    return renderer;
+}
+
+static void release_frames(renderer_t* renderer) {
+    free(renderer->maze);
+    free(renderer->back);
+    free(renderer->front);
+    free(renderer->dirty_rows);
+    free(renderer->batch);
+    renderer->maze = renderer->back = renderer->front = renderer->batch = NULL;
+    renderer->dirty_rows = NULL;
+    renderer->width = renderer->height = 0;
+    renderer->dirty_count = 0;
+    renderer->player_count = 0;
+}
+
+int renderer_free(renderer_t* renderer) {
+    if(!renderer) {
+        fprintf(stderr, "cannot free an invalid renderer\n");
+        return ERROR;
+    }
+
+    release_frames(renderer);
+    free(renderer);
+    return SUCCESS;
+}
+
+//the character print_maze() puts at a position of its 3x3 layout of a cell: corners are always walls, the middle of a
+//side is open if the cell has no wall there and the center is open if any side is.
+static char layout_char(maze_t* maze, int layout_row, int layout_column) {
+    maze_cell_t* cell = &maze->cells[layout_row / 3][layout_column / 3];
+    int row = layout_row % 3;
+    int column = layout_column % 3;
+
+    if(row != 1 && column != 1) return WALL_CHAR;
+    if(row == 1 && column == 1) {
+        int open = maze_cell_check_wall(cell, NORTH) == FALSE || maze_cell_check_wall(cell, SOUTH) == FALSE ||
+                   maze_cell_check_wall(cell, EAST) == FALSE || maze_cell_check_wall(cell, WEST) == FALSE;
+        return open ? ' ' : WALL_CHAR;
+    }
+
+    uint8_t direction = row == 0 ? NORTH : row == 2 ? SOUTH : column == 0 ? WEST : EAST;
+    return maze_cell_check_wall(cell, direction) == FALSE ? ' ' : WALL_CHAR;
+}
+
+static void mark_dirty(renderer_t* renderer, int y) {
+    if(renderer->dirty_rows[y] == FALSE) {
+        renderer->dirty_rows[y] = TRUE;
+        ++renderer->dirty_count;
+    }
+}
+
+int renderer_set_maze(renderer_t* renderer, maze_t* maze, platform_point_t origin) {
+    release_frames(renderer);
+
+    platform_point_t terminal = platform_terminal_size();
+    int width = maze->columns * 3 * 2;
+    int height = maze->rows * 3;
+    if(width > terminal.x - origin.x) width = terminal.x - origin.x;
+    if(height > terminal.y - origin.y - RENDERER_MESSAGE_LINES) height = terminal.y - origin.y - RENDERER_MESSAGE_LINES;
+    if(width <= 0 || height <= 0) {
+        fprintf(stderr, "the terminal is too small to draw the maze\n");
+        return ERROR;
+    }
+
+    size_t frame_size = (size_t) width * height;
+    //worst case every other run of changes is one cell long, each with a cursor movement in front of it.
+    size_t batch_capacity = (size_t) height * (2 * width + 24) + 64;
+    renderer->maze = malloc(frame_size);
+    renderer->back = malloc(frame_size);
+    renderer->front = calloc(frame_size, 1);
+    renderer->dirty_rows = calloc(height, 1);
+    renderer->batch = malloc(batch_capacity);
+    if(!renderer->maze || !renderer->back || !renderer->front || !renderer->dirty_rows || !renderer->batch) {
+        perror("failed to initialize renderer frames");
+        release_frames(renderer);
+        return ERROR;
+    }
+
+    renderer->origin = origin;
+    renderer->width = width;
+    renderer->height = height;
+    renderer->batch_capacity = batch_capacity;
+    for(int y = 0; y < height; ++y) {
+        for(int x = 0; x < width; ++x) {
+            renderer->maze[y * width + x] = x % 2 == 1 ? ' ' : layout_char(maze, y, x / 2);
+        }
+        mark_dirty(renderer, y);
+    }
+    memcpy(renderer->back, renderer->maze, frame_size);
+
+    //the front frame is unknown, so every cell differs and the first frame draws everything right away.
+    renderer->first_frame = TRUE;
+    renderer->last_frame_ms = 0;
+    return SUCCESS;
+}
+
+void renderer_clear_players(renderer_t* renderer) {
+    for(int i = 0; i < renderer->player_count; ++i) {
+        platform_point_t cell = renderer->players[i];
+        renderer->back[cell.y * renderer->width + cell.x] = renderer->maze[cell.y * renderer->width + cell.x];
+        mark_dirty(renderer, cell.y);
+    }
+    renderer->player_count = 0;
+}
+
+void renderer_put_player(renderer_t* renderer, int row, int column, char symbol) {
+    //players stand in the center of their cell.
+    int x = (column * 3 + 1) * 2;
+    int y = row * 3 + 1;
+    if(row < 0 || column < 0 || x >= renderer->width || y >= renderer->height) return;
+    if(renderer->player_count == RENDERER_MAX_PLAYERS) return;
+
+    renderer->back[y * renderer->width + x] = symbol;
+    renderer->players[renderer->player_count].x = x;
+    renderer->players[renderer->player_count].y = y;
+    ++renderer->player_count;
+    mark_dirty(renderer, y);
+}
+
+//drops dirty marks from rows that ended up the same as on screen, a player taken off and put back in the same cell
+//leaves nothing to draw.
+static void settle_dirty_rows(renderer_t* renderer) {
+    for(int y = 0; y < renderer->height && renderer->dirty_count > 0; ++y) {
+        if(renderer->dirty_rows[y] == FALSE) continue;
+        size_t offset = (size_t) y * renderer->width;
+        if(memcmp(renderer->back + offset, renderer->front + offset, renderer->width) == 0) {
+            renderer->dirty_rows[y] = FALSE;
+            --renderer->dirty_count;
+        }
+    }
+}
+
+int renderer_wait_ms(renderer_t* renderer, ULONGLONG now_ms) {
+    settle_dirty_rows(renderer);
+    if(renderer->dirty_count == 0) return -1;
+
+    ULONGLONG since_frame_ms = now_ms - renderer->last_frame_ms;
+    return since_frame_ms >= renderer->frame_interval_ms ? 0 : (int)(renderer->frame_interval_ms - since_frame_ms);
+}
+
+static void append(renderer_t* renderer, size_t* length, const char* data, size_t size) {
+    memcpy(renderer->batch + *length, data, size);
+    *length += size;
+}
+
+static void append_cursor_move(renderer_t* renderer, size_t* length, int x, int y) {
+    *length += (size_t) snprintf(renderer->batch + *length, renderer->batch_capacity - *length, "\x1b[%d;%dH",
+                                 renderer->origin.y + y + 1, renderer->origin.x + x + 1);
+}
+
+//writes the dirty rows of the composed frame in one batch.
+static int draw_frame(renderer_t* renderer, ULONGLONG now_ms) {
+    //the cursor is hidden while it jumps around, so it doesn't flicker across the maze.
+    size_t length = 0;
+    if(renderer->first_frame == FALSE) append(renderer, &length, "\x1b" "7", 2);
+    append(renderer, &length, "\x1b[?25l", 6);
+
+    for(int y = 0; y < renderer->height; ++y) {
+        if(renderer->dirty_rows[y] == FALSE) continue;
+
+        const char* back = renderer->back + (size_t) y * renderer->width;
+        char* front = renderer->front + (size_t) y * renderer->width;
+        int x = 0;
+        while(x < renderer->width) {
+            if(back[x] == front[x]) {
+                ++x;
+                continue;
+            }
+
+            //a run of changes ends once more than RENDERER_MAX_GAP unchanged cells follow it.
+            int start = x;
+            int end = x + 1;
+            int unchanged = 0;
+            for(int i = end; i < renderer->width && unchanged <= RENDERER_MAX_GAP; ++i) {
+                if(back[i] == front[i]) {
+                    ++unchanged;
+                } else {
+                    unchanged = 0;
+                    end = i + 1;
+                }
+            }
+
+            append_cursor_move(renderer, &length, start, y);
+            append(renderer, &length, back + start, end - start);
+            x = end;
+        }
+
+        memcpy(front, back, renderer->width);
+        renderer->dirty_rows[y] = FALSE;
+    }
+    renderer->dirty_count = 0;
+
+    append(renderer, &length, "\x1b[?25h", 6);
+    if(renderer->first_frame == TRUE) {
+        //whatever is printed next goes below the maze, like after print_maze().
+        length += (size_t) snprintf(renderer->batch + length, renderer->batch_capacity - length, "\x1b[%d;1H",
+                                    renderer->origin.y + renderer->height + 1);
+        renderer->first_frame = FALSE;
+    } else {
+        append(renderer, &length, "\x1b" "8", 2);
+    }
+
+    renderer->last_frame_ms = now_ms;
+    return platform_write_terminal(renderer->batch, length) == SUCCESS;
+}
+
+int renderer_present(renderer_t* renderer, ULONGLONG now_ms) {
+    if(renderer_wait_ms(renderer, now_ms) != 0) return FALSE;
+    return draw_frame(renderer, now_ms);
+}
+
+int renderer_flush(renderer_t* renderer) {
+    settle_dirty_rows(renderer);
+    if(renderer->dirty_count == 0) return FALSE;
+    return draw_frame(renderer, platform_now_ms());
+}
@@ -0,0 +1,426 @@
+// Filename: replay.c
+// Programmer(s): Abdurrahman Alyajouri
+// Date: 10/19/2026
+// Purpose: To implement the api functions defined in replay.h
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "replay.h"
+#include "networking_utils.h"
+
+//header field offsets.
+#define REPLAY_OFFSET_VERSION       4
+#define REPLAY_OFFSET_PLAYERS       5
+#define REPLAY_OFFSET_ROWS          6
+#define REPLAY_OFFSET_COLUMNS       7
+#define REPLAY_OFFSET_SESSION       8
+#define REPLAY_OFFSET_RACE          12
+#define REPLAY_OFFSET_STARTED       16
+#define REPLAY_OFFSET_DURATION      24
+#define REPLAY_OFFSET_EVENTS        28
+#define REPLAY_OFFSET_INDEX         32
+#define REPLAY_OFFSET_INDEX_COUNT   36
+#define REPLAY_OFFSET_OUTCOME       40
+#define REPLAY_OFFSET_WINNER        41
+
+static void put_u16(uint8_t* buffer, uint16_t value) {
+    buffer[0] = (uint8_t)(value >> 8);
+    buffer[1] = (uint8_t) value;
+}
+
+static void put_u32(uint8_t* buffer, uint32_t value) {
+    for(int i = 0; i < 4; ++i) buffer[i] = (uint8_t)(value >> (24 - i * 8));
+}
+
+static void put_u64(uint8_t* buffer, uint64_t value) {
+    put_u32(buffer, (uint32_t)(value >> 32));
+    put_u32(buffer + 4, (uint32_t) value);
+}
+
+static uint16_t get_u16(const uint8_t* buffer) {
+    return (uint16_t)((buffer[0] << 8) | buffer[1]);
+}
+
+static uint32_t get_u32(const uint8_t* buffer) {
+    return ((uint32_t) buffer[0] << 24) | ((uint32_t) buffer[1] << 16) | ((uint32_t) buffer[2] << 8) | (uint32_t) buffer[3];
+}
+
+static uint64_t get_u64(const uint8_t* buffer) {
+    return ((uint64_t) get_u32(buffer) << 32) | get_u32(buffer + 4);
+}
+
+//makes room for length more bytes, doubling the buffer so appending stays cheap.
+static uint8_t* reserve(uint8_t** buffer, size_t* capacity, size_t used, size_t length) {
+    if(used + length > *capacity) {
+        size_t new_capacity = *capacity == 0 ? 256 : *capacity;
+        while(used + length > new_capacity) new_capacity *= 2;
+
+        uint8_t* grown = realloc(*buffer, new_capacity);
+        if(grown == NULL) return NULL;
+        *buffer = grown;
+        *capacity = new_capacity;
+    }
+    return *buffer + used;
+}
+
+replay_recorder_t* replay_recorder_init(maze_t* maze, int player_count, uint32_t session_id, uint32_t race, uint64_t started_at_ms) {
+    if(player_count < 1 || player_count > REPLAY_MAX_PLAYERS) {
+        fprintf(stderr, "cannot record a replay of %d players\n", player_count);
+        return NULL;
+    }
+
+    replay_recorder_t* recorder = calloc(1, sizeof(replay_recorder_t));
+    if(!recorder) {
+        perror("failed to initialize replay recorder");
+        return NULL;
+    }
+
+    size_t maze_size = (size_t) maze->rows * maze->columns;
+    uint8_t* header = reserve(&recorder->data, &recorder->capacity, 0, REPLAY_HEADER_SIZE + maze_size);
+    if(header == NULL) {
+        perror("failed to initialize replay recorder");
+        free(recorder);
+        return NULL;
+    }
+
+    //the fields only known once the race is over are filled in by replay_recorder_finish().
+    memset(header, 0, REPLAY_HEADER_SIZE);
+    memcpy(header, REPLAY_MAGIC, 4);
+    header[REPLAY_OFFSET_VERSION] = REPLAY_VERSION;
+    header[REPLAY_OFFSET_PLAYERS] = (uint8_t) player_count;
+    header[REPLAY_OFFSET_ROWS] = maze->rows;
+    header[REPLAY_OFFSET_COLUMNS] = maze->columns;
+    put_u32(header + REPLAY_OFFSET_SESSION, session_id);
+    put_u32(header + REPLAY_OFFSET_RACE, race);
+    put_u64(header + REPLAY_OFFSET_STARTED, started_at_ms);
+
+    for(maze_size_t row = 0; row < maze->rows; ++row) {
+        memcpy(header + REPLAY_HEADER_SIZE + (size_t) row * maze->columns, maze->cells[row], maze->columns);
+    }
+
+    recorder->length = REPLAY_HEADER_SIZE + maze_size;
+    recorder->player_count = player_count;
+    return recorder;
+}
+
+int replay_recorder_free(replay_recorder_t* recorder) {
+    if(!recorder) {
+        fprintf(stderr, "cannot free an invalid replay recorder\n");
+        return ERROR;
+    }
+
+    free(recorder->data);
+    free(recorder->index);
+    free(recorder);
+    return SUCCESS;
+}
+
+//writes the index entry due before the next event, if any, and the event's time and kind. returns NULL on failure.
+static uint8_t* begin_event(replay_recorder_t* recorder, uint32_t time_ms, int player, uint8_t kind, size_t extra) {
+    if(recorder->failed == TRUE || player < 0 || player >= recorder->player_count) return NULL;
+
+    if(recorder->event_count % REPLAY_INDEX_INTERVAL == 0) {
+        size_t entry_size = REPLAY_INDEX_ENTRY_SIZE(recorder->player_count);
+        uint8_t* entry = reserve(&recorder->index, &recorder->index_capacity, recorder->index_length, entry_size);
+        if(entry == NULL) {
+            recorder->failed = TRUE;
+            return NULL;
+        }
+
+        //the state before the event, including the time of the event before it that its delta counts from.
+        put_u32(entry, recorder->event_count);
+        put_u32(entry + 4, (uint32_t) recorder->length);
+        put_u32(entry + 8, recorder->last_ms);
+        put_u16(entry + 12, recorder->left);
+        for(int i = 0; i < recorder->player_count; ++i) {
+            entry[14 + i * 2] = (uint8_t) recorder->rows[i];
+            entry[15 + i * 2] = (uint8_t) recorder->columns[i];
+        }
+        recorder->index_length += entry_size;
+        ++recorder->index_count;
+    }
+
+    //5 bytes of varint at most, then the player and kind.
+    uint8_t* event = reserve(&recorder->data, &recorder->capacity, recorder->length, 6 + extra);
+    if(event == NULL) {
+        recorder->failed = TRUE;
+        return NULL;
+    }
+
+    //events never go back in time, a clock that did is clamped.
+    uint32_t delta = time_ms > recorder->last_ms ? time_ms - recorder->last_ms : 0;
+    recorder->last_ms += delta;
+
+    int length = 0;
+    do {
+        event[length] = (uint8_t)(delta & 0x7F);
+        delta >>= 7;
+        if(delta != 0) event[length] |= 0x80;
+        ++length;
+    } while(delta != 0);
+    event[length++] = (uint8_t)((player << 4) | kind);
+
+    recorder->length += length + extra;
+    ++recorder->event_count;
+    return event + length;
+}
+
+int replay_record_step(replay_recorder_t* recorder, uint32_t time_ms, int player, uint8_t direction) {
+    if(!recorder) {
+        fprintf(stderr, "cannot record to an invalid replay recorder\n");
+        return ERROR;
+    }
+
+    if(begin_event(recorder, time_ms, player, direction & 0b11, 0) == NULL) return ERROR;
+    mrmp_apply_step(direction & 0b11, &recorder->rows[player], &recorder->columns[player]);
+    return SUCCESS;
+}
+
+int replay_record_rejected(replay_recorder_t* recorder, uint32_t time_ms, int player, maze_size_t row, maze_size_t column) {
+    if(!recorder) {
+        fprintf(stderr, "cannot record to an invalid replay recorder\n");
+        return ERROR;
+    }
+
+    uint8_t* target = begin_event(recorder, time_ms, player, REPLAY_EVENT_REJECTED, 2);
+    if(target == NULL) return ERROR;
+    target[0] = row;
+    target[1] = column;
+    return SUCCESS;
+}
+
+int replay_record_leave(replay_recorder_t* recorder, uint32_t time_ms, int player) {
+    if(!recorder) {
+        fprintf(stderr, "cannot record to an invalid replay recorder\n");
+        return ERROR;
+    }
+
+    if(begin_event(recorder, time_ms, player, REPLAY_EVENT_LEAVE, 0) == NULL) return ERROR;
+    recorder->left |= (uint16_t)(1 << player);
+    return SUCCESS;
+}
+
+uint8_t* replay_recorder_finish(replay_recorder_t* recorder, uint8_t outcome, uint8_t winner, uint32_t duration_ms, size_t* out_length) {
+    if(!recorder) {
+        fprintf(stderr, "cannot finish an invalid replay recorder\n");
+        return NULL;
+    }
+
+    uint8_t* index = recorder->failed == TRUE ? NULL : reserve(&recorder->data, &recorder->capacity, recorder->length, recorder->index_length);
+    if(index == NULL) {
+        replay_recorder_free(recorder);
+        return NULL;
+    }
+
+    if(recorder->index_length > 0) memcpy(index, recorder->index, recorder->index_length);
+    uint8_t* header = recorder->data;
+    put_u32(header + REPLAY_OFFSET_DURATION, duration_ms);
+    put_u32(header + REPLAY_OFFSET_EVENTS, recorder->event_count);
+    put_u32(header + REPLAY_OFFSET_INDEX, (uint32_t) recorder->length);
+    put_u32(header + REPLAY_OFFSET_INDEX_COUNT, recorder->index_count);
+    header[REPLAY_OFFSET_OUTCOME] = outcome;
+    header[REPLAY_OFFSET_WINNER] = winner;
+
+    uint8_t* data = recorder->data;
+    *out_length = recorder->length + recorder->index_length;
+    recorder->data = NULL;
+    replay_recorder_free(recorder);
+    return data;
+}
+
+int replay_parse(replay_t* replay, const uint8_t* data, size_t length) {
+    if(length < REPLAY_HEADER_SIZE || memcmp(data, REPLAY_MAGIC, 4) != 0 || data[REPLAY_OFFSET_VERSION] != REPLAY_VERSION) return ERROR;
+
+    replay->data = data;
+    replay->length = length;
+    replay->version = data[REPLAY_OFFSET_VERSION];
+    replay->player_count = data[REPLAY_OFFSET_PLAYERS];
+    replay->rows = data[REPLAY_OFFSET_ROWS];
+    replay->columns = data[REPLAY_OFFSET_COLUMNS];
+    replay->session_id = get_u32(data + REPLAY_OFFSET_SESSION);
+    replay->race = get_u32(data + REPLAY_OFFSET_RACE);
+    replay->started_at_ms = get_u64(data + REPLAY_OFFSET_STARTED);
+    replay->duration_ms = get_u32(data + REPLAY_OFFSET_DURATION);
+    replay->event_count = get_u32(data + REPLAY_OFFSET_EVENTS);
+    replay->index_offset = get_u32(data + REPLAY_OFFSET_INDEX);
+    replay->index_count = get_u32(data + REPLAY_OFFSET_INDEX_COUNT);
+    replay->outcome = data[REPLAY_OFFSET_OUTCOME];
+    replay->winner = data[REPLAY_OFFSET_WINNER];
+
+    //every section has to lie within the file, in order.
+    size_t events_offset = REPLAY_HEADER_SIZE + (size_t) replay->rows * replay->columns;
+    if(replay->player_count < 1 || replay->player_count > REPLAY_MAX_PLAYERS || replay->rows == 0 || replay->columns == 0) return ERROR;
+    if(events_offset > replay->index_offset || replay->index_offset > length) return ERROR;
+    if((length - replay->index_offset) / REPLAY_INDEX_ENTRY_SIZE(replay->player_count) < replay->index_count) return ERROR;
+
+    replay->cells = data + REPLAY_HEADER_SIZE;
+    replay->events = data + events_offset;
+    replay->index = data + replay->index_offset;
+    return SUCCESS;
+}
+
+replay_t* replay_open(const char* path) {
+    replay_t* replay = calloc(1, sizeof(replay_t));
+    if(!replay) {
+        perror("failed to initialize replay");
+        return NULL;
+    }
+
+    //the file is read in place, pages are only faulted in as events are read.
+    if(platform_map_file(path, &replay->mapping) == ERROR) {
+        fprintf(stderr, "failed to open replay %s\n", path);
+        free(replay);
+        return NULL;
+    }
+
+    if(replay_parse(replay, replay->mapping.data, replay->mapping.length) == ERROR) {
+        fprintf(stderr, "%s is not a valid replay\n", path);
+        replay_close(replay);
+        return NULL;
+    }
+
+    return replay;
+}
+
+int replay_close(replay_t* replay) {
+    if(!replay) {
+        fprintf(stderr, "cannot free an invalid replay\n");
+        return ERROR;
+    }
+
+    platform_unmap_file(&replay->mapping);
+    free(replay);
+    return SUCCESS;
+}
+
+maze_t* replay_maze(const replay_t* replay) {
+    maze_t* maze = malloc(sizeof(maze_t));
+    maze_cell_t** cells = maze == NULL ? NULL : calloc(replay->rows, sizeof(maze_cell_t*));
+    if(cells == NULL) {
+        perror("failed to build the replay's maze");
+        free(maze);
+        return NULL;
+    }
+
+    maze->rows = replay->rows;
+    maze->columns = replay->columns;
+    maze->cells = cells;
+    for(maze_size_t row = 0; row < maze->rows; ++row) {
+        maze->cells[row] = malloc(sizeof(maze_cell_t) * maze->columns);
+        if(maze->cells[row] == NULL) {
+            perror("failed to build the replay's maze");
+            maze->rows = row;
+            free_maze(maze);
+            return NULL;
+        }
+        memcpy(maze->cells[row], replay->cells + (size_t) row * maze->columns, maze->columns);
+    }
+
+    return maze;
+}
+
+void replay_cursor_init(replay_cursor_t* cursor, const replay_t* replay) {
+    memset(cursor, 0, sizeof(replay_cursor_t));
+    cursor->replay = replay;
+    cursor->offset = (size_t)(replay->events - replay->data);
+}
+
+int replay_next(replay_cursor_t* cursor, replay_event_t* out_event) {
+    const replay_t* replay = cursor->replay;
+    if(cursor->event >= replay->event_count) return ERROR;
+
+    //the varint, then the player and kind, must end before the index does.
+    uint32_t delta = 0;
+    size_t offset = cursor->offset;
+    for(int shift = 0; ; shift += 7) {
+        if(offset >= replay->index_offset || shift > 28) return ERROR;
+        uint8_t byte = replay->data[offset++];
+        delta |= (uint32_t)(byte & 0x7F) << shift;
+        if((byte & 0x80) == 0) break;
+    }
+    if(offset >= replay->index_offset) return ERROR;
+
+    replay_event_t event;
+    event.time_ms = cursor->time_ms + delta;
+    event.player = replay->data[offset] >> 4;
+    event.kind = replay->data[offset] & 0x0F;
+    ++offset;
+    if(event.player >= replay->player_count) return ERROR;
+
+    switch(event.kind) {
+        case REPLAY_EVENT_STEP_NORTH:
+        case REPLAY_EVENT_STEP_EAST:
+        case REPLAY_EVENT_STEP_SOUTH:
+        case REPLAY_EVENT_STEP_WEST:
+            mrmp_apply_step(event.kind, &cursor->rows[event.player], &cursor->columns[event.player]);
+            event.row = cursor->rows[event.player];
+            event.column = cursor->columns[event.player];
+            break;
+        case REPLAY_EVENT_REJECTED:
+            if(offset + 2 > replay->index_offset) return ERROR;
+            event.row = replay->data[offset];
+            event.column = replay->data[offset + 1];
+            offset += 2;
+            break;
+        case REPLAY_EVENT_LEAVE:
+            cursor->left |= (uint16_t)(1 << event.player);
+            event.row = cursor->rows[event.player];
+            event.column = cursor->columns[event.player];
+            break;
+        default:
+            return ERROR;
+    }
+
+    cursor->offset = offset;
+    cursor->time_ms = event.time_ms;
+    ++cursor->event;
+    if(out_event != NULL) *out_event = event;
+    return SUCCESS;
+}
+
+int replay_seek(replay_cursor_t* cursor, uint32_t time_ms) {
+    const replay_t* replay = cursor->replay;
+    size_t entry_size = REPLAY_INDEX_ENTRY_SIZE(replay->player_count);
+
+    //the last index entry whose state is from no later than time_ms, entries are in time order.
+    int low = 0, high = (int) replay->index_count - 1, found = -1;
+    while(low <= high) {
+        int middle = low + (high - low) / 2;
+        if(get_u32(replay->index + (size_t) middle * entry_size + 8) <= time_ms) {
+            found = middle;
+            low = middle + 1;
+        } else {
+            high = middle - 1;
+        }
+    }
+
+    replay_cursor_init(cursor, replay);
+    if(found != -1) {
+        const uint8_t* entry = replay->index + (size_t) found * entry_size;
+        uint32_t event = get_u32(entry);
+        uint32_t offset = get_u32(entry + 4);
+        if(event > replay->event_count || offset < (size_t)(replay->events - replay->data) || offset > replay->index_offset) return ERROR;
+
+        cursor->event = event;
+        cursor->offset = offset;
+        cursor->time_ms = get_u32(entry + 8);
+        cursor->left = get_u16(entry + 12);
+        for(int i = 0; i < replay->player_count; ++i) {
+            cursor->rows[i] = entry[14 + i * 2];
+            cursor->columns[i] = entry[15 + i * 2];
+        }
+    }
+
+    //then decode forward, leaving the first event past time_ms unread.
+    while(cursor->event < replay->event_count) {
+        replay_cursor_t next = *cursor;
+        replay_event_t event;
+        if(replay_next(&next, &event) == ERROR) return ERROR;
+        if(event.time_ms > time_ms) break;
+        *cursor = next;
+    }
+
+    return SUCCESS;
+}
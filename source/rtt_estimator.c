@@ -0,0 +1,34 @@
+// Filename: rtt_estimator.c
+// Programmer(s): Abdurrahman Alyajouri
+// Date: 10/19/2026
+// Purpose: To implement the api functions defined in rtt_estimator.h
+
+#include "rtt_estimator.h"
+
+void rtt_estimator_init(rtt_estimator_t* estimator) {
+    estimator->srtt_us = 0;
+    estimator->rttvar_us = 0;
+    estimator->samples = 0;
+}
+
+void rtt_estimator_sample(rtt_estimator_t* estimator, uint32_t rtt_us) {
+    if(estimator->samples++ == 0) {
+        estimator->srtt_us = rtt_us;
+        estimator->rttvar_us = rtt_us / 2;
+        return;
+    }
+
+    //rttvar = 3/4 rttvar + 1/4 |srtt - rtt|, then srtt = 7/8 srtt + 1/8 rtt, in that order.
+    uint32_t deviation = estimator->srtt_us > rtt_us ? estimator->srtt_us - rtt_us : rtt_us - estimator->srtt_us;
+    estimator->rttvar_us = estimator->rttvar_us - estimator->rttvar_us / 4 + deviation / 4;
+    estimator->srtt_us = estimator->srtt_us - estimator->srtt_us / 8 + rtt_us / 8;
+}
+
+uint32_t rtt_estimator_timeout_ms(rtt_estimator_t* estimator, uint32_t min_ms, uint32_t max_ms) {
+    if(estimator->samples == 0) return max_ms;
+
+    uint64_t timeout_ms = ((uint64_t) estimator->srtt_us + 4 * (uint64_t) estimator->rttvar_us + 999) / 1000;
+    if(timeout_ms < min_ms) return min_ms;
+    if(timeout_ms > max_ms) return max_ms;
+    return (uint32_t) timeout_ms;
+}
@@ -0,0 +1,147 @@
+// Filename: slab_pool.c
+// Programmer(s): Abdurrahman Alyajouri
+// Date: 10/19/2026
+// Purpose: To implement the api functions defined in slab_pool.h
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "slab_pool.h"
+
+//headers are padded so the memory behind them is aligned as well.
+#define ALIGN(size) ((((size) + SLAB_POOL_ALIGNMENT - 1) / SLAB_POOL_ALIGNMENT) * SLAB_POOL_ALIGNMENT)
+#define SLAB_HEADER_SIZE ALIGN(sizeof(slab_pool_slab_t))
+#define CHUNK_HEADER_SIZE ALIGN(sizeof(slab_pool_chunk_t))
+
+static slab_pool_chunk_t* chunk_of(void* memory) {
+    return (slab_pool_chunk_t*)((uint8_t*) memory - CHUNK_HEADER_SIZE);
+}
+
+static void* memory_of(slab_pool_chunk_t* chunk) {
+    return (uint8_t*) chunk + CHUNK_HEADER_SIZE;
+}
+
+slab_pool_t* slab_pool_init(const size_t* class_sizes, int class_count) {
+    slab_pool_t* pool = calloc(1, sizeof(slab_pool_t));
+    if(!pool) {
+        perror("failed to initialize slab pool");
+        return NULL;
+    }
+
+    for(int i = 0; i < class_count && pool->class_count < SLAB_POOL_MAX_CLASSES; ++i) {
+        if(pool->class_count > 0 && class_sizes[i] <= pool->classes[pool->class_count - 1].size) continue;
+
+        slab_pool_class_t* size_class = &pool->classes[pool->class_count++];
+        size_class->size = class_sizes[i];
+        size_class->stride = CHUNK_HEADER_SIZE + ALIGN(class_sizes[i]);
+        size_class->blocks_per_slab = (SLAB_POOL_SLAB_SIZE - SLAB_HEADER_SIZE) / size_class->stride;
+        if(size_class->blocks_per_slab == 0) size_class->blocks_per_slab = 1;
+    }
+
+    return pool;
+}
+
+int slab_pool_free(slab_pool_t* pool) {
+    if(!pool) {
+        fprintf(stderr, "cannot free an invalid slab pool\n");
+        return ERROR;
+    }
+
+    for(int i = 0; i < pool->class_count; ++i) {
+        slab_pool_slab_t* slab = pool->classes[i].slabs;
+        while(slab != NULL) {
+            slab_pool_slab_t* next = slab->next;
+            free(slab);
+            slab = next;
+        }
+    }
+
+    free(pool);
+    return SUCCESS;
+}
+
+//carves a new slab into blocks and puts them all on the class's free list.
+static int grow_class(slab_pool_class_t* size_class, uint32_t class_index) {
+    slab_pool_slab_t* slab = malloc(SLAB_HEADER_SIZE + size_class->stride * size_class->blocks_per_slab);
+    if(slab == NULL) return ERROR;
+
+    slab->next = size_class->slabs;
+    size_class->slabs = slab;
+    ++size_class->slab_count;
+
+    //pushed back to front, so blocks are handed out in address order.
+    uint8_t* blocks = (uint8_t*) slab + SLAB_HEADER_SIZE;
+    for(size_t i = size_class->blocks_per_slab; i > 0; --i) {
+        slab_pool_chunk_t* chunk = (slab_pool_chunk_t*)(blocks + (i - 1) * size_class->stride);
+        chunk->size_class = class_index;
+        chunk->link.next = size_class->free_list;
+        size_class->free_list = chunk;
+    }
+
+    return SUCCESS;
+}
+
+void* slab_pool_alloc(slab_pool_t* pool, size_t size) {
+    int class_index = 0;
+    while(pool != NULL && class_index < pool->class_count && pool->classes[class_index].size < size) ++class_index;
+
+    if(pool == NULL || class_index == pool->class_count) {
+        slab_pool_chunk_t* chunk = malloc(CHUNK_HEADER_SIZE + size);
+        if(chunk == NULL) return NULL;
+        chunk->link.pool = pool;
+        chunk->size_class = SLAB_POOL_HEAP_CLASS;
+        if(pool != NULL) {
+            ++pool->heap_in_use;
+            ++pool->heap_allocations;
+        }
+        return memory_of(chunk);
+    }
+
+    slab_pool_class_t* size_class = &pool->classes[class_index];
+    if(size_class->free_list == NULL && grow_class(size_class, (uint32_t) class_index) == ERROR) {
+        fprintf(stderr, "failed to malloc() a slab of %zu byte blocks.\n", size_class->size);
+        return NULL;
+    }
+
+    slab_pool_chunk_t* chunk = size_class->free_list;
+    size_class->free_list = chunk->link.next;
+    chunk->link.pool = pool;
+
+    ++size_class->allocations;
+    if(++size_class->in_use > size_class->in_use_peak) size_class->in_use_peak = size_class->in_use;
+    return memory_of(chunk);
+}
+
+void slab_pool_release(void* memory) {
+    if(memory == NULL) return;
+
+    slab_pool_chunk_t* chunk = chunk_of(memory);
+    slab_pool_t* pool = chunk->link.pool;
+    if(chunk->size_class == SLAB_POOL_HEAP_CLASS) {
+        if(pool != NULL) --pool->heap_in_use;
+        free(chunk);
+        return;
+    }
+
+    slab_pool_class_t* size_class = &pool->classes[chunk->size_class];
+    chunk->link.next = size_class->free_list;
+    size_class->free_list = chunk;
+    --size_class->in_use;
+}
+
+void slab_pool_print(slab_pool_t* pool, FILE* file) {
+    fprintf(file, "%-12s %-8s %-10s %-10s %-12s %-12s\n", "block bytes", "slabs", "in use", "peak", "occupied %", "allocations");
+    for(int i = 0; i < pool->class_count; ++i) {
+        slab_pool_class_t* size_class = &pool->classes[i];
+        uint32_t in_use = size_class->in_use;
+        uint64_t blocks = (uint64_t) size_class->slab_count * size_class->blocks_per_slab;
+        fprintf(file, "%-12zu %-8lu %-10lu %-10lu %-12.1f %-12llu\n", size_class->size,
+            (unsigned long) size_class->slab_count,
+            (unsigned long) in_use,
+            (unsigned long) size_class->in_use_peak,
+            blocks == 0 ? 0.0 : 100.0 * in_use / blocks,
+            (unsigned long long) size_class->allocations);
+    }
+    fprintf(file, "%llu allocations were too large for every class and came from the heap, %lu of them are in use.\n",
+        (unsigned long long) pool->heap_allocations, (unsigned long) pool->heap_in_use);
+}
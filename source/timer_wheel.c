@@ -0,0 +1,147 @@
+// Filename: timer_wheel.c
+// Programmer(s): Abdurrahman Alyajouri
+// Date: 10/19/2026
+// Purpose: To implement the api functions defined in timer_wheel.h
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "timer_wheel.h"
+
+#define TIMER_WHEEL_MASK        (TIMER_WHEEL_SLOTS - 1)
+#define TIMER_WHEEL_MAX_DELTA   ((1ULL << (TIMER_WHEEL_SLOT_BITS * TIMER_WHEEL_LEVELS)) - 1)
+
+static void link_timer(timer_wheel_timer_t** head, timer_wheel_timer_t* timer) {
+    timer->next = *head;
+    if(*head != NULL) (*head)->pprev = &timer->next;
+    *head = timer;
+    timer->pprev = head;
+}
+
+static void unlink_timer(timer_wheel_timer_t* timer) {
+    *timer->pprev = timer->next;
+    if(timer->next != NULL) timer->next->pprev = timer->pprev;
+    timer->next = NULL;
+    timer->pprev = NULL;
+}
+
+//a timer goes into the lowest level whose range covers its distance from the current tick, a level's slot being
+//picked by the bits of the expiry tick that level is responsible for.
+static void place_timer(timer_wheel_t* wheel, timer_wheel_timer_t* timer) {
+    uint64_t delta = timer->expires_tick - wheel->current_tick;
+
+    int level = 0;
+    while(level < TIMER_WHEEL_LEVELS - 1 && delta >= (1ULL << (TIMER_WHEEL_SLOT_BITS * (level + 1)))) {
+        ++level;
+    }
+
+    int slot = (int)((timer->expires_tick >> (TIMER_WHEEL_SLOT_BITS * level)) & TIMER_WHEEL_MASK);
+    link_timer(&wheel->slots[level][slot], timer);
+}
+
+//moves every timer of the level's current slot down to where it belongs now that its range has come up.
+static void cascade(timer_wheel_t* wheel, int level) {
+    int slot = (int)((wheel->current_tick >> (TIMER_WHEEL_SLOT_BITS * level)) & TIMER_WHEEL_MASK);
+
+    timer_wheel_timer_t* timer = wheel->slots[level][slot];
+    wheel->slots[level][slot] = NULL;
+    while(timer != NULL) {
+        timer_wheel_timer_t* next = timer->next;
+        place_timer(wheel, timer);
+        timer = next;
+    }
+}
+
+timer_wheel_t* timer_wheel_init(uint64_t now_ms, uint64_t granularity_ms) {
+    timer_wheel_t* wheel = calloc(1, sizeof(timer_wheel_t));
+    if(!wheel) {
+        perror("failed to initialize timer wheel");
+        return NULL;
+    }
+
+    wheel->granularity_ms = granularity_ms == 0 ? 1 : granularity_ms;
+    wheel->current_tick = now_ms / wheel->granularity_ms;
+    return wheel;
+}
+
+int timer_wheel_free(timer_wheel_t* wheel) {
+    if(!wheel) {
+        fprintf(stderr, "cannot free an invalid timer wheel\n");
+        return ERROR;
+    }
+
+    free(wheel);
+    return SUCCESS;
+}
+
+void timer_wheel_timer_init(timer_wheel_timer_t* timer, void* data) {
+    timer->next = NULL;
+    timer->pprev = NULL;
+    timer->expires_tick = 0;
+    timer->data = data;
+}
+
+void timer_wheel_arm(timer_wheel_t* wheel, timer_wheel_timer_t* timer, uint64_t deadline_ms) {
+    timer_wheel_cancel(wheel, timer);
+
+    //round up so a timer never fires before its deadline, and never into a slot that was already processed.
+    uint64_t expires_tick = (deadline_ms + wheel->granularity_ms - 1) / wheel->granularity_ms;
+    if(expires_tick <= wheel->current_tick) expires_tick = wheel->current_tick + 1;
+    if(expires_tick - wheel->current_tick > TIMER_WHEEL_MAX_DELTA) expires_tick = wheel->current_tick + TIMER_WHEEL_MAX_DELTA;
+
+    timer->expires_tick = expires_tick;
+    place_timer(wheel, timer);
+    ++wheel->armed_count;
+}
+
+void timer_wheel_cancel(timer_wheel_t* wheel, timer_wheel_timer_t* timer) {
+    if(timer->pprev == NULL) return;
+
+    unlink_timer(timer);
+    --wheel->armed_count;
+}
+
+int timer_wheel_is_armed(timer_wheel_timer_t* timer) {
+    return timer->pprev != NULL;
+}
+
+size_t timer_wheel_advance(timer_wheel_t* wheel, uint64_t now_ms, timer_wheel_callback_t callback, void* context) {
+    uint64_t target_tick = now_ms / wheel->granularity_ms;
+    size_t fired = 0;
+
+    while(wheel->current_tick < target_tick) {
+        //nothing can fire, skip straight to the target instead of walking every empty slot.
+        if(wheel->armed_count == 0) {
+            wheel->current_tick = target_tick;
+            break;
+        }
+
+        ++wheel->current_tick;
+
+        //whenever a level wraps around, the next level's slot for the new range is redistributed, top down.
+        int wrapped_levels = 0;
+        while(wrapped_levels < TIMER_WHEEL_LEVELS - 1 &&
+              ((wheel->current_tick >> (TIMER_WHEEL_SLOT_BITS * wrapped_levels)) & TIMER_WHEEL_MASK) == 0) {
+            ++wrapped_levels;
+        }
+        for(int level = wrapped_levels; level > 0; --level) {
+            cascade(wheel, level);
+        }
+
+        //detach the due slot first, so timers armed by the callbacks can't end up in the list being walked.
+        int slot = (int)(wheel->current_tick & TIMER_WHEEL_MASK);
+        timer_wheel_timer_t* due = wheel->slots[0][slot];
+        wheel->slots[0][slot] = NULL;
+        if(due != NULL) due->pprev = &due;
+
+        while(due != NULL) {
+            timer_wheel_timer_t* timer = due;
+            unlink_timer(timer);
+            --wheel->armed_count;
+            ++fired;
+            callback(timer, context);
+        }
+    }
+
+    return fired;
+}
@@ -0,0 +1,55 @@
+// Filename: token_bucket.c
+// Programmer(s): Abdurrahman Alyajouri
+// Date: 10/19/2026
+// Purpose: To implement the api functions defined in token_bucket.h
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "token_bucket.h"
+
+token_bucket_t* token_bucket_init(double refill_rate, double capacity) {
+    token_bucket_t* bucket = malloc(sizeof(token_bucket_t));
+    if(!bucket) {
+        perror("failed to initialize token bucket");
+        return NULL;
+    }
+
+    bucket->tokens = capacity;
+    bucket->capacity = capacity;
+    bucket->refill_rate = refill_rate;
+    QueryPerformanceFrequency(&bucket->frequency);
+    QueryPerformanceCounter(&bucket->last_refill);
+    return bucket;
+}
+
+int token_bucket_free(token_bucket_t* bucket) {
+    if(!bucket) {
+        fprintf(stderr, "cannot free an invalid token bucket\n");
+        return ERROR;
+    }
+
+    free(bucket);
+    return SUCCESS;
+}
+
+int token_bucket_take(token_bucket_t* bucket) {
+    if(!bucket) {
+        fprintf(stderr, "cannot take from an invalid token bucket\n");
+        return FALSE;
+    }
+
+    //refill lazily based on the time elapsed since the last call instead of using a timer.
+    LARGE_INTEGER now;
+    QueryPerformanceCounter(&now);
+    double elapsed_seconds = (double)(now.QuadPart - bucket->last_refill.QuadPart) / (double)bucket->frequency.QuadPart;
+    bucket->last_refill = now;
+
+    bucket->tokens += elapsed_seconds * bucket->refill_rate;
+    if(bucket->tokens > bucket->capacity) bucket->tokens = bucket->capacity;
+
+    if(bucket->tokens < 1.0) return FALSE;
+
+    bucket->tokens -= 1.0;
+    return TRUE;
+}
@@ -0,0 +1,160 @@
+// Filename: trace.c
+// Programmer(s): Abdurrahman Alyajouri
+// Date: 10/19/2026
+// Purpose: To implement the api functions defined in trace.h
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "trace.h"
+
+trace_t* trace_init(void) {
+    trace_t* trace = calloc(1, sizeof(trace_t));
+    if(!trace) {
+        perror("failed to initialize trace");
+        return NULL;
+    }
+
+    QueryPerformanceFrequency(&trace->frequency);
+    trace->enabled = FALSE;
+    return trace;
+}
+
+int trace_free(trace_t* trace) {
+    if(!trace) {
+        fprintf(stderr, "cannot free an invalid trace\n");
+        return ERROR;
+    }
+
+    for(int i = 0; i < TRACE_MAX_RINGS; ++i) {
+        free(trace->rings[i]);
+    }
+    free(trace);
+    return SUCCESS;
+}
+
+trace_ring_t* trace_ring(trace_t* trace, const char* name) {
+    trace_ring_t* ring = calloc(1, sizeof(trace_ring_t));
+    if(!ring) {
+        perror("failed to initialize trace ring");
+        return NULL;
+    }
+
+    //readers skip a claimed slot until its pointer is stored.
+    LONG index = InterlockedIncrement(&trace->ring_count) - 1;
+    if(index >= TRACE_MAX_RINGS) {
+        InterlockedDecrement(&trace->ring_count);
+        fprintf(stderr, "cannot hand out more than %d trace rings\n", TRACE_MAX_RINGS);
+        free(ring);
+        return NULL;
+    }
+
+    ring->trace = trace;
+    ring->id = (int) index + 1;
+    strncpy(ring->name, name, TRACE_MAX_NAME - 1);
+    InterlockedExchangePointer((PVOID volatile*) &trace->rings[index], ring);
+    return ring;
+}
+
+void trace_set_enabled(trace_t* trace, int enabled) {
+    InterlockedExchange(&trace->enabled, enabled == TRUE ? TRUE : FALSE);
+}
+
+uint64_t trace_now_us(trace_t* trace) {
+    LARGE_INTEGER counter;
+    QueryPerformanceCounter(&counter);
+    return (uint64_t)(counter.QuadPart / trace->frequency.QuadPart) * 1000000 +
+        (uint64_t)(counter.QuadPart % trace->frequency.QuadPart) * 1000000 / trace->frequency.QuadPart;
+}
+
+static void trace_record(trace_ring_t* ring, char phase, const char* name, uint32_t session_id, uint64_t timestamp_us, uint64_t duration_us) {
+    LONG64 head = ring->head;
+    trace_event_t* event = &ring->events[head & (TRACE_RING_SIZE - 1)];
+    event->timestamp_us = timestamp_us;
+    event->duration_us = duration_us;
+    event->name = name;
+    event->session_id = session_id;
+    event->phase = phase;
+
+    //publishes the event, readers never see head move past an event that isn't fully written.
+    InterlockedExchange64(&ring->head, head + 1);
+}
+
+void trace_begin(trace_ring_t* ring, const char* name, uint32_t session_id) {
+    if(ring == NULL || ring->trace->enabled == FALSE) return;
+    trace_record(ring, TRACE_PHASE_BEGIN, name, session_id, trace_now_us(ring->trace), 0);
+}
+
+void trace_end(trace_ring_t* ring, const char* name, uint32_t session_id) {
+    if(ring == NULL || ring->trace->enabled == FALSE) return;
+    trace_record(ring, TRACE_PHASE_END, name, session_id, trace_now_us(ring->trace), 0);
+}
+
+void trace_complete(trace_ring_t* ring, const char* name, uint32_t session_id, uint64_t started_us) {
+    if(ring == NULL || ring->trace->enabled == FALSE) return;
+    uint64_t now = trace_now_us(ring->trace);
+    trace_record(ring, TRACE_PHASE_COMPLETE, name, session_id, started_us, now > started_us ? now - started_us : 0);
+}
+
+void trace_instant(trace_ring_t* ring, const char* name, uint32_t session_id) {
+    if(ring == NULL || ring->trace->enabled == FALSE) return;
+    trace_record(ring, TRACE_PHASE_INSTANT, name, session_id, trace_now_us(ring->trace), 0);
+}
+
+static int write_event(FILE* file, int* first, trace_ring_t* ring, trace_event_t* event) {
+    int result = fprintf(file, "%s\n{\"name\":\"%s\",\"cat\":\"mrmp\",\"ph\":\"%c\",\"ts\":%llu,\"pid\":1,\"tid\":%d",
+        *first == TRUE ? "" : ",", event->name, event->phase, (unsigned long long) event->timestamp_us, ring->id);
+    *first = FALSE;
+
+    if(result >= 0 && event->phase == TRACE_PHASE_COMPLETE)
+        result = fprintf(file, ",\"dur\":%llu", (unsigned long long) event->duration_us);
+    if(result >= 0 && event->phase == TRACE_PHASE_INSTANT)
+        result = fprintf(file, ",\"s\":\"t\"");
+    if(result >= 0 && event->session_id != 0)
+        result = fprintf(file, ",\"args\":{\"session\":%u}", event->session_id);
+    if(result >= 0)
+        result = fprintf(file, "}");
+    return result < 0 ? ERROR : SUCCESS;
+}
+
+long long trace_write_chrome(trace_t* trace, FILE* file) {
+    trace_event_t* copy = malloc(TRACE_RING_SIZE * sizeof(trace_event_t));
+    if(copy == NULL) {
+        perror("failed to dump trace");
+        return -1;
+    }
+
+    long long written = 0;
+    int first = TRUE;
+    int failed = fprintf(file, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[") < 0;
+
+    LONG count = trace->ring_count < TRACE_MAX_RINGS ? trace->ring_count : TRACE_MAX_RINGS;
+    for(LONG i = 0; i < count && failed == FALSE; ++i) {
+        trace_ring_t* ring = trace->rings[i];
+        if(ring == NULL) continue;
+
+        //names the thread in trace viewers.
+        failed = fprintf(file, "%s\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,\"args\":{\"name\":\"%s\"}}",
+            first == TRUE ? "" : ",", ring->id, ring->name) < 0;
+        first = FALSE;
+
+        //copy first, then drop whatever the writer may have overwritten while we were copying. a writer about to
+        //publish head + 1 is already overwriting the slot of head - TRACE_RING_SIZE, so that one is dropped too.
+        LONG64 head = ring->head;
+        LONG64 oldest = head > TRACE_RING_SIZE ? head - TRACE_RING_SIZE : 0;
+        for(LONG64 sequence = oldest; sequence < head; ++sequence) {
+            copy[sequence & (TRACE_RING_SIZE - 1)] = ring->events[sequence & (TRACE_RING_SIZE - 1)];
+        }
+        LONG64 head_after = ring->head;
+        if(head_after - TRACE_RING_SIZE + 1 > oldest) oldest = head_after - TRACE_RING_SIZE + 1;
+
+        for(LONG64 sequence = oldest; sequence < head && failed == FALSE; ++sequence) {
+            failed = write_event(file, &first, ring, &copy[sequence & (TRACE_RING_SIZE - 1)]) == ERROR;
+            ++written;
+        }
+    }
+
+    if(failed == FALSE) failed = fprintf(file, "\n]}\n") < 0;
+    free(copy);
+    return failed == TRUE ? -1 : written;
+}